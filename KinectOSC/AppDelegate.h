@@ -17,6 +17,8 @@
 #include "KinectGLView.h"
 #include "OscController.h"
 
+#define KINECTOSC_CONTROL_PORT "7401"     // OSC control messages (/kinectosc/...)
+
 @interface AppDelegate : NSObject <NSApplicationDelegate> {
     
     /* Kinect */
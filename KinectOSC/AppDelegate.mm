@@ -55,8 +55,11 @@
     oscSender_ = new OscController();
     const char *address = [[oscOutputServerAddress_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding];
     const char *port = [[oscOutputPortNumber_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding];
-    oscSender_->setServerAddress(address, port);
     skeletonController_->setOscSender(oscSender_);
+    skeletonController_->setOscTarget(address, port);
+    
+    /* Accept remote control alongside the GUI */
+    skeletonController_->startControlServer(KINECTOSC_CONTROL_PORT);
 }
 
 - (IBAction)deviceSelected:(id)sender {
@@ -105,26 +108,26 @@
     
     if ([sender state] == NSOnState) {
         skeletonController_->enableOscTransmit();
-        oscSender_->enableLogging();
+        skeletonController_->setOscLogging(true);
     }
     
     else {
         skeletonController_->disableOscTransmit();
-        oscSender_->disableLogging();
+        skeletonController_->setOscLogging(false);
     }
 }
 
 - (IBAction)oscOutputPortNumberChanged:(NSTextField *)sender {
     
     if (oscSender_) {
-        oscSender_->setServerAddress([[oscOutputServerAddress_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding],[[oscOutputPortNumber_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding]);
+        skeletonController_->setOscTarget([[oscOutputServerAddress_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding],[[oscOutputPortNumber_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding]);
     }
 }
 
 - (IBAction)oscOutputServerAddressChanged:(NSTextField *)sender {
     
     if (oscSender_) {
-        oscSender_->setServerAddress([[oscOutputServerAddress_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding],[[oscOutputPortNumber_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding]);
+        skeletonController_->setOscTarget([[oscOutputServerAddress_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding],[[oscOutputPortNumber_ stringValue] cStringUsingEncoding:NSASCIIStringEncoding]);
     }
 }
 
@@ -0,0 +1,442 @@
+//
+//  BatchAnalysis.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "BatchAnalysis.h"
+#include "SkeletonController.h"
+#include "SessionRecording.h"
+#include "OscController.h"
+#include "OscCapture.h"
+#include "Utility.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define BATCH_NUM_NOTES 128
+
+/* Everything captured from one run */
+struct AnalysisCapture {
+    FrameStampSource *source;
+    FILE *notes;
+    FILE *curves;
+    double onTime[BATCH_NUM_NOTES];
+    bool sounding[BATCH_NUM_NOTES];
+    int nNotes;
+    int nReleased;
+    double totalLength;
+    int nControlMessages;
+};
+
+static void captureMessage(void *context, const char *path, const char *types, lo_message message) {
+
+    AnalysisCapture *capture = (AnalysisCapture *)context;
+    lo_arg **argv = lo_message_get_argv(message);
+    double time = capture->source->time();
+    int frame = capture->source->frameNumber();
+
+    /* Note on, or off at velocity 0 */
+    if (!strcmp(path, "/mrp/midi") && !strcmp(types, "iii")) {
+
+        int note = argv[1]->i;
+        int velocity = argv[2]->i;
+        fprintf(capture->notes, "%.6f,%d,%d,%d\n", time, frame, note, velocity);
+
+        if (note < 0 || note >= BATCH_NUM_NOTES)
+            return;
+
+        if (velocity > 0) {
+            capture->nNotes++;
+            capture->onTime[note] = time;
+            capture->sounding[note] = true;
+        }
+        else if (capture->sounding[note]) {
+            capture->nReleased++;
+            capture->totalLength += time - capture->onTime[note];
+            capture->sounding[note] = false;
+        }
+        return;
+    }
+
+    capture->nControlMessages++;
+
+    if (!capture->curves)
+        return;
+
+    /* Per-note values are sent as (0, note, value), others as a single value */
+    if (!strcmp(types, "iif"))
+        fprintf(capture->curves, "%.6f,%d,%s,%d,%.6f\n", time, frame, path, argv[1]->i, argv[2]->f);
+    else if (!strcmp(types, "f"))
+        fprintf(capture->curves, "%.6f,%d,%s,-1,%.6f\n", time, frame, path, argv[0]->f);
+}
+
+/* Session file name without its directory or extension */
+static string baseName(const string &path) {
+
+    size_t slash = path.find_last_of('/');
+    string name = slash == string::npos ? path : path.substr(slash + 1);
+
+    size_t dot = name.find_last_of('.');
+    if (dot != string::npos && dot > 0)
+        name = name.substr(0, dot);
+
+    return name;
+}
+
+/* Parameter values may be paths */
+static string fileSafe(const string &name) {
+
+    string safe = name;
+    for (size_t i = 0; i < safe.size(); i++) {
+        if (safe[i] == '/' || safe[i] == ' ' || safe[i] == '\t')
+            safe[i] = '_';
+    }
+    return safe;
+}
+
+BatchAnalyzer::BatchAnalyzer() {
+
+    writeCurves_ = true;
+    nextRun_ = 0;
+    nDone_ = 0;
+    pthread_mutex_init(&mutex_, NULL);
+}
+
+BatchAnalyzer::~BatchAnalyzer() {
+
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool BatchAnalyzer::addConfigFile(const char *path) {
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("%s: Can't open %s\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+    fclose(file);
+
+    AnalysisParameterSet set;
+    set.name = baseName(path);
+    set.configPath = path;
+    sets_.push_back(set);
+
+    return true;
+}
+
+bool BatchAnalyzer::addSweep(const char *spec) {
+
+    const char *equals = strchr(spec, '=');
+    if (!equals || equals == spec || !equals[1]) {
+        printf("%s: Expected \"name=v1,v2,...\" or \"name=lo:hi:step\", not \"%s\"\n", __PRETTY_FUNCTION__, spec);
+        return false;
+    }
+
+    Sweep sweep;
+    sweep.name.assign(spec, equals - spec);
+    string values(equals + 1);
+
+    /* A range, stepped from lo to hi inclusive */
+    float lo, hi, step;
+    char extra;
+    if (sscanf(values.c_str(), "%f:%f:%f%c", &lo, &hi, &step, &extra) == 3) {
+
+        if (step <= 0 || hi < lo || (hi - lo) / step > BATCH_MAX_RUNS) {
+            printf("%s: Bad range \"%s\"\n", __PRETTY_FUNCTION__, values.c_str());
+            return false;
+        }
+
+        int nSteps = (int)floorf((hi - lo) / step + 1e-3f);
+        for (int i = 0; i <= nSteps; i++) {
+            char value[32];
+            snprintf(value, sizeof(value), "%g", lo + i * step);
+            sweep.values.push_back(value);
+        }
+    }
+    else {
+        size_t start = 0;
+        while (start <= values.size()) {
+            size_t comma = values.find(',', start);
+            if (comma == string::npos)
+                comma = values.size();
+            if (comma > start)
+                sweep.values.push_back(values.substr(start, comma - start));
+            start = comma + 1;
+        }
+    }
+
+    if (sweep.values.empty()) {
+        printf("%s: No values in \"%s\"\n", __PRETTY_FUNCTION__, spec);
+        return false;
+    }
+
+    sweeps_.push_back(sweep);
+    return true;
+}
+
+/* Each set (or the defaults, if there are none) with every combination of sweep values */
+void BatchAnalyzer::expandSets(vector<AnalysisParameterSet> *sets) {
+
+    *sets = sets_;
+
+    if (sets->empty()) {
+        AnalysisParameterSet defaults;
+        defaults.name = "default";
+        sets->push_back(defaults);
+    }
+
+    for (size_t s = 0; s < sweeps_.size(); s++) {
+
+        const Sweep &sweep = sweeps_[s];
+        vector<AnalysisParameterSet> expanded;
+
+        for (size_t i = 0; i < sets->size(); i++) {
+            for (size_t v = 0; v < sweep.values.size(); v++) {
+                AnalysisParameterSet set = (*sets)[i];
+                set.name += "," + sweep.name + "=" + sweep.values[v];
+                set.settings.push_back(make_pair(sweep.name, sweep.values[v]));
+                expanded.push_back(set);
+            }
+        }
+
+        sets->swap(expanded);
+    }
+}
+
+int BatchAnalyzer::numRuns() {
+
+    size_t nSets = sets_.empty() ? 1 : sets_.size();
+    for (size_t s = 0; s < sweeps_.size() && nSets <= BATCH_MAX_RUNS; s++)
+        nSets *= sweeps_[s].values.size();
+
+    size_t nRuns = nSets * sessions_.size();
+    return nRuns > BATCH_MAX_RUNS ? BATCH_MAX_RUNS + 1 : (int)nRuns;
+}
+
+#pragma mark - Running
+
+bool BatchAnalyzer::run(const char *outputDir, int nThreads) {
+
+    int nRuns = numRuns();
+
+    if (nRuns == 0) {
+        printf("%s: No sessions to analyze\n", __PRETTY_FUNCTION__);
+        return false;
+    }
+    if (nRuns > BATCH_MAX_RUNS) {
+        printf("%s: More than %d runs\n", __PRETTY_FUNCTION__, BATCH_MAX_RUNS);
+        return false;
+    }
+
+    /* Output files are named after the sessions */
+    for (size_t i = 0; i < sessions_.size(); i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (baseName(sessions_[i]) == baseName(sessions_[j])) {
+                printf("%s: %s and %s have the same name\n", __PRETTY_FUNCTION__,
+                       sessions_[j].c_str(), sessions_[i].c_str());
+                return false;
+            }
+        }
+    }
+
+    if (mkdir(outputDir, 0755) != 0 && errno != EEXIST) {
+        printf("%s: Can't create %s\n", __PRETTY_FUNCTION__, outputDir);
+        return false;
+    }
+
+    outputDir_ = outputDir;
+    expandSets(&runSets_);
+
+    /* Runs are numbered session-major, so a session's runs are spread across the threads */
+    results_.assign(nRuns, AnalysisResult());
+    for (int i = 0; i < nRuns; i++) {
+        results_[i].session = sessions_[i / runSets_.size()];
+        results_[i].parameters = runSets_[i % runSets_.size()].name;
+        results_[i].ok = false;
+    }
+
+    nextRun_ = 0;
+    nDone_ = 0;
+
+    if (nThreads < 1)
+        nThreads = 1;
+    if (nThreads > BATCH_MAX_THREADS)
+        nThreads = BATCH_MAX_THREADS;
+    if (nThreads > nRuns)
+        nThreads = nRuns;
+
+    printf("Analyzing %d sessions with %d parameter sets (%d runs) on %d threads\n",
+           (int)sessions_.size(), (int)runSets_.size(), nRuns, nThreads);
+
+    uint64_t start = hostTimeMicros();
+
+    vector<Worker> workers(nThreads);
+    int nStarted = 0;
+
+    for (int i = 0; i < nThreads; i++) {
+        workers[i].owner = this;
+        if (pthread_create(&workers[i].thread, NULL, staticWorker, (void *)&workers[i]) != 0) {
+            printf("%s: Error creating thread\n", __PRETTY_FUNCTION__);
+            break;
+        }
+        nStarted++;
+    }
+
+    /* Run everything here if no thread could be started */
+    if (nStarted == 0)
+        worker();
+
+    for (int i = 0; i < nStarted; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    double seconds = (hostTimeMicros() - start) * 1e-6;
+    double sessionSeconds = 0;
+    int nFailed = 0;
+
+    for (size_t i = 0; i < results_.size(); i++) {
+        sessionSeconds += results_[i].duration;
+        nFailed += !results_[i].ok;
+    }
+
+    printf("%d runs in %.2f s, %.0fx realtime; %d failed\n", nRuns, seconds,
+           seconds > 0 ? sessionSeconds / seconds : 0, nFailed);
+
+    return writeSummary() && nFailed == 0;
+}
+
+void *BatchAnalyzer::worker() {
+
+    int nRuns = (int)results_.size();
+
+    for (int i = nextRun_++; i < nRuns; i = nextRun_++) {
+
+        AnalysisResult *result = &results_[i];
+        result->ok = runOne(result->session, runSets_[i % runSets_.size()], result);
+
+        int nDone = ++nDone_;
+
+        pthread_mutex_lock(&mutex_);
+        printf("[%d/%d] %s %s: %d frames, %d notes%s\n", nDone, nRuns, baseName(result->session).c_str(),
+               result->parameters.c_str(), result->nFrames, result->nNotes, result->ok ? "" : " (failed)");
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    return 0;
+}
+
+bool BatchAnalyzer::runOne(const string &session, const AnalysisParameterSet &set, AnalysisResult *result) {
+
+    result->nFrames = 0;
+    result->nNotes = 0;
+    result->nControlMessages = 0;
+    result->duration = 0;
+    result->meanNoteLength = 0;
+    result->seconds = 0;
+
+    uint64_t start = hostTimeMicros();
+
+    /* Sessions are read without their depth images, which mappings don't use */
+    SessionPlayer player;
+    ReplaySkeletonSource replay;
+    SkeletonSource *source;
+
+    if (SessionPlayer::isSessionFile(session.c_str())) {
+        player.setDecodeImages(false);
+        if (!player.open(session.c_str(), 1))
+            return false;
+        source = &player;
+    }
+    else {
+        if (!replay.open(session.c_str()))
+            return false;
+        source = &replay;
+    }
+
+    string prefix = outputDir_ + "/" + fileSafe(baseName(session) + "." + set.name);
+    FILE *notes = fopen((prefix + ".notes.csv").c_str(), "w");
+    FILE *curves = writeCurves_ ? fopen((prefix + ".curves.csv").c_str(), "w") : NULL;
+
+    if (!notes || (writeCurves_ && !curves)) {
+        printf("%s: Can't write %s.*.csv\n", __PRETTY_FUNCTION__, prefix.c_str());
+        if (notes)
+            fclose(notes);
+        if (curves)
+            fclose(curves);
+        return false;
+    }
+
+    fprintf(notes, "time,frame,note,velocity\n");
+    if (curves)
+        fprintf(curves, "time,frame,address,note,value\n");
+
+    FrameStampSource stamps(source);
+    AnalysisCapture capture;
+    memset(&capture, 0, sizeof(capture));
+    capture.source = &stamps;
+    capture.notes = notes;
+    capture.curves = curves;
+
+    OscController sink;
+    sink.setMessageCallback(captureMessage, &capture);
+
+    /* Never init()ed, so independent of NiTE and of the other workers' controllers */
+    SkeletonController *controller = new SkeletonController();
+
+    controller->setOscSender(&sink);
+    bool ok = controller->setParameter("transmit", "on");
+
+    if (ok && !set.configPath.empty())
+        ok = controller->loadConfigFile(set.configPath.c_str());
+
+    for (size_t i = 0; ok && i < set.settings.size(); i++)
+        ok = controller->setParameter(set.settings[i].first.c_str(), set.settings[i].second.c_str());
+
+    int nFrames = ok ? controller->processSource(&stamps) : -1;
+
+    delete controller;
+
+    fclose(notes);
+    if (curves)
+        fclose(curves);
+
+    if (nFrames < 0)
+        return false;
+
+    result->nFrames = nFrames;
+    result->nNotes = capture.nNotes;
+    result->nControlMessages = capture.nControlMessages;
+    result->duration = stamps.time();
+    result->meanNoteLength = capture.nReleased ? capture.totalLength / capture.nReleased : 0;
+    result->seconds = (hostTimeMicros() - start) * 1e-6;
+
+    return true;
+}
+
+bool BatchAnalyzer::writeSummary() {
+
+    string path = outputDir_ + "/summary.csv";
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+        printf("%s: Can't write %s\n", __PRETTY_FUNCTION__, path.c_str());
+        return false;
+    }
+
+    fprintf(file, "session,parameters,ok,frames,duration,notes,notes_per_minute,mean_note_length,control_messages,seconds\n");
+
+    for (size_t i = 0; i < results_.size(); i++) {
+        const AnalysisResult &r = results_[i];
+        fprintf(file, "%s,\"%s\",%d,%d,%.3f,%d,%.2f,%.4f,%d,%.4f\n", baseName(r.session).c_str(),
+                r.parameters.c_str(), r.ok, r.nFrames, r.duration, r.nNotes,
+                r.duration > 0 ? r.nNotes * 60 / r.duration : 0, r.meanNoteLength,
+                r.nControlMessages, r.seconds);
+    }
+
+    fclose(file);
+    return true;
+}
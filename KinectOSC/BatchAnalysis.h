@@ -0,0 +1,114 @@
+//
+//  BatchAnalysis.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Offline parameter tuning. Every recorded session (SessionPlayer or SkeletonFileWriter
+//  recordings) is run through the full mapping path, SkeletonController::processSource(),
+//  once for each parameter set, as fast as the CPU allows and spread over a pool of
+//  threads. What would have been sent over OSC is captured instead and written per run as
+//  a list of note events and the control curves, with a summary row for each run, so the
+//  runs of a sweep can be compared side by side.
+//
+//  A parameter set is a config file, a list of "name = value" settings as taken by
+//  SkeletonController::setParameter(), or both. Sweeps multiply the sets: each one names a
+//  parameter and its values, given as a list ("key=C,E,G") or a range
+//  ("threshold=0.4:0.8:0.05"), and every set is run with every combination of them.
+
+#ifndef __KinectOSC__BatchAnalysis__
+#define __KinectOSC__BatchAnalysis__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+
+using namespace std;
+
+#define BATCH_MAX_THREADS 64
+#define BATCH_MAX_RUNS 100000
+
+struct AnalysisParameterSet {
+    string name;
+    string configPath;                          // Loaded first, unless empty
+    vector<pair<string, string> > settings;     // Then applied in order
+};
+
+struct AnalysisResult {
+    string session;
+    string parameters;                          // Parameter set name
+    bool ok;
+    int nFrames;
+    int nNotes;                                 // Note-ons
+    int nControlMessages;                       // Everything other than notes
+    double duration;                            // Session time covered (s)
+    double meanNoteLength;                      // Of notes released within the session (s)
+    double seconds;                             // Wall time taken
+};
+
+class BatchAnalyzer {
+
+public:
+
+    BatchAnalyzer();
+    ~BatchAnalyzer();
+
+    void addSession(const char *path) { sessions_.push_back(path); }
+    void addParameterSet(const AnalysisParameterSet &set) { sets_.push_back(set); }
+    bool addConfigFile(const char *path);       // A set named after the file
+    bool addSweep(const char *spec);            // "name=v1,v2,..." or "name=lo:hi:step"
+    void setWriteCurves(bool write) { writeCurves_ = write; }   // Curves are most of the output
+
+    /* Runs that run() would make: sessions times sets times every sweep combination */
+    int numRuns();
+
+    /* Run everything on nThreads threads, writing <session>.<set>.notes.csv (and
+       .curves.csv) for each run, and summary.csv, into outputDir. Returns false if the
+       output can't be written or any run failed. */
+    bool run(const char *outputDir, int nThreads);
+
+    /* Getters */
+    const vector<AnalysisResult> &results() { return results_; }
+
+private:
+
+    struct Sweep {
+        string name;
+        vector<string> values;
+    };
+
+    struct Worker {
+        BatchAnalyzer *owner;
+        pthread_t thread;
+    };
+
+    void expandSets(vector<AnalysisParameterSet> *sets);
+
+    void *worker();
+    static void *staticWorker(void *arg) {
+        Worker *worker = (Worker *)arg;
+        return worker->owner->worker();
+    }
+
+    bool runOne(const string &session, const AnalysisParameterSet &set, AnalysisResult *result);
+    bool writeSummary();
+
+private:
+
+    vector<string> sessions_;
+    vector<AnalysisParameterSet> sets_;
+    vector<Sweep> sweeps_;
+    bool writeCurves_;
+
+    /* While running */
+    vector<AnalysisParameterSet> runSets_;      // With the sweeps expanded
+    vector<AnalysisResult> results_;            // One per run, session-major
+    atomic<int> nextRun_;
+    atomic<int> nDone_;
+    string outputDir_;
+    pthread_mutex_t mutex_;                     // Serializes progress output
+};
+
+#endif /* defined(__KinectOSC__BatchAnalysis__) */
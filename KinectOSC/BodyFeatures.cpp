@@ -0,0 +1,131 @@
+//
+//  BodyFeatures.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "BodyFeatures.h"
+
+#include <string.h>
+#include <math.h>
+
+FeatureExtractor::FeatureExtractor() {
+
+    reset();
+}
+
+void FeatureExtractor::reset() {
+
+    memset(history_, 0, sizeof(history_));
+}
+
+FeatureExtractor::History *FeatureExtractor::history(int userId) {
+
+    History *oldest = &history_[0];
+
+    for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+        if (history_[i].id == userId)
+            return &history_[i];
+        if (history_[i].timestamp < oldest->timestamp)
+            oldest = &history_[i];
+    }
+
+    /* New user; a zero timestamp means no previous positions yet */
+    memset(oldest, 0, sizeof(History));
+    oldest->id = userId;
+    return oldest;
+}
+
+void FeatureExtractor::extract(const SkeletonUser &user, uint64_t timestamp, BodyFeatures *out) {
+
+    computeLimbMetrics(user, &out->limbs);
+
+    History *h = history(user.id);
+    if (user.flags & USER_NEW) {
+        memset(h, 0, sizeof(History));
+        h->id = user.id;
+    }
+
+    float dt = h->timestamp && timestamp > h->timestamp ? (timestamp - h->timestamp) * 1e-6f : 0;
+
+    float measured = out->limbs.height;
+    h->height = h->height > 0 ? h->height + (measured - h->height) * FEATURE_HEIGHT_SMOOTHING : measured;
+    out->height = h->height;
+
+    /* The spine, then the shoulder line made square to it */
+    Vec3 torso = jointPosition(user, SKEL_TORSO);
+    Vec3 spine = jointPosition(user, SKEL_NECK) - torso;
+    Vec3 across = jointPosition(user, SKEL_SHOULDER_R) - jointPosition(user, SKEL_SHOULDER_L);
+
+    out->origin = torso;
+    out->up = normalize(spine);
+    out->right = normalize(across - out->up * dot(across, out->up));
+    out->forward = cross(out->up, out->right);
+    out->hasFrame = lengthSquared(out->up) > 0 && lengthSquared(out->right) > 0 && out->height > 0;
+
+    /* Rows of the rotation into the body frame, scaled to heights */
+    float scale = out->hasFrame ? 1 / out->height : 0;
+    Vec3 r = out->right * scale;
+    Vec3 u = out->up * scale;
+    Vec3 f = out->forward * scale;
+
+    /* Padding lanes sit on the torso so they stay at zero */
+    float sx[FEATURE_LANES], sy[FEATURE_LANES], sz[FEATURE_LANES];
+    memcpy(sx, user.x, sizeof(user.x));
+    memcpy(sy, user.y, sizeof(user.y));
+    memcpy(sz, user.z, sizeof(user.z));
+    for (int j = SKELETON_NUM_JOINTS; j < FEATURE_LANES; j++) {
+        sx[j] = torso.x;
+        sy[j] = torso.y;
+        sz[j] = torso.z;
+    }
+
+    for (int j = 0; j < FEATURE_LANES; j++) {
+        float dx = sx[j] - torso.x;
+        float dy = sy[j] - torso.y;
+        float dz = sz[j] - torso.z;
+        out->x[j] = dx * r.x + dy * r.y + dz * r.z;
+        out->y[j] = dx * u.x + dy * u.y + dz * u.z;
+        out->z[j] = dx * f.x + dy * f.y + dz * f.z;
+    }
+
+    /* Body velocities need a body frame at both ends. Written to locals first: stores
+       through out could alias the history, which keeps the loop from vectorizing. */
+    float rate = dt > 0 ? 1 / dt : 0;
+    float bodyRate = h->hasFrame && out->hasFrame ? rate : 0;
+    float vx[FEATURE_LANES], vy[FEATURE_LANES], vz[FEATURE_LANES];
+    float bodySpeed[FEATURE_LANES], speed[FEATURE_LANES];
+
+    for (int j = 0; j < FEATURE_LANES; j++) {
+        vx[j] = (out->x[j] - h->x[j]) * bodyRate;
+        vy[j] = (out->y[j] - h->y[j]) * bodyRate;
+        vz[j] = (out->z[j] - h->z[j]) * bodyRate;
+        bodySpeed[j] = sqrtf(vx[j] * vx[j] + vy[j] * vy[j] + vz[j] * vz[j]);
+
+        float dx = (sx[j] - h->sx[j]) * rate;
+        float dy = (sy[j] - h->sy[j]) * rate;
+        float dz = (sz[j] - h->sz[j]) * rate;
+        speed[j] = sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+
+    memcpy(out->vx, vx, sizeof(vx));
+    memcpy(out->vy, vy, sizeof(vy));
+    memcpy(out->vz, vz, sizeof(vz));
+    memcpy(out->bodySpeed, bodySpeed, sizeof(bodySpeed));
+    memcpy(out->speed, speed, sizeof(speed));
+
+    /* Jumps and squats move the whole body, so they're read against where the torso has
+       been over the last few seconds */
+    h->restY = h->timestamp ? h->restY + (torso.y - h->restY) * fminf(1, dt / FEATURE_REST_TIME) : torso.y;
+    out->rise = out->hasFrame ? (torso.y - h->restY) / out->height : 0;
+
+    memcpy(h->x, out->x, sizeof(h->x));
+    memcpy(h->y, out->y, sizeof(h->y));
+    memcpy(h->z, out->z, sizeof(h->z));
+    memcpy(h->sx, sx, sizeof(h->sx));
+    memcpy(h->sy, sy, sizeof(h->sy));
+    memcpy(h->sz, sz, sizeof(h->sz));
+    h->hasFrame = out->hasFrame;
+    h->timestamp = timestamp;
+}
@@ -0,0 +1,97 @@
+//
+//  BodyFeatures.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Per-frame kinematic features, computed once per user and read by every mapping.
+//  Besides the limb metrics, each joint is expressed in the user's own body frame:
+//
+//      origin     torso
+//      up         torso to neck
+//      right      toward shoulder_r, square to up
+//      forward    up x right, toward the sensor for a user facing it
+//
+//  in units of the user's height along the body, so a body coordinate or velocity reads
+//  the same wherever the user stands and whichever way they face. Joints are laid out
+//  structure-of-arrays and padded to FEATURE_LANES so each pass is one vector loop.
+
+#ifndef __KinectOSC__BodyFeatures__
+#define __KinectOSC__BodyFeatures__
+
+#include <iostream>
+#include <stdint.h>
+
+#include "SkeletonFrame.h"
+#include "JointGeometry.h"
+#include "Vec3.h"
+
+#define FEATURE_LANES 16                // SKELETON_NUM_JOINTS rounded up to whole vectors
+#define FEATURE_HEIGHT_SMOOTHING 0.1f   // Weight of each frame's height measurement
+#define FEATURE_REST_TIME 2.0f          // Time constant of the torso's resting height (s)
+
+/* Joints the body frame is built from */
+#define BODY_FRAME_JOINTS ((1 << SKEL_TORSO) | (1 << SKEL_NECK) | (1 << SKEL_SHOULDER_L) | (1 << SKEL_SHOULDER_R))
+
+struct BodyFeatures {
+
+    LimbMetrics limbs;
+
+    bool hasFrame;                      // False if the spine or shoulders are degenerate
+    Vec3 origin;
+    Vec3 right;
+    Vec3 up;
+    Vec3 forward;
+    float height;                       // LimbMetrics::height smoothed per user (mm)
+
+    /* Body coordinates (heights) */
+    float x[FEATURE_LANES];
+    float y[FEATURE_LANES];
+    float z[FEATURE_LANES];
+
+    /* Since the user's previous frame, and 0 on their first */
+    float vx[FEATURE_LANES];            // Body velocity (heights/s)
+    float vy[FEATURE_LANES];
+    float vz[FEATURE_LANES];
+    float bodySpeed[FEATURE_LANES];     // heights/s
+    float speed[FEATURE_LANES];         // Sensor space (mm/s)
+    float rise;                         // Torso above its resting height (heights)
+};
+
+class FeatureExtractor {
+
+    /* Previous positions per user, for velocities */
+    struct History {
+        int id;
+        uint64_t timestamp;
+        float height;
+        float restY;                    // Torso's resting height (mm)
+        bool hasFrame;
+        float x[FEATURE_LANES];         // Body coordinates
+        float y[FEATURE_LANES];
+        float z[FEATURE_LANES];
+        float sx[FEATURE_LANES];        // Sensor coordinates
+        float sy[FEATURE_LANES];
+        float sz[FEATURE_LANES];
+    };
+
+public:
+
+    FeatureExtractor();
+
+    void reset();
+
+    /* Everything in BodyFeatures for one user. Confidence isn't checked, so user should
+       have its gaps filled in (see JointTracker.h). */
+    void extract(const SkeletonUser &user, uint64_t timestamp, BodyFeatures *out);
+
+private:
+
+    History *history(int userId);
+
+private:
+
+    History history_[SKELETON_MAX_USERS];
+};
+
+#endif /* defined(__KinectOSC__BodyFeatures__) */
@@ -0,0 +1,257 @@
+//
+//  ConfigStore.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "ConfigStore.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#pragma mark - ConfigStore
+
+ConfigStore::ConfigStore(const Config &initial) {
+
+    pthread_mutex_init(&writeMutex_, NULL);
+
+    Config *config = new Config(initial);
+    config->version = 1;
+    active_ = config;
+
+    for (int r = 0; r < CONFIG_MAX_READERS; r++) {
+        readerVersion_[r] = 0;
+        readerUsed_[r] = false;
+    }
+}
+
+ConfigStore::~ConfigStore() {
+
+    delete active_.load();
+    for (size_t i = 0; i < retired_.size(); i++)
+        delete retired_[i];
+
+    pthread_mutex_destroy(&writeMutex_);
+}
+
+Config ConfigStore::current() {
+
+    /* Snapshots are only freed under the writer lock */
+    pthread_mutex_lock(&writeMutex_);
+    Config config = *active_.load();
+    pthread_mutex_unlock(&writeMutex_);
+
+    return config;
+}
+
+Config *ConfigStore::beginUpdate() {
+
+    pthread_mutex_lock(&writeMutex_);
+    pending_ = *active_.load();
+    return &pending_;
+}
+
+uint64_t ConfigStore::commitUpdate() {
+
+    Config *config = new Config(pending_);
+    Config *old = active_.load();
+    config->version = old->version + 1;
+
+    active_.store(config);
+    retired_.push_back(old);
+    reclaim();
+
+    uint64_t version = config->version;
+    pthread_mutex_unlock(&writeMutex_);
+
+    return version;
+}
+
+void ConfigStore::abortUpdate() {
+
+    pthread_mutex_unlock(&writeMutex_);
+}
+
+/* Free retired snapshots older than anything a reader holds. A reader between loading the
+   active pointer and recording its version still has its previous version recorded, which is
+   no newer than the snapshot it loaded, so that snapshot survives. Called with writeMutex_. */
+void ConfigStore::reclaim() {
+
+    uint64_t oldestHeld = UINT64_MAX;
+
+    for (int r = 0; r < CONFIG_MAX_READERS; r++) {
+        uint64_t v = readerVersion_[r].load();
+        if (v != 0 && v < oldestHeld)
+            oldestHeld = v;
+    }
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < retired_.size(); i++) {
+        if (retired_[i]->version < oldestHeld)
+            delete retired_[i];
+        else
+            retired_[kept++] = retired_[i];
+    }
+
+    retired_.resize(kept);
+}
+
+int ConfigStore::registerReader() {
+
+    pthread_mutex_lock(&writeMutex_);
+
+    int reader = -1;
+    for (int r = 0; r < CONFIG_MAX_READERS && reader < 0; r++) {
+        if (!readerUsed_[r])
+            reader = r;
+    }
+
+    /* Start out holding the latest snapshot, so a reader never holds nothing */
+    if (reader >= 0) {
+        readerUsed_[reader] = true;
+        readerVersion_[reader].store(active_.load()->version);
+    }
+    else
+        printf("%s: At most %d readers are supported\n", __PRETTY_FUNCTION__, CONFIG_MAX_READERS);
+
+    pthread_mutex_unlock(&writeMutex_);
+    return reader;
+}
+
+void ConfigStore::unregisterReader(int reader) {
+
+    if (reader < 0 || reader >= CONFIG_MAX_READERS)
+        return;
+
+    pthread_mutex_lock(&writeMutex_);
+    readerVersion_[reader].store(0);
+    readerUsed_[reader] = false;
+    reclaim();
+    pthread_mutex_unlock(&writeMutex_);
+}
+
+const Config *ConfigStore::acquire(int reader) {
+
+    Config *config = active_.load();
+    readerVersion_[reader].store(config->version);
+    return config;
+}
+
+int ConfigStore::numRetired() {
+
+    pthread_mutex_lock(&writeMutex_);
+    int nRetired = (int)retired_.size();
+    pthread_mutex_unlock(&writeMutex_);
+
+    return nRetired;
+}
+
+#pragma mark - ConfigFileWatcher
+
+ConfigFileWatcher::ConfigFileWatcher() {
+
+    callback_ = NULL;
+    context_ = NULL;
+    intervalMs_ = 500;
+    lastModified_ = 0;
+    lastSize_ = 0;
+    running_ = false;
+    shouldStop_ = false;
+
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&wake_, NULL);
+}
+
+ConfigFileWatcher::~ConfigFileWatcher() {
+
+    stop();
+    pthread_cond_destroy(&wake_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool ConfigFileWatcher::start(const char *path, ChangeCallback callback, void *context, int intervalMs) {
+
+    stop();
+
+    path_ = path;
+    callback_ = callback;
+    context_ = context;
+    intervalMs_ = intervalMs > 0 ? intervalMs : 500;
+
+    /* Record the current state so only later changes are reported */
+    lastModified_ = 0;
+    lastSize_ = 0;
+    fileChanged();
+
+    shouldStop_ = false;
+
+    if (pthread_create(&thread_, NULL, staticWatch, (void *)this) != 0) {
+        printf("%s: Error creating watch thread\n", __PRETTY_FUNCTION__);
+        return false;
+    }
+
+    running_ = true;
+    return true;
+}
+
+void ConfigFileWatcher::stop() {
+
+    if (!running_)
+        return;
+
+    pthread_mutex_lock(&mutex_);
+    shouldStop_ = true;
+    pthread_cond_signal(&wake_);
+    pthread_mutex_unlock(&mutex_);
+
+    pthread_join(thread_, NULL);
+    running_ = false;
+}
+
+bool ConfigFileWatcher::fileChanged() {
+
+    struct stat st;
+    if (stat(path_.c_str(), &st) != 0)
+        return false;
+
+    if (st.st_mtime == lastModified_ && st.st_size == lastSize_)
+        return false;
+
+    lastModified_ = st.st_mtime;
+    lastSize_ = st.st_size;
+    return true;
+}
+
+void *ConfigFileWatcher::watch() {
+
+    pthread_mutex_lock(&mutex_);
+
+    while (!shouldStop_) {
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        struct timespec deadline;
+        uint64_t usec = now.tv_usec + (uint64_t)intervalMs_ * 1000;
+        deadline.tv_sec = now.tv_sec + usec / 1000000;
+        deadline.tv_nsec = (usec % 1000000) * 1000;
+
+        pthread_cond_timedwait(&wake_, &mutex_, &deadline);
+
+        if (shouldStop_)
+            break;
+
+        if (fileChanged()) {
+            pthread_mutex_unlock(&mutex_);
+            callback_(context_, path_.c_str());
+            pthread_mutex_lock(&mutex_);
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_);
+    return 0;
+}
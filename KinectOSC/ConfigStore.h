@@ -0,0 +1,135 @@
+//
+//  ConfigStore.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Runtime parameters as versioned, immutable snapshots. Writers copy the current snapshot,
+//  change it and publish the copy with an atomic pointer swap. Readers pick up the latest
+//  snapshot at their own boundaries (the tracking thread once per frame) without locking,
+//  and record the version they hold; a replaced snapshot is freed once every reader has
+//  moved past it.
+
+#ifndef __KinectOSC__ConfigStore__
+#define __KinectOSC__ConfigStore__
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "NoteMap.h"
+
+using namespace std;
+
+#define CONFIG_MAX_READERS 4
+
+struct Config {
+
+    uint64_t version;           // Assigned on publication
+
+    /* Tracking */
+    float confThresh;
+    float stageWidth;           // Floor-space width spanned by the regions (mm)
+    int voiceTimeoutFrames;
+
+    /* Note map and the selections it was built from (ScaleLibrary indices) */
+    int scale;
+    int key;
+    int octave;
+    NoteMap noteMap;
+
+    /* Output */
+    bool sendOsc;
+    bool oscLogging;
+    bool oscTimetags;           // Bundle messages with the frame's capture time
+    char oscHost[64];
+    char oscPort[16];
+    int controlRate;            // Mapped values per second from ControlStream, 0 for once per frame
+    bool controlPredict;        // Predict ahead of the newest frame instead of interpolating
+};
+
+class ConfigStore {
+
+public:
+
+    ConfigStore(const Config &initial);
+    ~ConfigStore();
+
+    /* Copy of the latest snapshot */
+    Config current();
+
+    /* Writers. beginUpdate returns a private copy of the latest snapshot and holds the writer
+       lock until commitUpdate publishes it (returning its version) or abortUpdate drops it. */
+    Config *beginUpdate();
+    uint64_t commitUpdate();
+    void abortUpdate();
+
+    /* Readers register once, then call acquire at each boundary. The returned snapshot stays
+       valid until the reader's next acquire or unregisterReader. */
+    int registerReader();
+    void unregisterReader(int reader);
+    const Config *acquire(int reader);
+
+    uint64_t version() { return current().version; }
+    int numRetired();                   // Replaced snapshots a reader may still hold
+
+private:
+
+    void reclaim();
+
+private:
+
+    atomic<Config *> active_;
+    atomic<uint64_t> readerVersion_[CONFIG_MAX_READERS];   // Version each reader holds, 0 if none
+    bool readerUsed_[CONFIG_MAX_READERS];
+
+    pthread_mutex_t writeMutex_;        // Serializes writers and guards the fields below
+    Config pending_;
+    vector<Config *> retired_;
+};
+
+/* Polls a file and calls back when its modification time or size changes. Polling works the
+   same on every platform and a config file doesn't need faster notice. */
+class ConfigFileWatcher {
+
+public:
+
+    typedef void (*ChangeCallback)(void *context, const char *path);
+
+    ConfigFileWatcher();
+    ~ConfigFileWatcher();
+
+    bool start(const char *path, ChangeCallback callback, void *context, int intervalMs = 500);
+    void stop();
+    bool isWatching() { return running_; }
+
+private:
+
+    void *watch();
+    static void *staticWatch(void *arg) {
+        return ((ConfigFileWatcher *)arg)->watch();
+    }
+
+    bool fileChanged();
+
+private:
+
+    string path_;
+    ChangeCallback callback_;
+    void *context_;
+    int intervalMs_;
+
+    time_t lastModified_;
+    off_t lastSize_;
+
+    pthread_t thread_;
+    pthread_mutex_t mutex_;
+    pthread_cond_t wake_;
+    bool running_;
+    bool shouldStop_;
+};
+
+#endif /* defined(__KinectOSC__ConfigStore__) */
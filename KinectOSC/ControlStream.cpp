@@ -0,0 +1,304 @@
+//
+//  ControlStream.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "ControlStream.h"
+#include "Utility.h"
+
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+ControlStream::ControlStream() {
+
+    nStaged_ = 0;
+    captureTime_ = 0;
+    nChannels_ = 0;
+    lastCapture_ = 0;
+    delayUs_ = 0;
+    periodUs_ = 1000000 / CONTROL_MIN_RATE;
+    predict_ = false;
+    glide_ = 1;
+    running_ = false;
+    shouldStop_ = false;
+    nTicks_ = 0;
+    nLate_ = 0;
+    nMessages_ = 0;
+    nBundles_ = 0;
+
+    pthread_mutex_init(&mutex_, NULL);
+}
+
+ControlStream::~ControlStream() {
+
+    stop();
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool ControlStream::start(int rate, bool predict) {
+
+    stop();
+
+    if (rate < CONTROL_MIN_RATE)
+        rate = CONTROL_MIN_RATE;
+    if (rate > CONTROL_MAX_RATE)
+        rate = CONTROL_MAX_RATE;
+
+    periodUs_ = 1000000 / rate;
+    predict_ = predict;
+    glide_ = 1 - expf(-(float)periodUs_ / CONTROL_GLIDE_US);
+
+    nTicks_ = 0;
+    nLate_ = 0;
+    nMessages_ = 0;
+    nBundles_ = 0;
+    shouldStop_ = false;
+
+    if (pthread_create(&thread_, NULL, staticRun, (void *)this) != 0) {
+        printf("%s: Error creating output thread\n", __PRETTY_FUNCTION__);
+        return false;
+    }
+
+    running_ = true;
+    return true;
+}
+
+void ControlStream::stop() {
+
+    if (!running_)
+        return;
+
+    shouldStop_ = true;
+    pthread_join(thread_, NULL);
+    running_ = false;
+
+    /* The next start begins from whatever the tracking thread sends then */
+    pthread_mutex_lock(&mutex_);
+    nChannels_ = 0;
+    lastCapture_ = 0;
+    delayUs_ = 0;
+    pthread_mutex_unlock(&mutex_);
+}
+
+#pragma mark - Targets
+
+void ControlStream::beginFrame(uint64_t captureTime) {
+
+    captureTime_ = captureTime;
+    nStaged_ = 0;
+}
+
+void ControlStream::setTarget(const char *address, int note, float value) {
+
+    if (nStaged_ == CONTROL_MAX_CHANNELS || strlen(address) >= CONTROL_ADDRESS_MAX)
+        return;
+
+    Channel *staged = &staged_[nStaged_++];
+    strcpy(staged->address, address);
+    staged->note = note;
+    staged->v2 = value;
+}
+
+void ControlStream::endFrame() {
+
+    uint64_t now = hostTimeMicros();
+    Channel merged[CONTROL_MAX_CHANNELS];
+    int nMerged = 0;
+
+    pthread_mutex_lock(&mutex_);
+
+    /* Rendering runs this far behind so the next target has always arrived by the time
+       it's needed: up at once when a target comes later, down slowly when they're prompt */
+    if (lastCapture_ && now > lastCapture_) {
+        float wait = (float)(now - lastCapture_);
+        delayUs_ = wait > delayUs_ ? wait : delayUs_ + (wait - delayUs_) * CONTROL_DELAY_DECAY;
+    }
+    lastCapture_ = captureTime_;
+
+    /* Continue each channel that has a new target; the rest are dropped */
+    for (int i = 0; i < nStaged_; i++) {
+
+        const Channel &staged = staged_[i];
+        Channel *channel = &merged[nMerged];
+        float value = staged.v2;
+
+        int found = -1;
+        for (int c = 0; c < nChannels_ && found < 0; c++) {
+            if (channels_[c].note == staged.note && !strcmp(channels_[c].address, staged.address))
+                found = c;
+        }
+
+        /* Later targets for the same channel in one frame replace earlier ones */
+        bool duplicate = false;
+        for (int m = 0; m < nMerged && !duplicate; m++) {
+            if (merged[m].note == staged.note && !strcmp(merged[m].address, staged.address)) {
+                merged[m].v2 = value;
+                merged[m].lo = fminf(merged[m].lo, value);
+                merged[m].hi = fmaxf(merged[m].hi, value);
+                duplicate = true;
+            }
+        }
+        if (duplicate)
+            continue;
+
+        if (found >= 0) {
+            *channel = channels_[found];
+            channel->t0 = channel->t1;
+            channel->v0 = channel->v1;
+            channel->t1 = channel->t2;
+            channel->v1 = channel->v2;
+        }
+        else {
+            strcpy(channel->address, staged.address);
+            channel->note = staged.note;
+            channel->t0 = channel->t1 = captureTime_;
+            channel->v0 = channel->v1 = value;
+            channel->lo = value;
+            channel->hi = value;
+            channel->output = value;
+            channel->sent = value;
+            channel->hasSent = false;
+        }
+
+        channel->t2 = captureTime_;
+        channel->v2 = value;
+        channel->lo = fminf(channel->lo, value);
+        channel->hi = fmaxf(channel->hi, value);
+        nMerged++;
+    }
+
+    memcpy(channels_, merged, nMerged * sizeof(Channel));
+    nChannels_ = nMerged;
+
+    pthread_mutex_unlock(&mutex_);
+}
+
+#pragma mark - Output
+
+/* Channel's value at now. Called with mutex_ held. */
+float ControlStream::render(Channel *channel, uint64_t now) {
+
+    float span = (float)(channel->t2 - channel->t1);
+
+    if (!predict_) {
+
+        /* delayUs_ behind, relative to the newest target. That point is usually still short
+           of the previous target when the newest arrives, so the step before it is kept. */
+        float t = (float)((int64_t)(now - channel->t2)) - delayUs_;
+        float previousSpan = (float)(channel->t1 - channel->t0);
+
+        if (t >= 0 || span <= 0)
+            channel->output = channel->v2;
+        else if (t >= -span)
+            channel->output = channel->v1 + (channel->v2 - channel->v1) * (t + span) / span;
+        else if (previousSpan > 0 && t > -span - previousSpan)
+            channel->output = channel->v0 + (channel->v1 - channel->v0) * (t + span + previousSpan) / previousSpan;
+        else
+            channel->output = channel->v0;
+    }
+    else {
+
+        /* Past the newest target along the last step, at most one wait ahead */
+        float lead = fminf((float)((int64_t)(now - channel->t2)), delayUs_);
+        float target = channel->v2;
+        if (span > 0 && lead > 0)
+            target += (channel->v2 - channel->v1) * lead / span;
+
+        target = fminf(fmaxf(target, channel->lo), channel->hi);
+        channel->output += (target - channel->output) * glide_;
+    }
+
+    return channel->output;
+}
+
+void ControlStream::tick(uint64_t now) {
+
+    struct Change {
+        char address[CONTROL_ADDRESS_MAX];
+        int note;
+        float value;
+    };
+
+    Change changes[CONTROL_MAX_CHANNELS];
+    int nChanges = 0;
+
+    pthread_mutex_lock(&mutex_);
+
+    for (int c = 0; c < nChannels_; c++) {
+
+        Channel *channel = &channels_[c];
+        float value = render(channel, now);
+
+        if (channel->hasSent && fabsf(value - channel->sent) < CONTROL_DEADBAND)
+            continue;
+
+        channel->sent = value;
+        channel->hasSent = true;
+
+        Change *change = &changes[nChanges++];
+        strcpy(change->address, channel->address);
+        change->note = channel->note;
+        change->value = value;
+    }
+
+    pthread_mutex_unlock(&mutex_);
+
+    if (nChanges == 0)
+        return;
+
+    const char *paths[CONTROL_MAX_CHANNELS];
+    const char *types[CONTROL_MAX_CHANNELS];
+    lo_message messages[CONTROL_MAX_CHANNELS];
+
+    for (int i = 0; i < nChanges; i++) {
+        messages[i] = lo_message_new();
+        paths[i] = changes[i].address;
+
+        if (changes[i].note >= 0) {
+            types[i] = "iif";
+            lo_message_add_int32(messages[i], 0);
+            lo_message_add_int32(messages[i], changes[i].note);
+        }
+        else
+            types[i] = "f";
+
+        lo_message_add_float(messages[i], changes[i].value);
+    }
+
+    sender_.sendBundle(paths, types, messages, nChanges);
+
+    for (int i = 0; i < nChanges; i++)
+        lo_message_free(messages[i]);
+
+    nMessages_ += nChanges;
+    nBundles_++;
+}
+
+void *ControlStream::run() {
+
+    uint64_t next = hostTimeMicros();
+
+    while (!shouldStop_) {
+
+        uint64_t now = hostTimeMicros();
+        if (next > now) {
+            usleep((useconds_t)(next - now));
+            now = hostTimeMicros();
+        }
+
+        /* Ticks missed by a whole period are dropped rather than sent in a burst */
+        if (now >= next + periodUs_) {
+            nLate_++;
+            next = now;
+        }
+
+        tick(now);
+        nTicks_++;
+        next += periodUs_;
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+//
+//  ControlStream.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Sends mapped control values (intensity, brightness, ...) at a fixed rate between 100
+//  and 500 Hz instead of once per sensor frame, so the piano hears a ramp rather than
+//  30 Hz steps. The tracking thread hands over each frame's targets; an output thread
+//  wakes on its own clock and renders every channel, either interpolated between its
+//  targets, about one frame late, or predicted ahead of the newest one and glided onto each
+//  correction. Each tick's changes go out as one bundle, and a channel whose value hasn't
+//  moved by CONTROL_DEADBAND sends nothing, so the channel cap and the rate bound both
+//  CPU and bandwidth.
+
+#ifndef __KinectOSC__ControlStream__
+#define __KinectOSC__ControlStream__
+
+#include <iostream>
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "OscController.h"
+
+using namespace std;
+
+#define CONTROL_MIN_RATE 100                // Ticks per second
+#define CONTROL_MAX_RATE 500
+#define CONTROL_MAX_CHANNELS 64
+#define CONTROL_ADDRESS_MAX 64
+#define CONTROL_DEADBAND 1e-4f              // Smallest change worth a message
+#define CONTROL_GLIDE_US 8000               // Time constant for settling onto a corrected prediction
+#define CONTROL_DELAY_DECAY 0.02f           // Per frame, toward a shorter gap between targets
+
+class ControlStream {
+
+    struct Channel {
+        char address[CONTROL_ADDRESS_MAX];
+        int note;                       // Sent as "iif" 0, note, value; -1 for a bare "f"
+        uint64_t t0, t1, t2;            // Capture times of the last three targets (host us), newest last
+        float v0, v1, v2;
+        float lo, hi;                   // Range of every target so far; predictions stay inside
+        float output;                   // Output thread's current value
+        float sent;                     // Last value sent
+        bool hasSent;
+    };
+
+public:
+
+    ControlStream();
+    ~ControlStream();
+
+    /* Output thread, at rate ticks per second (clamped to CONTROL_MIN_RATE..CONTROL_MAX_RATE) */
+    bool start(int rate, bool predict);
+    void stop();
+    bool isRunning() { return running_; }              // Safe from any thread
+
+    /* Messages go to their own address, since the tracking thread owns the main sender's.
+       Tests may set a callback on it before start(). */
+    void setServerAddress(const char *host, const char *port) { sender_.setServerAddress(host, port); }
+    OscController &sender() { return sender_; }
+
+    /* Tracking thread: one frame's targets, captured at captureTime (host us). A channel
+       that isn't given a target before endFrame() stops sending. */
+    void beginFrame(uint64_t captureTime);
+    void setTarget(const char *address, int note, float value);
+    void endFrame();
+
+    /* Getters */
+    uint64_t numTicks() { return nTicks_; }
+    uint64_t numLateTicks() { return nLate_; }         // Woke a whole period or more late
+    uint64_t numMessages() { return nMessages_; }
+    uint64_t numBundles() { return nBundles_; }
+    float delay() { return delayUs_ * 1e-6f; }          // Interpolation delay (s)
+
+private:
+
+    void *run();
+    static void *staticRun(void *arg) {
+        return ((ControlStream *)arg)->run();
+    }
+
+    void tick(uint64_t now);
+    float render(Channel *channel, uint64_t now);
+
+private:
+
+    OscController sender_;
+
+    /* Tracking thread's targets for the frame in progress */
+    Channel staged_[CONTROL_MAX_CHANNELS];
+    int nStaged_;
+    uint64_t captureTime_;
+
+    /* Shared, under mutex_ */
+    Channel channels_[CONTROL_MAX_CHANNELS];
+    int nChannels_;
+    uint64_t lastCapture_;
+    float delayUs_;                     // Longest recent wait for the next target, decaying
+    pthread_mutex_t mutex_;
+
+    int periodUs_;
+    bool predict_;
+    float glide_;                       // Per tick
+
+    pthread_t thread_;
+    atomic<bool> running_;
+    atomic<bool> shouldStop_;
+
+    atomic<uint64_t> nTicks_;
+    atomic<uint64_t> nLate_;
+    atomic<uint64_t> nMessages_;
+    atomic<uint64_t> nBundles_;
+};
+
+#endif /* defined(__KinectOSC__ControlStream__) */
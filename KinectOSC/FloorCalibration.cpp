@@ -0,0 +1,431 @@
+//
+//  FloorCalibration.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "FloorCalibration.h"
+
+#include <cmath>
+#include <string.h>
+
+FloorCalibration::FloorCalibration() {
+
+    bgWidth_ = 0;
+    bgHeight_ = 0;
+    bgFrames_ = 0;
+    bgTarget_ = 0;
+
+    /* Kinect depth camera field of view as reported by OpenNI */
+    setFieldOfView(1.0144686f, 0.7898385f);
+
+    inlierThresh_ = 25;
+    minUpComponent_ = 0.85f;
+    nIterations_ = 256;
+    subsampleStep_ = 8;
+
+    transform_ = NULL;
+
+    collecting_ = false;
+    estimating_ = false;
+    abandon_ = false;
+    threadStarted_ = false;
+
+    pthread_mutex_init(&bgMutex_, NULL);
+    pthread_mutex_init(&joinMutex_, NULL);
+    pthread_mutex_init(&transformMutex_, NULL);
+}
+
+FloorCalibration::~FloorCalibration() {
+
+    pthread_mutex_lock(&bgMutex_);
+    collecting_ = false;
+    abandon_ = true;
+    if (threadStarted_)
+        pthread_join(estimateThread_, NULL);
+    pthread_mutex_unlock(&bgMutex_);
+
+    for (size_t i = 0; i < transforms_.size(); i++)
+        delete transforms_[i];
+
+    pthread_mutex_destroy(&transformMutex_);
+    pthread_mutex_destroy(&bgMutex_);
+    pthread_mutex_destroy(&joinMutex_);
+}
+
+void FloorCalibration::setFieldOfView(float horizontal, float vertical) {
+
+    xzFactor_ = tanf(horizontal / 2) * 2;
+    yzFactor_ = tanf(vertical / 2) * 2;
+}
+
+#pragma mark - Background model
+
+/* A previous estimate is joined outside bgMutex_, so addDepthFrame() on the tracking thread
+   never waits on it. joinMutex_ keeps a concurrent call from collecting, and so starting a
+   thread on snapshot_, until the old thread is gone. */
+void FloorCalibration::beginCalibration(int nFrames) {
+
+    pthread_mutex_lock(&joinMutex_);
+
+    /* No estimate can start once collecting_ is clear */
+    pthread_mutex_lock(&bgMutex_);
+    collecting_ = false;
+    bool joinThread = threadStarted_;
+    threadStarted_ = false;
+    pthread_mutex_unlock(&bgMutex_);
+
+    /* Its result would be replaced by this calibration's anyway */
+    if (joinThread) {
+        abandon_ = true;
+        pthread_join(estimateThread_, NULL);
+        abandon_ = false;
+    }
+
+    pthread_mutex_lock(&bgMutex_);
+
+    background_.clear();
+    bgWidth_ = 0;
+    bgHeight_ = 0;
+    bgFrames_ = 0;
+    bgTarget_ = nFrames < 1 ? 1 : nFrames;
+    collecting_ = true;
+
+    pthread_mutex_unlock(&bgMutex_);
+    pthread_mutex_unlock(&joinMutex_);
+}
+
+void FloorCalibration::addDepthFrame(const uint16_t *pDepth, int width, int height, int strideInPixels) {
+
+    if (!collecting_)
+        return;
+
+    pthread_mutex_lock(&bgMutex_);
+
+    /* Lost a race with the last frame of the calibration */
+    if (!collecting_) {
+        pthread_mutex_unlock(&bgMutex_);
+        return;
+    }
+
+    if (width != bgWidth_ || height != bgHeight_) {
+        background_.assign(width * height, 0);
+        bgWidth_ = width;
+        bgHeight_ = height;
+        bgFrames_ = 0;
+    }
+
+    /* Keep the farthest valid depth at each pixel */
+    uint16_t *pBg = &background_[0];
+
+    for (int y = 0; y < height; y++) {
+        const uint16_t *pRow = pDepth + y * strideInPixels;
+        uint16_t *pBgRow = pBg + y * width;
+        for (int x = 0; x < width; x++)
+            pBgRow[x] = pRow[x] > pBgRow[x] ? pRow[x] : pBgRow[x];
+    }
+
+    bgFrames_++;
+
+    /* Hand a snapshot to the estimation thread; the tracking thread never waits on RANSAC.
+       Any earlier thread was joined when this calibration began. */
+    if (bgFrames_ >= bgTarget_) {
+
+        collecting_ = false;
+        estimating_ = true;
+        snapshot_ = background_;
+
+        if (pthread_create(&estimateThread_, NULL, staticEstimateThread, (void *)this) != 0) {
+            printf("%s: Error creating floor estimation thread\n", __PRETTY_FUNCTION__);
+            estimating_ = false;
+        }
+        else
+            threadStarted_ = true;
+    }
+
+    pthread_mutex_unlock(&bgMutex_);
+}
+
+/* bgWidth_ and bgHeight_ can't change until this thread is joined */
+void *FloorCalibration::estimateThread() {
+
+    Plane plane;
+
+    if (estimateFrom(snapshot_, bgWidth_, bgHeight_, &plane))
+        printf("Floor calibrated: normal (%.3f, %.3f, %.3f), sensor height %.0f mm\n",
+               plane.n[0], plane.n[1], plane.n[2], plane.d);
+    else if (!abandon_)
+        printf("%s: No floor plane found; using depth-image regions\n", __PRETTY_FUNCTION__);
+
+    estimating_ = false;
+    return 0;
+}
+
+#pragma mark - Plane estimation
+
+FloorCalibration::Point3 FloorCalibration::depthToWorld(int u, int v, uint16_t depth, int width, int height) {
+
+    Point3 p;
+    p.z = depth;
+    p.x = ((float)u / width - 0.5f) * p.z * xzFactor_;
+    p.y = (0.5f - (float)v / height) * p.z * yzFactor_;
+    return p;
+}
+
+void FloorCalibration::buildPointCloud(const vector<uint16_t> &background, int width, int height,
+                                       vector<Point3> *cloud) {
+
+    cloud->clear();
+
+    for (int v = 0; v < height; v += subsampleStep_) {
+        for (int u = 0; u < width; u += subsampleStep_) {
+            uint16_t d = background[v * width + u];
+            if (d != 0)
+                cloud->push_back(depthToWorld(u, v, d, width, height));
+        }
+    }
+}
+
+bool FloorCalibration::planeFromPoints(const Point3 &a, const Point3 &b, const Point3 &c, Plane *plane) {
+
+    float ab[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+    float ac[3] = {c.x - a.x, c.y - a.y, c.z - a.z};
+
+    float n[3] = {ab[1]*ac[2] - ab[2]*ac[1],
+                  ab[2]*ac[0] - ab[0]*ac[2],
+                  ab[0]*ac[1] - ab[1]*ac[0]};
+
+    float norm = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if (norm < 1e-6f)
+        return false;
+
+    /* Orient the normal up */
+    if (n[1] < 0) norm = -norm;
+
+    plane->n[0] = n[0] / norm;
+    plane->n[1] = n[1] / norm;
+    plane->n[2] = n[2] / norm;
+    plane->d = -(plane->n[0]*a.x + plane->n[1]*a.y + plane->n[2]*a.z);
+
+    /* The sensor must be above the floor, and the floor roughly level */
+    return plane->d > 0 && plane->n[1] >= minUpComponent_;
+}
+
+int FloorCalibration::countInliers(const vector<Point3> &cloud, const Plane &plane) {
+
+    int nInliers = 0;
+    const Point3 *p = &cloud[0];
+
+    for (size_t i = 0; i < cloud.size(); i++) {
+        float dist = plane.n[0]*p[i].x + plane.n[1]*p[i].y + plane.n[2]*p[i].z + plane.d;
+        nInliers += fabsf(dist) < inlierThresh_;
+    }
+
+    return nInliers;
+}
+
+void *FloorCalibration::ransacWorker(RansacJob *job) {
+
+    const vector<Point3> &cloud = *job->cloud;
+    unsigned int seed = job->seed;
+    int nPoints = (int)cloud.size();
+
+    job->bestInliers = 0;
+
+    for (int i = 0; i < job->nIterations && !abandon_; i++) {
+
+        /* Deterministic LCG so calibration is reproducible for a given background */
+        int idx[3];
+        for (int k = 0; k < 3; k++) {
+            seed = seed * 1103515245u + 12345u;
+            idx[k] = (int)((seed >> 8) % nPoints);
+        }
+
+        Plane candidate;
+        if (!planeFromPoints(cloud[idx[0]], cloud[idx[1]], cloud[idx[2]], &candidate))
+            continue;
+
+        int nInliers = countInliers(cloud, candidate);
+        if (nInliers > job->bestInliers) {
+            job->bestInliers = nInliers;
+            job->best = candidate;
+        }
+    }
+
+    return 0;
+}
+
+/* Least-squares fit of y = a*x + b*z + c over the inliers of a candidate plane */
+bool FloorCalibration::refinePlane(const vector<Point3> &cloud, Plane *plane) {
+
+    double sxx = 0, sxz = 0, szz = 0, sx = 0, sz = 0, n = 0;
+    double sxy = 0, szy = 0, sy = 0;
+
+    for (size_t i = 0; i < cloud.size(); i++) {
+
+        const Point3 &p = cloud[i];
+        float dist = plane->n[0]*p.x + plane->n[1]*p.y + plane->n[2]*p.z + plane->d;
+        if (fabsf(dist) >= inlierThresh_)
+            continue;
+
+        sxx += p.x*p.x; sxz += p.x*p.z; szz += p.z*p.z;
+        sx  += p.x;     sz  += p.z;     n   += 1;
+        sxy += p.x*p.y; szy += p.z*p.y; sy  += p.y;
+    }
+
+    /* Solve [sxx sxz sx; sxz szz sz; sx sz n] [a b c]' = [sxy szy sy]' by Cramer's rule */
+    double det = sxx*(szz*n - sz*sz) - sxz*(sxz*n - sz*sx) + sx*(sxz*sz - szz*sx);
+    if (fabs(det) < 1e-9)
+        return false;
+
+    double a = (sxy*(szz*n - sz*sz) - sxz*(szy*n - sz*sy) + sx*(szy*sz - szz*sy)) / det;
+    double b = (sxx*(szy*n - sy*sz) - sxy*(sxz*n - sz*sx) + sx*(sxz*sy - szy*sx)) / det;
+    double c = (sxx*(szz*sy - sz*szy) - sxz*(sxz*sy - sx*szy) + sxy*(sxz*sz - szz*sx)) / det;
+
+    /* y - a*x - b*z - c = 0 */
+    double norm = sqrt(a*a + 1 + b*b);
+    Plane refined;
+    refined.n[0] = (float)(-a / norm);
+    refined.n[1] = (float)(1 / norm);
+    refined.n[2] = (float)(-b / norm);
+    refined.d = (float)(-c / norm);
+
+    if (refined.d <= 0 || refined.n[1] < minUpComponent_)
+        return false;
+
+    *plane = refined;
+    return true;
+}
+
+bool FloorCalibration::estimateFloor() {
+
+    /* Work from a snapshot so the tracking thread can keep adding frames */
+    pthread_mutex_lock(&bgMutex_);
+    vector<uint16_t> background(background_);
+    int width = bgWidth_;
+    int height = bgHeight_;
+    pthread_mutex_unlock(&bgMutex_);
+
+    Plane plane;
+    return estimateFrom(background, width, height, &plane);
+}
+
+/* Publishes the transform if a floor is found. Everything it works on is its own, so
+   estimates on different threads don't interfere. */
+bool FloorCalibration::estimateFrom(const vector<uint16_t> &background, int width, int height, Plane *plane) {
+
+    if (background.empty())
+        return false;
+
+    vector<Point3> cloud;
+    buildPointCloud(background, width, height, &cloud);
+    if (cloud.size() < 3)
+        return false;
+
+    /* Split the hypotheses across threads; each keeps its own best plane */
+    RansacJob jobs[FLOOR_CAL_MAX_THREADS];
+    pthread_t threads[FLOOR_CAL_MAX_THREADS];
+    bool started[FLOOR_CAL_MAX_THREADS];
+
+    for (int i = 0; i < FLOOR_CAL_MAX_THREADS; i++) {
+        jobs[i].owner = this;
+        jobs[i].cloud = &cloud;
+        jobs[i].seed = 0x9e3779b9u * (i + 1);
+        jobs[i].nIterations = (nIterations_ + FLOOR_CAL_MAX_THREADS - 1) / FLOOR_CAL_MAX_THREADS;
+        jobs[i].bestInliers = 0;
+        started[i] = pthread_create(&threads[i], NULL, staticRansacWorker, (void *)&jobs[i]) == 0;
+        if (!started[i])
+            ransacWorker(&jobs[i]);
+    }
+
+    int best = 0;
+    for (int i = 0; i < FLOOR_CAL_MAX_THREADS; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        if (jobs[i].bestInliers > jobs[best].bestInliers)
+            best = i;
+    }
+
+    /* A new calibration began while the workers ran */
+    if (abandon_)
+        return false;
+
+    /* Require a meaningful fraction of the scene to be floor */
+    if (jobs[best].bestInliers < (int)cloud.size() / 10)
+        return false;
+
+    *plane = jobs[best].best;
+    refinePlane(cloud, plane);
+
+    publishTransform(*plane);
+    return true;
+}
+
+#pragma mark - Projection
+
+void FloorCalibration::publishTransform(const Plane &plane) {
+
+    const float *up = plane.n;
+
+    /* Forward: the sensor's viewing direction projected onto the floor */
+    float fwd[3] = {-up[2]*up[0], -up[2]*up[1], 1 - up[2]*up[2]};
+    float norm = sqrtf(fwd[0]*fwd[0] + fwd[1]*fwd[1] + fwd[2]*fwd[2]);
+    fwd[0] /= norm; fwd[1] /= norm; fwd[2] /= norm;
+
+    /* Lateral: up x forward */
+    float lat[3] = {up[1]*fwd[2] - up[2]*fwd[1],
+                    up[2]*fwd[0] - up[0]*fwd[2],
+                    up[0]*fwd[1] - up[1]*fwd[0]};
+
+    /* Origin: the point on the floor directly below the sensor */
+    float origin[3] = {-plane.d*up[0], -plane.d*up[1], -plane.d*up[2]};
+
+    const float *axes[3] = {lat, up, fwd};
+    Transform *transform = new Transform();
+
+    for (int r = 0; r < 3; r++) {
+        transform->m[r][0] = axes[r][0];
+        transform->m[r][1] = axes[r][1];
+        transform->m[r][2] = axes[r][2];
+        transform->m[r][3] = -(axes[r][0]*origin[0] + axes[r][1]*origin[1] + axes[r][2]*origin[2]);
+    }
+    transform->plane = plane;
+
+    /* Filled in before it's published, so readers never see it partly written */
+    pthread_mutex_lock(&transformMutex_);
+    transforms_.push_back(transform);
+    transform_.store(transform, memory_order_release);
+    pthread_mutex_unlock(&transformMutex_);
+}
+
+void FloorCalibration::floorPlane(float *normal, float *d) {
+
+    const Transform *transform = transform_.load(memory_order_acquire);
+    Plane plane;
+
+    if (transform)
+        plane = transform->plane;
+    else
+        memset(&plane, 0, sizeof(plane));
+
+    normal[0] = plane.n[0];
+    normal[1] = plane.n[1];
+    normal[2] = plane.n[2];
+    *d = plane.d;
+}
+
+void FloorCalibration::projectToFloor(float x, float y, float z, float *fx, float *fy, float *fz) {
+
+    const Transform *transform = transform_.load(memory_order_acquire);
+
+    if (!transform) {
+        *fx = *fy = *fz = 0;
+        return;
+    }
+
+    const float (*t)[4] = transform->m;
+    *fx = t[0][0]*x + t[0][1]*y + t[0][2]*z + t[0][3];
+    *fy = t[1][0]*x + t[1][1]*y + t[1][2]*z + t[1][3];
+    *fz = t[2][0]*x + t[2][1]*y + t[2][2]*z + t[2][3];
+}
@@ -0,0 +1,142 @@
+//
+//  FloorCalibration.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Estimates the floor plane from a background model of the depth image and maps
+//  sensor-space joint positions onto floor coordinates, so note regions can be laid
+//  out as physical areas of the stage instead of columns of the depth image.
+
+#ifndef __KinectOSC__FloorCalibration__
+#define __KinectOSC__FloorCalibration__
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+
+#define FLOOR_CAL_MAX_THREADS 4
+
+using namespace std;
+
+class FloorCalibration {
+
+public:
+
+    /* Point in sensor space (mm) */
+    struct Point3 {
+        float x;
+        float y;
+        float z;
+    };
+
+    FloorCalibration();
+    ~FloorCalibration();
+
+    /* Setters */
+    void setFieldOfView(float horizontal, float vertical);      // Radians
+    void setInlierThreshold(float mm) { inlierThresh_ = mm; }
+    void setIterations(int nIterations) { nIterations_ = nIterations; }
+    void setSubsampleStep(int step) { subsampleStep_ = step < 1 ? 1 : step; }
+
+    /* Begin collecting nFrames of depth data; the floor is estimated on a background thread
+       once they're in. Tracking keeps using the previous transform (if any) until then. An
+       estimate still running from an earlier calibration is abandoned. */
+    void beginCalibration(int nFrames = 30);
+    bool wantsFrames() { return collecting_; }
+    void addDepthFrame(const uint16_t *pDepth, int width, int height, int strideInPixels);
+
+    /* Estimate synchronously from whatever background has been collected */
+    bool estimateFloor();
+
+    /* Getters */
+    bool isCalibrated() { return transform_ != NULL; }
+    bool isEstimating() { return estimating_; }
+    void floorPlane(float *normal, float *d);
+
+    /* Transform a sensor-space point to floor coordinates: x lateral, y height above the
+       floor, z distance along the floor away from the sensor (all mm). Lock-free, for the
+       tracking thread; all zeros until calibrated. */
+    void projectToFloor(float x, float y, float z, float *fx, float *fy, float *fz);
+
+    /* Depth image to sensor space, matching OpenNI's conversion for the configured field of view */
+    Point3 depthToWorld(int u, int v, uint16_t depth, int width, int height);
+
+private:
+
+    struct Plane {
+        float n[3];     // Unit normal, pointing up
+        float d;        // n . p + d = 0
+    };
+
+    /* World-to-floor transform, rows are [x; y; z] of the floor frame. Never modified once
+       published, so a reader holding one always sees a whole calibration. */
+    struct Transform {
+        float m[3][4];
+        Plane plane;
+    };
+
+    struct RansacJob {
+        FloorCalibration *owner;
+        const vector<Point3> *cloud;
+        unsigned int seed;
+        int nIterations;
+        Plane best;
+        int bestInliers;
+    };
+
+    void *estimateThread();
+    static void *staticEstimateThread(void *arg) {
+        return ((FloorCalibration *)arg)->estimateThread();
+    }
+
+    void *ransacWorker(RansacJob *job);
+    static void *staticRansacWorker(void *arg) {
+        RansacJob *job = (RansacJob *)arg;
+        return job->owner->ransacWorker(job);
+    }
+
+    bool estimateFrom(const vector<uint16_t> &background, int width, int height, Plane *plane);
+    void buildPointCloud(const vector<uint16_t> &background, int width, int height, vector<Point3> *cloud);
+    bool planeFromPoints(const Point3 &a, const Point3 &b, const Point3 &c, Plane *plane);
+    int countInliers(const vector<Point3> &cloud, const Plane &plane);
+    bool refinePlane(const vector<Point3> &cloud, Plane *plane);
+    void publishTransform(const Plane &plane);
+
+private:
+
+    /* Background model: farthest valid depth seen at each pixel, so performers moving
+       through the calibration window don't occlude the floor */
+    vector<uint16_t> background_;
+    int bgWidth_;
+    int bgHeight_;
+    int bgFrames_;
+    int bgTarget_;
+
+    vector<uint16_t> snapshot_; // Background handed to the estimating thread, which owns it until joined
+
+    float xzFactor_;            // tan(hFov/2) * 2
+    float yzFactor_;            // tan(vFov/2) * 2
+    float inlierThresh_;
+    float minUpComponent_;      // Reject planes tilted more than this from the sensor's vertical
+    int nIterations_;
+    int subsampleStep_;
+
+    /* The current transform, NULL until calibrated. Replaced ones are kept until destruction,
+       since the tracking thread may still be using one; there's one per calibration. */
+    atomic<const Transform *> transform_;
+    vector<Transform *> transforms_;
+    pthread_mutex_t transformMutex_;    // Guards transforms_
+
+    atomic<bool> collecting_;
+    atomic<bool> estimating_;
+    atomic<bool> abandon_;              // Makes a running estimate give up without publishing
+    atomic<bool> threadStarted_;
+    pthread_t estimateThread_;
+    pthread_mutex_t bgMutex_;           // Guards the background model, and starting the thread
+    pthread_mutex_t joinMutex_;         // Held by beginCalibration() from joining the thread until collecting again
+};
+
+#endif /* defined(__KinectOSC__FloorCalibration__) */
@@ -0,0 +1,183 @@
+//
+//  FrameClock.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "FrameClock.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+static const double kOffsetProcessNoise = 0.01;     // us^2 per us: the offset wanders ~20 us per frame
+static const double kDriftProcessNoise = 1e-20;     // per us: drift changes by ppm over minutes
+static const double kInitialNoise = 1e6;            // (1 ms)^2 until arrivals have been seen
+static const double kMinNoise = 100;                // (10 us)^2
+static const double kInitialDriftVariance = 1e-8;   // (100 ppm)^2
+
+FrameClock::FrameClock() {
+
+    reset();
+}
+
+void FrameClock::reset() {
+
+    started_ = false;
+    lastSensorTime_ = 0;
+    lastHostTime_ = 0;
+    lastFrameIndex_ = 0;
+
+    offset_ = 0;
+    drift_ = 0;
+    noise_ = kInitialNoise;
+    P_[0][0] = P_[0][1] = P_[1][0] = P_[1][1] = 0;
+
+    period_ = 0;
+    nFrames_ = 0;
+    nDropped_ = 0;
+    nDuplicates_ = 0;
+
+    publish();
+}
+
+void FrameClock::restart(double measurement) {
+
+    offset_ = measurement;
+    drift_ = 0;
+    P_[0][0] = noise_;
+    P_[0][1] = P_[1][0] = 0;
+    P_[1][1] = kInitialDriftVariance;
+}
+
+void FrameClock::filter(double measurement, double dt) {
+
+    /* Predict: the offset moves by the drift over dt */
+    offset_ += drift_ * dt;
+    P_[0][0] += 2 * dt * P_[0][1] + dt * dt * P_[1][1] + kOffsetProcessNoise * dt;
+    P_[0][1] += dt * P_[1][1];
+    P_[1][0] = P_[0][1];
+    P_[1][1] += kDriftProcessNoise * dt;
+
+    /* Correct, trusting late arrivals less than early ones so the estimate settles on the
+       least-delayed arrivals, and outliers hardly at all */
+    double residual = measurement - offset_;
+    double R = noise_;
+    if (residual > 3 * sqrt(noise_))
+        R *= 1000;
+    else if (residual > 0)
+        R *= 20;
+
+    double S = P_[0][0] + R;
+    double K0 = P_[0][0] / S;
+    double K1 = P_[1][0] / S;
+
+    offset_ += K0 * residual;
+    drift_ += K1 * residual;
+
+    double P00 = P_[0][0], P01 = P_[0][1];
+    P_[0][0] = (1 - K0) * P00;
+    P_[0][1] = (1 - K0) * P01;
+    P_[1][0] = P_[0][1];
+    P_[1][1] -= K1 * P01;
+
+    /* Track arrival jitter, clipping outliers so one stall doesn't blow it up */
+    double r2 = residual * residual;
+    if (r2 > 16 * noise_)
+        r2 = 16 * noise_;
+    noise_ += 0.02 * (r2 - noise_);
+    if (noise_ < kMinNoise)
+        noise_ = kMinNoise;
+}
+
+FrameTiming FrameClock::update(const SkeletonFrame *frame) {
+
+    FrameTiming timing;
+    timing.sensorTime = frame->timestamp;
+    timing.hostTime = frame->hostTime;
+    timing.interval = 0;
+    timing.dropped = 0;
+    timing.duplicate = false;
+
+    double measurement = (double)(int64_t)(frame->hostTime - frame->timestamp);
+
+    if (!started_) {
+        started_ = true;
+        restart(measurement);
+    }
+
+    else if (frame->timestamp == lastSensorTime_ && frame->frameIndex == lastFrameIndex_) {
+        timing.duplicate = true;
+        timing.captureTime = toHostTime(frame->timestamp);
+        nDuplicates_++;
+        publish();
+        return timing;
+    }
+
+    else {
+
+        int64_t dtSensor = (int64_t)(frame->timestamp - lastSensorTime_);
+        int64_t dtHost = (int64_t)(frame->hostTime - lastHostTime_);
+
+        /* A clock that went backwards or jumped: the source restarted */
+        if (dtSensor <= 0 || dtSensor > FRAME_CLOCK_RESET_GAP_US || llabs(dtHost - dtSensor) > FRAME_CLOCK_RESET_GAP_US)
+            restart(measurement);
+        else {
+            filter(measurement, (double)dtSensor);
+            timing.interval = dtSensor * 1e-6f;
+        }
+
+        /* Frame indices count drops exactly; sources without them fall back on timestamps */
+        int indexStep = frame->frameIndex - lastFrameIndex_;
+
+        if (indexStep > 1 && indexStep < 1000)
+            timing.dropped = indexStep - 1;
+        else if (indexStep != 1 && period_ > 0 && timing.interval > 1.5f * period_)
+            timing.dropped = (int)lroundf(timing.interval / period_) - 1;
+
+        if (timing.dropped == 0 && timing.interval > 0)
+            period_ = period_ == 0 ? timing.interval : period_ + 0.05f * (timing.interval - period_);
+    }
+
+    lastSensorTime_ = frame->timestamp;
+    lastHostTime_ = frame->hostTime;
+    lastFrameIndex_ = frame->frameIndex;
+
+    nFrames_++;
+    nDropped_ += timing.dropped;
+    publish();
+
+    timing.captureTime = frame->timestamp + (int64_t)llround(offset_);
+    return timing;
+}
+
+uint64_t FrameClock::toHostTime(uint64_t sensorTime) {
+
+    double dt = (double)(int64_t)(sensorTime - lastSensorTime_);
+    return sensorTime + (int64_t)llround(offset_ + drift_ * dt);
+}
+
+double FrameClock::jitter() {
+
+    return sqrt(noise_);
+}
+
+void FrameClock::publish() {
+
+    publishedDrift_.store((float)drift(), memory_order_relaxed);
+    publishedJitter_.store((float)jitter(), memory_order_relaxed);
+    publishedFrames_.store(nFrames_, memory_order_relaxed);
+    publishedDropped_.store(nDropped_, memory_order_relaxed);
+    publishedDuplicates_.store(nDuplicates_, memory_order_relaxed);
+}
+
+FrameClockStats FrameClock::stats() {
+
+    FrameClockStats stats;
+    stats.drift = publishedDrift_.load(memory_order_relaxed);
+    stats.jitter = publishedJitter_.load(memory_order_relaxed);
+    stats.nFrames = publishedFrames_.load(memory_order_relaxed);
+    stats.nDropped = publishedDropped_.load(memory_order_relaxed);
+    stats.nDuplicates = publishedDuplicates_.load(memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,102 @@
+//
+//  FrameClock.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Places frames on the host clock and notices frames that were dropped or repeated.
+//  A two-state Kalman filter tracks the offset between the sensor and host clocks and
+//  its drift from (host arrival - sensor timestamp) each frame. Arrival delay only ever
+//  adds to that difference, so arrivals later than predicted are weighted less than early
+//  ones and outliers beyond three standard deviations hardly count, keeping the estimate
+//  near the least-delayed arrivals.
+
+#ifndef __KinectOSC__FrameClock__
+#define __KinectOSC__FrameClock__
+
+#include <iostream>
+#include <atomic>
+#include <stdint.h>
+
+#include "SkeletonFrame.h"
+
+#define FRAME_CLOCK_RESET_GAP_US 1000000    // A jump this large in either clock restarts the filter
+
+using namespace std;
+
+struct FrameTiming {
+    uint64_t sensorTime;        // Sensor clock (us)
+    uint64_t hostTime;          // Host monotonic clock at arrival (us)
+    uint64_t captureTime;       // Sensor time mapped onto the host clock (us)
+    float interval;             // Sensor time since the previous frame (s)
+    int dropped;                // Frames missed just before this one
+    bool duplicate;             // Repeat of the previous frame
+};
+
+/* What the clock has seen so far, for other threads to report */
+struct FrameClockStats {
+    float drift;                // Sensor clock rate error (ppm)
+    float jitter;               // Arrival jitter (us, standard deviation)
+    int nFrames;
+    int nDropped;
+    int nDuplicates;
+};
+
+class FrameClock {
+
+public:
+
+    FrameClock();
+
+    void reset();
+
+    /* Tracking thread, once per frame read */
+    FrameTiming update(const SkeletonFrame *frame);
+
+    /* Getters */
+    uint64_t toHostTime(uint64_t sensorTime);
+    double offset() { return offset_; }             // Host minus sensor time at the last frame (us)
+    double drift() { return drift_ * 1e6; }         // Sensor clock rate error (ppm)
+    double jitter();                                // Arrival jitter (us, standard deviation)
+    float framePeriod() { return period_; }         // Nominal interval between frames (s)
+    int numFrames() { return nFrames_; }
+    int numDropped() { return nDropped_; }
+    int numDuplicates() { return nDuplicates_; }
+
+    /* Any thread: the statistics as of the last update, published by the tracking thread
+       so readers never touch the filter state it is changing */
+    FrameClockStats stats();
+
+private:
+
+    void restart(double measurement);
+    void filter(double measurement, double dt);
+    void publish();
+
+private:
+
+    bool started_;
+    uint64_t lastSensorTime_;
+    uint64_t lastHostTime_;
+    int lastFrameIndex_;
+
+    double offset_;             // State: host - sensor (us) at lastSensorTime_
+    double drift_;              // State: d(offset)/d(sensor time)
+    double P_[2][2];            // State covariance
+    double noise_;              // Measurement noise variance estimate (us^2)
+
+    float period_;
+    int nFrames_;
+    int nDropped_;
+    int nDuplicates_;
+
+    /* Published copies of the above. Each is read on its own, so a report may mix two
+       consecutive frames; the counts only ever grow between resets. */
+    atomic<float> publishedDrift_;
+    atomic<float> publishedJitter_;
+    atomic<int> publishedFrames_;
+    atomic<int> publishedDropped_;
+    atomic<int> publishedDuplicates_;
+};
+
+#endif /* defined(__KinectOSC__FrameClock__) */
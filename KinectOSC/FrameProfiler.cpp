@@ -0,0 +1,165 @@
+//
+//  FrameProfiler.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "FrameProfiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+static const char *kStageNames[PROFILE_NUM_STAGES] = {
+    "frame", "stream", "joints", "display", "foot", "features", "mappings", "send", "gestures", "voices"
+};
+
+static const char *kReportColumns = "stage,count,mean_ns,p50_ns,p90_ns,p99_ns,max_ns";
+
+FrameProfiler::FrameProfiler() {
+
+    enabled_ = false;
+    reset();
+}
+
+void FrameProfiler::reset() {
+
+    for (int i = 0; i < PROFILE_NUM_STAGES; i++) {
+        stages_[i].count = 0;
+        stages_[i].total = 0;
+        stages_[i].max = 0;
+    }
+}
+
+const char *FrameProfiler::stageName(int stage) {
+
+    if (stage < 0 || stage >= PROFILE_NUM_STAGES)
+        return NULL;
+
+    return kStageNames[stage];
+}
+
+void FrameProfiler::record(ProfileStage stage, uint64_t ns) {
+
+    Stage &s = stages_[stage];
+
+    s.samples[s.count % PROFILE_SAMPLES] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+    s.count++;
+    s.total += ns;
+    if (ns > s.max)
+        s.max = ns;
+}
+
+/* Over the most recent PROFILE_SAMPLES durations */
+uint32_t FrameProfiler::percentile(const Stage &s, float p) {
+
+    int n = s.count < PROFILE_SAMPLES ? (int)s.count : PROFILE_SAMPLES;
+    if (n == 0)
+        return 0;
+
+    vector<uint32_t> sorted(s.samples, s.samples + n);
+    int k = (int)(p * (n - 1));
+    nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+
+    return sorted[k];
+}
+
+bool FrameProfiler::writeReport(const char *path, const char *label) {
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        printf("%s: Can't write \"%s\"\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    fprintf(file, "# KinectOSC frame profile: %s\n", label ? label : "");
+    fprintf(file, "%s\n", kReportColumns);
+
+    for (int i = 0; i < PROFILE_NUM_STAGES; i++) {
+
+        const Stage &s = stages_[i];
+        if (s.count == 0)
+            continue;
+
+        fprintf(file, "%s,%llu,%llu,%u,%u,%u,%llu\n", kStageNames[i],
+                (unsigned long long)s.count, (unsigned long long)(s.total / s.count),
+                percentile(s, 0.5f), percentile(s, 0.9f), percentile(s, 0.99f),
+                (unsigned long long)s.max);
+    }
+
+    fclose(file);
+    return true;
+}
+
+/* Median of each stage in a report, or -1 where the stage is missing */
+static bool readMedians(const char *path, double medians[PROFILE_NUM_STAGES]) {
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("%s: Can't open \"%s\"\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    for (int i = 0; i < PROFILE_NUM_STAGES; i++)
+        medians[i] = -1;
+
+    char line[256];
+    bool sawHeader = false;
+
+    while (fgets(line, sizeof(line), file)) {
+
+        if (line[0] == '#')
+            continue;
+
+        if (!sawHeader) {
+            sawHeader = strncmp(line, kReportColumns, strlen(kReportColumns)) == 0;
+            continue;
+        }
+
+        char name[32];
+        unsigned long long count, mean, median;
+        if (sscanf(line, "%31[^,],%llu,%llu,%llu", name, &count, &mean, &median) != 4)
+            continue;
+
+        for (int i = 0; i < PROFILE_NUM_STAGES; i++) {
+            if (strcmp(name, kStageNames[i]) == 0)
+                medians[i] = (double)median;
+        }
+    }
+
+    fclose(file);
+
+    if (!sawHeader)
+        printf("%s: \"%s\" is not a frame profile\n", __PRETTY_FUNCTION__, path);
+
+    return sawHeader;
+}
+
+int FrameProfiler::compare(const char *baselinePath, const char *path, float threshold) {
+
+    double baseline[PROFILE_NUM_STAGES], current[PROFILE_NUM_STAGES];
+
+    if (!readMedians(baselinePath, baseline) || !readMedians(path, current))
+        return -1;
+
+    int nSlower = 0;
+
+    for (int i = 0; i < PROFILE_NUM_STAGES; i++) {
+
+        if (baseline[i] < 0 || current[i] < 0)
+            continue;
+
+        double change = baseline[i] > 0 ? (current[i] - baseline[i]) / baseline[i] : 0;
+        bool slower = change > threshold && current[i] - baseline[i] > PROFILE_NOISE_FLOOR_NS;
+
+        printf("%-10s %10.0f ns -> %10.0f ns  %+6.1f%%%s\n", kStageNames[i],
+               baseline[i], current[i], change * 100, slower ? "  SLOWER" : "");
+
+        if (slower)
+            nSlower++;
+    }
+
+    return nSlower;
+}
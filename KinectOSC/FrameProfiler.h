@@ -0,0 +1,88 @@
+//
+//  FrameProfiler.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Times each stage of the per-frame mapping path on the tracking thread. Run tracking
+//  over a recording (ReplaySkeletonSource, not realtime) or a SyntheticSkeletonSource with
+//  profiling on, then write the report: one CSV row of nanosecond statistics per stage.
+//  Reports from two builds are compared with compare(), which flags stages whose median
+//  got slower by more than a threshold.
+
+#ifndef __KinectOSC__FrameProfiler__
+#define __KinectOSC__FrameProfiler__
+
+#include <iostream>
+#include <atomic>
+#include <stdint.h>
+
+#include "Utility.h"
+
+#define PROFILE_SAMPLES 4096            // Most recent durations kept per stage for percentiles
+#define PROFILE_NOISE_FLOOR_NS 50       // Differences below this are never flagged
+
+using namespace std;
+
+enum ProfileStage {
+    PROFILE_FRAME = 0,      // Everything after the read, per frame
+    PROFILE_STREAM,         // SkeletonStreamer::publish
+    PROFILE_JOINTS,         // JointTracker::update
+    PROFILE_DISPLAY,        // KinectDisplay::updateJoint for each joint
+    PROFILE_FOOT,           // trackFoot, including region lookup and note messages
+    PROFILE_FEATURES,       // FeatureExtractor::extract
+    PROFILE_MAPPINGS,       // MappingEngine::evaluate
+    PROFILE_SEND,           // Sending mapped values
+    PROFILE_GESTURES,       // GestureRecognizer::process and its events
+    PROFILE_VOICES,         // VoiceManager::endFrame
+    PROFILE_NUM_STAGES
+};
+
+class FrameProfiler {
+
+    struct Stage {
+        uint64_t count;
+        uint64_t total;
+        uint64_t max;
+        uint32_t samples[PROFILE_SAMPLES];
+    };
+
+public:
+
+    FrameProfiler();
+
+    /* Setters */
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+    void reset();
+
+    /* Tracking thread. begin() returns 0 while disabled, and end() ignores it. */
+    uint64_t begin() { return enabled_ ? hostTimeNanos() : 0; }
+    void end(ProfileStage stage, uint64_t start) {
+        if (start)
+            record(stage, hostTimeNanos() - start);
+    }
+
+    /* Only while the tracking thread isn't running */
+    bool writeReport(const char *path, const char *label);
+
+    /* Print each stage of the current report against the baseline, marking those whose
+       median rose by more than threshold (0.1 = 10%). Returns the number marked, or -1 if
+       either report can't be read. */
+    static int compare(const char *baselinePath, const char *path, float threshold);
+
+    /* Getters */
+    bool isEnabled() { return enabled_; }
+    static const char *stageName(int stage);
+
+private:
+
+    void record(ProfileStage stage, uint64_t ns);
+    uint32_t percentile(const Stage &s, float p);
+
+private:
+
+    atomic<bool> enabled_;
+    Stage stages_[PROFILE_NUM_STAGES];
+};
+
+#endif /* defined(__KinectOSC__FrameProfiler__) */
@@ -0,0 +1,566 @@
+//
+//  GestureRecognizer.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "GestureRecognizer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <ctype.h>
+
+GestureRecognizer::GestureRecognizer() {
+
+    pthread_mutex_init(&loadMutex_, NULL);
+    active_ = NULL;
+    current_ = NULL;
+    readerGeneration_ = 1;
+    nextGeneration_ = 1;
+    cellsEvaluated_ = 0;
+
+    reset();
+}
+
+GestureRecognizer::~GestureRecognizer() {
+
+    delete active_.load();
+    for (size_t i = 0; i < retired_.size(); i++)
+        delete retired_[i];
+
+    pthread_mutex_destroy(&loadMutex_);
+}
+
+void GestureRecognizer::reset() {
+
+    for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+        tracks_[i].id = 0;
+        tracks_[i].timestamp = 0;
+        tracks_[i].generation = 0;
+    }
+}
+
+int GestureRecognizer::parseChannel(const char *name) {
+
+    if (name && !strcasecmp(name, "rise"))
+        return GESTURE_RISE_CHANNEL;
+
+    return parseJointName(name);
+}
+
+#pragma mark - Libraries
+
+bool GestureRecognizer::loadString(const char *text, const char *sourceName) {
+
+    Library *library = parse(text, sourceName);
+    if (!library)
+        return false;
+
+    publish(library);
+    return true;
+}
+
+bool GestureRecognizer::loadFile(const char *path) {
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("%s: Can't open %s\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    string text;
+    char buffer[1024];
+    size_t n;
+
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, n);
+
+    fclose(file);
+    return loadString(text.c_str(), path);
+}
+
+void GestureRecognizer::publish(Library *library) {
+
+    pthread_mutex_lock(&loadMutex_);
+
+    library->generation = nextGeneration_++;
+
+    Library *old = active_.exchange(library);
+    if (old)
+        retired_.push_back(old);
+
+    reclaim();
+    pthread_mutex_unlock(&loadMutex_);
+}
+
+/* Free replaced libraries older than the one the tracking thread holds; see
+   MappingEngine::reclaim(). Called with loadMutex_. */
+void GestureRecognizer::reclaim() {
+
+    uint64_t held = readerGeneration_.load();
+    size_t kept = 0;
+
+    for (size_t i = 0; i < retired_.size(); i++) {
+        if (retired_[i]->generation < held)
+            delete retired_[i];
+        else
+            retired_[kept++] = retired_[i];
+    }
+
+    retired_.resize(kept);
+}
+
+/* Close the open template: check its length and find its bounding box */
+static bool finishTemplate(GestureTemplate *gesture, int *nCells, const char *sourceName, int lineNumber) {
+
+    if (gesture->length < 2) {
+        printf("%s: %s:%d: \"%s\" needs at least two frames\n", __PRETTY_FUNCTION__, sourceName, lineNumber,
+               gesture->name.c_str());
+        return false;
+    }
+
+    *nCells += gesture->length;
+    if (*nCells > GESTURE_MAX_CELLS) {
+        printf("%s: %s:%d: More than %d template frames in all\n", __PRETTY_FUNCTION__, sourceName, lineNumber,
+               GESTURE_MAX_CELLS);
+        return false;
+    }
+
+    gesture->lo.assign(gesture->frames.begin(), gesture->frames.begin() + gesture->dims);
+    gesture->hi = gesture->lo;
+
+    for (int i = 1; i < gesture->length; i++) {
+        const float *frame = &gesture->frames[i * gesture->dims];
+        for (int k = 0; k < gesture->dims; k++) {
+            gesture->lo[k] = fminf(gesture->lo[k], frame[k]);
+            gesture->hi[k] = fmaxf(gesture->hi[k], frame[k]);
+        }
+    }
+
+    return true;
+}
+
+GestureRecognizer::Library *GestureRecognizer::parse(const char *text, const char *sourceName) {
+
+    Library *library = new Library();
+    library->nCells = 0;
+
+    vector<GestureTemplate> &templates = library->templates;
+    bool open = false;
+    bool ok = true;
+
+    string source(text);
+    size_t start = 0;
+    int lineNumber = 0;
+
+    while (ok && start <= source.size()) {
+
+        size_t end = source.find('\n', start);
+        if (end == string::npos)
+            end = source.size();
+
+        string line = source.substr(start, end - start);
+        lineNumber++;
+        start = end + 1;
+
+        char *comment = strchr(&line[0], '#');
+        if (comment)
+            *comment = '\0';
+
+        char *save;
+        char *word = strtok_r(&line[0], " \t\r", &save);
+        if (!word)
+            continue;
+
+        if (!strcasecmp(word, "gesture")) {
+
+            if (open) {
+                printf("%s: %s:%d: Missing \"end\"\n", __PRETTY_FUNCTION__, sourceName, lineNumber);
+                ok = false;
+                break;
+            }
+            if (templates.size() == GESTURE_MAX_TEMPLATES) {
+                printf("%s: %s:%d: More than %d gestures\n", __PRETTY_FUNCTION__, sourceName, lineNumber,
+                       GESTURE_MAX_TEMPLATES);
+                ok = false;
+                break;
+            }
+
+            GestureTemplate gesture;
+            char *name = strtok_r(NULL, " \t\r", &save);
+            char *address = strtok_r(NULL, " \t\r", &save);
+            char *threshold = strtok_r(NULL, " \t\r", &save);
+            char *endptr = NULL;
+
+            gesture.threshold = threshold ? strtof(threshold, &endptr) : 0;
+            gesture.joints = 0;
+            gesture.dims = 0;
+            gesture.length = 0;
+
+            if (!name || !address || address[0] != '/' || !threshold || *endptr || gesture.threshold <= 0) {
+                printf("%s: %s:%d: Expected \"gesture <name> <address> <threshold> <channel> ...\"\n",
+                       __PRETTY_FUNCTION__, sourceName, lineNumber);
+                ok = false;
+                break;
+            }
+
+            gesture.name = name;
+            gesture.address = address;
+            gesture.group = (int)templates.size();
+
+            for (size_t i = 0; i < templates.size(); i++) {
+                if (templates[i].name == gesture.name) {
+                    gesture.group = templates[i].group;
+                    break;
+                }
+            }
+
+            for (char *channel = strtok_r(NULL, " \t\r", &save); channel; channel = strtok_r(NULL, " \t\r", &save)) {
+                int c = parseChannel(channel);
+                if (c < 0) {
+                    printf("%s: %s:%d: Unknown channel \"%s\"\n", __PRETTY_FUNCTION__, sourceName, lineNumber, channel);
+                    ok = false;
+                    break;
+                }
+                gesture.channels.push_back(c);
+                gesture.dims += c == GESTURE_RISE_CHANNEL ? 1 : 3;
+                gesture.joints |= c == GESTURE_RISE_CHANNEL ? BODY_FRAME_JOINTS : 1 << c;
+            }
+
+            if (ok && (gesture.channels.empty() || gesture.dims > GESTURE_MAX_DIMS)) {
+                printf("%s: %s:%d: Between 1 and %d dimensions needed\n", __PRETTY_FUNCTION__, sourceName,
+                       lineNumber, GESTURE_MAX_DIMS);
+                ok = false;
+            }
+
+            /* Body coordinates also read the joints the body frame is built from */
+            gesture.joints |= BODY_FRAME_JOINTS;
+
+            templates.push_back(gesture);
+            open = true;
+        }
+        else if (!strcasecmp(word, "end")) {
+
+            if (!open) {
+                printf("%s: %s:%d: \"end\" outside a gesture\n", __PRETTY_FUNCTION__, sourceName, lineNumber);
+                ok = false;
+                break;
+            }
+
+            ok = finishTemplate(&templates.back(), &library->nCells, sourceName, lineNumber);
+            open = false;
+        }
+        else {
+
+            if (!open) {
+                printf("%s: %s:%d: Values outside a gesture\n", __PRETTY_FUNCTION__, sourceName, lineNumber);
+                ok = false;
+                break;
+            }
+
+            GestureTemplate &gesture = templates.back();
+            int nValues = 0;
+
+            for (; word; word = strtok_r(NULL, " \t\r", &save)) {
+                char *endptr;
+                float value = strtof(word, &endptr);
+                if (*endptr || nValues == gesture.dims) {
+                    nValues = -1;
+                    break;
+                }
+                gesture.frames.push_back(value);
+                nValues++;
+            }
+
+            if (nValues != gesture.dims) {
+                printf("%s: %s:%d: Expected %d values\n", __PRETTY_FUNCTION__, sourceName, lineNumber, gesture.dims);
+                ok = false;
+                break;
+            }
+            gesture.length++;
+        }
+    }
+
+    if (ok && open) {
+        printf("%s: %s: Missing \"end\"\n", __PRETTY_FUNCTION__, sourceName);
+        ok = false;
+    }
+
+    if (!ok) {
+        delete library;
+        return NULL;
+    }
+
+    return library;
+}
+
+void GestureRecognizer::observe(const GestureTemplate &gesture, const BodyFeatures &features, float *x) {
+
+    int k = 0;
+
+    for (size_t i = 0; i < gesture.channels.size(); i++) {
+        int c = gesture.channels[i];
+        if (c == GESTURE_RISE_CHANNEL)
+            x[k++] = features.rise;
+        else {
+            x[k++] = features.x[c];
+            x[k++] = features.y[c];
+            x[k++] = features.z[c];
+        }
+    }
+}
+
+bool GestureRecognizer::appendTemplate(const char *path, const char *name, const char *address, float threshold,
+                                       const vector<int> &channels, const BodyFeatures *frames, int nFrames) {
+
+    GestureTemplate gesture;
+    gesture.channels = channels;
+    gesture.dims = 0;
+    for (size_t i = 0; i < channels.size(); i++)
+        gesture.dims += channels[i] == GESTURE_RISE_CHANNEL ? 1 : 3;
+
+    if (gesture.dims == 0 || gesture.dims > GESTURE_MAX_DIMS || nFrames < 2) {
+        printf("%s: Nothing to record for \"%s\"\n", __PRETTY_FUNCTION__, name);
+        return false;
+    }
+
+    FILE *file = fopen(path, "a");
+    if (!file) {
+        printf("%s: Can't write %s\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    fprintf(file, "gesture %s %s %g", name, address, threshold);
+    for (size_t i = 0; i < channels.size(); i++)
+        fprintf(file, " %s", channels[i] == GESTURE_RISE_CHANNEL ? "rise" : jointName(channels[i]));
+    fprintf(file, "\n");
+
+    float x[GESTURE_MAX_DIMS];
+
+    for (int i = 0; i < nFrames; i++) {
+        observe(gesture, frames[i], x);
+        for (int k = 0; k < gesture.dims; k++)
+            fprintf(file, k ? " %.5g" : "%.5g", x[k]);
+        fprintf(file, "\n");
+    }
+
+    fprintf(file, "end\n");
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+#pragma mark - Matching
+
+void GestureRecognizer::beginFrame() {
+
+    current_ = active_.load();
+    if (current_)
+        readerGeneration_.store(current_->generation);
+}
+
+int GestureRecognizer::numTemplates() {
+
+    /* Libraries are only freed under the loader lock */
+    pthread_mutex_lock(&loadMutex_);
+    Library *library = active_.load();
+    int n = library ? (int)library->templates.size() : 0;
+    pthread_mutex_unlock(&loadMutex_);
+
+    return n;
+}
+
+GestureRecognizer::Track *GestureRecognizer::track(int userId) {
+
+    Track *oldest = &tracks_[0];
+
+    for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+        if (tracks_[i].id == userId)
+            return &tracks_[i];
+        if (tracks_[i].timestamp < oldest->timestamp)
+            oldest = &tracks_[i];
+    }
+
+    /* New user; their state is laid out on first use */
+    oldest->id = userId;
+    oldest->generation = 0;
+    return oldest;
+}
+
+/* Every path pruned and no candidates, for a new user or a new library */
+void GestureRecognizer::layout(Track *track, const Library *library) {
+
+    track->generation = library->generation;
+    track->frame = 0;
+    track->matches.resize(library->templates.size());
+    track->reported.assign(library->templates.size(), -1);
+    track->cost.assign(library->nCells, INFINITY);
+    track->start.assign(library->nCells, 0);
+
+    int cells = 0;
+    for (size_t g = 0; g < library->templates.size(); g++) {
+        Match &match = track->matches[g];
+        match.cells = cells;
+        match.last = -1;
+        match.best = INFINITY;
+        match.start = 0;
+        match.end = 0;
+        cells += library->templates[g].length;
+    }
+}
+
+int GestureRecognizer::process(const SkeletonUser &user, const JointStates &joints, const BodyFeatures &features,
+                               uint64_t timestamp, GestureEvent *out, int capacity) {
+
+    const Library *library = current_;
+    if (!library || library->templates.empty())
+        return 0;
+
+    /* State laid out for another library has the wrong shape, even if that library was
+       freed and this one reuses its address */
+    Track *t = track(user.id);
+    if (t->generation != library->generation || (user.flags & USER_NEW))
+        layout(t, library);
+    t->timestamp = timestamp;
+
+    int now = t->frame++;
+    int n = 0;
+    float x[GESTURE_MAX_DIMS];
+
+    for (size_t g = 0; g < library->templates.size(); g++) {
+
+        const GestureTemplate &gesture = library->templates[g];
+        Match &match = t->matches[g];
+        float *cost = &t->cost[match.cells];
+        int *start = &t->start[match.cells];
+        int m = gesture.length;
+        int dims = gesture.dims;
+        float limit = gesture.threshold * m;
+
+        /* Paths can't pass through a frame whose joints can't be read */
+        bool readable = features.hasFrame && (joints.valid & gesture.joints) == gesture.joints;
+
+        /* No template frame is nearer than its bounding box. If even that is further than a
+           whole match may cost, every path dies here. */
+        if (readable) {
+            observe(gesture, features, x);
+            float outside = 0;
+            for (int k = 0; k < dims; k++) {
+                float d = fmaxf(gesture.lo[k] - x[k], fmaxf(0, x[k] - gesture.hi[k]));
+                outside += d * d;
+            }
+            readable = sqrtf(outside) <= limit;
+        }
+
+        if (!readable) {
+            for (int i = 0; i <= match.last; i++)
+                cost[i] = INFINITY;
+            match.last = -1;
+        }
+        else {
+
+            /* One SPRING column. A path may start at any frame (left of cell 0 costs nothing)
+               and may span at most twice the template. Cells past the last live one of the
+               previous column stay dead once their left neighbour is. */
+            float left = 0;
+            int leftStart = now;
+            float diag = INFINITY;
+            int diagStart = now;
+            int last = -1;
+
+            for (int i = 0; i < m; i++) {
+
+                if (i > match.last + 1 && left == INFINITY)
+                    break;
+
+                float up = cost[i];
+                int upStart = start[i];
+
+                float best = left;
+                int bestStart = leftStart;
+                if (up < best) {
+                    best = up;
+                    bestStart = upStart;
+                }
+                if (diag < best) {
+                    best = diag;
+                    bestStart = diagStart;
+                }
+
+                diag = up;
+                diagStart = upStart;
+
+                if (best < limit && now - bestStart < 2 * m) {
+                    const float *frame = &gesture.frames[i * dims];
+                    float d2 = 0;
+                    for (int k = 0; k < dims; k++) {
+                        float d = x[k] - frame[k];
+                        d2 += d * d;
+                    }
+                    best += sqrtf(d2);
+                    cellsEvaluated_++;
+                }
+                else
+                    best = INFINITY;
+
+                if (best <= limit) {
+                    cost[i] = best;
+                    start[i] = bestStart;
+                    last = i;
+                }
+                else
+                    cost[i] = INFINITY;
+
+                left = cost[i];
+                leftStart = start[i];
+            }
+
+            match.last = last;
+        }
+
+        /* Report the candidate once no path overlapping it can beat it */
+        if (match.best < INFINITY) {
+
+            bool beatable = false;
+            for (int i = 0; i <= match.last && !beatable; i++)
+                beatable = cost[i] < match.best && start[i] <= match.end;
+
+            /* Another variant of the gesture may already have reported this stretch */
+            if (!beatable) {
+                int &reported = t->reported[gesture.group];
+                if (match.start > reported && n < capacity) {
+                    out[n].gesture = &gesture;
+                    out[n].userId = user.id;
+                    out[n].score = 1 - match.best / limit;
+                    out[n].frames = match.end - match.start + 1;
+                    n++;
+                    reported = match.end;
+                }
+
+                /* Paths overlapping the reported match can't be reported again */
+                int last = -1;
+                for (int i = 0; i <= match.last; i++) {
+                    if (start[i] <= match.end)
+                        cost[i] = INFINITY;
+                    else if (cost[i] < INFINITY)
+                        last = i;
+                }
+                match.last = last;
+                match.best = INFINITY;
+            }
+        }
+
+        /* A complete path at least half the template's length is a candidate */
+        if (match.last == m - 1 && cost[m - 1] < match.best && 2 * (now - start[m - 1] + 1) >= m) {
+            match.best = cost[m - 1];
+            match.start = start[m - 1];
+            match.end = now;
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,159 @@
+//
+//  GestureRecognizer.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Discrete gestures (kick, clap, arms up, jump, ...) matched against recorded templates
+//  as the frames arrive. Each template is tracked per user by streaming subsequence DTW
+//  (SPRING): one column of warped path costs, updated once per frame, so a gesture is
+//  found wherever it starts and however it's stretched, between half and twice the
+//  template's length. A match is reported once no overlapping path can beat it, a few
+//  frames after the gesture ends.
+//
+//  Path costs are pruned as soon as they exceed what a match may cost, and a template
+//  whose every path has been pruned costs one bounding-box test per frame until the pose
+//  comes near it again. The library's total template length is capped so the worst case
+//  per user per frame stays fixed.
+//
+//  A library is text:
+//
+//      gesture <name> <address> <threshold> <channel> ...
+//      <values>
+//      ...
+//      end
+//
+//  with one line of values per template frame. A channel is a joint, read as its three
+//  body coordinates (see BodyFeatures.h), or "rise", the torso's height above its resting height.
+//  Templates sharing a name are variants of one gesture and report once between them. The
+//  threshold is the largest mean distance per frame (heights) that counts as a match.
+//  Matches are sent to the address as "if": user id and a score from 1 (exact) down to 0
+//  (at the threshold). Lines starting with '#' are comments.
+
+#ifndef __KinectOSC__GestureRecognizer__
+#define __KinectOSC__GestureRecognizer__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "SkeletonFrame.h"
+#include "JointTracker.h"
+#include "BodyFeatures.h"
+
+using namespace std;
+
+#define GESTURE_MAX_TEMPLATES 64
+#define GESTURE_MAX_CELLS 4096          // Total template frames in a library
+#define GESTURE_MAX_DIMS 48
+#define GESTURE_RISE_CHANNEL SKELETON_NUM_JOINTS
+
+struct GestureTemplate {
+    string name;
+    string address;
+    int group;                          // First template with the same name
+    float threshold;                    // Mean distance per frame (heights)
+    vector<int> channels;               // Joints, or GESTURE_RISE_CHANNEL
+    int joints;                         // Mask of the joints the channels read
+    int dims;
+    int length;                         // Frames
+    vector<float> frames;               // length x dims
+    vector<float> lo;                   // Bounding box of the frames, per dim
+    vector<float> hi;
+};
+
+struct GestureEvent {
+    const GestureTemplate *gesture;
+    int userId;
+    float score;                        // 1 for an exact match, 0 at the threshold
+    int frames;                         // Length of the matched stretch
+};
+
+class GestureRecognizer {
+
+    struct Library {
+        uint64_t generation;            // Assigned on publication, from 1
+        vector<GestureTemplate> templates;
+        int nCells;
+    };
+
+    /* One template's SPRING state for one user */
+    struct Match {
+        int cells;                      // Offset of the template's column in Track::cost
+        int last;                       // Last cell in the column below the cost limit, or -1
+        float best;                     // Best candidate so far, or infinity
+        int start;                      // Its first and last frames
+        int end;
+    };
+
+    struct Track {
+        int id;
+        uint64_t timestamp;
+        int frame;                      // Frames seen for this user
+        uint64_t generation;            // Library the state below was laid out for, 0 for none
+        vector<Match> matches;
+        vector<int> reported;           // Last frame of each group's last reported match
+        vector<float> cost;             // Path cost per template frame, infinity if pruned
+        vector<int> start;              // First frame of each path
+    };
+
+public:
+
+    GestureRecognizer();
+    ~GestureRecognizer();
+
+    /* Parse a library and make it the active one. On error, the active library is kept
+       and false is returned. Safe to call while tracking. */
+    bool loadString(const char *text, const char *sourceName = "gestures");
+    bool loadFile(const char *path);
+
+    /* Append a template recorded from consecutive frames of one user to a library file */
+    static bool appendTemplate(const char *path, const char *name, const char *address, float threshold,
+                               const vector<int> &channels, const BodyFeatures *frames, int nFrames);
+
+    /* Tracking thread: take the active library for this frame */
+    void beginFrame();
+
+    /* Advance every template by one of the user's frames. Writes at most capacity events
+       and returns how many were written. */
+    int process(const SkeletonUser &user, const JointStates &joints, const BodyFeatures &features,
+                uint64_t timestamp, GestureEvent *out, int capacity);
+
+    /* Forget every user's partial matches */
+    void reset();
+
+    /* Getters */
+    int numTemplates();
+    uint64_t cellsEvaluated() { return cellsEvaluated_; }   // Distances computed, for profiling
+
+    static int parseChannel(const char *name);
+
+private:
+
+    Library *parse(const char *text, const char *sourceName);
+    void publish(Library *library);
+    void reclaim();
+
+    Track *track(int userId);
+    void layout(Track *track, const Library *library);
+
+    static void observe(const GestureTemplate &gesture, const BodyFeatures &features, float *x);
+
+private:
+
+    atomic<Library *> active_;
+    Library *current_;                  // Tracking thread's library for this frame
+    atomic<uint64_t> readerGeneration_; // Generation of current_, recorded at beginFrame()
+    pthread_mutex_t loadMutex_;         // Serializes loaders and guards the fields below
+    uint64_t nextGeneration_;
+    vector<Library *> retired_;         // Replaced libraries the tracking thread may still hold
+
+    Track tracks_[SKELETON_MAX_USERS];
+    uint64_t cellsEvaluated_;
+};
+
+#endif /* defined(__KinectOSC__GestureRecognizer__) */
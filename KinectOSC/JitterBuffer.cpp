@@ -0,0 +1,178 @@
+//
+//  JitterBuffer.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "JitterBuffer.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/* Signed distance between sequence numbers, correct across wraparound */
+static inline int sequenceDelta(uint16_t a, uint16_t b) {
+    return (int16_t)(uint16_t)(a - b);
+}
+
+JitterBuffer::JitterBuffer() {
+
+    reset();
+}
+
+void JitterBuffer::reset() {
+
+    for (int i = 0; i < JITTER_BUFFER_SLOTS; i++)
+        slots_[i].used = false;
+
+    nBuffered_ = 0;
+    started_ = false;
+    next_ = 0;
+    highest_ = 0;
+    highestArrival_ = 0;
+    haveTransit_ = false;
+    lastTransit_ = 0;
+    jitter_ = 0;
+    reorderLateness_ = 0;
+
+    memset(&stats_, 0, sizeof(stats_));
+    stats_.delay = JITTER_MIN_DELAY_US;
+}
+
+bool JitterBuffer::push(uint16_t sequence, uint64_t sendTime, const uint8_t *data, int length, uint64_t arrival) {
+
+    if (length > SKELETON_STREAM_MAX_BYTES)
+        return false;
+
+    if (!started_) {
+        started_ = true;
+        next_ = sequence;
+        highest_ = sequence;
+        highestArrival_ = arrival;
+    }
+
+    /* A sender that restarted, or a very long outage: start over from this packet */
+    int ahead = sequenceDelta(sequence, next_);
+    if (ahead >= JITTER_BUFFER_SLOTS || ahead < -JITTER_BUFFER_SLOTS) {
+        for (int i = 0; i < JITTER_BUFFER_SLOTS; i++)
+            slots_[i].used = false;
+        nBuffered_ = 0;
+        next_ = sequence;
+        highest_ = sequence;
+        highestArrival_ = arrival;
+        ahead = 0;
+    }
+
+    stats_.received++;
+
+    /* Reordering: how long this packet trailed the newer one that came first */
+    if (sequenceDelta(sequence, highest_) < 0) {
+        stats_.reordered++;
+        float lateness = (float)(arrival - highestArrival_);
+        if (lateness > reorderLateness_)
+            reorderLateness_ = lateness;
+    }
+    else {
+        highest_ = sequence;
+        highestArrival_ = arrival;
+
+        /* Interarrival jitter from in-order packets (RFC 3550, section 6.4.1) */
+        int64_t transit = (int64_t)(arrival - sendTime);
+        if (haveTransit_) {
+            float d = (float)llabs(transit - lastTransit_);
+            jitter_ += (d - jitter_) / 16;
+        }
+        lastTransit_ = transit;
+        haveTransit_ = true;
+    }
+
+    updateDelay();
+
+    if (ahead < 0) {
+        stats_.late++;
+        return false;
+    }
+
+    if (holds(sequence)) {
+        stats_.duplicates++;
+        return false;
+    }
+
+    Slot &s = slot(sequence);
+    s.used = true;
+    s.sequence = sequence;
+    s.arrival = arrival;
+    s.length = length;
+    memcpy(s.data, data, length);
+    nBuffered_++;
+
+    return true;
+}
+
+int JitterBuffer::pop(uint8_t *data, int capacity, uint64_t now) {
+
+    if (nBuffered_ == 0)
+        return 0;
+
+    /* Wait for a missing packet until the earliest later one has been held for the delay */
+    if (!holds(next_)) {
+
+        if (now < earliestArrival() + stats_.delay)
+            return 0;
+
+        while (!holds(next_)) {
+            next_++;
+            stats_.lost++;
+        }
+    }
+
+    Slot &s = slot(next_);
+    if (s.length > capacity)
+        return 0;
+
+    memcpy(data, s.data, s.length);
+    s.used = false;
+    nBuffered_--;
+    next_++;
+
+    /* Let the reordering allowance fall back slowly once the network settles */
+    reorderLateness_ *= 0.995f;
+    updateDelay();
+
+    return s.length;
+}
+
+uint64_t JitterBuffer::nextDue() {
+
+    if (nBuffered_ == 0)
+        return 0;
+
+    if (holds(next_))
+        return slot(next_).arrival;
+
+    return earliestArrival() + stats_.delay;
+}
+
+uint64_t JitterBuffer::earliestArrival() {
+
+    uint64_t earliest = UINT64_MAX;
+
+    for (int i = 0; i < JITTER_BUFFER_SLOTS; i++) {
+        if (slots_[i].used && slots_[i].arrival < earliest)
+            earliest = slots_[i].arrival;
+    }
+
+    return earliest;
+}
+
+void JitterBuffer::updateDelay() {
+
+    float delay = 3 * jitter_ + reorderLateness_;
+
+    if (delay < JITTER_MIN_DELAY_US)
+        delay = JITTER_MIN_DELAY_US;
+    if (delay > JITTER_MAX_DELAY_US)
+        delay = JITTER_MAX_DELAY_US;
+
+    stats_.delay = (uint64_t)delay;
+}
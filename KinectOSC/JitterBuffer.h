@@ -0,0 +1,88 @@
+//
+//  JitterBuffer.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Puts sequence-numbered packets from the network back in order. A packet that arrives in
+//  turn is released immediately; when one is missing, later packets are held for the
+//  playout delay before the gap is given up as lost. The delay adapts to the network: it
+//  follows an RFC 3550 style interarrival jitter estimate plus the worst recent reordering,
+//  within [JITTER_MIN_DELAY_US, JITTER_MAX_DELAY_US]. Not thread-safe; the owner locks.
+
+#ifndef __KinectOSC__JitterBuffer__
+#define __KinectOSC__JitterBuffer__
+
+#include <iostream>
+#include <stdint.h>
+
+#include "SkeletonStream.h"
+
+#define JITTER_BUFFER_SLOTS 64
+#define JITTER_MIN_DELAY_US 2000
+#define JITTER_MAX_DELAY_US 60000
+
+class JitterBuffer {
+
+    struct Slot {
+        bool used;
+        uint16_t sequence;
+        uint64_t arrival;
+        int length;
+        uint8_t data[SKELETON_STREAM_MAX_BYTES];
+    };
+
+public:
+
+    struct Stats {
+        int received;
+        int duplicates;
+        int late;               // Arrived after their gap was given up
+        int lost;               // Sequence numbers skipped
+        int reordered;
+        uint64_t delay;         // Current playout delay (us)
+    };
+
+    JitterBuffer();
+
+    void reset();
+
+    /* Add a packet. sendTime is the sender's timestamp (any clock, us) and arrival the local
+       receive time. Returns false if the packet is a duplicate or too late to play. */
+    bool push(uint16_t sequence, uint64_t sendTime, const uint8_t *data, int length, uint64_t arrival);
+
+    /* Copy out the next packet in order, skipping a gap whose wait has expired. Returns the
+       packet length, or 0 if nothing is due yet. */
+    int pop(uint8_t *data, int capacity, uint64_t now);
+
+    /* Earliest time pop() may return a packet, or 0 if the buffer is empty */
+    uint64_t nextDue();
+
+    Stats stats() { return stats_; }
+
+private:
+
+    Slot &slot(uint16_t sequence) { return slots_[sequence % JITTER_BUFFER_SLOTS]; }
+    bool holds(uint16_t sequence) { return slot(sequence).used && slot(sequence).sequence == sequence; }
+    uint64_t earliestArrival();
+    void updateDelay();
+
+private:
+
+    Slot slots_[JITTER_BUFFER_SLOTS];
+    int nBuffered_;
+    bool started_;
+    uint16_t next_;                 // Next sequence number to play
+
+    uint16_t highest_;              // Newest sequence number received, and when
+    uint64_t highestArrival_;
+
+    bool haveTransit_;
+    int64_t lastTransit_;
+    float jitter_;                  // Interarrival jitter estimate (us)
+    float reorderLateness_;         // Recent worst reordering delay (us), decaying
+
+    Stats stats_;
+};
+
+#endif /* defined(__KinectOSC__JitterBuffer__) */
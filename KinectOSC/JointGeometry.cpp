@@ -0,0 +1,74 @@
+//
+//  JointGeometry.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "JointGeometry.h"
+
+static const uint8_t kSegmentJoints[SKELETON_NUM_SEGMENTS][2] = {
+    { SKEL_HEAD,       SKEL_NECK },
+    { SKEL_NECK,       SKEL_TORSO },
+    { SKEL_SHOULDER_L, SKEL_ELBOW_L },
+    { SKEL_SHOULDER_R, SKEL_ELBOW_R },
+    { SKEL_ELBOW_L,    SKEL_HAND_L },
+    { SKEL_ELBOW_R,    SKEL_HAND_R },
+    { SKEL_TORSO,      SKEL_HIP_L },
+    { SKEL_TORSO,      SKEL_HIP_R },
+    { SKEL_HIP_L,      SKEL_KNEE_L },
+    { SKEL_HIP_R,      SKEL_KNEE_R },
+    { SKEL_KNEE_L,     SKEL_FOOT_L },
+    { SKEL_KNEE_R,     SKEL_FOOT_R },
+    { SKEL_SHOULDER_L, SKEL_SHOULDER_R },
+    { SKEL_HIP_L,      SKEL_HIP_R },
+    { SKEL_HAND_L,     SKEL_HAND_R },
+    { SKEL_FOOT_L,     SKEL_FOOT_R }
+};
+
+static const uint8_t kAngleJoints[SKELETON_NUM_ANGLES][3] = {
+    { SKEL_SHOULDER_L, SKEL_ELBOW_L, SKEL_HAND_L },
+    { SKEL_SHOULDER_R, SKEL_ELBOW_R, SKEL_HAND_R },
+    { SKEL_HIP_L,      SKEL_KNEE_L,  SKEL_FOOT_L },
+    { SKEL_HIP_R,      SKEL_KNEE_R,  SKEL_FOOT_R }
+};
+
+void jointDistancesSquared(const SkeletonUser &user, const uint8_t (*pairs)[2], int n, float *out) {
+
+    for (int i = 0; i < n; i++) {
+        int a = pairs[i][0], b = pairs[i][1];
+        float dx = user.x[a] - user.x[b];
+        float dy = user.y[a] - user.y[b];
+        float dz = user.z[a] - user.z[b];
+        out[i] = dx*dx + dy*dy + dz*dz;
+    }
+}
+
+/* Gather first, then take the roots in a separate loop the compiler can vectorize */
+void jointDistances(const SkeletonUser &user, const uint8_t (*pairs)[2], int n, float *out) {
+
+    jointDistancesSquared(user, pairs, n, out);
+
+    for (int i = 0; i < n; i++)
+        out[i] = sqrtf(out[i]);
+}
+
+void jointAngles(const SkeletonUser &user, const uint8_t (*triples)[3], int n, float *out) {
+
+    for (int i = 0; i < n; i++) {
+        Vec3 vertex = jointPosition(user, triples[i][1]);
+        out[i] = angleBetween(jointPosition(user, triples[i][0]) - vertex,
+                              jointPosition(user, triples[i][2]) - vertex);
+    }
+}
+
+void computeLimbMetrics(const SkeletonUser &user, LimbMetrics *metrics) {
+
+    jointDistances(user, kSegmentJoints, SKELETON_NUM_SEGMENTS, metrics->length);
+    jointAngles(user, kAngleJoints, SKELETON_NUM_ANGLES, metrics->angle);
+
+    /* The sum the height estimate has always used, torso to hip counted twice */
+    const float *len = metrics->length;
+    metrics->height = len[SEG_HEAD_NECK] + len[SEG_NECK_TORSO] + 2 * len[SEG_TORSO_HIP_R] +
+                      len[SEG_THIGH_R] + len[SEG_SHIN_R];
+}
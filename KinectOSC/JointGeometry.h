@@ -0,0 +1,75 @@
+//
+//  JointGeometry.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Distances and angles between the joints of a SkeletonUser, read straight from its
+//  coordinate arrays. The batch functions take lists of joint index pairs (or triples)
+//  and fill an output array, so a frame's limb metrics come from one pass over the joints.
+
+#ifndef __KinectOSC__JointGeometry__
+#define __KinectOSC__JointGeometry__
+
+#include <iostream>
+#include <stdint.h>
+
+#include "SkeletonFrame.h"
+#include "Vec3.h"
+
+/* Body segments and spans measured every frame */
+enum SkeletonSegment {
+    SEG_HEAD_NECK = 0,
+    SEG_NECK_TORSO,
+    SEG_UPPER_ARM_L,
+    SEG_UPPER_ARM_R,
+    SEG_FOREARM_L,
+    SEG_FOREARM_R,
+    SEG_TORSO_HIP_L,
+    SEG_TORSO_HIP_R,
+    SEG_THIGH_L,
+    SEG_THIGH_R,
+    SEG_SHIN_L,
+    SEG_SHIN_R,
+    SEG_SHOULDER_WIDTH,
+    SEG_HIP_WIDTH,
+    SEG_HAND_SPREAD,            // Hand to hand
+    SEG_FOOT_SPREAD,            // Foot to foot
+    SKELETON_NUM_SEGMENTS
+};
+
+/* Angles at the middle joint of a limb: pi when straight */
+enum SkeletonAngle {
+    ANGLE_ELBOW_L = 0,
+    ANGLE_ELBOW_R,
+    ANGLE_KNEE_L,
+    ANGLE_KNEE_R,
+    SKELETON_NUM_ANGLES
+};
+
+struct LimbMetrics {
+    float length[SKELETON_NUM_SEGMENTS];    // mm
+    float angle[SKELETON_NUM_ANGLES];       // Radians
+    float height;                           // Head to right foot along the body (mm)
+};
+
+inline Vec3 jointPosition(const SkeletonUser &user, int joint) {
+    return vec3(user.x[joint], user.y[joint], user.z[joint]);
+}
+
+inline float jointDistance(const SkeletonUser &user, int j1, int j2) {
+    return distance(jointPosition(user, j1), jointPosition(user, j2));
+}
+
+/* out[i] is the (squared) distance between joints pairs[i][0] and pairs[i][1] */
+void jointDistancesSquared(const SkeletonUser &user, const uint8_t (*pairs)[2], int n, float *out);
+void jointDistances(const SkeletonUser &user, const uint8_t (*pairs)[2], int n, float *out);
+
+/* out[i] is the angle at joint triples[i][1] between the other two */
+void jointAngles(const SkeletonUser &user, const uint8_t (*triples)[3], int n, float *out);
+
+/* All segments, angles and the height estimate. Confidence isn't checked; callers look
+   at the joints they use. */
+void computeLimbMetrics(const SkeletonUser &user, LimbMetrics *metrics);
+
+#endif /* defined(__KinectOSC__JointGeometry__) */
@@ -0,0 +1,181 @@
+//
+//  JointTracker.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "JointTracker.h"
+
+#include <string.h>
+#include <math.h>
+
+/* Each joint's parent, from which it hangs at a fixed bone length */
+static const int8_t kParent[SKELETON_NUM_JOINTS] = {
+    SKEL_NECK,          // Head
+    SKEL_TORSO,         // Neck
+    SKEL_NECK,          // Shoulders
+    SKEL_NECK,
+    SKEL_SHOULDER_L,    // Elbows
+    SKEL_SHOULDER_R,
+    SKEL_ELBOW_L,       // Hands
+    SKEL_ELBOW_R,
+    -1,                 // Torso
+    SKEL_TORSO,         // Hips
+    SKEL_TORSO,
+    SKEL_HIP_L,         // Knees
+    SKEL_HIP_R,
+    SKEL_KNEE_L,        // Feet
+    SKEL_KNEE_R
+};
+
+/* Parents before their children, so a missing joint can follow its parent's estimate */
+static const uint8_t kOrder[SKELETON_NUM_JOINTS] = {
+    SKEL_TORSO, SKEL_NECK, SKEL_HEAD,
+    SKEL_SHOULDER_L, SKEL_SHOULDER_R, SKEL_ELBOW_L, SKEL_ELBOW_R, SKEL_HAND_L, SKEL_HAND_R,
+    SKEL_HIP_L, SKEL_HIP_R, SKEL_KNEE_L, SKEL_KNEE_R, SKEL_FOOT_L, SKEL_FOOT_R
+};
+
+static const char *kStateNames[] = { "lost", "stale", "extrapolated", "fresh" };
+
+JointTracker::JointTracker() {
+
+    reset();
+}
+
+void JointTracker::reset() {
+
+    memset(tracks_, 0, sizeof(tracks_));
+}
+
+int JointTracker::parent(int joint) {
+
+    return joint >= 0 && joint < SKELETON_NUM_JOINTS ? kParent[joint] : -1;
+}
+
+const char *JointTracker::stateName(int state) {
+
+    return state >= JOINT_LOST && state <= JOINT_FRESH ? kStateNames[state] : "unknown";
+}
+
+void JointTracker::resetTrack(Track *track, int userId) {
+
+    memset(track, 0, sizeof(Track));
+    track->id = userId;
+}
+
+JointTracker::Track *JointTracker::track(int userId) {
+
+    Track *oldest = &tracks_[0];
+
+    for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+        if (tracks_[i].id == userId)
+            return &tracks_[i];
+        if (tracks_[i].timestamp < oldest->timestamp)
+            oldest = &tracks_[i];
+    }
+
+    /* New user: every joint starts out lost */
+    resetTrack(oldest, userId);
+    return oldest;
+}
+
+void JointTracker::update(const SkeletonUser &user, float confThresh, uint64_t timestamp, int width, int height,
+                          SkeletonUser *filled, JointStates *states) {
+
+    Track *t = track(user.id);
+    if (user.flags & USER_NEW)
+        resetTrack(t, user.id);
+    t->timestamp = timestamp;
+
+    *filled = user;
+    states->fresh = 0;
+    states->valid = 0;
+
+    for (int i = 0; i < SKELETON_NUM_JOINTS; i++) {
+
+        int j = kOrder[i];
+        int p = kParent[j];
+        Joint &joint = t->joints[j];
+
+        /* The parent has already been filled in for this frame */
+        bool parentValid = p >= 0 && (states->valid >> p & 1);
+        Vec3 origin = parentValid ? jointPosition(*filled, p) : vec3(0, 0, 0);
+
+        if (user.confidence[j] > confThresh) {
+
+            Vec3 position = jointPosition(user, j);
+            Vec3 offset = position - origin;
+
+            /* Velocity only between consecutive confident frames, measured from the same origin */
+            if (joint.state == JOINT_FRESH && joint.relative == parentValid && timestamp > joint.lastSeen) {
+                Vec3 velocity = (offset - joint.offset) * (1e6f / (timestamp - joint.lastSeen));
+                joint.velocity = joint.hasVelocity ?
+                    joint.velocity + (velocity - joint.velocity) * JOINT_VELOCITY_SMOOTHING : velocity;
+                joint.hasVelocity = true;
+            }
+            else {
+                joint.velocity = vec3(0, 0, 0);
+                joint.hasVelocity = false;
+            }
+
+            /* Bone lengths are only learned while both ends are seen */
+            if (p >= 0 && (states->fresh >> p & 1)) {
+                float bone = length(offset);
+                t->bone[j] = t->bone[j] > 0 ? t->bone[j] + (bone - t->bone[j]) * JOINT_BONE_SMOOTHING : bone;
+            }
+
+            joint.state = JOINT_FRESH;
+            joint.gap = 0;
+            joint.relative = parentValid;
+            joint.offset = offset;
+            joint.lastSeen = timestamp;
+            joint.position = position;
+        }
+        else if (joint.state != JOINT_LOST) {
+
+            joint.gap++;
+
+            if (joint.gap > JOINT_STALE_FRAMES)
+                joint.state = JOINT_LOST;
+
+            /* Hold the last estimate once the gap is too long to guess at, or the parent the
+               offset was measured from is gone */
+            else if (joint.gap > JOINT_EXTRAPOLATE_FRAMES || (joint.relative && !parentValid))
+                joint.state = JOINT_STALE;
+
+            /* Coast on the velocity, slowing with time constant tau: v * tau * (1 - e^(-dt / tau)) */
+            else {
+                float dt = timestamp > joint.lastSeen ? (timestamp - joint.lastSeen) * 1e-6f : 0;
+                float reach = JOINT_VELOCITY_DECAY_S * (1 - expf(-dt / JOINT_VELOCITY_DECAY_S));
+                Vec3 estimate = joint.offset + joint.velocity * reach;
+
+                /* Back onto the sphere of the bone's length around the parent */
+                if (joint.relative) {
+                    float bone = t->bone[j];
+                    float distance = length(estimate);
+                    if (bone > 0 && distance > 0)
+                        estimate = estimate * (bone / distance);
+                    estimate = estimate + origin;
+                }
+
+                joint.position = estimate;
+                joint.state = JOINT_EXTRAPOLATED;
+            }
+        }
+
+        states->state[j] = (uint8_t)joint.state;
+
+        if (joint.state == JOINT_FRESH)
+            states->fresh |= 1 << j;
+        else if (joint.state != JOINT_LOST) {
+            filled->x[j] = joint.position.x;
+            filled->y[j] = joint.position.y;
+            filled->z[j] = joint.position.z;
+            projectToDepthImage(filled->x[j], filled->y[j], filled->z[j], width, height, &filled->u[j], &filled->v[j]);
+        }
+
+        if (joint.state >= JOINT_EXTRAPOLATED)
+            states->valid |= 1 << j;
+    }
+}
@@ -0,0 +1,94 @@
+//
+//  JointTracker.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Per-joint tracking state, so a joint that drops below the confidence threshold is
+//  neither frozen where it was last seen nor forgotten at once. Each joint is
+//
+//      FRESH           confident this frame
+//      EXTRAPOLATED    missing for at most JOINT_EXTRAPOLATE_FRAMES; estimated
+//      STALE           missing for at most JOINT_STALE_FRAMES; last estimate held
+//      LOST            missing for longer, or never seen
+//
+//  A missing joint keeps moving with its parent (torso outward) and continues its own
+//  motion relative to it with a velocity that decays, then is put back at the bone length
+//  measured while both were confident. Fresh and extrapolated joints are valid for
+//  mappings; stale and lost ones aren't. Constant time per joint.
+
+#ifndef __KinectOSC__JointTracker__
+#define __KinectOSC__JointTracker__
+
+#include <iostream>
+#include <stdint.h>
+
+#include "SkeletonFrame.h"
+#include "JointGeometry.h"
+#include "Vec3.h"
+
+#define JOINT_EXTRAPOLATE_FRAMES 6      // About 200 ms at 30 fps
+#define JOINT_STALE_FRAMES 30
+#define JOINT_VELOCITY_DECAY_S 0.1f     // Time constant of an extrapolated joint's slowing down
+#define JOINT_VELOCITY_SMOOTHING 0.5f   // Weight of each new velocity measurement
+#define JOINT_BONE_SMOOTHING 0.05f      // Weight of each new bone length measurement
+
+enum JointState {
+    JOINT_LOST = 0,
+    JOINT_STALE,
+    JOINT_EXTRAPOLATED,
+    JOINT_FRESH
+};
+
+struct JointStates {
+    uint8_t state[SKELETON_NUM_JOINTS];
+    int fresh;                          // Joint masks
+    int valid;                          // Fresh or extrapolated
+};
+
+class JointTracker {
+
+    struct Joint {
+        int state;
+        int gap;                        // Frames since last confident
+        bool relative;                  // Offset and velocity are relative to the parent
+        Vec3 offset;                    // From the parent (or the origin) when last confident
+        Vec3 velocity;                  // Of the offset (mm/s)
+        bool hasVelocity;
+        uint64_t lastSeen;              // Timestamp when last confident (us)
+        Vec3 position;                  // Current estimate
+    };
+
+    struct Track {
+        int id;
+        uint64_t timestamp;
+        Joint joints[SKELETON_NUM_JOINTS];
+        float bone[SKELETON_NUM_JOINTS];    // Length to the parent, 0 until measured
+    };
+
+public:
+
+    JointTracker();
+
+    void reset();
+
+    /* Fill in the user's missing joints. filled is the user with every joint that has been
+       seen at its current estimate and u, v projected to match. */
+    void update(const SkeletonUser &user, float confThresh, uint64_t timestamp, int width, int height,
+                SkeletonUser *filled, JointStates *states);
+
+    /* Getters */
+    static int parent(int joint);       // -1 for the torso
+    static const char *stateName(int state);
+
+private:
+
+    Track *track(int userId);
+    void resetTrack(Track *track, int userId);
+
+private:
+
+    Track tracks_[SKELETON_MAX_USERS];
+};
+
+#endif /* defined(__KinectOSC__JointTracker__) */
@@ -8,16 +8,24 @@
 
 #include "KinectDisplay.h"
 
-KinectDisplay::KinectDisplay() {
+#include <string.h>
+
+KinectDisplay::KinectDisplay() : depthHistogram_(DISPLAY_HISTOGRAM_SIZE) {
     
     /* Initialize the mutex with default parameters */
     pthread_mutex_init(&displayMutex_, NULL);
     
     needsRender_ = true;
+    memset(&userSkeleton_, 0, sizeof(userSkeleton_));
     displayPixelWidth_ = 0;
     displayPixelHeight_ = 0;
     
+    drawUser_ = false;
     drawRegions_ = true;
+    
+    histogram_.resize(DISPLAY_HISTOGRAM_SIZE);
+    depthHistogram_.setIncrementalThreshold(DISPLAY_INCREMENTAL_FRACTION);
+    depthTexture_ = 0;
 }
 
 KinectDisplay::~KinectDisplay() {
@@ -40,7 +48,8 @@ void KinectDisplay::setDisplaySize(float width, float height) {
 }
 
 /* Update the joint positions internal to this class, scaling to the interval [-1, 1] for the OpenGL drawing */
-void KinectDisplay::updateJoint(nite::JointType jointType, float x, float y, float frameWidth, float frameHeight) {
+void KinectDisplay::updateJoint(nite::JointType jointType, float x, float y, float frameWidth, float frameHeight,
+                                int state) {
     
     /* Mirrored coordinates */
     float xM = frameWidth  - x;
@@ -50,97 +59,110 @@ void KinectDisplay::updateJoint(nite::JointType jointType, float x, float y, flo
     float rX = mapToInterval(xM, 0, frameWidth,  -1, 1);
     float rY = mapToInterval(yM, 0, frameHeight, -1, 1);
     
+    Joint *joint;
+    
     switch (jointType) {
         case nite::JOINT_HEAD:
-            userSkeleton_.head.x = rX;
-            userSkeleton_.head.y = rY;
+            joint = &userSkeleton_.head;
             break;
             
         case nite::JOINT_NECK:
-            userSkeleton_.neck.x = rX;
-            userSkeleton_.neck.y = rY;
+            joint = &userSkeleton_.neck;
             break;
             
         case nite::JOINT_TORSO:
-            userSkeleton_.torso.x = rX;
-            userSkeleton_.torso.y = rY;
+            joint = &userSkeleton_.torso;
             break;
             
         case nite::JOINT_LEFT_SHOULDER:
-            userSkeleton_.shoulderL.x = rX;
-            userSkeleton_.shoulderL.y = rY;
+            joint = &userSkeleton_.shoulderL;
             break;
             
         case nite::JOINT_RIGHT_SHOULDER:
-            userSkeleton_.shoulderR.x = rX;
-            userSkeleton_.shoulderR.y = rY;
+            joint = &userSkeleton_.shoulderR;
             break;
             
         case nite::JOINT_LEFT_ELBOW:
-            userSkeleton_.elbowL.x = rX;
-            userSkeleton_.elbowL.y = rY;
+            joint = &userSkeleton_.elbowL;
             break;
             
         case nite::JOINT_RIGHT_ELBOW:
-            userSkeleton_.elbowR.x = rX;
-            userSkeleton_.elbowR.y = rY;
+            joint = &userSkeleton_.elbowR;
             break;
             
         case nite::JOINT_LEFT_HAND:
-            userSkeleton_.handL.x = rX;
-            userSkeleton_.handL.y = rY;
+            joint = &userSkeleton_.handL;
             break;
             
         case nite::JOINT_RIGHT_HAND:
-            userSkeleton_.handR.x = rX;
-            userSkeleton_.handR.y = rY;
+            joint = &userSkeleton_.handR;
             break;
             
         case nite::JOINT_LEFT_HIP:
-            userSkeleton_.hipL.x = rX;
-            userSkeleton_.hipL.y = rY;
+            joint = &userSkeleton_.hipL;
             break;
             
         case nite::JOINT_RIGHT_HIP:
-            userSkeleton_.hipR.x = rX;
-            userSkeleton_.hipR.y = rY;
+            joint = &userSkeleton_.hipR;
             break;
             
         case nite::JOINT_LEFT_KNEE:
-            userSkeleton_.kneeL.x = rX;
-            userSkeleton_.kneeL.y = rY;
+            joint = &userSkeleton_.kneeL;
             break;
             
         case nite::JOINT_RIGHT_KNEE:
-            userSkeleton_.kneeR.x = rX;
-            userSkeleton_.kneeR.y = rY;
+            joint = &userSkeleton_.kneeR;
             break;
             
         case nite::JOINT_LEFT_FOOT:
-            userSkeleton_.footL.x = rX;
-            userSkeleton_.footL.y = rY;
+            joint = &userSkeleton_.footL;
             break;
             
         case nite::JOINT_RIGHT_FOOT:
-            userSkeleton_.footR.x = rX;
-            userSkeleton_.footR.y = rY;
+            joint = &userSkeleton_.footR;
             break;
             
         default:
-            break;
+            return;
     }
     
+    joint->x = rX;
+    joint->y = rY;
+    joint->state = state;
+    
+    needsRender_ = true;
+}
+
+/* Called by the tracking thread; an image that's replaced before it's drawn is just released */
+void KinectDisplay::setDepth(FrameBuffer depth) {
+    
+    pthread_mutex_lock(&displayMutex_);
+    
+    depth_ = std::move(depth);
     needsRender_ = true;
+    
+    pthread_mutex_unlock(&displayMutex_);
 }
 
 void KinectDisplay::render() {
     
+    /* Shade the newest depth image without holding the lock, so the tracking thread never
+       waits on the histogram */
+    pthread_mutex_lock(&displayMutex_);
+    FrameBuffer depth = std::move(depth_);
+    pthread_mutex_unlock(&displayMutex_);
+    
+    if (depth.isValid())
+        updateDepthTexture(depth);
+    
     pthread_mutex_lock(&displayMutex_);
     
     /* Dark black background */
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
     
+    drawDepth();
+    
     if (drawRegions_)
         drawRegions();
     
@@ -172,9 +194,18 @@ void KinectDisplay::render() {
 
 void KinectDisplay::drawLimb(Joint j1, Joint j2) {
     
-    /* Draw white lines */
+    if (j1.state == JOINT_LOST || j2.state == JOINT_LOST)
+        return;
+    
+    /* Draw white lines, dimmed where a joint is estimated or held */
+    float brightness = 1.0;
+    if (j1.state == JOINT_STALE || j2.state == JOINT_STALE)
+        brightness = 0.25;
+    else if (j1.state == JOINT_EXTRAPOLATED || j2.state == JOINT_EXTRAPOLATED)
+        brightness = 0.5;
+    
     glPolygonMode(GL_FRONT, GL_LINE);
-    glColor3f(1.0, 1.0, 1.0);
+    glColor3f(brightness, brightness, brightness);
     
     glBegin(GL_LINES);
     glVertex2f(j1.x, j1.y);
@@ -182,6 +213,66 @@ void KinectDisplay::drawLimb(Joint j1, Joint j2) {
     glEnd();
 }
 
+/* Yellow, brighter the nearer a pixel is than the rest of the scene, as the NiTE samples
+   draw depth; zero (no reading) and out-of-range depths are black */
+void KinectDisplay::updateDepthTexture(const FrameBuffer &depth) {
+    
+    int width = depth.width();
+    int height = depth.height();
+    int stride = depth.stride();
+    const uint16_t *pixels = depth.data();
+    
+    depthHistogram_.calculate(&histogram_[0], pixels, width, height, stride);
+    texels_.resize(width * height * 3);
+    
+    uint8_t *texel = &texels_[0];
+    
+    for (int y = 0; y < height; y++) {
+        
+        const uint16_t *row = pixels + y * stride;
+        
+        for (int x = 0; x < width; x++, texel += 3) {
+            uint16_t d = row[x];
+            uint8_t value = d != 0 && d < DISPLAY_HISTOGRAM_SIZE ? (uint8_t)histogram_[d] : 0;
+            texel[0] = value;
+            texel[1] = value;
+            texel[2] = 0;
+        }
+    }
+    
+    if (!depthTexture_) {
+        glGenTextures(1, &depthTexture_);
+        glBindTexture(GL_TEXTURE_2D, depthTexture_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    
+    glBindTexture(GL_TEXTURE_2D, depthTexture_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, &texels_[0]);
+}
+
+/* Mirrored in both axes to match the joints (see updateJoint()) */
+void KinectDisplay::drawDepth() {
+    
+    if (!depthTexture_)
+        return;
+    
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glColor3f(1.0, 1.0, 1.0);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, depthTexture_);
+    
+    glBegin(GL_QUADS);
+    glTexCoord2f(1, 1); glVertex2f(-1, -1);
+    glTexCoord2f(0, 1); glVertex2f( 1, -1);
+    glTexCoord2f(0, 0); glVertex2f( 1,  1);
+    glTexCoord2f(1, 0); glVertex2f(-1,  1);
+    glEnd();
+    
+    glDisable(GL_TEXTURE_2D);
+}
+
 void KinectDisplay::drawRegions() {
     
 //    /* Draw white lines */
@@ -16,10 +16,16 @@
 #include "NiTE.h"
 
 #include "Utility.h"
+#include "JointTracker.h"
+#include "DepthHistogram.h"
+#include "FrameBufferPool.h"
 
 #define GL_WIN_SIZE_X	1280
 #define GL_WIN_SIZE_Y	1024
 
+#define DISPLAY_HISTOGRAM_SIZE 10000        // Depths (mm) shaded by the histogram; deeper pixels are black
+#define DISPLAY_INCREMENTAL_FRACTION 0.05f  // Patch the histogram when fewer pixels than this changed
+
 using namespace std;
 
 /* Joint types */
@@ -47,6 +53,7 @@ class KinectDisplay {
     struct Joint {
         float x;
         float y;
+        int state;          // JointState; lost joints aren't drawn
     };
     
     struct ScaledSkeleton {
@@ -74,10 +81,16 @@ public:
     
     /* Setters */
     void setDisplaySize(float width, float height);
-    void updateJoint(nite::JointType jointType, float x, float y, float frameWidth, float frameHeight);
+    void updateJoint(nite::JointType jointType, float x, float y, float frameWidth, float frameHeight,
+                     int state = JOINT_FRESH);
     void setDrawUser()   { drawUser_ = true; }
     void clearUser() { drawUser_ = false; needsRender_ = true; }
     
+    /* Depth image drawn behind the skeleton, shaded by its accumulative histogram as in the
+       NiTE samples. Takes a shared handle from the tracking thread without copying; the
+       histogram and texture are made on the render thread from the newest image. */
+    void setDepth(FrameBuffer depth);
+    
     /* Getters */
     bool needsRender() { return needsRender_; }
     
@@ -92,6 +105,10 @@ private:
     /* Draw the note region boundaries */
     void drawRegions();
     
+    /* Depth background */
+    void updateDepthTexture(const FrameBuffer &depth);
+    void drawDepth();
+    
 private:
         
     ScaledSkeleton userSkeleton_;       // Internal skeleton joint positions scaled to interval [-1, 1
@@ -105,6 +122,12 @@ private:
     
     pthread_mutex_t displayMutex_;      // Mutex needed to synchronize data access and display threads
     
+    FrameBuffer depth_;                 // Newest depth image not yet drawn, under displayMutex_
+    DepthHistogram depthHistogram_;     // Render thread only, as are the rest
+    vector<float> histogram_;
+    vector<uint8_t> texels_;            // RGB
+    GLuint depthTexture_;               // 0 until the first depth image is drawn
+    
 };
 
 #endif /* defined(__KinectOSC__KinectDisplay__) */
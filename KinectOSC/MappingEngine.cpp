@@ -0,0 +1,462 @@
+//
+//  MappingEngine.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "MappingEngine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <ctype.h>
+
+static bool parseFloat(const char *s, float *value) {
+
+    if (!s)
+        return false;
+
+    char *end;
+    *value = strtof(s, &end);
+    return end != s && *end == '\0';
+}
+
+MappingEngine::MappingEngine() {
+
+    pthread_mutex_init(&loadMutex_, NULL);
+    active_ = NULL;
+    current_ = NULL;
+    readerVersion_ = 1;
+    nextVersion_ = 1;
+
+    loadString(defaultMappings(), "default");
+}
+
+MappingEngine::~MappingEngine() {
+
+    delete active_.load();
+    for (size_t i = 0; i < retired_.size(); i++)
+        delete retired_[i];
+
+    pthread_mutex_destroy(&loadMutex_);
+}
+
+const char *MappingEngine::defaultMappings() {
+
+    return
+        "# Hand spacing sets the intensity of the notes under the feet\n"
+        "/mrp/quality/intensity held: distance hand_l hand_r | range 0 1800\n"
+        "# Raising the right knee above the left foot lowers their brightness\n"
+        "/mrp/quality/brightness held: body-dy knee_r foot_l | abs | range 0 0.3333333 | clamp | invert\n";
+}
+
+#pragma mark - Compilation
+
+bool MappingEngine::loadString(const char *text, const char *sourceName) {
+
+    Program *program = compile(text, sourceName);
+    if (!program)
+        return false;
+
+    publish(program);
+    return true;
+}
+
+bool MappingEngine::loadFile(const char *path) {
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("%s: Can't open %s\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    string text;
+    char buffer[1024];
+    size_t n;
+
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, n);
+
+    fclose(file);
+    return loadString(text.c_str(), path);
+}
+
+void MappingEngine::publish(Program *program) {
+
+    pthread_mutex_lock(&loadMutex_);
+
+    program->version = nextVersion_++;
+
+    Program *old = active_.exchange(program);
+    if (old)
+        retired_.push_back(old);
+
+    reclaim();
+    pthread_mutex_unlock(&loadMutex_);
+}
+
+/* Free replaced programs older than the one the tracking thread holds, as ConfigStore
+   does for its readers. Between loading active_ and recording its version in beginFrame(),
+   the tracking thread still has its previous version recorded, which is no newer than the
+   program it loaded, so that program survives. Called with loadMutex_. */
+void MappingEngine::reclaim() {
+
+    uint64_t held = readerVersion_.load();
+    size_t kept = 0;
+
+    for (size_t i = 0; i < retired_.size(); i++) {
+        if (retired_[i]->version < held)
+            delete retired_[i];
+        else
+            retired_[kept++] = retired_[i];
+    }
+
+    retired_.resize(kept);
+}
+
+MappingEngine::Program *MappingEngine::compile(const char *text, const char *sourceName) {
+
+    Program *program = new Program();
+    program->nMappings = 0;
+
+    string source(text);
+    size_t start = 0;
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (start <= source.size()) {
+
+        size_t end = source.find('\n', start);
+        if (end == string::npos)
+            end = source.size();
+
+        string line = source.substr(start, end - start);
+        lineNumber++;
+        start = end + 1;
+
+        if (!compileLine(&line[0], sourceName, lineNumber, program))
+            ok = false;
+    }
+
+    if (!ok) {
+        delete program;
+        return NULL;
+    }
+
+    return program;
+}
+
+bool MappingEngine::compileLine(char *line, const char *sourceName, int lineNumber, Program *program) {
+
+    char *comment = strchr(line, '#');
+    if (comment)
+        *comment = '\0';
+
+    char *colon = strchr(line, ':');
+    if (!colon) {
+        for (char *c = line; *c; c++) {
+            if (!isspace(*c)) {
+                printf("%s: %s:%d: Expected \"<address> <target>: <feature> | ...\"\n",
+                       __PRETTY_FUNCTION__, sourceName, lineNumber);
+                return false;
+            }
+        }
+        return true;
+    }
+    *colon = '\0';
+
+    /* Address and target */
+    char *save;
+    char *address = strtok_r(line, " \t", &save);
+    char *kind = strtok_r(NULL, " \t", &save);
+    char *arg = strtok_r(NULL, " \t", &save);
+
+    MappingTarget target;
+
+    if (!address || address[0] != '/' || !kind) {
+        printf("%s: %s:%d: Expected an OSC address and target\n", __PRETTY_FUNCTION__, sourceName, lineNumber);
+        return false;
+    }
+
+    target.address = address;
+    target.note = 0;
+    target.isIntensity = !strcmp(address, "/mrp/quality/intensity");
+
+    if (!strcasecmp(kind, "held"))
+        target.kind = TARGET_HELD_NOTES;
+    else if (!strcasecmp(kind, "value"))
+        target.kind = TARGET_VALUE;
+    else if (!strcasecmp(kind, "note") && arg && (target.note = atoi(arg)) >= 0 && target.note < 128) {
+        target.kind = TARGET_NOTE;
+        arg = strtok_r(NULL, " \t", &save);
+    }
+    else {
+        printf("%s: %s:%d: Unknown target \"%s\"\n", __PRETTY_FUNCTION__, sourceName, lineNumber, kind);
+        return false;
+    }
+
+    if (target.kind != TARGET_NOTE && arg) {
+        printf("%s: %s:%d: Unexpected \"%s\"\n", __PRETTY_FUNCTION__, sourceName, lineNumber, arg);
+        return false;
+    }
+
+    /* The validity check comes first; its mask and jump are filled in at the end */
+    vector<Instruction> &code = program->code;
+    size_t require = code.size();
+    Instruction inst = { OP_REQUIRE, 0, 0, 0, 0, 0 };
+    code.push_back(inst);
+
+    int mask = 0;
+    int nStages = 0;
+    char *stageSave;
+
+    for (char *stage = strtok_r(colon + 1, "|", &stageSave); stage; stage = strtok_r(NULL, "|", &stageSave)) {
+
+        char *wordSave;
+        char *op = strtok_r(stage, " \t\r", &wordSave);
+        char *w[3];
+        for (int i = 0; i < 3; i++)
+            w[i] = strtok_r(NULL, " \t\r", &wordSave);
+
+        if (!op) {
+            printf("%s: %s:%d: Empty stage\n", __PRETTY_FUNCTION__, sourceName, lineNumber);
+            return false;
+        }
+
+        memset(&inst, 0, sizeof(inst));
+        int nArgs = 0;
+        bool feature = true;
+        bool valid = true;
+
+        /* Body frame features read the joints the frame is built from as well */
+        bool body = !strncasecmp(op, "body-", 5);
+        const char *name = body ? op + 5 : op;
+
+        if (!strcasecmp(op, "distance") || !strcasecmp(op, "angle") || !strcasecmp(name, "dx") ||
+            !strcasecmp(name, "dy") || !strcasecmp(name, "dz")) {
+
+            bool isAngle = !strcasecmp(op, "angle");
+            nArgs = isAngle ? 3 : 2;
+            inst.a = parseJointName(w[0]);
+            inst.b = parseJointName(w[1]);
+            valid = inst.a >= 0 && inst.b >= 0;
+
+            if (!strcasecmp(op, "distance"))
+                inst.op = OP_DISTANCE;
+            else if (isAngle) {
+                inst.op = OP_ANGLE;
+                inst.c = parseJointName(w[2]);
+                valid = valid && inst.c >= 0;
+            }
+            else {
+                inst.op = body ? OP_BODY_DELTA : OP_DELTA;
+                inst.c = tolower(name[1]) - 'x';
+            }
+
+            if (valid)
+                mask |= (1 << inst.a) | (1 << inst.b) | (isAngle ? 1 << inst.c : 0) | (body ? BODY_FRAME_JOINTS : 0);
+        }
+        else if (!strcasecmp(name, "x") || !strcasecmp(name, "y") || !strcasecmp(name, "z") || !strcasecmp(name, "speed")) {
+
+            bool isSpeed = !strcasecmp(name, "speed");
+            nArgs = 1;
+            if (body)
+                inst.op = isSpeed ? OP_BODY_SPEED : OP_BODY_COORD;
+            else
+                inst.op = isSpeed ? OP_SPEED : OP_COORD;
+            inst.a = parseJointName(w[0]);
+            inst.c = tolower(name[0]) - 'x';
+            valid = inst.a >= 0;
+
+            if (valid)
+                mask |= (1 << inst.a) | (body ? BODY_FRAME_JOINTS : 0);
+        }
+        else {
+
+            feature = false;
+
+            if (!strcasecmp(op, "abs"))
+                inst.op = OP_ABS;
+            else if (!strcasecmp(op, "per-height"))
+                inst.op = OP_PER_HEIGHT;
+            else if (!strcasecmp(op, "clamp"))
+                inst.op = OP_CLAMP;
+            else if (!strcasecmp(op, "invert"))
+                inst.op = OP_INVERT;
+            else if (!strcasecmp(op, "pow")) {
+                nArgs = 1;
+                inst.op = OP_POW;
+                valid = parseFloat(w[0], &inst.p0);
+            }
+            else if (!strcasecmp(op, "range") || !strcasecmp(op, "scale")) {
+                float lo, hi;
+                nArgs = 2;
+                valid = parseFloat(w[0], &lo) && parseFloat(w[1], &hi) && hi != lo;
+                inst.op = tolower(op[0]) == 'r' ? OP_RANGE : OP_SCALE;
+                inst.p0 = lo;
+                inst.p1 = inst.op == OP_RANGE ? 1 / (hi - lo) : hi - lo;
+            }
+            else {
+                printf("%s: %s:%d: Unknown stage \"%s\"\n", __PRETTY_FUNCTION__, sourceName, lineNumber, op);
+                return false;
+            }
+        }
+
+        if (!valid || (nArgs < 3 && w[nArgs])) {
+            printf("%s: %s:%d: Bad arguments to \"%s\"\n", __PRETTY_FUNCTION__, sourceName, lineNumber, op);
+            return false;
+        }
+
+        if (feature != (nStages == 0)) {
+            printf("%s: %s:%d: A mapping starts with exactly one feature\n", __PRETTY_FUNCTION__, sourceName, lineNumber);
+            return false;
+        }
+
+        code.push_back(inst);
+        nStages++;
+    }
+
+    if (nStages == 0) {
+        printf("%s: %s:%d: Missing feature\n", __PRETTY_FUNCTION__, sourceName, lineNumber);
+        return false;
+    }
+
+    memset(&inst, 0, sizeof(inst));
+    inst.op = OP_EMIT;
+    inst.a = (int)program->targets.size();
+    code.push_back(inst);
+    program->targets.push_back(target);
+
+    code[require].a = mask;
+    code[require].b = (int)code.size();
+    program->nMappings++;
+
+    return true;
+}
+
+#pragma mark - Evaluation
+
+void MappingEngine::beginFrame() {
+
+    current_ = active_.load();
+    if (current_)
+        readerVersion_.store(current_->version);
+}
+
+int MappingEngine::numMappings() {
+
+    /* Programs are only freed under the loader lock */
+    pthread_mutex_lock(&loadMutex_);
+    Program *program = active_.load();
+    int n = program ? program->nMappings : 0;
+    pthread_mutex_unlock(&loadMutex_);
+
+    return n;
+}
+
+int MappingEngine::evaluate(const SkeletonUser &user, const JointStates &joints, const BodyFeatures &features,
+                            float userHeight, MappingOutput *out, int capacity) {
+
+    Program *program = current_;
+    if (!program || program->code.empty())
+        return 0;
+
+    const float *axes[3] = { user.x, user.y, user.z };
+    const float *bodyAxes[3] = { features.x, features.y, features.z };
+
+    const Instruction *code = &program->code[0];
+    int size = (int)program->code.size();
+    int n = 0;
+    float v = 0;
+    bool estimated = false;
+
+    for (int pc = 0; pc < size; ) {
+
+        const Instruction &in = code[pc++];
+
+        switch (in.op) {
+
+            case OP_REQUIRE:
+                if ((joints.valid & in.a) != in.a)
+                    pc = in.b;
+                estimated = (joints.fresh & in.a) != in.a;
+                break;
+
+            case OP_DISTANCE:
+                v = jointDistance(user, in.a, in.b);
+                break;
+
+            case OP_DELTA:
+                v = axes[in.c][in.a] - axes[in.c][in.b];
+                break;
+
+            case OP_COORD:
+                v = axes[in.c][in.a];
+                break;
+
+            case OP_SPEED:
+                v = features.speed[in.a];
+                break;
+
+            case OP_BODY_DELTA:
+                v = bodyAxes[in.c][in.a] - bodyAxes[in.c][in.b];
+                break;
+
+            case OP_BODY_COORD:
+                v = bodyAxes[in.c][in.a];
+                break;
+
+            case OP_BODY_SPEED:
+                v = features.bodySpeed[in.a];
+                break;
+
+            case OP_ANGLE: {
+                Vec3 vertex = jointPosition(user, in.b);
+                v = angleBetween(jointPosition(user, in.a) - vertex, jointPosition(user, in.c) - vertex);
+                break;
+            }
+
+            case OP_ABS:
+                v = fabsf(v);
+                break;
+
+            case OP_PER_HEIGHT:
+                v = userHeight > 0 ? v / userHeight : 0;
+                break;
+
+            case OP_RANGE:
+                v = (v - in.p0) * in.p1;
+                break;
+
+            case OP_CLAMP:
+                v = fmaxf(0, fminf(1, v));
+                break;
+
+            case OP_INVERT:
+                v = 1 - v;
+                break;
+
+            case OP_POW:
+                v = powf(fmaxf(0, v), in.p0);
+                break;
+
+            case OP_SCALE:
+                v = in.p0 + v * in.p1;
+                break;
+
+            case OP_EMIT:
+                if (n < capacity) {
+                    out[n].target = &program->targets[in.a];
+                    out[n].value = v;
+                    out[n].estimated = estimated;
+                    n++;
+                }
+                break;
+        }
+    }
+
+    return n;
+}
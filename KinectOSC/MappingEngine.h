@@ -0,0 +1,146 @@
+//
+//  MappingEngine.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Continuous gesture-to-OSC mappings described in text and compiled into a flat
+//  instruction array that runs once per user per frame. Each line of a description is
+//
+//      <address> <target>: <feature> | <stage> | <stage> ...
+//
+//  where the target is "held" (once for each note the user's feet hold, sent as
+//  "iif" 0 note value), "note <n>" (a fixed note, "iif") or "value" (a single "f").
+//  Features read the skeleton, the first row in sensor space (mm) and the second in the
+//  user's body frame (heights; see BodyFeatures.h), which doesn't change with where the
+//  user stands or which way they face:
+//
+//      distance a b    dx a b    dy a b    dz a b    x a    y a    z a    speed a (mm/s)
+//      body-dx a b    body-dy a b    body-dz a b    body-x a    body-y a    body-z a
+//      body-speed a (heights/s)    angle a b c (radians at b)
+//
+//  and stages shape the value in order:
+//
+//      abs    per-height    range lo hi    clamp    invert    pow k    scale lo hi
+//
+//  Joints are named head, neck, shoulder_l, ..., foot_r. A mapping only runs while
+//  every joint it reads is valid, seen this frame or filled in over a short gap (see
+//  JointTracker.h); its output is then marked estimated. Lines starting with '#' are comments.
+
+#ifndef __KinectOSC__MappingEngine__
+#define __KinectOSC__MappingEngine__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "SkeletonFrame.h"
+#include "JointGeometry.h"
+#include "JointTracker.h"
+#include "BodyFeatures.h"
+
+using namespace std;
+
+#define MAPPING_MAX_OUTPUTS 32
+
+enum MappingTargetKind {
+    TARGET_HELD_NOTES = 0,
+    TARGET_NOTE,
+    TARGET_VALUE
+};
+
+struct MappingTarget {
+    string address;
+    MappingTargetKind kind;
+    int note;               // For TARGET_NOTE
+    bool isIntensity;       // Intensity targets also drive the keyboard display
+};
+
+struct MappingOutput {
+    const MappingTarget *target;
+    float value;
+    bool estimated;         // Read a joint that wasn't seen this frame
+};
+
+class MappingEngine {
+
+    enum OpCode {
+        OP_REQUIRE = 0,     // Jump to b unless every joint in mask a is valid
+        OP_DISTANCE,
+        OP_DELTA,           // Signed difference along axis c
+        OP_COORD,           // Coordinate of joint a along axis c
+        OP_SPEED,
+        OP_BODY_DELTA,      // Body frame versions of OP_DELTA, OP_COORD and OP_SPEED
+        OP_BODY_COORD,
+        OP_BODY_SPEED,
+        OP_ANGLE,
+        OP_ABS,
+        OP_PER_HEIGHT,
+        OP_RANGE,           // (v - p0) * p1
+        OP_CLAMP,
+        OP_INVERT,
+        OP_POW,
+        OP_SCALE,           // p0 + v * p1
+        OP_EMIT             // Output the value to target a
+    };
+
+    struct Instruction {
+        int op;
+        int a, b, c;        // Joints, joint mask, jump target or output target
+        float p0, p1;       // Constants, folded at compile time
+    };
+
+    struct Program {
+        uint64_t version;               // Assigned on publication, from 1
+        vector<Instruction> code;
+        vector<MappingTarget> targets;
+        int nMappings;
+    };
+
+public:
+
+    MappingEngine();
+    ~MappingEngine();
+
+    /* Compile a description and make it the active program. On error, the active program
+       is left running and false is returned. Safe to call while tracking. */
+    bool loadString(const char *text, const char *sourceName = "mappings");
+    bool loadFile(const char *path);
+
+    /* Tracking thread: take the active program for this frame */
+    void beginFrame();
+
+    /* Run the frame's program for one user, with its joints filled in by a JointTracker
+       and its features extracted. Writes at most capacity outputs and returns how many
+       were written. */
+    int evaluate(const SkeletonUser &user, const JointStates &joints, const BodyFeatures &features,
+                 float userHeight, MappingOutput *out, int capacity);
+
+    /* Getters */
+    int numMappings();
+
+    /* Hand spacing to intensity and right-knee height to brightness */
+    static const char *defaultMappings();
+
+private:
+
+    Program *compile(const char *text, const char *sourceName);
+    bool compileLine(char *line, const char *sourceName, int lineNumber, Program *program);
+    void publish(Program *program);
+    void reclaim();
+
+private:
+
+    atomic<Program *> active_;
+    Program *current_;                  // Tracking thread's program for this frame
+    atomic<uint64_t> readerVersion_;    // Version of current_, recorded at beginFrame()
+    pthread_mutex_t loadMutex_;         // Serializes loaders and guards the fields below
+    uint64_t nextVersion_;
+    vector<Program *> retired_;         // Replaced programs the tracking thread may still hold
+
+};
+
+#endif /* defined(__KinectOSC__MappingEngine__) */
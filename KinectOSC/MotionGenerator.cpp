@@ -0,0 +1,304 @@
+//
+//  MotionGenerator.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "MotionGenerator.h"
+
+#include <math.h>
+#include <unistd.h>
+
+MotionGenerator::MotionGenerator(int nUsers, float frameRate, unsigned int seed) {
+
+    nUsers_ = nUsers < SKELETON_MAX_USERS ? nUsers : SKELETON_MAX_USERS;
+    frameRate_ = frameRate > 0 ? frameRate : 30;
+    seed_ = seed;
+    realtime_ = true;
+
+    stageWidth_ = 3000;
+    noise_ = 5;
+    dropoutRate_ = 0.02;
+    exitRate_ = 0.01;
+    behaviorMask_ = (1 << NUM_BEHAVIORS) - 1;
+
+    /* Everyone starts out of frame and enters a little after the previous performer */
+    for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+        memset(&performers_[i], 0, sizeof(Performer));
+        performers_[i].presence = PRESENCE_OUT;
+        performers_[i].framesLeft = 1 + (int)(i * 0.5f * frameRate_);
+        performers_[i].dropoutJoint = -1;
+    }
+
+    nextId_ = 1;
+    frameIndex_ = 0;
+    startTime_ = 0;
+}
+
+void MotionGenerator::setBehaviorEnabled(Behavior behavior, bool enabled) {
+
+    if (behavior < 0 || behavior >= NUM_BEHAVIORS)
+        return;
+
+    if (enabled)
+        behaviorMask_ |= 1 << behavior;
+    else
+        behaviorMask_ &= ~(1 << behavior);
+}
+
+/* Same LCG as SyntheticSkeletonSource, so a seed fully determines the stream */
+float MotionGenerator::uniform() {
+
+    seed_ = seed_ * 1103515245u + 12345u;
+    return ((seed_ >> 8) & 0xffff) / 65536.0f;
+}
+
+bool MotionGenerator::chance(float perSecond) {
+
+    return perSecond > 0 && uniform() < perSecond / frameRate_;
+}
+
+void MotionGenerator::chooseBehavior(Performer *p, float t) {
+
+    /* Pick uniformly among the enabled behaviors; idle if none are */
+    Behavior candidates[NUM_BEHAVIORS];
+    int n = 0;
+    for (int b = 0; b < NUM_BEHAVIORS; b++) {
+        if (behaviorMask_ & (1 << b))
+            candidates[n++] = (Behavior)b;
+    }
+
+    p->behavior = n > 0 ? candidates[(int)(uniform() * n)] : BEHAVIOR_IDLE;
+    p->behaviorStart = t;
+
+    if (p->behavior == BEHAVIOR_WALK) {
+
+        /* Walk at about 1 m/s to somewhere else on the stage */
+        float halfWidth = stageWidth_ / 2 - 200;
+        p->walkFrom = p->x;
+        p->walkTo = (2 * uniform() - 1) * halfWidth;
+        p->behaviorEnd = t + fmaxf(1.0f, fabsf(p->walkTo - p->walkFrom) / 1000);
+    }
+    else
+        p->behaviorEnd = t + 2 + 4 * uniform();
+}
+
+/* Advance a performer's presence by one frame and set the flags NiTE would report */
+void MotionGenerator::updatePresence(Performer *p, SkeletonUser *user) {
+
+    float t = frameIndex_ / frameRate_;
+    user->id = p->id;
+    user->flags = 0;
+
+    switch (p->presence) {
+
+        case PRESENCE_OUT:
+            if (--p->framesLeft > 0)
+                return;
+
+            /* Step in from one side of the stage and walk toward the middle */
+            p->presence = PRESENCE_CALIBRATING;
+            p->id = nextId_;
+            nextId_ = nextId_ < 32767 ? nextId_ + 1 : 1;
+            p->framesLeft = (int)((0.5f + uniform()) * frameRate_);
+            p->dropoutFrames = 0;
+
+            p->x = (uniform() < 0.5f ? -1 : 1) * stageWidth_ / 2;
+            p->z = 2800 + 600 * uniform();
+            p->behavior = BEHAVIOR_WALK;
+            p->behaviorStart = t;
+            p->walkFrom = p->x;
+            p->walkTo = (uniform() - 0.5f) * stageWidth_ / 2;
+            p->behaviorEnd = t + fmaxf(1.0f, fabsf(p->walkTo - p->walkFrom) / 1000);
+
+            user->id = p->id;
+            user->flags = USER_NEW | USER_VISIBLE;
+            break;
+
+        case PRESENCE_CALIBRATING:
+            user->flags = USER_VISIBLE;
+            if (--p->framesLeft <= 0)
+                p->presence = PRESENCE_TRACKED;
+            break;
+
+        case PRESENCE_TRACKED:
+            if (chance(exitRate_)) {
+                p->presence = PRESENCE_LEAVING;
+                return;
+            }
+
+            user->flags = USER_VISIBLE | USER_TRACKED;
+
+            if (p->dropoutFrames == 0 && chance(dropoutRate_)) {
+                /* Lose the whole skeleton a third of the time, otherwise one joint */
+                p->dropoutFrames = 1 + (int)((0.2f + 1.8f * uniform()) * frameRate_);
+                p->dropoutJoint = uniform() < 0.33f ? -1 : (int)(uniform() * SKELETON_NUM_JOINTS);
+            }
+
+            if (p->dropoutFrames > 0) {
+                p->dropoutFrames--;
+                if (p->dropoutJoint < 0)
+                    user->flags &= ~USER_TRACKED;
+            }
+            break;
+
+        case PRESENCE_LEAVING:
+            user->flags = USER_LOST;
+            p->presence = PRESENCE_OUT;
+            p->framesLeft = 1 + (int)((1 + 4 * uniform()) * frameRate_);
+            break;
+    }
+}
+
+void MotionGenerator::synthesizePose(Performer *p, float t, SkeletonUser *user) {
+
+    float offset[SKELETON_NUM_JOINTS][3];
+    memcpy(offset, kStandingPose, sizeof(offset));
+
+    float phase = t - p->behaviorStart;
+    float twoPi = 2 * (float)M_PI;
+
+    switch (p->behavior) {
+
+        case BEHAVIOR_WALK: {
+
+            float duration = p->behaviorEnd - p->behaviorStart;
+            float s = duration > 0 ? fminf(phase / duration, 1) : 1;
+            p->x = p->walkFrom + s * (p->walkTo - p->walkFrom);
+
+            /* Alternate steps at 1.8 Hz with the arms swinging against the legs */
+            float w = sinf(twoPi * 1.8f * phase);
+            float liftL = 120 * fmaxf(0, w);
+            float liftR = 120 * fmaxf(0, -w);
+
+            offset[SKEL_FOOT_L][1] += liftL;
+            offset[SKEL_KNEE_L][1] += liftL / 2;
+            offset[SKEL_FOOT_R][1] += liftR;
+            offset[SKEL_KNEE_R][1] += liftR / 2;
+            offset[SKEL_FOOT_L][2] -= 150 * w;
+            offset[SKEL_FOOT_R][2] += 150 * w;
+            offset[SKEL_HAND_L][2] += 120 * w;
+            offset[SKEL_HAND_R][2] -= 120 * w;
+            break;
+        }
+
+        case BEHAVIOR_STOMP: {
+
+            /* Sharp alternating foot lifts at 1.5 Hz */
+            float w = sinf(twoPi * 1.5f * phase);
+            float liftL = 250 * powf(fmaxf(0, w), 2);
+            float liftR = 250 * powf(fmaxf(0, -w), 2);
+
+            offset[SKEL_FOOT_L][1] += liftL;
+            offset[SKEL_KNEE_L][1] += liftL * 0.6f;
+            offset[SKEL_FOOT_R][1] += liftR;
+            offset[SKEL_KNEE_R][1] += liftR * 0.6f;
+            break;
+        }
+
+        case BEHAVIOR_SPREAD_HANDS: {
+
+            /* Open and close the arms every two seconds */
+            float spread = 0.5f - 0.5f * cosf(twoPi * 0.5f * phase);
+
+            offset[SKEL_HAND_L][0] -= 600 * spread;
+            offset[SKEL_HAND_R][0] += 600 * spread;
+            offset[SKEL_HAND_L][1] += 480 * spread;
+            offset[SKEL_HAND_R][1] += 480 * spread;
+            offset[SKEL_ELBOW_L][0] -= 250 * spread;
+            offset[SKEL_ELBOW_R][0] += 250 * spread;
+            offset[SKEL_ELBOW_L][1] += 230 * spread;
+            offset[SKEL_ELBOW_R][1] += 230 * spread;
+            break;
+        }
+
+        case BEHAVIOR_KNEE_LIFT: {
+
+            float lift = fmaxf(0, sinf(twoPi * 0.4f * phase));
+
+            offset[SKEL_KNEE_R][1] += 450 * lift;
+            offset[SKEL_KNEE_R][2] -= 350 * lift;
+            offset[SKEL_FOOT_R][1] += 300 * lift;
+            offset[SKEL_FOOT_R][2] -= 250 * lift;
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    /* Gentle sway so idle frames still differ */
+    float sway = 30 * sinf(twoPi * 0.3f * t + p->id);
+
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+
+        user->x[j] = p->x + offset[j][0] + sway + noise_ * (2 * uniform() - 1);
+        user->y[j] = offset[j][1] + noise_ * (2 * uniform() - 1);
+        user->z[j] = p->z + offset[j][2] + noise_ * (2 * uniform() - 1);
+
+        bool dropped = p->dropoutFrames > 0 && j == p->dropoutJoint;
+        user->confidence[j] = (user->flags & USER_TRACKED) && !dropped ? 1 : 0;
+    }
+}
+
+bool MotionGenerator::readFrame(SkeletonFrame *frame) {
+
+    /* Pace to the frame rate when standing in for a real device */
+    if (realtime_) {
+        if (startTime_ == 0)
+            startTime_ = hostTimeMicros();
+
+        uint64_t due = startTime_ + (uint64_t)(frameIndex_ * 1e6 / frameRate_);
+        uint64_t now = hostTimeMicros();
+        if (due > now)
+            usleep((useconds_t)(due - now));
+    }
+
+    float t = frameIndex_ / frameRate_;
+
+    frame->timestamp = (uint64_t)(frameIndex_ * 1e6 / frameRate_);
+    frame->hostTime = hostTimeMicros();
+    frame->frameIndex = frameIndex_;
+    frame->sensorId = 0;
+    frame->width = 640;
+    frame->height = 480;
+    frame->nUsers = 0;
+
+    for (int i = 0; i < nUsers_; i++) {
+
+        Performer *p = &performers_[i];
+        SkeletonUser &user = frame->users[frame->nUsers];
+
+        bool inFrame = p->presence != PRESENCE_OUT;
+        updatePresence(p, &user);
+
+        /* Performers that were already out of frame aren't reported */
+        if (!inFrame && p->presence == PRESENCE_OUT)
+            continue;
+
+        if (p->presence == PRESENCE_TRACKED && t >= p->behaviorEnd)
+            chooseBehavior(p, t);
+
+        /* Users out of view carry no joints, like NiTE's */
+        if (user.flags & USER_VISIBLE) {
+            synthesizePose(p, t, &user);
+            for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+                projectToDepthImage(user.x[j], user.y[j], user.z[j], frame->width, frame->height,
+                                    &user.u[j], &user.v[j]);
+        }
+        else {
+            memset(user.x, 0, sizeof(user.x));
+            memset(user.y, 0, sizeof(user.y));
+            memset(user.z, 0, sizeof(user.z));
+            memset(user.confidence, 0, sizeof(user.confidence));
+            memset(user.u, 0, sizeof(user.u));
+            memset(user.v, 0, sizeof(user.v));
+        }
+
+        frame->nUsers++;
+    }
+
+    frameIndex_++;
+    return true;
+}
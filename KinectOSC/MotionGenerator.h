@@ -0,0 +1,106 @@
+//
+//  MotionGenerator.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Deterministic synthetic performers for load and soak testing. Each user runs a
+//  seeded script of behaviors (walking across regions, stomping, spreading hands,
+//  knee lifts), enters and leaves the frame, and occasionally loses tracking.
+//  The same seed always produces the same stream.
+
+#ifndef __KinectOSC__MotionGenerator__
+#define __KinectOSC__MotionGenerator__
+
+#include <iostream>
+
+#include "SkeletonSource.h"
+
+class MotionGenerator : public SkeletonSource {
+
+public:
+
+    enum Behavior {
+        BEHAVIOR_IDLE = 0,
+        BEHAVIOR_WALK,
+        BEHAVIOR_STOMP,
+        BEHAVIOR_SPREAD_HANDS,
+        BEHAVIOR_KNEE_LIFT,
+        NUM_BEHAVIORS
+    };
+
+private:
+
+    enum Presence {
+        PRESENCE_OUT = 0,       // Not in frame
+        PRESENCE_CALIBRATING,   // Visible, skeleton not yet tracked
+        PRESENCE_TRACKED,
+        PRESENCE_LEAVING        // Out of view; reported lost on the next frame
+    };
+
+    struct Performer {
+        Presence presence;
+        int id;
+        int framesLeft;         // Frames until the next presence change
+
+        Behavior behavior;
+        float behaviorStart;    // Seconds
+        float behaviorEnd;
+
+        float x;                // Torso position on the stage (mm)
+        float z;
+        float walkFrom;
+        float walkTo;
+
+        int dropoutFrames;      // Remaining frames of lost tracking
+        int dropoutJoint;       // Joint with zero confidence, or -1 for the whole skeleton
+    };
+
+public:
+
+    MotionGenerator(int nUsers = 1, float frameRate = 30, unsigned int seed = 1);
+
+    /* Setters */
+    void setRealtime(bool realtime) { realtime_ = realtime; }
+    void setStageWidth(float mm) { stageWidth_ = mm; }
+    void setNoise(float mm) { noise_ = mm; }
+    void setDropoutRate(float perSecond) { dropoutRate_ = perSecond; }     // Tracking losses per user
+    void setExitRate(float perSecond) { exitRate_ = perSecond; }           // Exits per user
+    void setBehaviorEnabled(Behavior behavior, bool enabled);
+
+    /* Getters */
+    int frameIndex() { return frameIndex_; }
+    float frameRate() { return frameRate_; }
+
+    bool readFrame(SkeletonFrame *frame);
+    const char *name() { return "MotionGenerator"; }
+
+private:
+
+    float uniform();                            // [0, 1)
+    bool chance(float perSecond);               // Poisson event this frame
+    void chooseBehavior(Performer *p, float t);
+    void updatePresence(Performer *p, SkeletonUser *user);
+    void synthesizePose(Performer *p, float t, SkeletonUser *user);
+
+private:
+
+    int nUsers_;
+    float frameRate_;
+    unsigned int seed_;
+    bool realtime_;
+
+    float stageWidth_;
+    float noise_;
+    float dropoutRate_;
+    float exitRate_;
+    int behaviorMask_;
+
+    Performer performers_[SKELETON_MAX_USERS];
+    int nextId_;
+
+    int frameIndex_;
+    uint64_t startTime_;
+};
+
+#endif /* defined(__KinectOSC__MotionGenerator__) */
@@ -0,0 +1,297 @@
+//
+//  MultiDeviceManager.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "MultiDeviceManager.h"
+
+#include <sys/time.h>
+
+MultiDeviceManager::MultiDeviceManager() {
+
+    pthread_mutex_init(&notifyMutex_, NULL);
+    pthread_cond_init(&frameCond_, NULL);
+    pthread_cond_init(&stopCond_, NULL);
+
+    produced_ = 0;
+    consumed_ = 0;
+    woken_ = false;
+    running_ = false;
+    shouldStop_ = false;
+}
+
+MultiDeviceManager::~MultiDeviceManager() {
+
+    stop();
+
+    for (size_t i = 0; i < sensors_.size(); i++) {
+        pthread_mutex_destroy(&sensors_[i]->mutex);
+        delete sensors_[i]->source;
+        delete sensors_[i];
+    }
+
+    pthread_cond_destroy(&stopCond_);
+    pthread_cond_destroy(&frameCond_);
+    pthread_mutex_destroy(&notifyMutex_);
+}
+
+int MultiDeviceManager::addSource(SkeletonSource *source) {
+
+    if (running_) {
+        printf("%s: Can't add sensors while running\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if (sensors_.size() >= FUSION_MAX_SENSORS) {
+        printf("%s: At most %d sensors are supported\n", __PRETTY_FUNCTION__, FUSION_MAX_SENSORS);
+        return -1;
+    }
+
+    Sensor *sensor = new Sensor();
+    sensor->owner = this;
+    sensor->index = (int)sensors_.size();
+    sensor->source = source;
+    sensor->hasLatest = false;
+    sensor->hasPrevious = false;
+    sensor->threadStarted = false;
+    pthread_mutex_init(&sensor->mutex, NULL);
+
+    memset(sensor->extrinsics, 0, sizeof(sensor->extrinsics));
+    sensor->extrinsics[0][0] = sensor->extrinsics[1][1] = sensor->extrinsics[2][2] = 1;
+
+    sensors_.push_back(sensor);
+    return sensor->index;
+}
+
+int MultiDeviceManager::openAllDevices() {
+
+    openni::Array<openni::DeviceInfo> devs;
+    openni::OpenNI::enumerateDevices(&devs);
+
+    int nOpened = 0;
+
+    for (int i = 0; i < devs.getSize(); i++) {
+
+        NiteSkeletonSource *source = new NiteSkeletonSource();
+
+        if (!source->open(devs[i].getUri()) || addSource(source) < 0) {
+            printf("%s: Skipping device %d (%s)\n", __PRETTY_FUNCTION__, i, devs[i].getName());
+            delete source;
+            continue;
+        }
+
+        nOpened++;
+    }
+
+    return nOpened;
+}
+
+void MultiDeviceManager::setExtrinsics(int sensor, const float sensorToWorld[3][4]) {
+
+    if (sensor < 0 || sensor >= (int)sensors_.size())
+        return;
+
+    pthread_mutex_lock(&sensors_[sensor]->mutex);
+    memcpy(sensors_[sensor]->extrinsics, sensorToWorld, sizeof(sensors_[sensor]->extrinsics));
+    pthread_mutex_unlock(&sensors_[sensor]->mutex);
+}
+
+bool MultiDeviceManager::start() {
+
+    if (running_ || sensors_.empty())
+        return false;
+
+    shouldStop_ = false;
+    produced_ = 0;
+    consumed_ = 0;
+    fusion_.reset();
+
+    for (size_t i = 0; i < sensors_.size(); i++) {
+
+        Sensor *sensor = sensors_[i];
+        sensor->hasLatest = false;
+        sensor->hasPrevious = false;
+
+        if (pthread_create(&sensor->thread, NULL, staticCaptureLoop, (void *)sensor) != 0) {
+            printf("%s: Error creating capture thread for sensor %d\n", __PRETTY_FUNCTION__, (int)i);
+            running_ = true;
+            stop();
+            return false;
+        }
+        sensor->threadStarted = true;
+    }
+
+    running_ = true;
+    return true;
+}
+
+void MultiDeviceManager::stop() {
+
+    if (!running_)
+        return;
+
+    pthread_mutex_lock(&notifyMutex_);
+    shouldStop_ = true;
+    pthread_cond_broadcast(&frameCond_);
+    pthread_cond_broadcast(&stopCond_);
+    pthread_mutex_unlock(&notifyMutex_);
+
+    /* Don't wait out reads in progress */
+    for (size_t i = 0; i < sensors_.size(); i++)
+        sensors_[i]->source->wake();
+
+    for (size_t i = 0; i < sensors_.size(); i++) {
+        if (sensors_[i]->threadStarted) {
+            pthread_join(sensors_[i]->thread, NULL);
+            sensors_[i]->threadStarted = false;
+        }
+    }
+
+    running_ = false;
+}
+
+void MultiDeviceManager::applyExtrinsics(Sensor *sensor, SkeletonFrame *frame) {
+
+    const float (*m)[4] = sensor->extrinsics;
+
+    for (int i = 0; i < frame->nUsers; i++) {
+
+        SkeletonUser &user = frame->users[i];
+
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+            float x = user.x[j], y = user.y[j], z = user.z[j];
+            user.x[j] = m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3];
+            user.y[j] = m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3];
+            user.z[j] = m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3];
+        }
+    }
+}
+
+/* Sleep for up to ms, returning early (and true) if the manager is stopped */
+bool MultiDeviceManager::waitForStop(int ms) {
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&notifyMutex_);
+    while (!shouldStop_) {
+        if (pthread_cond_timedwait(&stopCond_, &notifyMutex_, &deadline) != 0)
+            break;
+    }
+    pthread_mutex_unlock(&notifyMutex_);
+
+    return shouldStop_;
+}
+
+/* Each sensor reads on its own thread and only takes its own lock to publish, so adding
+   sensors doesn't serialize their capture. A source whose reads fail at once (unplugged,
+   or out of frames) is paused between tries, backing off while it keeps failing, rather
+   than spun on. */
+void *MultiDeviceManager::captureLoop(Sensor *sensor) {
+
+    int retryMs = MULTI_RETRY_MIN_MS;
+
+    while (!shouldStop_) {
+
+        if (!sensor->source->readFrame(&sensor->scratch)) {
+
+            if (waitForStop(retryMs))
+                break;
+
+            retryMs *= 2;
+            if (retryMs > MULTI_RETRY_MAX_MS)
+                retryMs = MULTI_RETRY_MAX_MS;
+            continue;
+        }
+
+        retryMs = MULTI_RETRY_MIN_MS;
+        sensor->scratch.sensorId = sensor->index;
+
+        pthread_mutex_lock(&sensor->mutex);
+        applyExtrinsics(sensor, &sensor->scratch);
+        if (sensor->hasLatest) {
+            sensor->previous = sensor->latest;
+            sensor->hasPrevious = true;
+        }
+        sensor->latest = sensor->scratch;
+        sensor->hasLatest = true;
+        pthread_mutex_unlock(&sensor->mutex);
+
+        pthread_mutex_lock(&notifyMutex_);
+        produced_++;
+        pthread_cond_signal(&frameCond_);
+        pthread_mutex_unlock(&notifyMutex_);
+    }
+
+    return 0;
+}
+
+void MultiDeviceManager::wake() {
+
+    pthread_mutex_lock(&notifyMutex_);
+    woken_ = true;
+    pthread_cond_broadcast(&frameCond_);
+    pthread_mutex_unlock(&notifyMutex_);
+}
+
+bool MultiDeviceManager::readFusedFrame(SkeletonFrame *frame, int timeoutMs) {
+
+    if (!running_)
+        return false;
+
+    /* Wait for a frame we haven't fused yet */
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    struct timespec deadline;
+    uint64_t usec = now.tv_usec + (uint64_t)timeoutMs * 1000;
+    deadline.tv_sec = now.tv_sec + usec / 1000000;
+    deadline.tv_nsec = (usec % 1000000) * 1000;
+
+    pthread_mutex_lock(&notifyMutex_);
+    while (produced_ == consumed_ && !shouldStop_ && !woken_) {
+        if (pthread_cond_timedwait(&frameCond_, &notifyMutex_, &deadline) != 0)
+            break;
+    }
+    bool haveFrame = produced_ != consumed_;
+    consumed_ = produced_;
+    woken_ = false;
+    pthread_mutex_unlock(&notifyMutex_);
+
+    if (!haveFrame)
+        return false;
+
+    /* Snapshot every sensor, then fuse outside the locks */
+    const SkeletonFrame *latest[FUSION_MAX_SENSORS];
+    const SkeletonFrame *previous[FUSION_MAX_SENSORS];
+    int nSensors = (int)sensors_.size();
+
+    for (int s = 0; s < nSensors; s++) {
+
+        Sensor *sensor = sensors_[s];
+        latest[s] = NULL;
+        previous[s] = NULL;
+
+        pthread_mutex_lock(&sensor->mutex);
+        if (sensor->hasLatest) {
+            latestCopy_[s] = sensor->latest;
+            latest[s] = &latestCopy_[s];
+        }
+        if (sensor->hasPrevious) {
+            previousCopy_[s] = sensor->previous;
+            previous[s] = &previousCopy_[s];
+        }
+        pthread_mutex_unlock(&sensor->mutex);
+    }
+
+    fusion_.fuse(latest, previous, nSensors, frame);
+    return true;
+}
@@ -0,0 +1,103 @@
+//
+//  MultiDeviceManager.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Runs one capture thread per sensor, transforms each sensor's skeletons into a shared
+//  world frame with its extrinsic calibration, and fuses them. The manager is itself a
+//  SkeletonSource, so the fused stream can be consumed like a single device.
+
+#ifndef __KinectOSC__MultiDeviceManager__
+#define __KinectOSC__MultiDeviceManager__
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+
+#include "SkeletonSource.h"
+#include "SkeletonFusion.h"
+
+#define MULTI_RETRY_MIN_MS 1            // Pause after a failed read, doubling up to the max
+#define MULTI_RETRY_MAX_MS 100
+
+using namespace std;
+
+class MultiDeviceManager : public SkeletonSource {
+
+    struct Sensor {
+        MultiDeviceManager *owner;
+        int index;
+        SkeletonSource *source;
+        float extrinsics[3][4];         // Sensor to world
+        SkeletonFrame scratch;          // Written by the capture thread without the lock
+        SkeletonFrame latest;
+        SkeletonFrame previous;
+        bool hasLatest;
+        bool hasPrevious;
+        pthread_t thread;
+        bool threadStarted;
+        pthread_mutex_t mutex;          // Guards latest/previous
+    };
+
+public:
+
+    MultiDeviceManager();
+    ~MultiDeviceManager();
+
+    /* Add a sensor; the manager takes ownership of the source. Returns the sensor index. */
+    int addSource(SkeletonSource *source);
+
+    /* Open every available OpenNI device as a NiTE source */
+    int openAllDevices();
+
+    /* Sensor-to-world transform for a sensor (identity by default) */
+    void setExtrinsics(int sensor, const float sensorToWorld[3][4]);
+
+    bool start();
+    void stop();
+    bool isRunning() { return running_; }
+    int numSensors() { return (int)sensors_.size(); }
+
+    /* Wait up to timeoutMs for any sensor to deliver a frame, then fuse */
+    bool readFusedFrame(SkeletonFrame *frame, int timeoutMs);
+
+    /* SkeletonSource */
+    bool readFrame(SkeletonFrame *frame) { return readFusedFrame(frame, 100); }
+    void wake();
+    const char *name() { return "Fused"; }
+
+    SkeletonFusion &fusion() { return fusion_; }
+
+private:
+
+    void *captureLoop(Sensor *sensor);
+    static void *staticCaptureLoop(void *arg) {
+        Sensor *sensor = (Sensor *)arg;
+        return sensor->owner->captureLoop(sensor);
+    }
+
+    void applyExtrinsics(Sensor *sensor, SkeletonFrame *frame);
+    bool waitForStop(int ms);
+
+private:
+
+    vector<Sensor *> sensors_;
+    SkeletonFusion fusion_;
+
+    /* Snapshots taken by the reader so fusion runs without holding sensor locks */
+    SkeletonFrame latestCopy_[FUSION_MAX_SENSORS];
+    SkeletonFrame previousCopy_[FUSION_MAX_SENSORS];
+
+    pthread_mutex_t notifyMutex_;
+    pthread_cond_t frameCond_;
+    pthread_cond_t stopCond_;           // Interrupts capture threads pausing after failed reads
+    uint64_t produced_;                 // Frames delivered by all sensors
+    uint64_t consumed_;                 // Value of produced_ at the last fusion
+    bool woken_;
+    atomic<bool> running_;              // Read by readFusedFrame() on the consumer's thread
+    atomic<bool> shouldStop_;
+};
+
+#endif /* defined(__KinectOSC__MultiDeviceManager__) */
@@ -0,0 +1,248 @@
+//
+//  NoteMap.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "NoteMap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#define NO_TONALITY -1
+
+struct BuiltinScale {
+    const char *name;           // As shown in the UI
+    int tonality;
+    const char *label;          // Unique name including the tonality
+    int steps[NOTE_MAP_SIZE];   // Semitones above the key for each region
+};
+
+/* Indexed by Scale */
+static constexpr BuiltinScale kBuiltinScales[] = {
+    { "Diatonic",   TONALITY_MAJOR, "Diatonic Major",   { 0, 2, 4, 5, 7, 9, 11, 12, 14, 16, 17, 19 } },
+    { "Diatonic",   TONALITY_MINOR, "Diatonic Minor",   { 0, 2, 3, 5, 7, 8, 10, 12, 14, 15, 17, 19 } },
+    { "Pentatonic", TONALITY_MAJOR, "Pentatonic Major", { 0, 2, 4, 7, 9, 12, 14, 16, 19, 21, 24, 26 } },
+    { "Pentatonic", TONALITY_MINOR, "Pentatonic Minor", { 0, 3, 5, 7, 10, 12, 15, 17, 19, 22, 24, 27 } },
+    { "Chromatic",  NO_TONALITY,    "Chromatic",        { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 } }
+};
+
+static_assert(sizeof(kBuiltinScales) / sizeof(kBuiltinScales[0]) == NUM_BUILTIN_SCALES,
+              "kBuiltinScales must have an entry for each Scale");
+
+struct KeyName {
+    const char *name;
+    int key;
+};
+
+static constexpr KeyName kKeyNames[] = {
+    { "C",  KEY_C  }, { "B#", KEY_C  },
+    { "C#", KEY_CS }, { "Db", KEY_CS },
+    { "D",  KEY_D  },
+    { "D#", KEY_DS }, { "Eb", KEY_DS },
+    { "E",  KEY_E  }, { "Fb", KEY_E  },
+    { "F",  KEY_F  }, { "E#", KEY_F  },
+    { "F#", KEY_FS }, { "Gb", KEY_FS },
+    { "G",  KEY_G  },
+    { "G#", KEY_GS }, { "Ab", KEY_GS },
+    { "A",  KEY_A  },
+    { "A#", KEY_AS }, { "Bb", KEY_AS },
+    { "B",  KEY_B  }, { "Cb", KEY_B  }
+};
+
+bool ScaleLibrary::parseScale(const char *name, Tonality tonality, int *scale) {
+
+    if (!name)
+        return false;
+
+    for (int i = 0; i < NUM_BUILTIN_SCALES; i++) {
+        const BuiltinScale &s = kBuiltinScales[i];
+        bool nameMatches = !strcasecmp(name, s.name) && (s.tonality == NO_TONALITY || s.tonality == tonality);
+        if (nameMatches || !strcasecmp(name, s.label)) {
+            *scale = i;
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < userScales_.size(); i++) {
+        if (!strcasecmp(name, userScales_[i].name.c_str())) {
+            *scale = NUM_BUILTIN_SCALES + (int)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ScaleLibrary::parseTonality(const char *name, Tonality *tonality) {
+
+    if (!name)
+        return false;
+
+    if (!strcasecmp(name, "Major"))
+        *tonality = TONALITY_MAJOR;
+    else if (!strcasecmp(name, "Minor"))
+        *tonality = TONALITY_MINOR;
+    else
+        return false;
+
+    return true;
+}
+
+bool ScaleLibrary::parseKey(const char *name, int *key) {
+
+    if (!name)
+        return false;
+
+    for (size_t i = 0; i < sizeof(kKeyNames) / sizeof(kKeyNames[0]); i++) {
+        if (!strcasecmp(name, kKeyNames[i].name)) {
+            *key = kKeyNames[i].key;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ScaleLibrary::build(int scale, int key, int octave, NoteMap *map) {
+
+    if (scale < 0 || scale >= numScales() || key < 0 || key >= NUM_KEYS)
+        return false;
+
+    const int *steps = scale < NUM_BUILTIN_SCALES ? kBuiltinScales[scale].steps
+                                                  : userScales_[scale - NUM_BUILTIN_SCALES].steps;
+    int base = key + octave * 12;
+
+    /* Check the whole range first so a bad octave never leaves a partial map */
+    for (int i = 0; i < NOTE_MAP_SIZE; i++) {
+        if (base + steps[i] < 0 || base + steps[i] > 127)
+            return false;
+    }
+
+    for (int i = 0; i < NOTE_MAP_SIZE; i++)
+        map->notes[i] = base + steps[i];
+
+    return true;
+}
+
+/* First (sharp) spelling of a key */
+const char *ScaleLibrary::keyName(int key) {
+
+    for (size_t i = 0; i < sizeof(kKeyNames) / sizeof(kKeyNames[0]); i++) {
+        if (kKeyNames[i].key == key)
+            return kKeyNames[i].name;
+    }
+
+    return NULL;
+}
+
+const char *ScaleLibrary::scaleName(int scale) {
+
+    if (scale >= 0 && scale < NUM_BUILTIN_SCALES)
+        return kBuiltinScales[scale].label;
+
+    if (scale >= NUM_BUILTIN_SCALES && scale < numScales())
+        return userScales_[scale - NUM_BUILTIN_SCALES].name.c_str();
+
+    return NULL;
+}
+
+bool ScaleLibrary::hasTonality(int scale) {
+
+    return scale >= 0 && scale < NUM_BUILTIN_SCALES && kBuiltinScales[scale].tonality != NO_TONALITY;
+}
+
+int ScaleLibrary::loadFile(const char *path) {
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("%s: Can't open %s\n", __PRETTY_FUNCTION__, path);
+        return -1;
+    }
+
+    char line[256];
+    int lineNumber = 0;
+    int nRead = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+
+        lineNumber++;
+
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char *colon = strchr(line, ':');
+        if (!colon) {
+            /* Blank lines are fine, anything else is a mistake */
+            for (char *c = line; *c; c++) {
+                if (!isspace(*c)) {
+                    printf("%s: %s:%d: Expected \"name: steps\"\n", __PRETTY_FUNCTION__, path, lineNumber);
+                    break;
+                }
+            }
+            continue;
+        }
+
+        /* Name, trimmed */
+        *colon = '\0';
+        char *name = line;
+        while (isspace(*name))
+            name++;
+        char *end = colon;
+        while (end > name && isspace(end[-1]))
+            *--end = '\0';
+
+        /* Steps must rise */
+        int degrees[NOTE_MAP_SIZE];
+        int nDegrees = 0;
+        bool valid = *name != '\0';
+        char *p = colon + 1;
+
+        while (valid) {
+            char *next;
+            long step = strtol(p, &next, 10);
+            if (next == p)
+                break;
+            p = next;
+
+            if (nDegrees == NOTE_MAP_SIZE || step < 0 || step > 127 ||
+                (nDegrees > 0 && step <= degrees[nDegrees-1]))
+                valid = false;
+            else
+                degrees[nDegrees++] = (int)step;
+        }
+
+        while (isspace(*p))
+            p++;
+
+        if (!valid || nDegrees == 0 || *p != '\0') {
+            printf("%s: %s:%d: Invalid scale\n", __PRETTY_FUNCTION__, path, lineNumber);
+            continue;
+        }
+
+        UserScale scale;
+        scale.name = name;
+        for (int i = 0; i < NOTE_MAP_SIZE; i++)
+            scale.steps[i] = degrees[i % nDegrees] + 12 * (i / nDegrees);
+
+        /* A later definition replaces an earlier one */
+        size_t s = 0;
+        while (s < userScales_.size() && strcasecmp(userScales_[s].name.c_str(), name))
+            s++;
+
+        if (s < userScales_.size())
+            userScales_[s] = scale;
+        else
+            userScales_.push_back(scale);
+
+        nRead++;
+    }
+
+    fclose(file);
+    return nRead;
+}
@@ -0,0 +1,85 @@
+//
+//  NoteMap.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Maps the twelve floor regions to MIDI notes. Built-in scales and key names are
+//  compile-time tables; further scales can be loaded from a text file with one scale per
+//  line, a name followed by the semitone steps of one octave:
+//
+//      # name: steps
+//      Blues: 0 3 5 6 7 10
+//
+//  Scales shorter than twelve steps repeat up an octave to fill the regions.
+
+#ifndef __KinectOSC__NoteMap__
+#define __KinectOSC__NoteMap__
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define NOTE_MAP_SIZE 12
+
+struct NoteMap {
+    int notes[NOTE_MAP_SIZE];
+};
+
+enum Tonality {
+    TONALITY_MAJOR = 0,
+    TONALITY_MINOR
+};
+
+/* Built-in scales. User scales are numbered from NUM_BUILTIN_SCALES in load order. */
+enum Scale {
+    SCALE_DIATONIC_MAJOR = 0,
+    SCALE_DIATONIC_MINOR,
+    SCALE_PENTATONIC_MAJOR,
+    SCALE_PENTATONIC_MINOR,
+    SCALE_CHROMATIC,
+    NUM_BUILTIN_SCALES
+};
+
+enum Key {
+    KEY_C = 0, KEY_CS, KEY_D, KEY_DS, KEY_E, KEY_F, KEY_FS, KEY_G, KEY_GS, KEY_A, KEY_AS, KEY_B,
+    NUM_KEYS
+};
+
+class ScaleLibrary {
+
+    struct UserScale {
+        string name;
+        int steps[NOTE_MAP_SIZE];
+    };
+
+public:
+
+    /* Parse UI selections. Names are case-insensitive; tonality is ignored for scales that
+       don't have one (chromatic and user scales) and for full labels like "Diatonic Minor".
+       Return false if the name isn't known. */
+    bool parseScale(const char *name, Tonality tonality, int *scale);
+    static bool parseTonality(const char *name, Tonality *tonality);
+    static bool parseKey(const char *name, int *key);
+    static const char *keyName(int key);
+
+    /* Fill map with the scale starting on the key in the given octave (C0 = MIDI 0).
+       Returns false if the scale is unknown or any note falls outside 0-127. */
+    bool build(int scale, int key, int octave, NoteMap *map);
+
+    /* Add the scales in a file, replacing scales with the same name. Returns the number of
+       scales read, or -1 if the file can't be opened. */
+    int loadFile(const char *path);
+
+    int numScales() { return NUM_BUILTIN_SCALES + (int)userScales_.size(); }
+    const char *scaleName(int scale);
+    bool hasTonality(int scale);
+
+private:
+
+    vector<UserScale> userScales_;
+};
+
+#endif /* defined(__KinectOSC__NoteMap__) */
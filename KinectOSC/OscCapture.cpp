@@ -0,0 +1,237 @@
+//
+//  OscCapture.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "OscCapture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#pragma mark - FrameStampSource
+
+FrameStampSource::FrameStampSource(SkeletonSource *source) {
+
+    source_ = source;
+    limit_ = 0;
+    nFrames_ = 0;
+    firstTimestamp_ = 0;
+    time_ = 0;
+}
+
+bool FrameStampSource::readFrame(SkeletonFrame *frame) {
+
+    if ((limit_ > 0 && nFrames_ >= limit_) || !source_->readFrame(frame))
+        return false;
+
+    if (nFrames_++ == 0)
+        firstTimestamp_ = frame->timestamp;
+
+    time_ = frame->timestamp >= firstTimestamp_ ? (frame->timestamp - firstTimestamp_) * 1e-6 : 0;
+    return true;
+}
+
+#pragma mark - OscCapture
+
+OscCapture::OscCapture() {
+
+    stamps_ = NULL;
+}
+
+void OscCapture::attach(OscController *osc, FrameStampSource *stamps) {
+
+    stamps_ = stamps;
+    osc->setMessageCallback(staticMessage, this);
+}
+
+void OscCapture::message(const char *path, const char *types, lo_message message) {
+
+    CapturedMessage captured;
+    captured.frame = stamps_ ? stamps_->frameNumber() : 0;
+    captured.path = path;
+    captured.types = types;
+
+    lo_arg **argv = lo_message_get_argv(message);
+
+    for (int i = 0; types[i]; i++) {
+        if (types[i] == 'i')
+            captured.args.push_back(argv[i]->i);
+        else if (types[i] == 'f')
+            captured.args.push_back(argv[i]->f);
+        else
+            captured.args.push_back(0);
+    }
+
+    messages_.push_back(captured);
+}
+
+string OscCapture::format(const CapturedMessage &message) {
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%d ", message.frame);
+
+    string line = buffer + message.path + " " + (message.types.empty() ? "-" : message.types);
+
+    for (size_t i = 0; i < message.args.size(); i++) {
+        if (message.types[i] == 'f')
+            snprintf(buffer, sizeof(buffer), " %.9g", message.args[i]);
+        else
+            snprintf(buffer, sizeof(buffer), " %d", (int)message.args[i]);
+        line += buffer;
+    }
+
+    return line;
+}
+
+bool OscCapture::writeFile(const char *path, const char *header) {
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        printf("%s: Can't write %s\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    for (const char *line = header; line && *line; ) {
+        const char *end = strchr(line, '\n');
+        int length = end ? (int)(end - line) : (int)strlen(line);
+        fprintf(file, "# %.*s\n", length, line);
+        line = end ? end + 1 : NULL;
+    }
+
+    for (size_t i = 0; i < messages_.size(); i++)
+        fprintf(file, "%s\n", format(messages_[i]).c_str());
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+/* One canonical line; an empty type tag is written as "-" */
+bool OscCapture::parse(const char *line, CapturedMessage *message) {
+
+    char path[256];
+    char types[64];
+    int consumed;
+
+    if (sscanf(line, "%d %255s %63s%n", &message->frame, path, types, &consumed) != 3)
+        return false;
+
+    message->path = path;
+    message->types = strcmp(types, "-") ? types : "";
+    message->args.clear();
+
+    const char *p = line + consumed;
+
+    for (size_t i = 0; i < message->types.size(); i++) {
+        char *end;
+        double value = strtod(p, &end);
+        if (end == p)
+            return false;
+        message->args.push_back(value);
+        p = end;
+    }
+
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+
+    return *p == '\0';
+}
+
+bool OscCapture::readFile(const char *path, vector<CapturedMessage> *messages) {
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("%s: Can't open %s\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    messages->clear();
+
+    char line[1024];
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (fgets(line, sizeof(line), file)) {
+
+        lineNumber++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        CapturedMessage message;
+        if (!parse(line, &message)) {
+            printf("%s: %s:%d: Can't parse \"%s\"\n", __PRETTY_FUNCTION__, path, lineNumber, line);
+            ok = false;
+            break;
+        }
+        messages->push_back(message);
+    }
+
+    fclose(file);
+    return ok;
+}
+
+bool OscCapture::matches(const CapturedMessage &a, const CapturedMessage &b, float tolerance) {
+
+    if (a.frame != b.frame || a.path != b.path || a.types != b.types || a.args.size() != b.args.size())
+        return false;
+
+    for (size_t i = 0; i < a.args.size(); i++) {
+        if (a.types[i] == 'f' ? fabs(a.args[i] - b.args[i]) > tolerance : a.args[i] != b.args[i])
+            return false;
+    }
+
+    return true;
+}
+
+/* Frame by frame, so a message added or lost only shows up in its own frame */
+int OscCapture::compare(const char *goldenPath, float tolerance) {
+
+    vector<CapturedMessage> golden;
+    if (!readFile(goldenPath, &golden))
+        return -1;
+
+    const vector<CapturedMessage> &actual = messages_;
+    size_t g = 0;
+    size_t a = 0;
+    int nDiffering = 0;
+
+    while (g < golden.size() || a < actual.size()) {
+
+        int frame;
+        if (g < golden.size() && a < actual.size())
+            frame = golden[g].frame < actual[a].frame ? golden[g].frame : actual[a].frame;
+        else
+            frame = g < golden.size() ? golden[g].frame : actual[a].frame;
+
+        size_t gEnd = g;
+        while (gEnd < golden.size() && golden[gEnd].frame == frame)
+            gEnd++;
+        size_t aEnd = a;
+        while (aEnd < actual.size() && actual[aEnd].frame == frame)
+            aEnd++;
+
+        bool same = gEnd - g == aEnd - a;
+        for (size_t i = 0; same && i < gEnd - g; i++)
+            same = matches(golden[g + i], actual[a + i], tolerance);
+
+        if (!same && nDiffering++ < CAPTURE_MAX_REPORTED) {
+            printf("Frame %d differs:\n", frame);
+            for (size_t i = g; i < gEnd; i++)
+                printf("  - %s\n", format(golden[i]).c_str());
+            for (size_t i = a; i < aEnd; i++)
+                printf("  + %s\n", format(actual[i]).c_str());
+        }
+
+        g = gEnd;
+        a = aEnd;
+    }
+
+    if (nDiffering > CAPTURE_MAX_REPORTED)
+        printf("... and %d more frames\n", nDiffering - CAPTURE_MAX_REPORTED);
+
+    return nDiffering;
+}
@@ -0,0 +1,108 @@
+//
+//  OscCapture.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Golden-output checks for the OSC stream. OscCapture keeps every message an
+//  OscController would have sent, stamped with the number of the frame that caused it,
+//  and writes them canonically, one per line:
+//
+//      <frame> <path> <types> <arg> ...
+//
+//  with ints in decimal and floats to nine significant digits. A golden file is that
+//  text, recorded from a trusted build; compare() reads one back and reports the frames
+//  whose messages differ, matching floats within a tolerance and everything else exactly.
+//  Lines starting with '#' are comments.
+
+#ifndef __KinectOSC__OscCapture__
+#define __KinectOSC__OscCapture__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "lo/lo.h"
+
+#include "SkeletonSource.h"
+#include "OscController.h"
+
+#define CAPTURE_DEFAULT_TOLERANCE 1e-4f
+#define CAPTURE_MAX_REPORTED 20         // Differing frames printed by compare()
+
+using namespace std;
+
+struct CapturedMessage {
+    int frame;
+    string path;
+    string types;
+    vector<double> args;                // Ints and floats; other types are kept as 0
+};
+
+/* Passes another source's frames through, keeping the number and session time of the
+   last one read so messages can be stamped with the frame that caused them */
+class FrameStampSource : public SkeletonSource {
+
+public:
+
+    FrameStampSource(SkeletonSource *source);
+
+    void setLimit(int nFrames) { limit_ = nFrames; }    // Stop after this many; 0 for none
+
+    bool readFrame(SkeletonFrame *frame);
+    const char *name() { return source_->name(); }
+
+    /* Getters */
+    int frameNumber() { return nFrames_ - 1; }  // From 0, whatever the source numbers them
+    double time() { return time_; }             // Seconds since the first frame
+
+private:
+
+    SkeletonSource *source_;
+    int limit_;
+    int nFrames_;
+    uint64_t firstTimestamp_;
+    double time_;
+};
+
+class OscCapture {
+
+public:
+
+    OscCapture();
+
+    /* Take over the controller's output; messages are stamped from stamps, if given */
+    void attach(OscController *osc, FrameStampSource *stamps);
+    void clear() { messages_.clear(); }
+
+    /* Getters */
+    const vector<CapturedMessage> &messages() { return messages_; }
+
+    /* Each line of the header is written as a comment */
+    bool writeFile(const char *path, const char *header);
+    static bool readFile(const char *path, vector<CapturedMessage> *messages);
+
+    /* Print the frames whose messages differ from the golden ones. Returns the number of
+       frames that differ, or -1 if the golden file can't be read. */
+    int compare(const char *goldenPath, float tolerance = CAPTURE_DEFAULT_TOLERANCE);
+
+    static string format(const CapturedMessage &message);
+
+private:
+
+    static void staticMessage(void *context, const char *path, const char *types, lo_message message) {
+        ((OscCapture *)context)->message(path, types, message);
+    }
+    void message(const char *path, const char *types, lo_message message);
+
+    static bool parse(const char *line, CapturedMessage *message);
+    static bool matches(const CapturedMessage &a, const CapturedMessage &b, float tolerance);
+
+private:
+
+    FrameStampSource *stamps_;
+    vector<CapturedMessage> messages_;
+};
+
+#endif /* defined(__KinectOSC__OscCapture__) */
@@ -0,0 +1,377 @@
+//
+//  OscControlServer.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "OscControlServer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+OscControlServer::OscControlServer(const char *root) {
+
+    root_ = root;
+    server_ = NULL;
+    running_ = false;
+    shouldStop_ = false;
+}
+
+OscControlServer::~OscControlServer() {
+
+    stop();
+}
+
+bool OscControlServer::addMethod(const char *address, const char *types, Handler handler, void *context, int method) {
+
+    if (running_) {
+        printf("%s: Methods can't be added while the server is running\n", __PRETTY_FUNCTION__);
+        return false;
+    }
+
+    if (address[0] != '/') {
+        printf("%s: Address \"%s\" must start with '/'\n", __PRETTY_FUNCTION__, address);
+        return false;
+    }
+
+    Method m;
+    m.address = root_ + address;
+    m.types = types ? types : "";
+    m.anyTypes = types == NULL;
+    m.handler = handler;
+    m.context = context;
+    m.method = method;
+    methods_.push_back(m);
+
+    return true;
+}
+
+#pragma mark - Address trie
+
+/* Build the trie from the registered methods and sort each node's children */
+void OscControlServer::compile() {
+
+    nodes_.clear();
+    nodes_.push_back(Node());
+
+    for (int m = 0; m < (int)methods_.size(); m++) {
+
+        const string &address = methods_[m].address;
+        int node = 0;
+        size_t start = 1;
+
+        while (start <= address.size()) {
+
+            size_t end = address.find('/', start);
+            if (end == string::npos)
+                end = address.size();
+
+            string segment = address.substr(start, end - start);
+
+            /* Linear search is fine here; lookups use the sorted children */
+            int child = -1;
+            for (size_t c = 0; c < nodes_[node].children.size() && child < 0; c++) {
+                if (nodes_[nodes_[node].children[c]].segment == segment)
+                    child = nodes_[node].children[c];
+            }
+
+            if (child < 0) {
+                Node n;
+                n.segment = segment;
+                nodes_.push_back(n);
+                child = (int)nodes_.size() - 1;
+                nodes_[node].children.push_back(child);
+            }
+
+            node = child;
+            start = end + 1;
+        }
+
+        nodes_[node].methods.push_back(m);
+    }
+
+    for (size_t n = 0; n < nodes_.size(); n++) {
+        sort(nodes_[n].children.begin(), nodes_[n].children.end(), [this](int a, int b) {
+            return nodes_[a].segment < nodes_[b].segment;
+        });
+    }
+}
+
+int OscControlServer::childNamed(const Node &node, const char *segment) {
+
+    int lo = 0;
+    int hi = (int)node.children.size() - 1;
+
+    while (lo <= hi) {
+
+        int mid = (lo + hi) / 2;
+        int c = strcmp(nodes_[node.children[mid]].segment.c_str(), segment);
+
+        if (c == 0)
+            return node.children[mid];
+        else if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
+bool OscControlServer::isPattern(const char *segment) {
+
+    return strpbrk(segment, "*?[{") != NULL;
+}
+
+/* OSC 1.0 pattern matching within one address segment */
+bool OscControlServer::patternMatch(const char *pattern, const char *segment) {
+
+    const char *s = segment;
+
+    while (*pattern) {
+
+        switch (*pattern) {
+
+            case '*':
+                while (*pattern == '*')
+                    pattern++;
+                if (!*pattern)
+                    return true;
+                for (;; s++) {
+                    if (patternMatch(pattern, s))
+                        return true;
+                    if (!*s)
+                        return false;
+                }
+
+            case '?':
+                if (!*s)
+                    return false;
+                pattern++;
+                s++;
+                break;
+
+            case '[': {
+                if (!*s)
+                    return false;
+
+                pattern++;
+                bool negate = *pattern == '!';
+                if (negate)
+                    pattern++;
+
+                bool matched = false;
+                while (*pattern && *pattern != ']') {
+                    if (pattern[1] == '-' && pattern[2] && pattern[2] != ']') {
+                        if (*s >= pattern[0] && *s <= pattern[2])
+                            matched = true;
+                        pattern += 3;
+                    }
+                    else {
+                        if (*s == *pattern)
+                            matched = true;
+                        pattern++;
+                    }
+                }
+
+                if (*pattern != ']' || matched == negate)
+                    return false;
+
+                pattern++;
+                s++;
+                break;
+            }
+
+            case '{': {
+                const char *close = strchr(pattern, '}');
+                if (!close)
+                    return false;
+
+                const char *option = pattern + 1;
+                while (option <= close) {
+                    const char *end = option;
+                    while (end < close && *end != ',')
+                        end++;
+                    size_t length = end - option;
+                    if (!strncmp(option, s, length) && patternMatch(close + 1, s + length))
+                        return true;
+                    option = end + 1;
+                }
+                return false;
+            }
+
+            default:
+                if (*pattern != *s)
+                    return false;
+                pattern++;
+                s++;
+        }
+    }
+
+    return *s == '\0';
+}
+
+#pragma mark - Dispatch
+
+int OscControlServer::dispatch(const char *path, const char *types, lo_arg **argv, int argc, lo_address source) {
+
+    /* Split a copy of the address into segments */
+    char buffer[256];
+    char *segments[OSC_CONTROL_MAX_DEPTH];
+    int nSegments = 0;
+
+    if (path[0] != '/' || strlen(path) >= sizeof(buffer)) {
+        sendError(path, source);
+        return 0;
+    }
+
+    strcpy(buffer, path);
+
+    for (char *p = buffer; *p == '/'; ) {
+
+        if (nSegments == OSC_CONTROL_MAX_DEPTH) {
+            sendError(path, source);
+            return 0;
+        }
+
+        *p++ = '\0';
+        segments[nSegments++] = p;
+        while (*p && *p != '/')
+            p++;
+    }
+
+    bool failed = false;
+    int nRun = matchNode(0, segments, 0, nSegments, types ? types : "", argv, argc, source, &failed);
+
+    if (nRun == 0 || failed)
+        sendError(path, source);
+
+    return nRun;
+}
+
+int OscControlServer::matchNode(int node, char **segments, int depth, int nSegments, const char *types,
+                                lo_arg **argv, int argc, lo_address source, bool *failed) {
+
+    const Node &n = nodes_[node];
+
+    /* End of the address: run the first method that accepts the arguments */
+    if (depth == nSegments) {
+
+        for (size_t i = 0; i < n.methods.size(); i++) {
+            const Method &method = methods_[n.methods[i]];
+            if (method.anyTypes || method.types == types) {
+                if (!callMethod(method, types, argv, argc, source))
+                    *failed = true;
+                return 1;
+            }
+        }
+
+        if (!n.methods.empty())
+            *failed = true;
+
+        return 0;
+    }
+
+    const char *segment = segments[depth];
+    int nRun = 0;
+
+    if (isPattern(segment)) {
+        for (size_t c = 0; c < n.children.size(); c++) {
+            if (patternMatch(segment, nodes_[n.children[c]].segment.c_str()))
+                nRun += matchNode(n.children[c], segments, depth + 1, nSegments, types, argv, argc, source, failed);
+        }
+    }
+    else {
+        int child = childNamed(n, segment);
+        if (child >= 0)
+            nRun += matchNode(child, segments, depth + 1, nSegments, types, argv, argc, source, failed);
+    }
+
+    return nRun;
+}
+
+bool OscControlServer::callMethod(const Method &method, const char *types, lo_arg **argv, int argc, lo_address source) {
+
+    lo_message reply = lo_message_new();
+    bool ok = method.handler(method.context, method.method, types, argv, argc, reply);
+
+    if (ok && source && server_ && lo_message_get_argc(reply) > 0)
+        lo_send_message_from(source, server_, method.address.c_str(), reply);
+
+    lo_message_free(reply);
+    return ok;
+}
+
+void OscControlServer::sendError(const char *path, lo_address source) {
+
+    printf("%s: Can't handle %s\n", __PRETTY_FUNCTION__, path);
+
+    if (source && server_)
+        lo_send_from(source, server_, LO_TT_IMMEDIATE, (root_ + "/error").c_str(), "s", path);
+}
+
+#pragma mark - Server thread
+
+bool OscControlServer::start(const char *port) {
+
+    stop();
+    compile();
+
+    server_ = lo_server_new(port, serverError);
+    if (!server_) {
+        printf("%s: Can't listen on port %s\n", __PRETTY_FUNCTION__, port);
+        return false;
+    }
+
+    /* One catch-all liblo method; our own trie does the dispatch */
+    lo_server_add_method(server_, NULL, NULL, staticMessage, this);
+
+    shouldStop_ = false;
+
+    if (pthread_create(&thread_, NULL, staticServe, (void *)this) != 0) {
+        printf("%s: Error creating server thread\n", __PRETTY_FUNCTION__);
+        lo_server_free(server_);
+        server_ = NULL;
+        return false;
+    }
+
+    running_ = true;
+    printf("Listening for control messages on port %s\n", port);
+
+    return true;
+}
+
+void OscControlServer::stop() {
+
+    if (!running_)
+        return;
+
+    shouldStop_ = true;
+    pthread_join(thread_, NULL);
+
+    lo_server_free(server_);
+    server_ = NULL;
+    running_ = false;
+}
+
+void *OscControlServer::serve() {
+
+    while (!shouldStop_)
+        lo_server_recv_noblock(server_, OSC_CONTROL_POLL_MS);
+
+    return 0;
+}
+
+int OscControlServer::staticMessage(const char *path, const char *types, lo_arg **argv, int argc,
+                                    lo_message message, void *context) {
+
+    ((OscControlServer *)context)->dispatch(path, types, argv, argc, lo_message_get_source(message));
+    return 0;
+}
+
+void OscControlServer::serverError(int number, const char *message, const char *where) {
+
+    printf("OscControlServer: liblo error %d in %s: %s\n", number, where ? where : "?", message);
+}
@@ -0,0 +1,104 @@
+//
+//  OscControlServer.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Receives OSC control messages on its own thread and dispatches them to handlers. Method
+//  addresses are registered under a root ("/kinectosc") before the server starts and compiled
+//  into a trie of address segments, with each node's children sorted so a plain segment is a
+//  binary search. Incoming addresses may use OSC patterns (? * [a-z] [!a] {foo,bar}), which
+//  are matched segment by segment against the children at that level, so
+//  "/kinectosc/query/*" reaches every query method.
+//
+//  A handler may add arguments to the reply message; a non-empty reply is sent back to the
+//  sender at the method's address. A failed handler or an argument list no method accepts
+//  gets "<root>/error" with the requested address.
+
+#ifndef __KinectOSC__OscControlServer__
+#define __KinectOSC__OscControlServer__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+
+#include "lo/lo.h"
+
+using namespace std;
+
+#define OSC_CONTROL_MAX_DEPTH 8         // Address segments, including the root
+#define OSC_CONTROL_POLL_MS 100         // Longest the server thread waits before checking for stop
+
+class OscControlServer {
+
+public:
+
+    typedef bool (*Handler)(void *context, int method, const char *types, lo_arg **argv, int argc,
+                            lo_message reply);
+
+    OscControlServer(const char *root);
+    ~OscControlServer();
+
+    /* Register a method at root + address. A NULL typespec accepts any arguments; an address
+       may be registered more than once with different typespecs. Only before start(). */
+    bool addMethod(const char *address, const char *types, Handler handler, void *context, int method);
+
+    bool start(const char *port);
+    void stop();
+    bool isRunning() { return running_; }
+
+    /* Dispatch one message as if received; source may be NULL to discard replies. Returns
+       the number of handlers that ran. Called by the server thread. */
+    int dispatch(const char *path, const char *types, lo_arg **argv, int argc, lo_address source);
+
+private:
+
+    struct Method {
+        string address;
+        string types;
+        bool anyTypes;
+        Handler handler;
+        void *context;
+        int method;
+    };
+
+    struct Node {
+        string segment;
+        vector<int> children;           // Node indices, sorted by segment
+        vector<int> methods;            // Indices into methods_
+    };
+
+    void compile();
+    int childNamed(const Node &node, const char *segment);
+    int matchNode(int node, char **segments, int depth, int nSegments, const char *types,
+                  lo_arg **argv, int argc, lo_address source, bool *rejected);
+    bool callMethod(const Method &method, const char *types, lo_arg **argv, int argc, lo_address source);
+    void sendError(const char *path, lo_address source);
+
+    static bool patternMatch(const char *pattern, const char *segment);
+    static bool isPattern(const char *segment);
+
+    void *serve();
+    static void *staticServe(void *arg) {
+        return ((OscControlServer *)arg)->serve();
+    }
+
+    static int staticMessage(const char *path, const char *types, lo_arg **argv, int argc,
+                             lo_message message, void *context);
+    static void serverError(int number, const char *message, const char *where);
+
+private:
+
+    string root_;
+    vector<Method> methods_;
+    vector<Node> nodes_;                // Node 0 is the empty segment before the root
+
+    lo_server server_;
+    pthread_t thread_;
+    atomic<bool> running_;
+    atomic<bool> shouldStop_;
+};
+
+#endif /* defined(__KinectOSC__OscControlServer__) */
@@ -7,14 +7,74 @@
 //
 
 #include "OscController.h"
+#include "Utility.h"
 
-void OscController::setServerAddress(const char *host, const char *port) {
+OscController::OscController() {
     
-    if (hasAddress_)
+    serverAddress_ = NULL;
+    pendingAddress_ = NULL;
+    doLog_ = false;
+    useTimetags_ = false;
+    frameTag_ = LO_TT_IMMEDIATE;
+    callback_ = NULL;
+    callbackContext_ = NULL;
+}
+
+OscController::~OscController() {
+    
+    if (serverAddress_)
         lo_address_free(serverAddress_);
-        
-    serverAddress_ = lo_address_new(host, port);
-    hasAddress_ = true;   
+    
+    lo_address pending = pendingAddress_.exchange(NULL);
+    if (pending)
+        lo_address_free(pending);
+}
+
+void OscController::setServerAddress(const char *host, const char *port) {
+    
+    /* Hand the new address to the sender; an address it never picked up can be freed here */
+    lo_address previous = pendingAddress_.exchange(lo_address_new(host, port));
+    
+    if (previous)
+        lo_address_free(previous);
+}
+
+/* Current address, switching to a pending one first */
+lo_address OscController::address() {
+    
+    lo_address pending = pendingAddress_.exchange(NULL);
+    
+    if (pending) {
+        if (serverAddress_)
+            lo_address_free(serverAddress_);
+        serverAddress_ = pending;
+    }
+    
+    return serverAddress_;
+}
+
+/* Convert from the monotonic host clock to an NTP timetag by way of the current wall time */
+void OscController::setFrameTime(uint64_t hostTime) {
+    
+    lo_timetag now;
+    lo_timetag_now(&now);
+    int64_t age = (int64_t)(hostTimeMicros() - hostTime);
+    
+    /* Timetag fractions are 2^-32 s */
+    int64_t frac = (int64_t)now.frac - (int64_t)((double)age * 4294.967296);
+    int64_t sec = (int64_t)now.sec;
+    
+    while (frac < 0) {
+        frac += 4294967296LL;
+        sec--;
+    }
+    while (frac >= 4294967296LL) {
+        frac -= 4294967296LL;
+        sec++;
+    }
+    
+    frameTag_.sec = (uint32_t)sec;
+    frameTag_.frac = (uint32_t)frac;
 }
 
 void OscController::sendMessage(const char *path) {
@@ -22,7 +82,16 @@ void OscController::sendMessage(const char *path) {
     if (doLog_)
         printf("OSC: %s\n", path);
     
-    lo_send(serverAddress_, path, NULL);
+    if (callback_) {
+        lo_message msg = lo_message_new();
+        callback_(callbackContext_, path, "", msg);
+        lo_message_free(msg);
+        return;
+    }
+    
+    lo_address target = address();
+    if (target)
+        lo_send(target, path, NULL);
 }
 
 void OscController::sendMessage(const char *path, const char *types, ...) {
@@ -61,5 +130,42 @@ void OscController::sendMessage(const char *path, const char *types, ...) {
 
 void OscController::sendMessage(const char *path, const char *types, const lo_message &message) {
     
-    lo_send_message(serverAddress_, path, message);
-}
\ No newline at end of file
+    if (callback_) {
+        callback_(callbackContext_, path, types, message);
+        return;
+    }
+    
+    lo_address target = address();
+    if (!target)
+        return;
+    
+    if (useTimetags_) {
+        lo_bundle bundle = lo_bundle_new(frameTag_);
+        lo_bundle_add_message(bundle, path, message);
+        lo_send_bundle(target, bundle);
+        lo_bundle_free(bundle);
+    }
+    else
+        lo_send_message(target, path, message);
+}
+
+void OscController::sendBundle(const char *const *paths, const char *const *types, const lo_message *messages,
+                               int count) {
+    
+    if (callback_) {
+        for (int i = 0; i < count; i++)
+            callback_(callbackContext_, paths[i], types[i], messages[i]);
+        return;
+    }
+    
+    lo_address target = address();
+    if (!target || count == 0)
+        return;
+    
+    lo_bundle bundle = lo_bundle_new(LO_TT_IMMEDIATE);
+    for (int i = 0; i < count; i++)
+        lo_bundle_add_message(bundle, paths[i], messages[i]);
+    
+    lo_send_bundle(target, bundle);
+    lo_bundle_free(bundle);
+}
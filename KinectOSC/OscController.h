@@ -11,6 +11,8 @@
 
 #include <iostream>
 #include <vector>
+#include <atomic>
+#include <stdint.h>
 
 #include "lo/lo.h"
 
@@ -18,22 +20,52 @@ class OscController {
     
 public:
     
-    OscController() { hasAddress_ = false; }
-    ~OscController() {}
+    typedef void (*MessageCallback)(void *context, const char *path, const char *types, lo_message message);
+    
+    OscController();
+    ~OscController();
 
+    /* Safe to call while another thread is sending; the sender switches to the new address
+       before its next message and frees the old one itself. */
     void setServerAddress(const char *host, const char *port);
     void enableLogging()  { doLog_ = true; }
     void disableLogging() { doLog_ = false; }
     
+    /* While timetags are enabled, each message is sent in a bundle stamped with the time
+       last given to setFrameTime() (host clock, us), so receivers can schedule by capture
+       time instead of arrival. setFrameTime() is called by the sending thread. */
+    void enableTimetags()  { useTimetags_ = true; }
+    void disableTimetags() { useTimetags_ = false; }
+    void setFrameTime(uint64_t hostTime);
+    
+    /* Hand every message to a callback instead of sending it, for offline analysis and
+       tests. Set before the sending thread starts; NULL sends to the server again. */
+    void setMessageCallback(MessageCallback callback, void *context) {
+        callback_ = callback;
+        callbackContext_ = context;
+    }
+    
     void sendMessage(const char *path);
     void sendMessage(const char *path, const char *types, ...);
     void sendMessage(const char *path, const char *types, const lo_message &message);
     
+    /* Several messages in one immediate bundle, whether or not timetags are enabled. With a
+       callback set, each is handed to it in turn. */
+    void sendBundle(const char *const *paths, const char *const *types, const lo_message *messages, int count);
+    
+private:
+    
+    lo_address address();
+    
 private:
     
-    lo_address serverAddress_;
-    bool hasAddress_;
-    bool doLog_;
+    lo_address serverAddress_;              // Owned by the sending thread
+    std::atomic<lo_address> pendingAddress_;
+    std::atomic<bool> doLog_;
+    std::atomic<bool> useTimetags_;
+    lo_timetag frameTag_;                   // Owned by the sending thread
+    MessageCallback callback_;
+    void *callbackContext_;
 };
 
 #endif /* defined(__KinectOSC__OscController__) */
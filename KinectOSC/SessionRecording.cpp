@@ -0,0 +1,876 @@
+//
+//  SessionRecording.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "SessionRecording.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+/* File layout: magic, keyframe interval (u32), then records of [type (u8)][length (u32)]
+   [payload]. A GOP record (first timestamp, u64) starts each GOP; frame records are the
+   serialized skeleton with a u16 length, then flags (u8), depth width and height (u16)
+   and the compressed depth. Closing writes an index record of (timestamp, offset) pairs
+   for the GOPs and a trailer pointing at it. */
+static const char kSessionMagic[8] = {'K', 'O', 'S', 'C', 'S', 'E', 'S', '2'};
+static const char kIndexMagic[8] = {'K', 'O', 'S', 'C', 'I', 'D', 'X', '1'};
+
+#define SESSION_HEADER_BYTES 12
+#define SESSION_TRAILER_BYTES 16
+#define SESSION_RECORD_HEADER_BYTES 5
+
+enum {
+    SESSION_RECORD_GOP = 1,
+    SESSION_RECORD_FRAME,
+    SESSION_RECORD_INDEX
+};
+
+/* Frame record flags */
+#define SESSION_FRAME_DEPTH 0x01
+#define SESSION_FRAME_KEYFRAME 0x02
+
+#define SESSION_FRAME_HEADER_BYTES 5    // Flags, width, height
+
+#pragma mark - SessionRecorder
+
+SessionRecorder::SessionRecorder() {
+
+    file_ = NULL;
+    offset_ = 0;
+    keyframeInterval_ = SESSION_KEYFRAME_INTERVAL;
+    open_ = false;
+    closing_ = false;
+    head_ = 0;
+    count_ = 0;
+    gopFrames_ = 0;
+    writeFailed_ = false;
+    memset(&stats_, 0, sizeof(stats_));
+
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&queued_, NULL);
+}
+
+SessionRecorder::~SessionRecorder() {
+
+    close();
+
+    pthread_cond_destroy(&queued_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool SessionRecorder::open(const char *path, int keyframeInterval) {
+
+    close();
+
+    file_ = fopen(path, "wb");
+    if (!file_) {
+        printf("%s: Can't create \"%s\"\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    keyframeInterval_ = keyframeInterval < 1 ? 1 : keyframeInterval;
+
+    uint32_t interval = (uint32_t)keyframeInterval_;
+    fwrite(kSessionMagic, 1, sizeof(kSessionMagic), file_);
+    fwrite(&interval, 4, 1, file_);
+    offset_ = SESSION_HEADER_BYTES;
+
+    pthread_mutex_lock(&mutex_);
+    head_ = 0;
+    count_ = 0;
+    closing_ = false;
+    memset(&stats_, 0, sizeof(stats_));
+    pthread_mutex_unlock(&mutex_);
+
+    gopFrames_ = 0;
+    writeFailed_ = false;
+    index_.clear();
+
+    /* Room for a full-size frame, so the writer only grows it for larger images */
+    record_.resize(2 + SKELETON_FRAME_MAX_BYTES + SESSION_FRAME_HEADER_BYTES +
+                   DEPTH_CODEC_MAX_BYTES(FRAME_BUFFER_WIDTH, FRAME_BUFFER_HEIGHT));
+
+    if (pthread_create(&thread_, NULL, staticWriter, (void *)this) != 0) {
+        printf("%s: Error creating writer thread\n", __PRETTY_FUNCTION__);
+        fclose(file_);
+        file_ = NULL;
+        return false;
+    }
+
+    open_ = true;
+    return true;
+}
+
+void SessionRecorder::close() {
+
+    if (!open_)
+        return;
+
+    /* Refuse new frames, then let the writer drain the queue */
+    pthread_mutex_lock(&mutex_);
+    open_ = false;
+    closing_ = true;
+    pthread_cond_signal(&queued_);
+    pthread_mutex_unlock(&mutex_);
+
+    pthread_join(thread_, NULL);
+
+    if (!writeFailed_) {
+
+        uint64_t indexOffset = offset_;
+        vector<uint8_t> index(index_.size() * 16);
+
+        for (size_t i = 0; i < index_.size(); i++) {
+            memcpy(&index[i * 16], &index_[i].timestamp, 8);
+            memcpy(&index[i * 16 + 8], &index_[i].offset, 8);
+        }
+
+        if (writeRecord(SESSION_RECORD_INDEX, index.empty() ? NULL : &index[0], (uint32_t)index.size())) {
+            fwrite(&indexOffset, 8, 1, file_);
+            fwrite(kIndexMagic, 1, sizeof(kIndexMagic), file_);
+        }
+    }
+
+    fclose(file_);
+    file_ = NULL;
+
+    Stats s = stats();
+    if (s.compressedDepthBytes)
+        printf("Recorded %d frames (%d dropped), depth compressed %.1f:1\n", s.nFrames, s.nDropped,
+               (double)s.rawDepthBytes / s.compressedDepthBytes);
+    else
+        printf("Recorded %d frames (%d dropped)\n", s.nFrames, s.nDropped);
+}
+
+bool SessionRecorder::writeFrame(const SkeletonFrame *frame, FrameBuffer depth) {
+
+    if (!open_)
+        return false;
+
+    pthread_mutex_lock(&mutex_);
+
+    if (closing_) {
+        pthread_mutex_unlock(&mutex_);
+        return false;
+    }
+
+    /* The writer is behind; drop this frame rather than wait */
+    if (count_ == SESSION_QUEUE_FRAMES) {
+        stats_.nDropped++;
+        pthread_mutex_unlock(&mutex_);
+        return false;
+    }
+
+    Job &job = queue_[(head_ + count_) % SESSION_QUEUE_FRAMES];
+    job.frame = *frame;
+    job.depth = std::move(depth);
+    count_++;
+
+    pthread_cond_signal(&queued_);
+    pthread_mutex_unlock(&mutex_);
+
+    return true;
+}
+
+SessionRecorder::Stats SessionRecorder::stats() {
+
+    pthread_mutex_lock(&mutex_);
+    Stats s = stats_;
+    pthread_mutex_unlock(&mutex_);
+
+    return s;
+}
+
+void *SessionRecorder::writer() {
+
+    pthread_mutex_lock(&mutex_);
+
+    while (true) {
+
+        while (count_ == 0 && !closing_)
+            pthread_cond_wait(&queued_, &mutex_);
+
+        if (count_ == 0)
+            break;
+
+        /* The head job stays put until it's popped, so it can be written unlocked */
+        Job *job = &queue_[head_];
+        pthread_mutex_unlock(&mutex_);
+
+        writeJob(job);
+        job->depth.release();
+
+        pthread_mutex_lock(&mutex_);
+        head_ = (head_ + 1) % SESSION_QUEUE_FRAMES;
+        count_--;
+    }
+
+    pthread_mutex_unlock(&mutex_);
+    prevDepth_.release();
+
+    return 0;
+}
+
+void SessionRecorder::writeJob(Job *job) {
+
+    if (writeFailed_)
+        return;
+
+    /* A frame that can't be serialized is dropped before it can open a GOP, so every
+       indexed GOP has at least one frame */
+    int skeletonLength = serializeFrame(&job->frame, &record_[2], SKELETON_FRAME_MAX_BYTES);
+    if (skeletonLength < 0) {
+        pthread_mutex_lock(&mutex_);
+        stats_.nDropped++;
+        pthread_mutex_unlock(&mutex_);
+        return;
+    }
+
+    /* Start a new GOP; its first depth image is a keyframe */
+    if (gopFrames_ == 0 || gopFrames_ >= keyframeInterval_) {
+
+        GopEntry entry = {job->frame.timestamp, offset_};
+        index_.push_back(entry);
+
+        writeRecord(SESSION_RECORD_GOP, (const uint8_t *)&entry.timestamp, 8);
+        gopFrames_ = 0;
+        prevDepth_.release();
+    }
+
+    gopFrames_++;
+
+    uint16_t length16 = (uint16_t)skeletonLength;
+    memcpy(&record_[0], &length16, 2);
+    size_t pos = 2 + skeletonLength;
+
+    FrameBuffer &depth = job->depth;
+    uint8_t flags = 0;
+    uint16_t width = (uint16_t)depth.width();
+    uint16_t height = (uint16_t)depth.height();
+    int nCompressed = 0;
+    uint64_t encodeNanos = 0;
+
+    if (depth.isValid()) {
+
+        bool keyframe = !prevDepth_.isValid() || prevDepth_.width() != width || prevDepth_.height() != height;
+
+        size_t needed = pos + SESSION_FRAME_HEADER_BYTES + DEPTH_CODEC_MAX_BYTES(width, height);
+        if (record_.size() < needed)
+            record_.resize(needed);
+
+        uint64_t start = hostTimeNanos();
+        nCompressed = codec_.encode(depth.data(), keyframe ? NULL : prevDepth_.data(), width, height, depth.stride(),
+                                    &record_[pos + SESSION_FRAME_HEADER_BYTES],
+                                    (int)(record_.size() - pos - SESSION_FRAME_HEADER_BYTES));
+        encodeNanos = hostTimeNanos() - start;
+
+        if (nCompressed >= 0) {
+            flags = SESSION_FRAME_DEPTH | (keyframe ? SESSION_FRAME_KEYFRAME : 0);
+            prevDepth_ = std::move(depth);
+        }
+        else
+            nCompressed = 0;
+    }
+
+    record_[pos] = flags;
+    memcpy(&record_[pos + 1], &width, 2);
+    memcpy(&record_[pos + 3], &height, 2);
+    pos += SESSION_FRAME_HEADER_BYTES + nCompressed;
+
+    writeRecord(SESSION_RECORD_FRAME, &record_[0], (uint32_t)pos);
+
+    pthread_mutex_lock(&mutex_);
+    stats_.nFrames++;
+    if (flags & SESSION_FRAME_DEPTH) {
+        stats_.nDepthFrames++;
+        stats_.rawDepthBytes += (uint64_t)width * height * sizeof(uint16_t);
+        stats_.compressedDepthBytes += nCompressed;
+        stats_.encodeNanos += encodeNanos;
+    }
+    pthread_mutex_unlock(&mutex_);
+}
+
+bool SessionRecorder::writeRecord(uint8_t type, const uint8_t *payload, uint32_t length) {
+
+    if (writeFailed_)
+        return false;
+
+    if (fwrite(&type, 1, 1, file_) != 1 || fwrite(&length, 4, 1, file_) != 1 ||
+        (length && fwrite(payload, 1, length, file_) != length)) {
+        printf("%s: Write failed; the rest of the session is lost\n", __PRETTY_FUNCTION__);
+        writeFailed_ = true;
+        return false;
+    }
+
+    offset_ += SESSION_RECORD_HEADER_BYTES + length;
+    return true;
+}
+
+#pragma mark - SessionPlayer
+
+SessionPlayer::SessionPlayer() {
+
+    fd_ = -1;
+    keyframeInterval_ = SESSION_KEYFRAME_INTERVAL;
+    pool_ = NULL;
+    slots_ = NULL;
+    nSlots_ = SESSION_READ_AHEAD + 1;
+    shouldStop_ = false;
+    woken_ = false;
+    playGop_ = 0;
+    playFrame_ = 0;
+    seekTimestamp_ = 0;
+    nSeeks_ = 0;
+    realtime_ = false;
+    loop_ = false;
+    decodeImages_ = true;
+    firstTimestamp_ = 0;
+    startTime_ = 0;
+
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&changed_, NULL);
+}
+
+SessionPlayer::~SessionPlayer() {
+
+    close();
+
+    pthread_cond_destroy(&changed_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool SessionPlayer::open(const char *path, int nThreads) {
+
+    close();
+
+    fd_ = ::open(path, O_RDONLY);
+    if (fd_ < 0) {
+        printf("%s: Can't open \"%s\"\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    uint8_t header[SESSION_HEADER_BYTES];
+    off_t fileSize = lseek(fd_, 0, SEEK_END);
+    uint32_t interval = 0;
+
+    if (pread(fd_, header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        memcmp(header, kSessionMagic, sizeof(kSessionMagic)) == 0)
+        memcpy(&interval, header + 8, 4);
+
+    if (interval < 1 || interval > 3600) {
+        printf("%s: \"%s\" is not a session recording\n", __PRETTY_FUNCTION__, path);
+        close();
+        return false;
+    }
+
+    keyframeInterval_ = (int)interval;
+
+    /* A session cut short has no index; find its GOPs the slow way */
+    if (!readIndex(fileSize)) {
+        printf("%s: \"%s\" has no index, scanning\n", __PRETTY_FUNCTION__, path);
+        scanGops(fileSize);
+    }
+
+    if (gops_.empty()) {
+        printf("%s: \"%s\" has no frames\n", __PRETTY_FUNCTION__, path);
+        close();
+        return false;
+    }
+
+    /* Every slot's images, plus a few held by whoever is reading */
+    pool_ = new FrameBufferPool(nSlots_ * keyframeInterval_ + 4);
+
+    slots_ = new Slot[nSlots_];
+    for (int i = 0; i < nSlots_; i++) {
+        slots_[i].gop = -1;
+        slots_[i].ready = false;
+        slots_[i].busy = false;
+        slots_[i].nFrames = 0;
+        slots_[i].frames.resize(keyframeInterval_);
+        slots_[i].depth.resize(keyframeInterval_);
+    }
+
+    shouldStop_ = false;
+    woken_ = false;
+    playGop_ = 0;
+    playFrame_ = 0;
+    seekTimestamp_ = 0;
+    startTime_ = 0;
+
+    if (nThreads < 1)
+        nThreads = 1;
+    if (nThreads > SESSION_MAX_DECODE_THREADS)
+        nThreads = SESSION_MAX_DECODE_THREADS;
+
+    for (int i = 0; i < nThreads; i++) {
+
+        Worker *worker = new Worker;
+        worker->owner = this;
+
+        if (pthread_create(&worker->thread, NULL, staticDecodeWorker, (void *)worker) != 0) {
+            printf("%s: Error creating decoding thread\n", __PRETTY_FUNCTION__);
+            delete worker;
+            break;
+        }
+        workers_.push_back(worker);
+    }
+
+    if (workers_.empty()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool SessionPlayer::isSessionFile(const char *path) {
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    char magic[sizeof(kSessionMagic)];
+    bool isSession = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                     memcmp(magic, kSessionMagic, sizeof(magic)) == 0;
+
+    fclose(file);
+    return isSession;
+}
+
+void SessionPlayer::close() {
+
+    pthread_mutex_lock(&mutex_);
+    shouldStop_ = true;
+    pthread_cond_broadcast(&changed_);
+    pthread_mutex_unlock(&mutex_);
+
+    for (size_t i = 0; i < workers_.size(); i++) {
+        pthread_join(workers_[i]->thread, NULL);
+        delete workers_[i];
+    }
+    workers_.clear();
+
+    /* Images go back to the pool before it's freed */
+    depth_.release();
+    delete[] slots_;
+    slots_ = NULL;
+    delete pool_;
+    pool_ = NULL;
+
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    gops_.clear();
+}
+
+/* GOPs from the index the recorder writes on closing */
+bool SessionPlayer::readIndex(uint64_t fileSize) {
+
+    uint8_t trailer[SESSION_TRAILER_BYTES];
+    uint64_t indexOffset;
+    uint8_t recordHeader[SESSION_RECORD_HEADER_BYTES];
+    uint32_t length;
+
+    if (fileSize < SESSION_HEADER_BYTES + SESSION_RECORD_HEADER_BYTES + SESSION_TRAILER_BYTES)
+        return false;
+    if (pread(fd_, trailer, sizeof(trailer), fileSize - sizeof(trailer)) != (ssize_t)sizeof(trailer) ||
+        memcmp(trailer + 8, kIndexMagic, sizeof(kIndexMagic)) != 0)
+        return false;
+
+    memcpy(&indexOffset, trailer, 8);
+    if (indexOffset < SESSION_HEADER_BYTES || indexOffset + SESSION_RECORD_HEADER_BYTES > fileSize - sizeof(trailer))
+        return false;
+    if (pread(fd_, recordHeader, sizeof(recordHeader), indexOffset) != (ssize_t)sizeof(recordHeader))
+        return false;
+
+    memcpy(&length, recordHeader + 1, 4);
+    if (recordHeader[0] != SESSION_RECORD_INDEX || length % 16 ||
+        indexOffset + SESSION_RECORD_HEADER_BYTES + length != fileSize - sizeof(trailer))
+        return false;
+
+    vector<uint8_t> index(length);
+    if (length && pread(fd_, &index[0], length, indexOffset + SESSION_RECORD_HEADER_BYTES) != (ssize_t)length)
+        return false;
+
+    gops_.resize(length / 16);
+    for (size_t i = 0; i < gops_.size(); i++) {
+        memcpy(&gops_[i].timestamp, &index[i * 16], 8);
+        memcpy(&gops_[i].offset, &index[i * 16 + 8], 8);
+    }
+
+    /* Each GOP runs to the next, the last to the index */
+    for (size_t i = 0; i < gops_.size(); i++) {
+        uint64_t end = i + 1 < gops_.size() ? gops_[i + 1].offset : indexOffset;
+        if (gops_[i].offset < SESSION_HEADER_BYTES || end <= gops_[i].offset) {
+            gops_.clear();
+            return false;
+        }
+        gops_[i].length = end - gops_[i].offset;
+    }
+
+    return true;
+}
+
+/* GOPs from the GOP records, up to the first incomplete record */
+bool SessionPlayer::scanGops(uint64_t fileSize) {
+
+    gops_.clear();
+
+    uint64_t pos = SESSION_HEADER_BYTES;
+    uint8_t recordHeader[SESSION_RECORD_HEADER_BYTES + 8];
+
+    while (pos + SESSION_RECORD_HEADER_BYTES <= fileSize) {
+
+        ssize_t n = pread(fd_, recordHeader, sizeof(recordHeader), pos);
+        if (n < SESSION_RECORD_HEADER_BYTES)
+            break;
+
+        uint32_t length;
+        memcpy(&length, recordHeader + 1, 4);
+        if (pos + SESSION_RECORD_HEADER_BYTES + length > fileSize || recordHeader[0] == SESSION_RECORD_INDEX)
+            break;
+
+        if (recordHeader[0] == SESSION_RECORD_GOP && length == 8 && n == (ssize_t)sizeof(recordHeader)) {
+            Gop gop;
+            memcpy(&gop.timestamp, recordHeader + SESSION_RECORD_HEADER_BYTES, 8);
+            gop.offset = pos;
+            gops_.push_back(gop);
+        }
+
+        pos += SESSION_RECORD_HEADER_BYTES + length;
+    }
+
+    for (size_t i = 0; i < gops_.size(); i++)
+        gops_[i].length = (i + 1 < gops_.size() ? gops_[i + 1].offset : pos) - gops_[i].offset;
+
+    return !gops_.empty();
+}
+
+double SessionPlayer::duration() {
+
+    if (gops_.empty())
+        return 0;
+
+    return (double)(gops_.back().timestamp - gops_.front().timestamp) / 1e6;
+}
+
+void SessionPlayer::seek(double seconds) {
+
+    if (gops_.empty())
+        return;
+
+    uint64_t target = gops_[0].timestamp + (uint64_t)(seconds > 0 ? seconds * 1e6 : 0);
+
+    /* Last GOP starting at or before the target */
+    int gop = 0;
+    while (gop + 1 < (int)gops_.size() && gops_[gop + 1].timestamp <= target)
+        gop++;
+
+    pthread_mutex_lock(&mutex_);
+    playGop_ = gop;
+    playFrame_ = 0;
+    seekTimestamp_ = target;
+    startTime_ = 0;
+    nSeeks_++;
+    pthread_cond_broadcast(&changed_);
+    pthread_mutex_unlock(&mutex_);
+}
+
+void SessionPlayer::wake() {
+
+    pthread_mutex_lock(&mutex_);
+    woken_ = true;
+    pthread_cond_broadcast(&changed_);
+    pthread_mutex_unlock(&mutex_);
+}
+
+bool SessionPlayer::readFrame(SkeletonFrame *frame) {
+
+    if (gops_.empty())
+        return false;
+
+    pthread_mutex_lock(&mutex_);
+
+    while (true) {
+
+        if (woken_) {
+            woken_ = false;
+            pthread_mutex_unlock(&mutex_);
+            return false;
+        }
+
+        if (playGop_ >= (int)gops_.size()) {
+            if (!loop_) {
+                pthread_mutex_unlock(&mutex_);
+                return false;
+            }
+            playGop_ = 0;
+            playFrame_ = 0;
+            startTime_ = 0;
+            pthread_cond_broadcast(&changed_);
+        }
+
+        Slot *slot = NULL;
+        for (int i = 0; i < nSlots_; i++) {
+            if (slots_[i].gop == playGop_)
+                slot = &slots_[i];
+        }
+
+        /* Not decoded yet */
+        if (!slot || (playFrame_ >= slot->nFrames && !slot->ready)) {
+            pthread_cond_wait(&changed_, &mutex_);
+            continue;
+        }
+
+        /* Move on to the next GOP, freeing this one's slot. A seek only skips frames
+           within the GOP it landed in. */
+        if (playFrame_ >= slot->nFrames) {
+            playGop_++;
+            playFrame_ = 0;
+            seekTimestamp_ = 0;
+            pthread_cond_broadcast(&changed_);
+            continue;
+        }
+
+        int index = playFrame_++;
+        if (slot->frames[index].timestamp < seekTimestamp_)
+            continue;
+
+        *frame = slot->frames[index];
+        depth_ = slot->depth[index].share();
+        seekTimestamp_ = 0;
+        break;
+    }
+
+    /* Pace by the recorded sensor timestamps; a wake cuts the wait short */
+    if (realtime_) {
+
+        uint64_t now = hostTimeMicros();
+        if (startTime_ == 0) {
+            startTime_ = now;
+            firstTimestamp_ = frame->timestamp;
+        }
+
+        uint64_t due = startTime_ + (frame->timestamp - firstTimestamp_);
+
+        while (due > now && !woken_) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            uint64_t nanos = deadline.tv_nsec + (due - now) * 1000;
+            deadline.tv_sec += nanos / 1000000000;
+            deadline.tv_nsec = nanos % 1000000000;
+            pthread_cond_timedwait(&changed_, &mutex_, &deadline);
+            now = hostTimeMicros();
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_);
+
+    frame->hostTime = hostTimeMicros();
+    return true;
+}
+
+bool SessionPlayer::readImages(FrameBuffer *depth, FrameBuffer *userMap) {
+
+    if (!depth_.isValid())
+        return false;
+
+    if (depth)
+        *depth = depth_.share();
+    if (userMap)
+        userMap->release();
+
+    return true;
+}
+
+/* Within SESSION_READ_AHEAD GOPs of the play position, wrapping when looping */
+bool SessionPlayer::isWanted(int gop) {
+
+    int nGops = (int)gops_.size();
+    int ahead = gop - playGop_;
+
+    if (ahead < 0 && loop_)
+        ahead += nGops;
+
+    return ahead >= 0 && ahead < nSlots_;
+}
+
+/* The nearest GOP in the window that no slot holds, and a slot to decode it into.
+   Returns -1 if there's nothing to do. */
+int SessionPlayer::nextWanted(int *slot) {
+
+    int nGops = (int)gops_.size();
+
+    for (int ahead = 0; ahead < nSlots_; ahead++) {
+
+        int gop = playGop_ + ahead;
+        if (gop >= nGops) {
+            if (!loop_)
+                return -1;
+            gop %= nGops;
+        }
+
+        bool held = false;
+        int free = -1;
+
+        for (int i = 0; i < nSlots_; i++) {
+            if (slots_[i].gop == gop)
+                held = true;
+            else if (!slots_[i].busy && (slots_[i].gop < 0 || !isWanted(slots_[i].gop)))
+                free = i;
+        }
+
+        if (held)
+            continue;
+        if (free < 0)
+            return -1;
+
+        *slot = free;
+        return gop;
+    }
+
+    return -1;
+}
+
+void *SessionPlayer::decodeWorker(Worker *worker) {
+
+    pthread_mutex_lock(&mutex_);
+
+    while (!shouldStop_) {
+
+        int slotIndex;
+        int gop = nextWanted(&slotIndex);
+
+        if (gop < 0) {
+            pthread_cond_wait(&changed_, &mutex_);
+            continue;
+        }
+
+        /* Claim the slot; readers skip it until it's ready */
+        Slot *slot = &slots_[slotIndex];
+        slot->gop = gop;
+        slot->ready = false;
+        slot->busy = true;
+        slot->nFrames = 0;
+        pthread_mutex_unlock(&mutex_);
+
+        bool decoded = decodeGop(worker, slot);
+
+        pthread_mutex_lock(&mutex_);
+        slot->busy = false;
+        slot->ready = decoded;
+        if (!decoded)
+            slot->gop = -1;
+        pthread_cond_broadcast(&changed_);
+    }
+
+    pthread_mutex_unlock(&mutex_);
+
+    return 0;
+}
+
+/* Decode every frame of the slot's GOP. A depth image that can't be decoded is left out,
+   along with the rest of the GOP's images predicted from it. Returns false if a seek made
+   the GOP unwanted part way through. */
+bool SessionPlayer::decodeGop(Worker *worker, Slot *slot) {
+
+    const Gop &gop = gops_[slot->gop];
+    int nSeeks = nSeeks_;
+
+    for (int i = 0; i < keyframeInterval_; i++)
+        slot->depth[i].release();
+
+    worker->data.resize(gop.length);
+    if (pread(fd_, &worker->data[0], gop.length, gop.offset) != (ssize_t)gop.length) {
+        printf("%s: Can't read GOP %d\n", __PRETTY_FUNCTION__, slot->gop);
+        return true;
+    }
+
+    const uint8_t *data = &worker->data[0];
+    size_t pos = 0;
+    const uint16_t *prev = NULL;
+    int n = 0;
+    int published = 0;
+
+    while (pos + SESSION_RECORD_HEADER_BYTES <= gop.length && n < keyframeInterval_) {
+
+        if (nSeeks_ != nSeeks) {
+            pthread_mutex_lock(&mutex_);
+            bool wanted = isWanted(slot->gop);
+            pthread_mutex_unlock(&mutex_);
+            if (!wanted)
+                return false;
+            nSeeks = nSeeks_;
+        }
+
+        /* Publish the frames so far */
+        if (n > published) {
+            published = n;
+            pthread_mutex_lock(&mutex_);
+            slot->nFrames = n;
+            pthread_cond_broadcast(&changed_);
+            pthread_mutex_unlock(&mutex_);
+        }
+
+        uint8_t type = data[pos];
+        uint32_t length;
+        memcpy(&length, data + pos + 1, 4);
+        pos += SESSION_RECORD_HEADER_BYTES;
+
+        if (pos + length > gop.length)
+            break;
+
+        const uint8_t *record = data + pos;
+        pos += length;
+
+        if (type != SESSION_RECORD_FRAME || length < 2)
+            continue;
+
+        uint16_t skeletonLength;
+        memcpy(&skeletonLength, record, 2);
+        if (length < 2u + skeletonLength + SESSION_FRAME_HEADER_BYTES)
+            continue;
+        if (!deserializeFrame(record + 2, skeletonLength, &slot->frames[n]))
+            continue;
+
+        const uint8_t *image = record + 2 + skeletonLength;
+        uint8_t flags = image[0];
+        uint16_t width, height;
+        memcpy(&width, image + 1, 2);
+        memcpy(&height, image + 3, 2);
+
+        bool keyframe = (flags & SESSION_FRAME_KEYFRAME) != 0;
+
+        if (decodeImages_ && (flags & SESSION_FRAME_DEPTH) && (keyframe || prev)) {
+
+            FrameBuffer depth = pool_->acquire();
+            int nCompressed = (int)(length - 2 - skeletonLength - SESSION_FRAME_HEADER_BYTES);
+            const uint16_t *reference = keyframe ? NULL : prev;
+
+            prev = NULL;
+            if (depth.isValid() && width <= FRAME_BUFFER_WIDTH && height <= FRAME_BUFFER_HEIGHT &&
+                worker->codec.decode(image + SESSION_FRAME_HEADER_BYTES, nCompressed, reference,
+                                     width, height, depth.stride(), depth.data())) {
+                depth.setSize(width, height);
+                depth.setTimestamp(slot->frames[n].timestamp, slot->frames[n].frameIndex);
+                prev = depth.data();
+                slot->depth[n] = std::move(depth);
+            }
+        }
+
+        n++;
+    }
+
+    pthread_mutex_lock(&mutex_);
+    slot->nFrames = n;
+    pthread_mutex_unlock(&mutex_);
+
+    return true;
+}
@@ -0,0 +1,213 @@
+//
+//  SessionRecording.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Sessions: skeleton frames together with their depth images, depth compressed with
+//  DepthCodec. Frames are grouped into GOPs of keyframeInterval frames; the first depth
+//  image of a GOP is coded on its own and the rest against the one before, so any GOP
+//  decodes without the others. A GOP index at the end of the file makes seeking direct.
+//
+//  SessionRecorder takes frames from the tracking thread without waiting on the disk:
+//  they go into a short queue that a writer thread compresses and writes out, and if the
+//  queue is full the frame is dropped and counted. SessionPlayer is a SkeletonSource that
+//  decodes whole GOPs ahead of playback on a pool of worker threads.
+
+#ifndef __KinectOSC__SessionRecording__
+#define __KinectOSC__SessionRecording__
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "SkeletonFrame.h"
+#include "SkeletonSource.h"
+#include "FrameBufferPool.h"
+#include "DepthCodec.h"
+
+#define SESSION_KEYFRAME_INTERVAL 15    // Frames per GOP
+#define SESSION_QUEUE_FRAMES 8          // Frames waiting to be written; keep below NITE_IMAGE_BUFFERS
+#define SESSION_READ_AHEAD 4            // GOPs decoded ahead of playback
+#define SESSION_DECODE_THREADS 2
+#define SESSION_MAX_DECODE_THREADS 8
+
+using namespace std;
+
+class SessionRecorder {
+
+public:
+
+    struct Stats {
+        int nFrames;                    // Written
+        int nDepthFrames;
+        int nDropped;                   // Queue was full, or the frame wouldn't serialize
+        uint64_t rawDepthBytes;
+        uint64_t compressedDepthBytes;
+        uint64_t encodeNanos;           // Writer thread time spent compressing
+    };
+
+    SessionRecorder();
+    ~SessionRecorder();
+
+    bool open(const char *path, int keyframeInterval = SESSION_KEYFRAME_INTERVAL);
+
+    /* Write out whatever is queued, then the index */
+    void close();
+    bool isOpen() { return open_; }
+
+    /* Tracking thread. Queues the frame and its depth image (which may be invalid) for the
+       writer; returns false if the frame was dropped. */
+    bool writeFrame(const SkeletonFrame *frame, FrameBuffer depth);
+
+    Stats stats();
+
+private:
+
+    struct Job {
+        SkeletonFrame frame;
+        FrameBuffer depth;
+    };
+
+    struct GopEntry {
+        uint64_t timestamp;
+        uint64_t offset;
+    };
+
+    void *writer();
+    static void *staticWriter(void *arg) {
+        return ((SessionRecorder *)arg)->writer();
+    }
+
+    void writeJob(Job *job);
+    bool writeRecord(uint8_t type, const uint8_t *payload, uint32_t length);
+
+private:
+
+    FILE *file_;
+    uint64_t offset_;                   // Bytes written so far
+    int keyframeInterval_;
+    atomic<bool> open_;
+
+    pthread_t thread_;
+    pthread_mutex_t mutex_;             // Guards the queue, closing_ and stats_
+    pthread_cond_t queued_;
+    bool closing_;
+    Job queue_[SESSION_QUEUE_FRAMES];
+    int head_;
+    int count_;
+    Stats stats_;
+
+    /* Writer thread */
+    DepthCodec codec_;
+    FrameBuffer prevDepth_;             // Last depth image written in this GOP
+    int gopFrames_;
+    vector<GopEntry> index_;
+    vector<uint8_t> record_;
+    bool writeFailed_;
+};
+
+class SessionPlayer : public SkeletonSource {
+
+public:
+
+    SessionPlayer();
+    ~SessionPlayer();
+
+    /* Index the session and start the decoding threads. Close only once nothing is
+       reading from it, as images it handed out belong to its pool. */
+    bool open(const char *path, int nThreads = SESSION_DECODE_THREADS);
+    void close();
+
+    /* Whether a file starts like a session, without indexing it */
+    static bool isSessionFile(const char *path);
+
+    /* Setters */
+    void setRealtime(bool realtime) { realtime_ = realtime; }   // Pace by recorded timestamps
+    void setLoop(bool loop) { loop_ = loop; }
+    void setDecodeImages(bool decode) { decodeImages_ = decode; }   // Skeletons only if false; set before open()
+
+    /* Continue from the first frame at or after seconds into the session */
+    void seek(double seconds);
+
+    /* Getters */
+    int numGops() { return (int)gops_.size(); }
+    double duration();              // Seconds from the first GOP to the last
+
+    bool readFrame(SkeletonFrame *frame);
+    bool readImages(FrameBuffer *depth, FrameBuffer *userMap);
+    void wake();
+    const char *name() { return "Session"; }
+
+private:
+
+    struct Gop {
+        uint64_t timestamp;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    /* One decoded GOP, or a worker decoding one. Frames can be read as soon as they're
+       decoded, so playback after a seek doesn't wait for the whole GOP. */
+    struct Slot {
+        int gop;                        // -1 if empty
+        bool ready;                     // Completely decoded
+        bool busy;
+        int nFrames;                    // Decoded so far
+        vector<SkeletonFrame> frames;
+        vector<FrameBuffer> depth;      // Invalid where a frame has none
+    };
+
+    struct Worker {
+        SessionPlayer *owner;
+        pthread_t thread;
+        DepthCodec codec;
+        vector<uint8_t> data;
+    };
+
+    bool readIndex(uint64_t fileSize);
+    bool scanGops(uint64_t fileSize);
+
+    void *decodeWorker(Worker *worker);
+    static void *staticDecodeWorker(void *arg) {
+        Worker *worker = (Worker *)arg;
+        return worker->owner->decodeWorker(worker);
+    }
+
+    bool isWanted(int gop);
+    int nextWanted(int *slot);
+    bool decodeGop(Worker *worker, Slot *slot);
+
+private:
+
+    int fd_;
+    int keyframeInterval_;
+    vector<Gop> gops_;
+    FrameBufferPool *pool_;
+
+    vector<Worker *> workers_;
+    Slot *slots_;
+    int nSlots_;
+    pthread_mutex_t mutex_;             // Guards the slots and the play position
+    pthread_cond_t changed_;            // A slot became ready or free, or the position moved
+    bool shouldStop_;
+    bool woken_;
+
+    /* Play position */
+    int playGop_;
+    int playFrame_;
+    uint64_t seekTimestamp_;            // Frames before this are skipped after a seek
+    atomic<int> nSeeks_;                // Lets workers notice a seek mid-GOP
+    FrameBuffer depth_;                 // Of the frame last read
+
+    bool realtime_;
+    bool loop_;
+    bool decodeImages_;
+    uint64_t firstTimestamp_;
+    uint64_t startTime_;
+};
+
+#endif /* defined(__KinectOSC__SessionRecording__) */
@@ -8,38 +8,70 @@
 
 #include "SkeletonController.h"
 
-SkeletonController::SkeletonController() {
-    
-    confThresh_ = 0.6;
-    
-    noteMap_[0] = 52;
-    noteMap_[1] = 55;
-    noteMap_[2] = 57;
-    noteMap_[3] = 59;
-    noteMap_[4] = 62;
-    noteMap_[5] = 64;
-    noteMap_[6] = 67;
-    noteMap_[7] = 69;
-    noteMap_[8] = 71;
-    noteMap_[9] = 74;
-    noteMap_[10] = 76;
-    noteMap_[11] = 79;
-    
-    footRegion_[0] = 0;
-    footRegion_[1] = 0;
+#include <ctype.h>
+#include <strings.h>
+
+SkeletonController::SkeletonController() : controlServer_("/kinectosc") {
+    
+    /* Default configuration: E minor pentatonic from MIDI 52, transmit off until enabled */
+    Config config;
+    memset(&config, 0, sizeof(config));
+    config.confThresh = 0.6;
+    config.stageWidth = 3000;
+    config.voiceTimeoutFrames = 15;
+    config.scale = SCALE_PENTATONIC_MINOR;
+    config.key = KEY_E;
+    config.octave = 4;
+    scales_.build(config.scale, config.key, config.octave, &config.noteMap);
+    
+    configStore_ = new ConfigStore(config);
+    config_ = NULL;
+    configReader_ = -1;
+    addControlMethods();
+    
+    voices_.setNoteCallback(staticVoiceCallback, this);
     
     display_ = NULL;
+    kbDisplay_ = NULL;
+    oscSender_ = NULL;
+    streamingControls_ = false;
+    frameWidth_ = 0;
+    frameHeight_ = 0;
     deviceOpen_ = false;
-    tracking_ = false;
-    userInFrame_ = false;
-    sendOsc_ = false;
+    niteInitialized_ = false;
+    state_ = TRACKING_STOPPED;
+    shouldStop_ = false;
+    pthread_mutex_init(&lifecycleMutex_, NULL);
+    pthread_mutex_init(&stopMutex_, NULL);
+    pthread_cond_init(&stopCond_, NULL);
+    
+    floorCal_ = new FloorCalibration();
+    
+    /* Read from the local device unless another source is set */
+    niteSource_ = new NiteSkeletonSource();
+    niteSource_->setFloorCalibration(floorCal_);
+    source_ = niteSource_;
     
     generateRegionBoundaries();
 }
 
 SkeletonController::~SkeletonController() {
     
-    nite::NiTE::shutdown();
+    /* The control server could otherwise restart tracking once it's been stopped */
+    controlServer_.stop();
+    if (isTracking())
+        stopTracking();
+    
+    /* Queued images belong to the device's pool, as does any the display hasn't drawn */
+    stopRecording();
+    if (display_)
+        display_->setDepth(FrameBuffer());
+    delete niteSource_;
+    configWatcher_.stop();
+    delete floorCal_;
+    delete configStore_;
+    if (niteInitialized_)
+        nite::NiTE::shutdown();
 }
 
 bool SkeletonController::init() {
@@ -56,6 +88,7 @@ bool SkeletonController::init() {
         printf("%s: OpenNI initialization failed\n", __PRETTY_FUNCTION__);
         return false;
     }
+    niteInitialized_ = true;
     
     return true;
 }
@@ -84,155 +117,798 @@ vector<string> SkeletonController::getAvailableDeviceNames() {
 
 bool SkeletonController::openDeviceAtIndex(int idx) {
     
-    if (deviceOpen_) {
-        device_.close();
-//        userTracker_.destroy();
-    }
-    
-    bool rVal = true;
-    openni::Status status;
-    
     /* Get device info for any available devices */
     openni::Array<openni::DeviceInfo> devs;
     openni::OpenNI::enumerateDevices(&devs);
     
-    status = device_.open(devs[idx].getUri());
-    if (status != openni::STATUS_OK) {
-        printf("%s: Failed to open device\n%s\n",
-               __PRETTY_FUNCTION__, openni::OpenNI::getExtendedError());
-        rVal = false;
-    }
-    else {
-        /* Inintialize user tracker */
-        if (userTracker_.create(&device_) != nite::STATUS_OK) {
-            printf("%s: Failed to create user tracker\n", __PRETTY_FUNCTION__);
-            rVal = false;
-        }
-        else
-            deviceOpen_ = true;
+    if (idx < 0 || idx >= devs.getSize()) {
+        printf("%s: No device at index %d\n", __PRETTY_FUNCTION__, idx);
+        return false;
     }
     
-    return rVal;
+    /* Opening closes any previously open device */
+    deviceOpen_ = niteSource_->open(devs[idx].getUri());
+    
+    return deviceOpen_;
 }
 
 void SkeletonController::closeDevice() {
     
     if (deviceOpen_) {
-        device_.close();
+        niteSource_->close();
+        deviceOpen_ = false;
     }
 }
 
+void SkeletonController::setSkeletonSource(SkeletonSource *source) {
+    
+    if (isTracking()) {
+        printf("%s: Can't change source while tracking\n", __PRETTY_FUNCTION__);
+        return;
+    }
+    
+    source_ = source ? source : niteSource_;
+}
+
 bool SkeletonController::beginTracking() {
     
-    /* Make sure a device is open */
-    if (!deviceOpen_) {
+    /* The UI and the control server may both start and stop tracking */
+    pthread_mutex_lock(&lifecycleMutex_);
+    
+    /* Make sure a device is open if we're reading from it */
+    if (source_ == niteSource_ && !deviceOpen_) {
         printf("%s: No device is open\n", __PRETTY_FUNCTION__);
+        pthread_mutex_unlock(&lifecycleMutex_);
         return false;
     }
     
     /* Make sure we're not already tracking */
-    if (tracking_) {
+    if (state_ != TRACKING_STOPPED) {
         printf("%s: Already tracking skeleton\n", __PRETTY_FUNCTION__);
+        pthread_mutex_unlock(&lifecycleMutex_);
         return false;
     }
     
     /* Create the data mutex */
     pthread_mutex_init(&dataMutex_, NULL);
     
+    /* The source may have restarted its clock */
+    clock_.reset();
+    profiler_.reset();
+    
+    /* Estimate the floor from the first frames; regions follow the depth image until then */
+    if (!floorCal_->isCalibrated())
+        floorCal_->beginCalibration();
+    
+    /* Clear the flag before the thread can look at it */
+    shouldStop_ = false;
+    state_ = TRACKING_RUNNING;
+    
     /* Create the thread and set the callback */
     if (pthread_create(&dataThread_, NULL, staticTracSkeleton, (void *)this) != 0) {
         printf("%s: Error setting callback\n", __PRETTY_FUNCTION__);
+        state_ = TRACKING_STOPPED;
+        pthread_mutex_unlock(&lifecycleMutex_);
         return false;
     }
     else
         printf("\nTracking...\n");
     
-    tracking_ = true;
-    shouldStop_ = false;
+    updateControlStream(configStore_->current());
+    pthread_mutex_unlock(&lifecycleMutex_);
     
     return true;
 }
 
 bool SkeletonController::stopTracking() {
     
+    pthread_mutex_lock(&lifecycleMutex_);
+    
     /* Make sure we're actually tracking */
-    if (!tracking_) {
+    if (state_ == TRACKING_STOPPED) {
         printf("%s: Not currently tracking\n", __PRETTY_FUNCTION__);
+        pthread_mutex_unlock(&lifecycleMutex_);
         return false;
     }
-    else {
-        sendAllNotesOff();
-        printf("\nTracking ended\n");
-    }
     
-    /* Set the flag and wait for the tracking loop to finish */
+    state_ = TRACKING_STOPPING;
+    
+    /* Set the flag, then interrupt a read or backoff in progress so the loop sees it now */
+    pthread_mutex_lock(&stopMutex_);
     shouldStop_ = true;
+    pthread_cond_broadcast(&stopCond_);
+    pthread_mutex_unlock(&stopMutex_);
+    source_->wake();
+    
+    /* Wait for the tracking loop to finish before touching the voices it owns */
     pthread_join(dataThread_, NULL);
-    tracking_ = false;
+    controlStream_.stop();
+    
+    voices_.reset();
+    sendAllNotesOff();
+    printf("\nTracking ended\n");
+    
+    state_ = TRACKING_STOPPED;
+    pthread_mutex_unlock(&lifecycleMutex_);
     
     return true;
 }
 
-void SkeletonController::setNoteMap(const char *scale, const char *tonality, const char *key, int octave) {
+/* Sleep for up to ms, returning early (and true) if tracking is stopped */
+bool SkeletonController::waitForStop(int ms) {
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    
+    pthread_mutex_lock(&stopMutex_);
+    while (!shouldStop_) {
+        if (pthread_cond_timedwait(&stopCond_, &stopMutex_, &deadline) != 0)
+            break;
+    }
+    pthread_mutex_unlock(&stopMutex_);
+    
+    return shouldStop_;
+}
+
+/* Frames stopped coming: release held notes, then reconnect with exponential backoff if
+   the source can. Returns when the source is back or tracking is stopped. */
+void SkeletonController::handleStall() {
+    
+    int running = TRACKING_RUNNING;
+    if (state_.compare_exchange_strong(running, TRACKING_STALLED)) {
+        printf("%s: No frames from %s\n", __PRETTY_FUNCTION__, source_->name());
+        voices_.releaseAll();
+    }
+    
+    if (!source_->canReconnect())
+        return;
     
-    vector<int> intervals;
+    int delay = TRACKING_RECONNECT_MIN_MS;
     
-    /* Determine scale intervals for scale and tonality selections */
-    if (!strcmp(scale, "Diatonic")) {
-        if (!strcmp(tonality, "Major")) {
-            intervals = {2, 4, 5, 7, 9, 11, 12, 14, 16, 17, 19};
+    while (!shouldStop_) {
+        
+        if (source_->reconnect()) {
+            printf("%s: Reconnected to %s\n", __PRETTY_FUNCTION__, source_->name());
+            clock_.reset();
+            return;
         }
-        else if (!strcmp(tonality, "Minor")) {
-            intervals = {2, 3, 5, 7, 8, 10, 12, 14, 15, 17, 19};
+        
+        printf("%s: Reconnecting in %d ms\n", __PRETTY_FUNCTION__, delay);
+        if (waitForStop(delay))
+            return;
+        
+        delay *= 2;
+        if (delay > TRACKING_RECONNECT_MAX_MS)
+            delay = TRACKING_RECONNECT_MAX_MS;
+    }
+}
+
+int SkeletonController::processSource(SkeletonSource *source) {
+    
+    pthread_mutex_lock(&lifecycleMutex_);
+    
+    if (state_ != TRACKING_STOPPED) {
+        printf("%s: Can't process a source while tracking\n", __PRETTY_FUNCTION__);
+        pthread_mutex_unlock(&lifecycleMutex_);
+        return -1;
+    }
+    
+    SkeletonSource *previous = source_;
+    source_ = source;
+    configReader_ = configStore_->registerReader();
+    voices_.reset();
+    jointTracker_.reset();
+    featureExtractor_.reset();
+    gestures_.reset();
+    
+    int nFrames = 0;
+    int lastIndex = -1;
+    uint64_t lastTimestamp = 0;
+    
+    while (source_->readFrame(&frame_)) {
+        
+        if (nFrames > 0 && frame_.frameIndex == lastIndex)
+            continue;
+        
+        /* Speeds and note times then come out as recorded, however fast frames are read */
+        memset(&timing_, 0, sizeof(timing_));
+        timing_.sensorTime = frame_.timestamp;
+        timing_.hostTime = frame_.hostTime;
+        timing_.captureTime = frame_.timestamp;
+        timing_.interval = nFrames > 0 ? (frame_.timestamp - lastTimestamp) * 1e-6f : 0;
+        
+        processFrame();
+        
+        lastIndex = frame_.frameIndex;
+        lastTimestamp = frame_.timestamp;
+        nFrames++;
+    }
+    
+    /* Note-offs for whatever is still held, while the configuration is still acquired */
+    if (config_)
+        voices_.releaseAll();
+    
+    configStore_->unregisterReader(configReader_);
+    config_ = NULL;
+    source_ = previous;
+    
+    pthread_mutex_unlock(&lifecycleMutex_);
+    
+    return nFrames;
+}
+
+void SkeletonController::setDisplay(KinectDisplay *display) {
+    
+    display_ = display;
+    niteSource_->setCaptureImages(display_ || recorder_.isOpen());
+}
+
+bool SkeletonController::startRecording(const char *path) {
+    
+    if (!recorder_.open(path))
+        return false;
+    
+    /* Depth images come from the local device; other sources record skeletons only */
+    niteSource_->setCaptureImages(true);
+    printf("Recording to %s\n", path);
+    
+    return true;
+}
+
+void SkeletonController::stopRecording() {
+    
+    niteSource_->setCaptureImages(display_ != NULL);
+    recorder_.close();
+}
+
+bool SkeletonController::writeProfile(const char *path, const char *label) {
+    
+    pthread_mutex_lock(&lifecycleMutex_);
+    
+    if (state_ != TRACKING_STOPPED) {
+        printf("%s: Stop tracking first\n", __PRETTY_FUNCTION__);
+        pthread_mutex_unlock(&lifecycleMutex_);
+        return false;
+    }
+    
+    bool written = profiler_.writeReport(path, label ? label : source_->name());
+    pthread_mutex_unlock(&lifecycleMutex_);
+    
+    return written;
+}
+
+#pragma mark - Configuration
+
+void SkeletonController::setOscSender(OscController *oscSender) {
+    
+    oscSender_ = oscSender;
+    
+    Config config = configStore_->current();
+    if (oscSender_ && config.oscLogging)
+        oscSender_->enableLogging();
+    if (oscSender_ && config.oscTimetags)
+        oscSender_->enableTimetags();
+}
+
+void SkeletonController::setOscTarget(const char *host, const char *port) {
+    
+    Config *config = configStore_->beginUpdate();
+    Config old = *config;
+    
+    snprintf(config->oscHost, sizeof(config->oscHost), "%s", host);
+    snprintf(config->oscPort, sizeof(config->oscPort), "%s", port);
+    Config updated = *config;
+    configStore_->commitUpdate();
+    
+    applyOutputSettings(old, updated);
+}
+
+bool SkeletonController::setNoteMap(const char *scale, const char *tonality, const char *key, int octave) {
+    
+    Config *config = configStore_->beginUpdate();
+    
+    /* The scale library is only touched while holding an update */
+    Tonality t = TONALITY_MAJOR;
+    bool haveTonality = ScaleLibrary::parseTonality(tonality, &t);
+    int scaleIndex, keyIndex;
+    
+    if (!scales_.parseScale(scale, t, &scaleIndex)) {
+        printf("%s: Unrecognized scale \"%s\"\n", __PRETTY_FUNCTION__, scale);
+        configStore_->abortUpdate();
+        return false;
+    }
+    
+    if (!haveTonality && scales_.hasTonality(scaleIndex)) {
+        printf("%s: Unrecognized tonality \"%s\"\n", __PRETTY_FUNCTION__, tonality);
+        configStore_->abortUpdate();
+        return false;
+    }
+    
+    if (!ScaleLibrary::parseKey(key, &keyIndex)) {
+        printf("%s: Unrecognized key \"%s\"\n", __PRETTY_FUNCTION__, key);
+        configStore_->abortUpdate();
+        return false;
+    }
+    
+    if (!scales_.build(scaleIndex, keyIndex, octave, &config->noteMap)) {
+        printf("%s: %s in %s, octave %d is out of range\n", __PRETTY_FUNCTION__, scale, key, octave);
+        configStore_->abortUpdate();
+        return false;
+    }
+    
+    config->scale = scaleIndex;
+    config->key = keyIndex;
+    config->octave = octave;
+    configStore_->commitUpdate();
+    
+    return true;
+}
+
+bool SkeletonController::setNoteMap(int scale, int key, int octave) {
+    
+    Config *config = configStore_->beginUpdate();
+    
+    if (!scales_.build(scale, key, octave, &config->noteMap)) {
+        printf("%s: Scale %d in key %d, octave %d is out of range\n", __PRETTY_FUNCTION__, scale, key, octave);
+        configStore_->abortUpdate();
+        return false;
+    }
+    
+    config->scale = scale;
+    config->key = key;
+    config->octave = octave;
+    configStore_->commitUpdate();
+    
+    return true;
+}
+
+void SkeletonController::setConfidenceThreshold(float threshold) {
+    
+    Config *config = configStore_->beginUpdate();
+    config->confThresh = threshold;
+    configStore_->commitUpdate();
+}
+
+void SkeletonController::setStageWidth(float width) {
+    
+    Config *config = configStore_->beginUpdate();
+    config->stageWidth = width;
+    configStore_->commitUpdate();
+}
+
+void SkeletonController::setVoiceTimeout(int frames) {
+    
+    Config *config = configStore_->beginUpdate();
+    config->voiceTimeoutFrames = frames;
+    configStore_->commitUpdate();
+}
+
+bool SkeletonController::loadScales(const char *path) {
+    
+    configStore_->beginUpdate();
+    int nRead = scales_.loadFile(path);
+    configStore_->abortUpdate();
+    
+    return nRead >= 0;
+}
+
+static bool parseSwitch(const char *value, bool *on) {
+    
+    if (!strcasecmp(value, "on") || !strcasecmp(value, "true") || !strcasecmp(value, "yes") || !strcmp(value, "1"))
+        *on = true;
+    else if (!strcasecmp(value, "off") || !strcasecmp(value, "false") || !strcasecmp(value, "no") || !strcmp(value, "0"))
+        *on = false;
+    else
+        return false;
+    
+    return true;
+}
+
+/* Apply one named parameter to a pending config. Names:
+ 
+       threshold, stage_width, voice_timeout    Tracking
+       scale, key, octave                       Note map ("Diatonic Minor", "F#", 4)
+       transmit, logging, timetags              on/off
+       host, port                               OSC target
+       control_rate                             Mapped values per second (100-500), 0 for once per frame
+       control_predict                          on/off: predict between frames instead of interpolating
+       scales                                   File of user scales to load
+       mappings                                 Mapping description, loaded after publishing
+       gestures                                 Gesture templates, loaded after publishing
+ 
+   Called with the update held. The note map is rebuilt by the caller. */
+bool SkeletonController::applyParameter(Config *config, const char *name, const char *value, string *mappingsPath,
+                                        string *gesturesPath) {
+    
+    char *end;
+    
+    if (!strcasecmp(name, "threshold")) {
+        float threshold = strtof(value, &end);
+        if (*end || end == value || threshold < 0 || threshold > 1)
+            return false;
+        config->confThresh = threshold;
+    }
+    else if (!strcasecmp(name, "stage_width")) {
+        float width = strtof(value, &end);
+        if (*end || end == value || width <= 0)
+            return false;
+        config->stageWidth = width;
+    }
+    else if (!strcasecmp(name, "voice_timeout")) {
+        long frames = strtol(value, &end, 10);
+        if (*end || end == value || frames < 1)
+            return false;
+        config->voiceTimeoutFrames = (int)frames;
+    }
+    else if (!strcasecmp(name, "scale"))
+        return scales_.parseScale(value, TONALITY_MAJOR, &config->scale);
+    else if (!strcasecmp(name, "key"))
+        return ScaleLibrary::parseKey(value, &config->key);
+    else if (!strcasecmp(name, "octave")) {
+        long octave = strtol(value, &end, 10);
+        if (*end || end == value)
+            return false;
+        config->octave = (int)octave;
+    }
+    else if (!strcasecmp(name, "transmit"))
+        return parseSwitch(value, &config->sendOsc);
+    else if (!strcasecmp(name, "logging"))
+        return parseSwitch(value, &config->oscLogging);
+    else if (!strcasecmp(name, "timetags"))
+        return parseSwitch(value, &config->oscTimetags);
+    else if (!strcasecmp(name, "host"))
+        snprintf(config->oscHost, sizeof(config->oscHost), "%s", value);
+    else if (!strcasecmp(name, "port"))
+        snprintf(config->oscPort, sizeof(config->oscPort), "%s", value);
+    else if (!strcasecmp(name, "control_rate")) {
+        long rate = strtol(value, &end, 10);
+        if (*end || end == value || (rate != 0 && (rate < CONTROL_MIN_RATE || rate > CONTROL_MAX_RATE)))
+            return false;
+        config->controlRate = (int)rate;
+    }
+    else if (!strcasecmp(name, "control_predict"))
+        return parseSwitch(value, &config->controlPredict);
+    else if (!strcasecmp(name, "scales"))
+        return scales_.loadFile(value) >= 0;
+    else if (!strcasecmp(name, "mappings"))
+        *mappingsPath = value;
+    else if (!strcasecmp(name, "gestures"))
+        *gesturesPath = value;
+    else
+        return false;
+    
+    return true;
+}
+
+/* Push output settings that changed to the OSC sender */
+void SkeletonController::applyOutputSettings(const Config &old, const Config &updated) {
+    
+    bool targetChanged = strcmp(updated.oscHost, old.oscHost) || strcmp(updated.oscPort, old.oscPort);
+    if (targetChanged && updated.oscHost[0] && updated.oscPort[0])
+        controlStream_.setServerAddress(updated.oscHost, updated.oscPort);
+    
+    if (updated.controlRate != old.controlRate || updated.controlPredict != old.controlPredict) {
+        pthread_mutex_lock(&lifecycleMutex_);
+        updateControlStream(updated);
+        pthread_mutex_unlock(&lifecycleMutex_);
+    }
+    
+    if (!oscSender_)
+        return;
+    
+    if (updated.oscLogging != old.oscLogging) {
+        if (updated.oscLogging)
+            oscSender_->enableLogging();
+        else
+            oscSender_->disableLogging();
+    }
+    
+    if (updated.oscTimetags != old.oscTimetags) {
+        if (updated.oscTimetags)
+            oscSender_->enableTimetags();
+        else
+            oscSender_->disableTimetags();
+    }
+    
+    if (targetChanged && updated.oscHost[0] && updated.oscPort[0])
+        oscSender_->setServerAddress(updated.oscHost, updated.oscPort);
+}
+
+/* Run the output thread while tracking with a control rate, restarted for new settings.
+   Called with lifecycleMutex_ held. */
+void SkeletonController::updateControlStream(const Config &config) {
+    
+    if (state_ != TRACKING_STOPPED && config.controlRate > 0)
+        controlStream_.start(config.controlRate, config.controlPredict);
+    else
+        controlStream_.stop();
+}
+
+bool SkeletonController::setParameter(const char *name, const char *value) {
+    
+    Config *config = configStore_->beginUpdate();
+    Config old = *config;
+    string mappingsPath;
+    string gesturesPath;
+    
+    if (!applyParameter(config, name, value, &mappingsPath, &gesturesPath)) {
+        printf("%s: Bad value \"%s\" for \"%s\"\n", __PRETTY_FUNCTION__, value, name);
+        configStore_->abortUpdate();
+        return false;
+    }
+    
+    if (!scales_.build(config->scale, config->key, config->octave, &config->noteMap)) {
+        printf("%s: Note map out of range\n", __PRETTY_FUNCTION__);
+        configStore_->abortUpdate();
+        return false;
+    }
+    
+    Config updated = *config;
+    configStore_->commitUpdate();
+    applyOutputSettings(old, updated);
+    
+    bool loaded = true;
+    if (!mappingsPath.empty())
+        loaded = mappings_.loadFile(mappingsPath.c_str());
+    if (!gesturesPath.empty())
+        loaded = gestures_.loadFile(gesturesPath.c_str()) && loaded;
+    
+    return loaded;
+}
+
+bool SkeletonController::loadConfigFile(const char *path) {
+    
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("%s: Can't open %s\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+    
+    Config *config = configStore_->beginUpdate();
+    Config old = *config;
+    string mappingsPath;
+    string gesturesPath;
+    bool ok = true;
+    
+    char line[512];
+    int lineNumber = 0;
+    
+    while (fgets(line, sizeof(line), file)) {
+        
+        lineNumber++;
+        
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        
+        /* Trim, and skip blank lines */
+        char *name = line;
+        while (isspace(*name))
+            name++;
+        char *end = name + strlen(name);
+        while (end > name && isspace(end[-1]))
+            *--end = '\0';
+        
+        if (!*name)
+            continue;
+        
+        char *equals = strchr(name, '=');
+        if (!equals) {
+            printf("%s: %s:%d: Expected \"name = value\"\n", __PRETTY_FUNCTION__, path, lineNumber);
+            ok = false;
+            continue;
+        }
+        
+        char *value = equals + 1;
+        while (isspace(*value))
+            value++;
+        *equals = '\0';
+        while (equals > name && isspace(equals[-1]))
+            *--equals = '\0';
+        
+        if (!applyParameter(config, name, value, &mappingsPath, &gesturesPath)) {
+            printf("%s: %s:%d: Bad value \"%s\" for \"%s\"\n", __PRETTY_FUNCTION__, path, lineNumber, value, name);
+            ok = false;
         }
-        else printf("%s: Unrecognized tonality \"%s\"\n", __PRETTY_FUNCTION__, tonality);
     }
-    else if (!strcmp(scale, "Pentatonic")) {
-        if (!strcmp(tonality, "Major")) {
-            intervals = {2, 4, 7, 9, 12, 14, 16, 19, 21, 24, 26};
+    
+    fclose(file);
+    
+    if (ok && !scales_.build(config->scale, config->key, config->octave, &config->noteMap)) {
+        printf("%s: %s: Note map out of range\n", __PRETTY_FUNCTION__, path);
+        ok = false;
+    }
+    
+    if (!ok) {
+        configStore_->abortUpdate();
+        return false;
+    }
+    
+    Config updated = *config;
+    uint64_t version = configStore_->commitUpdate();
+    applyOutputSettings(old, updated);
+    
+    printf("Loaded %s (configuration %llu)\n", path, (unsigned long long)version);
+    
+    bool loaded = true;
+    if (!mappingsPath.empty())
+        loaded = mappings_.loadFile(mappingsPath.c_str());
+    if (!gesturesPath.empty())
+        loaded = gestures_.loadFile(gesturesPath.c_str()) && loaded;
+    
+    return loaded;
+}
+
+bool SkeletonController::watchConfigFile(const char *path) {
+    
+    if (!loadConfigFile(path))
+        return false;
+    
+    return configWatcher_.start(path, staticConfigFileChanged, this);
+}
+
+#pragma mark - Remote control
+
+void SkeletonController::addControlMethods() {
+    
+    controlServer_.addMethod("/start", "", staticControlMessage, this, CONTROL_START);
+    controlServer_.addMethod("/stop", "", staticControlMessage, this, CONTROL_STOP);
+    controlServer_.addMethod("/notemap", "ssi", staticControlMessage, this, CONTROL_NOTE_MAP);     // "Pentatonic Minor" E 4
+    controlServer_.addMethod("/notemap", "sssi", staticControlMessage, this, CONTROL_NOTE_MAP);    // Pentatonic Minor E 4
+    controlServer_.addMethod("/threshold", "f", staticControlMessage, this, CONTROL_THRESHOLD);
+    controlServer_.addMethod("/target", "ss", staticControlMessage, this, CONTROL_TARGET);
+    controlServer_.addMethod("/target", "si", staticControlMessage, this, CONTROL_TARGET);
+    controlServer_.addMethod("/transmit", "i", staticControlMessage, this, CONTROL_TRANSMIT);
+    controlServer_.addMethod("/set", "ss", staticControlMessage, this, CONTROL_SET);              // Any config file parameter
+    controlServer_.addMethod("/stream/subscribe", "ss", staticControlMessage, this, CONTROL_STREAM_SUBSCRIBE);       // Host, port
+    controlServer_.addMethod("/stream/subscribe", "ssii", staticControlMessage, this, CONTROL_STREAM_SUBSCRIBE);     // ..., joint mask, divisor
+    controlServer_.addMethod("/stream/subscribe", "sssii", staticControlMessage, this, CONTROL_STREAM_SUBSCRIBE);    // Host, port, binary/osc, ...
+    controlServer_.addMethod("/stream/unsubscribe", "ss", staticControlMessage, this, CONTROL_STREAM_UNSUBSCRIBE);
+    controlServer_.addMethod("/record/start", "s", staticControlMessage, this, CONTROL_RECORD_START);            // Session file path
+    controlServer_.addMethod("/record/stop", "", staticControlMessage, this, CONTROL_RECORD_STOP);
+    
+    /* Queries reply to the sender at their own address */
+    controlServer_.addMethod("/query/tracking", "", staticControlMessage, this, CONTROL_QUERY_TRACKING);
+    controlServer_.addMethod("/query/notemap", "", staticControlMessage, this, CONTROL_QUERY_NOTE_MAP);
+    controlServer_.addMethod("/query/threshold", "", staticControlMessage, this, CONTROL_QUERY_THRESHOLD);
+    controlServer_.addMethod("/query/target", "", staticControlMessage, this, CONTROL_QUERY_TARGET);
+    controlServer_.addMethod("/query/transmit", "", staticControlMessage, this, CONTROL_QUERY_TRANSMIT);
+    controlServer_.addMethod("/query/version", "", staticControlMessage, this, CONTROL_QUERY_VERSION);
+    controlServer_.addMethod("/query/stream", "", staticControlMessage, this, CONTROL_QUERY_STREAM);
+    controlServer_.addMethod("/query/timing", "", staticControlMessage, this, CONTROL_QUERY_TIMING);     // Drift (ppm), jitter (ms), dropped, duplicates
+    controlServer_.addMethod("/query/recording", "", staticControlMessage, this, CONTROL_QUERY_RECORDING);   // Recording, frames, dropped
+}
+
+/* Runs on the control server's thread */
+bool SkeletonController::controlMessage(int method, const char *types, lo_arg **argv, int argc, lo_message reply) {
+    
+    switch (method) {
+            
+        case CONTROL_START:
+            return isTracking() || beginTracking();
+            
+        case CONTROL_STOP:
+            return !isTracking() || stopTracking();
+            
+        case CONTROL_NOTE_MAP:
+            if (argc == 3)
+                return setNoteMap(&argv[0]->s, "Major", &argv[1]->s, argv[2]->i);
+            return setNoteMap(&argv[0]->s, &argv[1]->s, &argv[2]->s, argv[3]->i);
+            
+        case CONTROL_THRESHOLD:
+            if (argv[0]->f < 0 || argv[0]->f > 1)
+                return false;
+            setConfidenceThreshold(argv[0]->f);
+            return true;
+            
+        case CONTROL_TARGET: {
+            char port[16];
+            if (types[1] == 'i')
+                snprintf(port, sizeof(port), "%d", argv[1]->i);
+            else
+                snprintf(port, sizeof(port), "%s", &argv[1]->s);
+            setOscTarget(&argv[0]->s, port);
+            return true;
+        }
+            
+        case CONTROL_TRANSMIT:
+            return setParameter("transmit", argv[0]->i ? "on" : "off");
+            
+        case CONTROL_SET:
+            return setParameter(&argv[0]->s, &argv[1]->s);
+            
+        case CONTROL_STREAM_SUBSCRIBE: {
+            SkeletonStreamFormat format = STREAM_BINARY;
+            int jointMask = SKELETON_STREAM_ALL_JOINTS;
+            int divisor = 1;
+            if (argc == 5) {
+                if (!strcasecmp(&argv[2]->s, "osc"))
+                    format = STREAM_OSC_BLOB;
+                else if (strcasecmp(&argv[2]->s, "binary"))
+                    return false;
+            }
+            if (argc >= 4) {
+                jointMask = argv[argc - 2]->i;
+                divisor = argv[argc - 1]->i;
+            }
+            return streamer_.addSubscriber(&argv[0]->s, &argv[1]->s, format, jointMask, divisor);
+        }
+            
+        case CONTROL_STREAM_UNSUBSCRIBE:
+            return streamer_.removeSubscriber(&argv[0]->s, &argv[1]->s);
+            
+        case CONTROL_RECORD_START:
+            return startRecording(&argv[0]->s);
+            
+        case CONTROL_RECORD_STOP:
+            stopRecording();
+            return true;
+            
+        case CONTROL_QUERY_TRACKING:
+            lo_message_add_int32(reply, isTracking() ? 1 : 0);
+            return true;
+            
+        case CONTROL_QUERY_NOTE_MAP: {
+            /* Hold an update so the scale library can be read */
+            Config *config = configStore_->beginUpdate();
+            const char *scale = scales_.scaleName(config->scale);
+            lo_message_add_string(reply, scale ? scale : "");
+            lo_message_add_string(reply, ScaleLibrary::keyName(config->key));
+            lo_message_add_int32(reply, config->octave);
+            for (int i = 0; i < NOTE_MAP_SIZE; i++)
+                lo_message_add_int32(reply, config->noteMap.notes[i]);
+            configStore_->abortUpdate();
+            return true;
+        }
+            
+        case CONTROL_QUERY_THRESHOLD:
+            lo_message_add_float(reply, configStore_->current().confThresh);
+            return true;
+            
+        case CONTROL_QUERY_TARGET: {
+            Config config = configStore_->current();
+            lo_message_add_string(reply, config.oscHost);
+            lo_message_add_string(reply, config.oscPort);
+            return true;
+        }
+            
+        case CONTROL_QUERY_TRANSMIT:
+            lo_message_add_int32(reply, configStore_->current().sendOsc ? 1 : 0);
+            return true;
+            
+        case CONTROL_QUERY_VERSION:
+            lo_message_add_int32(reply, (int)configStore_->version());
+            return true;
+            
+        case CONTROL_QUERY_STREAM:
+            lo_message_add_int32(reply, streamer_.numSubscribers());
+            return true;
+            
+        case CONTROL_QUERY_TIMING: {
+            FrameClockStats stats = clock_.stats();
+            lo_message_add_float(reply, stats.drift);
+            lo_message_add_float(reply, stats.jitter / 1000);
+            lo_message_add_int32(reply, stats.nDropped);
+            lo_message_add_int32(reply, stats.nDuplicates);
+            return true;
         }
-        else if (!strcmp(tonality, "Minor")) {
-            intervals = {3, 5, 7, 10, 12, 15, 17, 19, 22, 24, 27};
+            
+        case CONTROL_QUERY_RECORDING: {
+            SessionRecorder::Stats stats = recorder_.stats();
+            lo_message_add_int32(reply, isRecording() ? 1 : 0);
+            lo_message_add_int32(reply, stats.nFrames);
+            lo_message_add_int32(reply, stats.nDropped);
+            return true;
         }
-        else printf("%s: Unrecognized tonality \"%s\"\n", __PRETTY_FUNCTION__, tonality);
-    }
-    else if (!strcmp(scale, "Chromatic")) {
-        intervals = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-    }
-    
-    /* Compute the base (C = 0 through B = 11) */
-    int base;
-    
-    if (!strcmp(key, "C") || !strcmp(key, "c"))
-        base = 0;
-    if (!strcmp(key, "C#") || !strcmp(key, "c#") || !strcmp(key, "Db") || !strcmp(key, "db"))
-        base = 1;
-    if (!strcmp(key, "D") || !strcmp(key, "d"))
-        base = 2;
-    if (!strcmp(key, "D#") || !strcmp(key, "d#") || !strcmp(key, "Eb") || !strcmp(key, "eb"))
-        base = 3;
-    if (!strcmp(key, "E") || !strcmp(key, "e"))
-        base = 4;
-    if (!strcmp(key, "F") || !strcmp(key, "f"))
-        base = 5;
-    if (!strcmp(key, "F#") || !strcmp(key, "f#") || !strcmp(key, "Gb") || !strcmp(key, "gb"))
-        base = 6;
-    if (!strcmp(key, "G") || !strcmp(key, "g"))
-        base = 7;
-    if (!strcmp(key, "G#") || !strcmp(key, "g#") || !strcmp(key, "Ab") || !strcmp(key, "ab"))
-        base = 8;
-    if (!strcmp(key, "A") || !strcmp(key, "a"))
-        base = 9;
-    if (!strcmp(key, "A#") || !strcmp(key, "a#") || !strcmp(key, "Bb") || !strcmp(key, "bb"))
-        base = 10;
-    if (!strcmp(key, "B") || !strcmp(key, "b"))
-        base = 11;
-    
-    base += octave*12;
-    
-    for (int i = 0; i < 12; i++) {
-        noteMap_[i] = base + intervals[i];
     }
+    
+    return false;
 }
 
 nite::UserTracker SkeletonController::userTracker() const {
@@ -240,8 +916,8 @@ nite::UserTracker SkeletonController::userTracker() const {
     nite::UserTracker rv;
     
     /* Make sure we're tracking so the skeleton exists */
-    if (userTracker_.isValid()) {
-        rv = userTracker_;
+    if (niteSource_->userTracker().isValid()) {
+        rv = niteSource_->userTracker();
     }
     
     return rv;
@@ -295,230 +971,219 @@ void SkeletonController::generateRegionBoundaries() {
 
 void *SkeletonController::trackSkeleton() {
     
-    nite::Status status;
-    nite::UserTrackerFrameRef frame;
-    
-#pragma mark TEST ME!
-    status = userTracker_.readFrame(&frame);
-    frameWidth_ = frame.getDepthFrame().getWidth();
-    frameHeight_ = frame.getDepthFrame().getHeight();
+    configReader_ = configStore_->registerReader();
     
-    generateRegionBoundaries();
-    
-//    printf("Device open = %s\n", deviceOpen_ ? "true" : "false");
+    int failedReads = 0;
     
     while (!shouldStop_) {
         
-        /* Read the next frame */
-        status = userTracker_.readFrame(&frame);
-        if (status != nite::STATUS_OK)
-        {
-            printf("%s: Get next frame failed\n", __PRETTY_FUNCTION__);
-            continue;
-        }
-        
-        /* Get all users in the frame */
-        const nite::Array<nite::UserData> &users = frame.getUsers();
-        
-        /* For each user */
-        for (int i = 0; i < users.getSize(); ++i) {
+        /* Read the next frame. Reads time out, so a silent source costs one timeout per
+           pass; one that fails at once is paused between tries instead of spun on. */
+        if (!source_->readFrame(&frame_)) {
             
-            const nite::UserData &user = users[i];
+            if (shouldStop_)
+                break;
             
-            if (user.isLost()) {
-                display_->clearUser();
-                printf("User lost!\n");
-                
-                if (sendOsc_)
-                    sendAllNotesOff();
-            }
-            
-            if (!user.isVisible()) {
-                display_->clearUser();
-                
-                /* Only send allnotesoff when user just steps out of frame */
-                if (userInFrame_) {
-                    if (sendOsc_)
-                        sendAllNotesOff();
-                    userInFrame_ = false;
-                }
-            }
-            else {
-                display_->setDrawUser();
-                userInFrame_ = true;
-            }
-            
-            if (user.isNew()) {
-                userTracker_.startSkeletonTracking(user.getId());
-                display_->setDrawUser();
-                estimateHeight(user.getSkeleton());
-                userInFrame_ = true;
-                printf("New User!\n");
+            if (++failedReads >= TRACKING_STALL_READS) {
+                handleStall();
+                failedReads = 0;
             }
+            else
+                waitForStop(TRACKING_RETRY_MS);
             
-            /* Check confidence of each joint and update if above a threshold */
-            else if (user.getSkeleton().getState() == nite::SKELETON_TRACKED) {
-                
-                float x, y;     // Depth-scaled joint coordinates
-//                printf("... frame...\n");
-                
-//                estimateHeight(user.getSkeleton());
-                
-                frameWidth_  = frame.getDepthFrame().getWidth();
-                frameHeight_ = frame.getDepthFrame().getHeight();
-                
-                /* Head */
-                nite::SkeletonJoint head = user.getSkeleton().getJoint(nite::JOINT_HEAD);
-                if (head.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(head.getPosition().x, head.getPosition().y, head.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_HEAD, x, y, frameWidth_, frameHeight_);
-                }
-                
-                /* Neck */
-                nite::SkeletonJoint neck = user.getSkeleton().getJoint(nite::JOINT_NECK);
-                if (neck.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(neck.getPosition().x, neck.getPosition().y, neck.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_NECK, x, y, frameWidth_, frameHeight_);
-                }
-                
-                /* Torso */
-                nite::SkeletonJoint torso = user.getSkeleton().getJoint(nite::JOINT_TORSO);
-                if (torso.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(torso.getPosition().x, torso.getPosition().y, torso.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_TORSO, x, y, frameWidth_, frameHeight_);
-                }
-                
-                /* Shoulders */
-                nite::SkeletonJoint shoulderL = user.getSkeleton().getJoint(nite::JOINT_LEFT_SHOULDER);
-                if (shoulderL.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(shoulderL.getPosition().x, shoulderL.getPosition().y, shoulderL.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_LEFT_SHOULDER, x, y, frameWidth_, frameHeight_);
-                }
-                
-                nite::SkeletonJoint shoulderR = user.getSkeleton().getJoint(nite::JOINT_RIGHT_SHOULDER);
-                if (shoulderR.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(shoulderR.getPosition().x, shoulderR.getPosition().y, shoulderR.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_RIGHT_SHOULDER, x, y, frameWidth_, frameHeight_);
-                }
-                
-                /* Elbows */
-                nite::SkeletonJoint elbowL = user.getSkeleton().getJoint(nite::JOINT_LEFT_ELBOW);
-                if (elbowL.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(elbowL.getPosition().x, elbowL.getPosition().y, elbowL.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_LEFT_ELBOW, x, y, frameWidth_, frameHeight_);
-                }
-                
-                nite::SkeletonJoint elbowR = user.getSkeleton().getJoint(nite::JOINT_RIGHT_ELBOW);
-                if (elbowR.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(elbowR.getPosition().x, elbowR.getPosition().y, elbowR.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_RIGHT_ELBOW, x, y, frameWidth_, frameHeight_);
-                }
-                
-                /* Hands */
-                nite::SkeletonJoint handL = user.getSkeleton().getJoint(nite::JOINT_LEFT_HAND);
-                if (handL.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(handL.getPosition().x, handL.getPosition().y, handL.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_LEFT_HAND, x, y, frameWidth_, frameHeight_);
-                }
-                
-                nite::SkeletonJoint handR = user.getSkeleton().getJoint(nite::JOINT_RIGHT_HAND);
-                if (handR.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(handR.getPosition().x, handR.getPosition().y, handR.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_RIGHT_HAND, x, y, frameWidth_, frameHeight_);
-                    
-                    if (sendOsc_) {
-                        /* Send hand spacing message only if prediction is confident for both hands */
-                        if (handL.getPositionConfidence() > confThresh_) {
-                            trackHands(handL, handR);
-                        }
-                    }
-                }
-                
-                /* Hips */
-                nite::SkeletonJoint hipL = user.getSkeleton().getJoint(nite::JOINT_LEFT_HIP);
-                if (hipL.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(hipL.getPosition().x, hipL.getPosition().y, hipL.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_LEFT_HIP, x, y, frameWidth_, frameHeight_);
-                }
-                
-                nite::SkeletonJoint hipR = user.getSkeleton().getJoint(nite::JOINT_RIGHT_HIP);
-                if (hipR.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(hipR.getPosition().x, hipR.getPosition().y, hipR.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_RIGHT_HIP, x, y, frameWidth_, frameHeight_);
-                }
-                
-                /* Feet */
-                nite::SkeletonJoint footL = user.getSkeleton().getJoint(nite::JOINT_LEFT_FOOT);
-                if (footL.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(footL.getPosition().x, footL.getPosition().y, footL.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_LEFT_FOOT, x, y, frameWidth_, frameHeight_);
-                    
-                    if (sendOsc_) {
-                        trackFoot("L", x);
-                    }
-                }
-                
-                nite::SkeletonJoint footR = user.getSkeleton().getJoint(nite::JOINT_RIGHT_FOOT);
-                if (footR.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(footR.getPosition().x, footR.getPosition().y, footR.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_RIGHT_FOOT, x, y, frameWidth_, frameHeight_);
-                    
-                    if (sendOsc_) {
-                        trackFoot("R", x);
-                    }
-                }
-                
-                /* Knees */
-                nite::SkeletonJoint kneeL = user.getSkeleton().getJoint(nite::JOINT_LEFT_KNEE);
-                if (kneeL.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(kneeL.getPosition().x, kneeL.getPosition().y, kneeL.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_LEFT_KNEE, x, y, frameWidth_, frameHeight_);
-                }
-                
-                nite::SkeletonJoint kneeR = user.getSkeleton().getJoint(nite::JOINT_RIGHT_KNEE);
-                if (kneeR.getPositionConfidence() > confThresh_) {
-                    userTracker_.convertJointCoordinatesToDepth(kneeR.getPosition().x, kneeR.getPosition().y, kneeR.getPosition().z, &x, &y);
-                    display_->updateJoint(nite::JOINT_RIGHT_KNEE, x, y, frameWidth_, frameHeight_);
-                    if (footL.getPositionConfidence() > confThresh_) {
-                        if (sendOsc_) {
-                            /* Right-knee height mapping */
-                            estimateHeight(user.getSkeleton());
-                            trackRightKnee(kneeR, footL);
-                        }
-                    }
-                }
-            } /* If skeleton is tracked */
-        } /* For each user */
+            continue;
+        }
+        
+        failedReads = 0;
+        
+        int stalled = TRACKING_STALLED;
+        if (state_.compare_exchange_strong(stalled, TRACKING_RUNNING))
+            printf("%s: Frames resumed from %s\n", __PRETTY_FUNCTION__, source_->name());
+        
+        /* Place the frame on the host clock; a repeat of the previous frame is skipped */
+        timing_ = clock_.update(&frame_);
+        if (timing_.duplicate)
+            continue;
+        
+        if (oscSender_)
+            oscSender_->setFrameTime(timing_.captureTime);
+        
+        processFrame();
+        
     } /* while (shouldStop_) */
+    
+    /* Note-offs for whatever is still held, while the configuration is still acquired, so
+       no receiver is left relying on the all-notes-off */
+    if (config_)
+        voices_.releaseAll();
+    
+    configStore_->unregisterReader(configReader_);
+    config_ = NULL;
 
     return 0;
 }
 
-void SkeletonController::estimateHeight(nite::Skeleton skeleton) {
+/* Everything done with a frame once it's been read and placed in time */
+void SkeletonController::processFrame() {
+    
+    uint64_t frameStart = profiler_.begin();
+    
+    /* Pick up configuration changes once per frame, so the whole frame sees one snapshot */
+    config_ = configStore_->acquire(configReader_);
+    voices_.setTimeoutFrames(config_->voiceTimeoutFrames);
+    
+    /* No notes start while transmission is off, so anything held is left over from
+       before it was turned off; release it now rather than leave it sounding */
+    if (!config_->sendOsc && voices_.numActive() > 0)
+        voices_.releaseAll();
+    
+    mappings_.beginFrame();
+    gestures_.beginFrame();
+    
+    /* Mapped values go to the output thread as targets, if it's running */
+    streamingControls_ = controlStream_.isRunning();
+    if (streamingControls_)
+        controlStream_.beginFrame(timing_.captureTime);
+    
+    uint64_t start = profiler_.begin();
+    streamer_.publish(&frame_, config_->confThresh);
+    profiler_.end(PROFILE_STREAM, start);
+    
+    /* The recorder's thread compresses and writes, and the display shades the depth image
+       on its own thread; this only hands each of them the frame */
+    if (recorder_.isOpen() || display_) {
+        FrameBuffer depth;
+        source_->readImages(&depth, NULL);
+        if (display_ && depth.isValid())
+            display_->setDepth(depth.share());
+        if (recorder_.isOpen())
+            recorder_.writeFrame(&frame_, std::move(depth));
+    }
     
-    // TO DO: add height estimates to a vector until the values converge
+    if (frame_.width != frameWidth_ || frame_.height != frameHeight_) {
+        frameWidth_  = frame_.width;
+        frameHeight_ = frame_.height;
+        generateRegionBoundaries();
+    }
     
-//    if (heightEst_.empty())
-//        heightEst_.push_back(1000.0);
-//    
-    float newEst_;
+    /* For each user */
+    for (int i = 0; i < frame_.nUsers; ++i) {
+        
+        const SkeletonUser &user = frame_.users[i];
+        
+        if (user.flags & USER_LOST) {
+            if (display_)
+                display_->clearUser();
+            printf("User lost!\n");
+        }
+        
+        /* Release only this user's notes when they step out of frame */
+        if (!(user.flags & USER_VISIBLE)) {
+            if (display_)
+                display_->clearUser();
+            voices_.releaseUser(user.id);
+        }
+        else if (display_)
+            display_->setDrawUser();
+        
+        if (user.flags & USER_NEW) {
+            computeLimbMetrics(user, &features_.limbs);
+            estimateHeight(features_.limbs);
+            printf("New User!\n");
+        }
+        
+        /* Check confidence of each joint and update if above a threshold */
+        else if (user.flags & USER_TRACKED)
+            processUser(user);
+        
+    } /* For each user */
+    
+    /* Release notes held by feet that have gone unseen, including users NiTE dropped */
+    start = profiler_.begin();
+    voices_.endFrame();
+    profiler_.end(PROFILE_VOICES, start);
     
-    newEst_  = getJointDistance(skeleton.getJoint(nite::JOINT_HEAD),
-                                skeleton.getJoint(nite::JOINT_NECK));
-    newEst_ += getJointDistance(skeleton.getJoint(nite::JOINT_NECK),
-                                skeleton.getJoint(nite::JOINT_TORSO));
-    newEst_ += getJointDistance(skeleton.getJoint(nite::JOINT_TORSO),
-                                skeleton.getJoint(nite::JOINT_RIGHT_HIP));
-    newEst_ += getJointDistance(skeleton.getJoint(nite::JOINT_TORSO),
-                                skeleton.getJoint(nite::JOINT_RIGHT_HIP));
-    newEst_ += getJointDistance(skeleton.getJoint(nite::JOINT_RIGHT_HIP),
-                                skeleton.getJoint(nite::JOINT_RIGHT_KNEE));
-    newEst_ += getJointDistance(skeleton.getJoint(nite::JOINT_RIGHT_KNEE),
-                                skeleton.getJoint(nite::JOINT_RIGHT_FOOT));
-    userHeight_ = newEst_;
+    if (streamingControls_)
+        controlStream_.endFrame();
+    
+    profiler_.end(PROFILE_FRAME, frameStart);
+}
+
+void SkeletonController::processUser(const SkeletonUser &tracked) {
+    
+    /* Fill in joints that dropped below the confidence threshold for a few frames */
+    uint64_t start = profiler_.begin();
+    SkeletonUser user;
+    JointStates joints;
+    jointTracker_.update(tracked, config_->confThresh, timing_.captureTime, frameWidth_, frameHeight_, &user, &joints);
+    profiler_.end(PROFILE_JOINTS, start);
+    
+    /* Display every joint that hasn't been lost, dimmed where it's estimated */
+    if (display_) {
+        start = profiler_.begin();
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+            display_->updateJoint((nite::JointType)j, user.u[j], user.v[j], frameWidth_, frameHeight_, joints.state[j]);
+        profiler_.end(PROFILE_DISPLAY, start);
+    }
+    
+    if (!config_->sendOsc)
+        return;
+    
+    /* Segments, angles, body frame and velocities, once for every mapping */
+    start = profiler_.begin();
+    featureExtractor_.extract(user, timing_.captureTime, &features_);
+    profiler_.end(PROFILE_FEATURES, start);
+    
+    /* Feet. An estimated foot keeps its note but doesn't change region. */
+    start = profiler_.begin();
+    
+    if (joints.state[SKEL_FOOT_L] == JOINT_FRESH)
+        trackFoot(user, LIMB_FOOT_L, floorCal_->isCalibrated() ? floorRegionCoordinate(user, SKEL_FOOT_L) : user.u[SKEL_FOOT_L]);
+    else if (joints.state[SKEL_FOOT_L] == JOINT_EXTRAPOLATED)
+        voices_.touch(user.id, LIMB_FOOT_L);
+    
+    if (joints.state[SKEL_FOOT_R] == JOINT_FRESH)
+        trackFoot(user, LIMB_FOOT_R, floorCal_->isCalibrated() ? floorRegionCoordinate(user, SKEL_FOOT_R) : user.u[SKEL_FOOT_R]);
+    else if (joints.state[SKEL_FOOT_R] == JOINT_EXTRAPOLATED)
+        voices_.touch(user.id, LIMB_FOOT_R);
+    
+    profiler_.end(PROFILE_FOOT, start);
+    
+    /* Height estimate used by per-height mappings */
+    int heightJoints = (1 << SKEL_KNEE_R) | (1 << SKEL_FOOT_L);
+    if ((joints.fresh & heightJoints) == heightJoints)
+        estimateHeight(features_.limbs);
+    
+    /* Continuous mappings (hand spacing, knee height, ...) */
+    start = profiler_.begin();
+    MappingOutput outputs[MAPPING_MAX_OUTPUTS];
+    int nOutputs = mappings_.evaluate(user, joints, features_, userHeight_, outputs, MAPPING_MAX_OUTPUTS);
+    profiler_.end(PROFILE_MAPPINGS, start);
+    
+    start = profiler_.begin();
+    for (int i = 0; i < nOutputs; i++)
+        sendMapped(user, outputs[i]);
+    profiler_.end(PROFILE_SEND, start);
+    
+    /* Discrete gestures (kicks, claps, jumps, ...) */
+    start = profiler_.begin();
+    GestureEvent events[GESTURE_MAX_TEMPLATES];
+    int nEvents = gestures_.process(user, joints, features_, timing_.captureTime, events, GESTURE_MAX_TEMPLATES);
+    if (oscSender_) {
+        for (int i = 0; i < nEvents; i++)
+            oscSender_->sendMessage(events[i].gesture->address.c_str(), "if", events[i].userId, events[i].score, LO_ARGS_END);
+    }
+    profiler_.end(PROFILE_GESTURES, start);
+}
+
+void SkeletonController::estimateHeight(const LimbMetrics &limbs) {
+    
+    // TO DO: add height estimates to a vector until the values converge
+    
+    userHeight_ = limbs.height;
 }
 
-void SkeletonController::trackFoot(const char *LR, float x) {
+void SkeletonController::trackFoot(const SkeletonUser &user, Limb foot, float x) {
     
     /* Mirror the x coordinate */
     x = frameWidth_ - x;
@@ -584,92 +1249,120 @@ void SkeletonController::trackFoot(const char *LR, float x) {
         }
     }
     
-    /* Checking if left foot has moved to a new region */
-    if (strcmp(LR, "L") != 0) {
-        
-        if (footRegion_[0] != region && footRegion_[1] != region) {
-            /* Note off == note on with velocity = 0 */
-            sendNoteOn(noteMap_[footRegion_[0]], 0);
-            footRegion_[0] = region;
-            sendNoteOn(noteMap_[footRegion_[0]], 90);
-            sendIntensity(noteMap_[footRegion_[0]], 1.0f);
-        }
-    }
-    /* Checking right foot */
-    else if (strcmp(LR, "R") != 0) {
-        
-        if (footRegion_[1] != region && footRegion_[0] != region) {
-            /* Note off == note on with velocity = 0 */
-            sendNoteOn(noteMap_[footRegion_[1]], 0);
-            footRegion_[1] = region;
-            sendNoteOn(noteMap_[footRegion_[1]], 90);
-            sendIntensity(noteMap_[footRegion_[1]], 1.0f);
-        }
-    }
-    else
-        printf("%s: Specify \"L\" or \"R\" only\n", __PRETTY_FUNCTION__);
+    /* A foot takes the note of a new region unless the user's other foot is already there.
+       Note off == note on with velocity = 0, sent by the voice manager. */
+    int note = config_->noteMap.notes[region];
     
+    if (voices_.heldByOtherLimb(user.id, foot, note))
+        voices_.touch(user.id, foot);
+    else
+        voices_.noteOn(user.id, foot, note, 90);
 }
 
-void SkeletonController::trackHands(nite::SkeletonJoint left, nite::SkeletonJoint right) {
+/* Lateral floor position of a foot, scaled so the stage width spans the depth frame width.
+   trackFoot() then divides it into regions exactly as it does depth-image coordinates. */
+float SkeletonController::floorRegionCoordinate(const SkeletonUser &user, int joint) {
+    
+    float fx, fy, fz;
     
-    float distance = getJointDistance(left, right);
+    floorCal_->projectToFloor(user.x[joint], user.y[joint], user.z[joint], &fx, &fy, &fz);
     
-    sendIntensity(noteMap_[footRegion_[0]], distance / 1800);
-    sendIntensity(noteMap_[footRegion_[1]], distance / 1800);
+    float stageWidth = config_->stageWidth;
+    return (fx + stageWidth / 2) / stageWidth * frameWidth_;
 }
 
-void SkeletonController::trackRightKnee(nite::SkeletonJoint knee, nite::SkeletonJoint foot) {
-    
-//    float height = 0;
-    
-//    float brightRange = 3 * getJointDistance(knee, head);
-    float value = 3*abs(knee.getPosition().y - foot.getPosition().y) / userHeight_;
+void SkeletonController::sendMapped(const SkeletonUser &user, const MappingOutput &output) {
     
-    if (value < 0) value = 0;
-    if (value > 1) value = 1;
+    const MappingTarget *target = output.target;
     
-    value = 1 - value;
-    
-    sendBrightness(noteMap_[footRegion_[0]], value);
-    sendBrightness(noteMap_[footRegion_[1]], value);
+    switch (target->kind) {
+            
+        case TARGET_VALUE:
+            if (streamingControls_)
+                controlStream_.setTarget(target->address.c_str(), -1, output.value);
+            else if (oscSender_)
+                oscSender_->sendMessage(target->address.c_str(), "f", output.value, LO_ARGS_END);
+            break;
+            
+        case TARGET_NOTE:
+            sendNoteValue(target, target->note, output.value);
+            break;
+            
+        case TARGET_HELD_NOTES: {
+            int noteL = voices_.heldNote(user.id, LIMB_FOOT_L);
+            int noteR = voices_.heldNote(user.id, LIMB_FOOT_R);
+            
+            if (noteL >= 0)
+                sendNoteValue(target, noteL, output.value);
+            if (noteR >= 0 && noteR != noteL)
+                sendNoteValue(target, noteR, output.value);
+            break;
+        }
+    }
+}
+
+void SkeletonController::sendNoteValue(const MappingTarget *target, int noteNumber, float value) {
+    
+    /* Sent from the output thread in the same "iif" form; the keyboard display still
+       follows intensity once per frame */
+    if (streamingControls_) {
+        controlStream_.setTarget(target->address.c_str(), noteNumber, value);
+        if (target->isIntensity && kbDisplay_)
+            kbDisplay_->setAnalogValueForKey(noteNumber, value);
+    }
+    else if (target->isIntensity)
+        sendIntensity(noteNumber, value);
+    else if (oscSender_)
+        oscSender_->sendMessage(target->address.c_str(), "iif", 0, noteNumber, value, LO_ARGS_END);
 }
 
 void SkeletonController::sendNoteOn(int noteNumber, int velocity) {
     
-    oscSender_->sendMessage("/mrp/midi", "iii", 144, noteNumber, velocity, LO_ARGS_END);
+    if (oscSender_)
+        oscSender_->sendMessage("/mrp/midi", "iii", 144, noteNumber, velocity, LO_ARGS_END);
+    
+    if (!kbDisplay_)
+        return;
+    
     kbDisplay_->setHighlightedKey(noteNumber, velocity == 0 ? false : true);
     
     if (velocity == 0)
         kbDisplay_->setAnalogValueForKey(noteNumber, 0);
 }
 
-void SkeletonController::sendIntensity(int noteNumber, float value) {
+void SkeletonController::voiceChanged(int note, int velocity) {
+    
+    /* Note-offs go out even with transmission off, so no note is left hanging */
+    if (!config_ || !oscSender_ || (velocity > 0 && !config_->sendOsc))
+        return;
     
-    oscSender_->sendMessage("/mrp/quality/intensity", "iif", 0, noteNumber, value, LO_ARGS_END);
-    kbDisplay_->setAnalogValueForKey(noteNumber, value);
+    sendNoteOn(note, velocity);
+    
+    if (velocity > 0)
+        sendIntensity(note, 1.0f);
 }
 
-void SkeletonController::sendBrightness(int noteNumber, float value) {
+void SkeletonController::sendIntensity(int noteNumber, float value) {
+    
+    if (oscSender_)
+        oscSender_->sendMessage("/mrp/quality/intensity", "iif", 0, noteNumber, value, LO_ARGS_END);
     
-    oscSender_->sendMessage("/mrp/quality/brightness", "iif", 0, noteNumber, value, LO_ARGS_END);
+    if (kbDisplay_)
+        kbDisplay_->setAnalogValueForKey(noteNumber, value);
 }
 
 void SkeletonController::sendAllNotesOff() {
     
-    oscSender_->sendMessage("/mrp/allnotesoff");
+    if (oscSender_)
+        oscSender_->sendMessage("/mrp/allnotesoff");
+    
+    if (!kbDisplay_)
+        return;
+    
     kbDisplay_->clearAnalogData();
     kbDisplay_->clearHighlightedKeys();
 }
 
-float SkeletonController::getJointDistance(nite::SkeletonJoint j1, nite::SkeletonJoint j2) {
-    
-    return sqrt(    powf(abs(j1.getPosition().x - j2.getPosition().x), 2) +
-                    powf(abs(j1.getPosition().y - j2.getPosition().y), 2) +
-                    powf(abs(j1.getPosition().z - j2.getPosition().z), 2)
-                );
-}
-
 
 
 
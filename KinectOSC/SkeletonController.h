@@ -11,6 +11,7 @@
 
 #include <iostream>
 #include <vector>
+#include <atomic>
 #include <cmath>
 #include <math.h>
 #include <string>
@@ -23,8 +24,29 @@
 
 #include "KinectDisplay.h"
 #include "OscController.h"
+#include "FloorCalibration.h"
+#include "SkeletonSource.h"
+#include "VoiceManager.h"
+#include "NoteMap.h"
+#include "MappingEngine.h"
+#include "ConfigStore.h"
+#include "OscControlServer.h"
+#include "SkeletonStream.h"
+#include "FrameClock.h"
+#include "FrameProfiler.h"
+#include "JointGeometry.h"
+#include "JointTracker.h"
+#include "BodyFeatures.h"
+#include "GestureRecognizer.h"
+#include "ControlStream.h"
+#include "SessionRecording.h"
 
 #define MAX_USERS 1
+
+#define TRACKING_STALL_READS 20             // Consecutive failed reads before the source is reconnected
+#define TRACKING_RETRY_MS 10                // Pause after a failed read that returned at once
+#define TRACKING_RECONNECT_MIN_MS 250       // Reconnection backoff, doubling up to the max
+#define TRACKING_RECONNECT_MAX_MS 8000
 //bool g_visibleUsers[MAX_USERS] = {false};
 //nite::SkeletonState g_skeletonStates[MAX_USERS] = {nite::SKELETON_NONE};
 
@@ -39,28 +61,105 @@ struct Point {
     
 public:
     
+    /* Tracking lifecycle. STALLED means frames stopped arriving; the thread keeps waiting
+       for them, reconnecting the source if it can, until they resume or tracking stops. */
+    enum TrackingState {
+        TRACKING_STOPPED = 0,
+        TRACKING_RUNNING,
+        TRACKING_STALLED,
+        TRACKING_STOPPING
+    };
+    
     SkeletonController();
     ~SkeletonController();
     
+    /* Start OpenNI and NiTE, for reading devices. Controllers that only process other
+       sources don't need it, and leave NiTE alone when they're deleted. */
     bool init();
     vector<string> getAvailableDeviceNames();
     bool openDeviceAtIndex(int idx);
     void closeDevice();
     
+    /* Either returns within about one source read timeout; stopping interrupts a stalled
+       read or a reconnection backoff rather than waiting it out */
     bool beginTracking();
     bool stopTracking();
     
-    /* Setters */
-    void setDisplay(KinectDisplay *display) { display_ = display; }
+    /* Setters. The displays are optional so the controller can run headless; with a
+       display, the local device captures depth images for it. */
+    void setDisplay(KinectDisplay *display);
     void setKeyboardDisplay(KeyboardDisplay *kbDisplay) { kbDisplay_ = kbDisplay; }
-    void enableOscTransmit()  { sendOsc_ = true; }
-    void disableOscTransmit() { sendOsc_ = false; }
-    void setOscSender(OscController *oscSender) { oscSender_ = oscSender; }
-    void setNoteMap(const char *scale, const char *tonality, const char *key, int octave);
+    void setOscSender(OscController *oscSender);
+    
+    /* Runtime parameters. Each call publishes a new configuration snapshot, which the
+       tracking thread picks up on its next frame, so all are safe mid-performance. */
+    void enableOscTransmit()  { setParameter("transmit", "on"); }
+    void disableOscTransmit() { setParameter("transmit", "off"); }
+    void setOscTarget(const char *host, const char *port);
+    void setOscLogging(bool log) { setParameter("logging", log ? "on" : "off"); }
+    bool setNoteMap(const char *scale, const char *tonality, const char *key, int octave);   // UI selections
+    bool setNoteMap(int scale, int key, int octave);
+    void setConfidenceThreshold(float threshold);
+    void setStageWidth(float width);
+    void setVoiceTimeout(int frames);           // Frames a foot may go unseen before its note is released
+    
+    /* Set one parameter by name, as in a config file */
+    bool setParameter(const char *name, const char *value);
+    
+    /* Read "name = value" lines (see applyParameter for names). A file with any bad line
+       is rejected whole. Watching reloads the file whenever it changes. */
+    bool loadConfigFile(const char *path);
+    bool watchConfigFile(const char *path);
+    
+    /* Listen for control messages under /kinectosc (start, stop, notemap, threshold, target,
+       transmit, set, record/..., query/...) on a separate thread. Handlers only publish configuration or
+       start and stop tracking, so they never wait on the tracking thread. */
+    bool startControlServer(const char *port) { return controlServer_.start(port); }
+    void stopControlServer() { controlServer_.stop(); }
+    
+    bool loadScales(const char *path);
+    
+    /* Replace the continuous mappings; takes effect on the next frame */
+    bool loadMappings(const char *path) { return mappings_.loadFile(path); }
+    
+    /* Replace the gesture templates; takes effect on the next frame */
+    bool loadGestures(const char *path) { return gestures_.loadFile(path); }
+    
+    /* Track from another source (replay, synthetic, network, multi-device) instead of the
+       local device. The controller doesn't take ownership; NULL restores the device. */
+    void setSkeletonSource(SkeletonSource *source);
+    
+    /* Run every frame of a source through the mapping path on the calling thread, as fast
+       as it can be read, until a read fails; notes still held are then released. Frames are
+       timed by their sensor timestamps instead of the host clock. Tracking must be stopped.
+       Returns the number of frames processed, or -1. See BatchAnalysis.h. */
+    int processSource(SkeletonSource *source);
+    
+    /* Full skeletons for other consumers, published every frame while tracking */
+    SkeletonStreamer &skeletonStreamer() { return streamer_; }
+    
+    /* Time each stage of the mapping path from the next beginTracking(). The report covers
+       the last run and can only be written while tracking is stopped. */
+    void setProfiling(bool profile) { profiler_.setEnabled(profile); }
+    bool writeProfile(const char *path, const char *label);
+    
+    /* Record every frame, with the device's depth images, to a session file that
+       SessionPlayer can play back. Safe to start and stop while tracking. */
+    bool startRecording(const char *path);
+    void stopRecording();
+    bool isRecording() { return recorder_.isOpen(); }
+    SessionRecorder::Stats recordingStats() { return recorder_.stats(); }
+    
+    /* Re-estimate the floor plane from the next few depth frames */
+    void recalibrateFloor() { floorCal_->beginCalibration(); }
     
     /* Getters */
-    bool isTracking() { return tracking_; }
+    Config config() { return configStore_->current(); }
+    FrameClock &frameClock() { return clock_; }     // Offset, drift and drop counts; tracking thread updates it
+    bool isTracking() { return state_ != TRACKING_STOPPED; }
+    TrackingState trackingState() { return (TrackingState)state_.load(); }
     bool deviceIsOpen() { return deviceOpen_; }
+    bool floorIsCalibrated() { return floorCal_->isCalibrated(); }
     nite::UserTracker userTracker() const;
     
 private:
@@ -71,18 +170,64 @@ private:
         return ((SkeletonController *)arg)->trackSkeleton();
     }
     
+    void processFrame();
+    void handleStall();
+    bool waitForStop(int ms);
+    
     void generateRegionBoundaries();
     
-    void estimateHeight(nite::Skeleton skeleton);
-    void trackFoot(const char *LR, float x);
-    void trackHands(nite::SkeletonJoint left, nite::SkeletonJoint right);
-    void trackRightKnee(nite::SkeletonJoint knee, nite::SkeletonJoint foot);
+    void processUser(const SkeletonUser &user);
+    
+    void estimateHeight(const LimbMetrics &limbs);
+    void trackFoot(const SkeletonUser &user, Limb foot, float x);
+    float floorRegionCoordinate(const SkeletonUser &user, int joint);
+    void sendMapped(const SkeletonUser &user, const MappingOutput &output);
+    void sendNoteValue(const MappingTarget *target, int noteNumber, float value);
     void sendNoteOn(int noteNumber, int velocity);
     void sendIntensity(int noteNumber, float value);
-    void sendBrightness(int noteNumber, float value);
     void sendAllNotesOff();
     
-    float getJointDistance(nite::SkeletonJoint j1, nite::SkeletonJoint j2);
+    static void staticVoiceCallback(void *arg, int note, int velocity) {
+        ((SkeletonController *)arg)->voiceChanged(note, velocity);
+    }
+    void voiceChanged(int note, int velocity);
+    
+    bool applyParameter(Config *config, const char *name, const char *value, string *mappingsPath,
+                        string *gesturesPath);
+    void applyOutputSettings(const Config &old, const Config &updated);
+    void updateControlStream(const Config &config);
+    static void staticConfigFileChanged(void *arg, const char *path) {
+        ((SkeletonController *)arg)->loadConfigFile(path);
+    }
+    
+    enum ControlMethod {
+        CONTROL_START = 0,
+        CONTROL_STOP,
+        CONTROL_NOTE_MAP,
+        CONTROL_THRESHOLD,
+        CONTROL_TARGET,
+        CONTROL_TRANSMIT,
+        CONTROL_SET,
+        CONTROL_STREAM_SUBSCRIBE,
+        CONTROL_STREAM_UNSUBSCRIBE,
+        CONTROL_RECORD_START,
+        CONTROL_RECORD_STOP,
+        CONTROL_QUERY_TRACKING,
+        CONTROL_QUERY_NOTE_MAP,
+        CONTROL_QUERY_THRESHOLD,
+        CONTROL_QUERY_TARGET,
+        CONTROL_QUERY_TRANSMIT,
+        CONTROL_QUERY_VERSION,
+        CONTROL_QUERY_STREAM,
+        CONTROL_QUERY_TIMING,
+        CONTROL_QUERY_RECORDING
+    };
+    
+    void addControlMethods();
+    bool controlMessage(int method, const char *types, lo_arg **argv, int argc, lo_message reply);
+    static bool staticControlMessage(void *arg, int method, const char *types, lo_arg **argv, int argc, lo_message reply) {
+        return ((SkeletonController *)arg)->controlMessage(method, types, argv, argc, reply);
+    }
     
 private:
     
@@ -91,11 +236,25 @@ private:
     
 //    vector<float> heightEst_;   // Height estimations for the current user
     float userHeight_;
-    float confThresh_;
+    JointTracker jointTracker_;         // Fills in joints that drop out for a few frames
+    FeatureExtractor featureExtractor_;
+    BodyFeatures features_;             // Current user's limb metrics and body frame
         
     OscController *oscSender_;
-    int noteMap_[12];
-    int footRegion_[2];
+    ControlStream controlStream_;       // Mapped values between frames, while tracking with a control rate
+    bool streamingControls_;            // This frame's mapped values go through controlStream_
+    VoiceManager voices_;
+    ScaleLibrary scales_;               // Only used while holding a config update
+    
+    ConfigStore *configStore_;
+    const Config *config_;              // Tracking thread's snapshot for the current frame
+    int configReader_;
+    ConfigFileWatcher configWatcher_;
+    OscControlServer controlServer_;
+    
+    MappingEngine mappings_;
+    GestureRecognizer gestures_;
+    SkeletonStreamer streamer_;
     
     KinectDisplay *display_;
     float frameWidth_;
@@ -103,17 +262,25 @@ private:
     
     KeyboardDisplay *kbDisplay_;
     
-    openni::Device device_;
-    nite::Status niteStatus_;
-    nite::UserTracker userTracker_;
+    FloorCalibration *floorCal_;
+    
+    NiteSkeletonSource *niteSource_;    // Local device
+    SkeletonSource *source_;            // Where frames are read from
+    SkeletonFrame frame_;
+    FrameClock clock_;
+    FrameTiming timing_;                // Current frame, on the host clock
+    FrameProfiler profiler_;
+    SessionRecorder recorder_;
     
     pthread_t dataThread_;
     pthread_mutex_t dataMutex_;
     bool deviceOpen_;
-    bool tracking_;
-    bool userInFrame_;
-    bool shouldStop_;
-    bool sendOsc_;
+    bool niteInitialized_;              // By init(), so NiTE is shut down with this controller
+    atomic<int> state_;                 // TrackingState
+    atomic<bool> shouldStop_;
+    pthread_mutex_t lifecycleMutex_;    // Serializes beginTracking and stopTracking
+    pthread_mutex_t stopMutex_;         // With stopCond_, cuts short the reconnection backoff
+    pthread_cond_t stopCond_;
 };
 
 #endif /* defined(__KinectOSC____SkeletonController__) */
@@ -0,0 +1,142 @@
+//
+//  SkeletonFrame.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "SkeletonFrame.h"
+
+#include <strings.h>
+
+/* Fields are copied packed in host order, so the format is little-endian only because
+   every machine we build for is */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "SkeletonFrame serialization assumes a little-endian host"
+#endif
+
+static const int kHeaderBytes = SKELETON_FRAME_HEADER_BYTES;
+static const int kUserBytes = SKELETON_FRAME_USER_BYTES;
+
+static_assert(kHeaderBytes == sizeof(uint64_t) * 2 + sizeof(int32_t) * 2 + sizeof(uint16_t) * 2 + sizeof(uint8_t),
+              "SKELETON_FRAME_HEADER_BYTES doesn't match the fields serializeFrame() writes");
+static_assert(kUserBytes == sizeof(int32_t) * 2 + 6 * SKELETON_NUM_JOINTS * sizeof(float),
+              "SKELETON_FRAME_USER_BYTES doesn't match the fields serializeFrame() writes");
+static_assert(SKELETON_FRAME_MAX_BYTES == kHeaderBytes + SKELETON_MAX_USERS * kUserBytes,
+              "SKELETON_FRAME_MAX_BYTES can't hold a frame of SKELETON_MAX_USERS users");
+
+static inline uint8_t *put(uint8_t *p, const void *data, int n) {
+    memcpy(p, data, n);
+    return p + n;
+}
+
+static inline const uint8_t *get(const uint8_t *p, void *data, int n) {
+    memcpy(data, p, n);
+    return p + n;
+}
+
+/* Indexed by joint, matching the order in SkeletonFrame.h */
+static const char *kJointNames[SKELETON_NUM_JOINTS] = {
+    "head", "neck", "shoulder_l", "shoulder_r", "elbow_l", "elbow_r", "hand_l", "hand_r",
+    "torso", "hip_l", "hip_r", "knee_l", "knee_r", "foot_l", "foot_r"
+};
+
+const char *jointName(int joint) {
+
+    return joint >= 0 && joint < SKELETON_NUM_JOINTS ? kJointNames[joint] : "unknown";
+}
+
+int parseJointName(const char *name) {
+
+    if (!name)
+        return -1;
+
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+        if (!strcasecmp(name, kJointNames[j]))
+            return j;
+    }
+
+    return -1;
+}
+
+int serializedFrameSize(const SkeletonFrame *frame) {
+
+    return kHeaderBytes + frame->nUsers * kUserBytes;
+}
+
+int serializeFrame(const SkeletonFrame *frame, uint8_t *buffer, int capacity) {
+
+    int size = serializedFrameSize(frame);
+    if (size > capacity)
+        return -1;
+
+    uint16_t width = (uint16_t)frame->width;
+    uint16_t height = (uint16_t)frame->height;
+    uint8_t nUsers = (uint8_t)frame->nUsers;
+
+    uint8_t *p = buffer;
+    p = put(p, &frame->timestamp, 8);
+    p = put(p, &frame->hostTime, 8);
+    p = put(p, &frame->frameIndex, 4);
+    p = put(p, &frame->sensorId, 4);
+    p = put(p, &width, 2);
+    p = put(p, &height, 2);
+    p = put(p, &nUsers, 1);
+
+    const int arrayBytes = SKELETON_NUM_JOINTS * sizeof(float);
+
+    for (int i = 0; i < frame->nUsers; i++) {
+        const SkeletonUser &user = frame->users[i];
+        p = put(p, &user.id, 4);
+        p = put(p, &user.flags, 4);
+        p = put(p, user.x, arrayBytes);
+        p = put(p, user.y, arrayBytes);
+        p = put(p, user.z, arrayBytes);
+        p = put(p, user.confidence, arrayBytes);
+        p = put(p, user.u, arrayBytes);
+        p = put(p, user.v, arrayBytes);
+    }
+
+    return size;
+}
+
+bool deserializeFrame(const uint8_t *buffer, int length, SkeletonFrame *frame) {
+
+    if (length < kHeaderBytes)
+        return false;
+
+    uint16_t width, height;
+    uint8_t nUsers;
+
+    const uint8_t *p = buffer;
+    p = get(p, &frame->timestamp, 8);
+    p = get(p, &frame->hostTime, 8);
+    p = get(p, &frame->frameIndex, 4);
+    p = get(p, &frame->sensorId, 4);
+    p = get(p, &width, 2);
+    p = get(p, &height, 2);
+    p = get(p, &nUsers, 1);
+
+    if (nUsers > SKELETON_MAX_USERS || length < kHeaderBytes + nUsers * kUserBytes)
+        return false;
+
+    frame->width = width;
+    frame->height = height;
+    frame->nUsers = nUsers;
+
+    const int arrayBytes = SKELETON_NUM_JOINTS * sizeof(float);
+
+    for (int i = 0; i < nUsers; i++) {
+        SkeletonUser &user = frame->users[i];
+        p = get(p, &user.id, 4);
+        p = get(p, &user.flags, 4);
+        p = get(p, user.x, arrayBytes);
+        p = get(p, user.y, arrayBytes);
+        p = get(p, user.z, arrayBytes);
+        p = get(p, user.confidence, arrayBytes);
+        p = get(p, user.u, arrayBytes);
+        p = get(p, user.v, arrayBytes);
+    }
+
+    return true;
+}
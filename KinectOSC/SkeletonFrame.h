@@ -0,0 +1,105 @@
+//
+//  SkeletonFrame.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Compact, SDK-free skeleton frame layout. Joint data is stored as arrays per
+//  coordinate so mapping code can loop over joints without touching NiTE objects.
+
+#ifndef __KinectOSC__SkeletonFrame__
+#define __KinectOSC__SkeletonFrame__
+
+#include <stdint.h>
+#include <string.h>
+#include <cmath>
+
+#define SKELETON_MAX_USERS  6
+#define SKELETON_NUM_JOINTS 15
+
+/* Joint indices, numbered as nite::JointType so NiTE joints copy straight across */
+enum {
+    SKEL_HEAD = 0,
+    SKEL_NECK,
+    SKEL_SHOULDER_L,
+    SKEL_SHOULDER_R,
+    SKEL_ELBOW_L,
+    SKEL_ELBOW_R,
+    SKEL_HAND_L,
+    SKEL_HAND_R,
+    SKEL_TORSO,
+    SKEL_HIP_L,
+    SKEL_HIP_R,
+    SKEL_KNEE_L,
+    SKEL_KNEE_R,
+    SKEL_FOOT_L,
+    SKEL_FOOT_R
+};
+
+/* User state flags */
+enum {
+    USER_VISIBLE = 1 << 0,
+    USER_NEW     = 1 << 1,
+    USER_LOST    = 1 << 2,
+    USER_TRACKED = 1 << 3       // Skeleton is tracked and joint data is valid
+};
+
+struct SkeletonUser {
+    int id;
+    int flags;
+    float x[SKELETON_NUM_JOINTS];           // Sensor or world space (mm)
+    float y[SKELETON_NUM_JOINTS];
+    float z[SKELETON_NUM_JOINTS];
+    float confidence[SKELETON_NUM_JOINTS];
+    float u[SKELETON_NUM_JOINTS];           // Depth-image coordinates (pixels)
+    float v[SKELETON_NUM_JOINTS];
+};
+
+struct SkeletonFrame {
+    uint64_t timestamp;         // Sensor timestamp (microseconds)
+    uint64_t hostTime;          // Monotonic host time at capture (microseconds)
+    int frameIndex;
+    int sensorId;
+    int width;                  // Depth frame size, for the u/v coordinates
+    int height;
+    int nUsers;
+    SkeletonUser users[SKELETON_MAX_USERS];
+};
+
+/* Serialized sizes: timestamp, hostTime, frameIndex, sensorId, width, height, nUsers, then
+   per user its id, flags and six joint arrays */
+#define SKELETON_FRAME_HEADER_BYTES (8 + 8 + 4 + 4 + 2 + 2 + 1)
+#define SKELETON_FRAME_USER_BYTES (4 + 4 + 6 * SKELETON_NUM_JOINTS * 4)
+#define SKELETON_FRAME_MAX_BYTES (SKELETON_FRAME_HEADER_BYTES + SKELETON_MAX_USERS * SKELETON_FRAME_USER_BYTES)
+
+/* Joint names used in text descriptions: head, neck, shoulder_l, ..., foot_r */
+const char *jointName(int joint);
+int parseJointName(const char *name);      // Case-insensitive; -1 if unknown or NULL
+
+/* Flat binary form of a frame, used for recordings and network transport */
+int serializedFrameSize(const SkeletonFrame *frame);
+int serializeFrame(const SkeletonFrame *frame, uint8_t *buffer, int capacity);     // Returns bytes written, or -1
+bool deserializeFrame(const uint8_t *buffer, int length, SkeletonFrame *frame);
+
+inline void clearSkeletonFrame(SkeletonFrame *frame) {
+    memset(frame, 0, sizeof(SkeletonFrame));
+}
+
+/* Project a sensor-space point to depth-image coordinates using the Kinect field of view,
+   the same conversion OpenNI applies in convertJointCoordinatesToDepth() */
+inline void projectToDepthImage(float x, float y, float z, int width, int height, float *u, float *v) {
+
+    const float xzFactor = 1.1114666f;  // tan(58.1 deg / 2) * 2
+    const float yzFactor = 0.8336341f;  // tan(45.3 deg / 2) * 2
+
+    if (z <= 0) {
+        *u = 0;
+        *v = 0;
+        return;
+    }
+
+    *u = (x / (z * xzFactor) + 0.5f) * width;
+    *v = (0.5f - y / (z * yzFactor)) * height;
+}
+
+#endif /* defined(__KinectOSC__SkeletonFrame__) */
@@ -0,0 +1,286 @@
+//
+//  SkeletonFusion.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "SkeletonFusion.h"
+
+SkeletonFusion::SkeletonFusion() {
+
+    associationRadius_ = 400;
+    alignmentWindow_ = 100000;      // 100 ms, three frames at 30 Hz
+
+    reset();
+}
+
+void SkeletonFusion::reset() {
+
+    for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+        tracks_[i].id = 0;
+        tracks_[i].active = false;
+    }
+
+    nextId_ = 1;
+    frameIndex_ = 0;
+}
+
+/* Linearly extrapolate the sensor's joints from its last two frames to the fusion time,
+   so a sensor that delivered its frame a few ms earlier doesn't lag the others */
+void SkeletonFusion::alignCandidate(Candidate *c, const SkeletonFrame *latest, const SkeletonFrame *previous, uint64_t fusionTime) {
+
+    const SkeletonUser *user = c->user;
+    const SkeletonUser *prevUser = NULL;
+
+    if (previous && previous->hostTime < latest->hostTime) {
+        for (int i = 0; i < previous->nUsers; i++) {
+            if (previous->users[i].id == user->id && (previous->users[i].flags & USER_TRACKED)) {
+                prevUser = &previous->users[i];
+                break;
+            }
+        }
+    }
+
+    float alpha = 0;
+    if (prevUser) {
+        alpha = (float)(fusionTime - latest->hostTime) / (float)(latest->hostTime - previous->hostTime);
+        if (alpha > 1) alpha = 1;
+    }
+
+    float sum = 0;
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+
+        c->x[j] = user->x[j];
+        c->y[j] = user->y[j];
+        c->z[j] = user->z[j];
+
+        if (prevUser && prevUser->confidence[j] > 0) {
+            c->x[j] += (user->x[j] - prevUser->x[j]) * alpha;
+            c->y[j] += (user->y[j] - prevUser->y[j]) * alpha;
+            c->z[j] += (user->z[j] - prevUser->z[j]) * alpha;
+        }
+
+        sum += user->confidence[j];
+    }
+
+    c->meanConfidence = sum / SKELETON_NUM_JOINTS;
+}
+
+/* Match a fused skeleton to the nearest unmatched track, or start a new one */
+int SkeletonFusion::assignTrack(const float *torso, bool *isNew) {
+
+    int best = -1;
+    float bestDist = associationRadius_ * associationRadius_;
+
+    for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+
+        if (!tracks_[i].active || trackMatched_[i])
+            continue;
+
+        float dx = torso[0] - tracks_[i].torso[0];
+        float dy = torso[1] - tracks_[i].torso[1];
+        float dz = torso[2] - tracks_[i].torso[2];
+        float dist = dx*dx + dy*dy + dz*dz;
+
+        if (dist < bestDist) {
+            bestDist = dist;
+            best = i;
+        }
+    }
+
+    *isNew = false;
+
+    if (best < 0) {
+        for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+            if (!tracks_[i].active && !trackMatched_[i]) {
+                best = i;
+                tracks_[i].active = true;
+                tracks_[i].id = nextId_++;
+                *isNew = true;
+                break;
+            }
+        }
+    }
+
+    if (best < 0)
+        return -1;
+
+    trackMatched_[best] = true;
+    tracks_[best].torso[0] = torso[0];
+    tracks_[best].torso[1] = torso[1];
+    tracks_[best].torso[2] = torso[2];
+
+    return best;
+}
+
+void SkeletonFusion::fuse(const SkeletonFrame *const *latest, const SkeletonFrame *const *previous,
+                          int nSensors, SkeletonFrame *out) {
+
+    if (nSensors > FUSION_MAX_SENSORS)
+        nSensors = FUSION_MAX_SENSORS;
+
+    /* Fuse at the time of the newest frame */
+    uint64_t fusionTime = 0;
+    const SkeletonFrame *newest = NULL;
+
+    for (int s = 0; s < nSensors; s++) {
+        if (latest[s] && latest[s]->hostTime >= fusionTime) {
+            fusionTime = latest[s]->hostTime;
+            newest = latest[s];
+        }
+    }
+
+    out->nUsers = 0;
+    if (!newest)
+        return;
+
+    out->timestamp = fusionTime;
+    out->hostTime = fusionTime;
+    out->frameIndex = frameIndex_++;
+    out->sensorId = -1;
+    out->width = newest->width;
+    out->height = newest->height;
+
+    /* Gather time-aligned candidates from every sensor inside the window */
+    int nCandidates = 0;
+
+    for (int s = 0; s < nSensors; s++) {
+
+        if (!latest[s] || fusionTime - latest[s]->hostTime > alignmentWindow_)
+            continue;
+
+        for (int i = 0; i < latest[s]->nUsers; i++) {
+
+            const SkeletonUser *user = &latest[s]->users[i];
+            if (!(user->flags & USER_TRACKED))
+                continue;
+
+            Candidate *c = &candidates_[nCandidates++];
+            c->sensor = s;
+            c->user = user;
+            alignCandidate(c, latest[s], previous[s], fusionTime);
+        }
+    }
+
+    /* Most confident views seed the clusters */
+    for (int i = 1; i < nCandidates; i++) {
+        Candidate tmp = candidates_[i];
+        int k = i - 1;
+        while (k >= 0 && candidates_[k].meanConfidence < tmp.meanConfidence) {
+            candidates_[k+1] = candidates_[k];
+            k--;
+        }
+        candidates_[k+1] = tmp;
+    }
+
+    /* Associate: a candidate joins the nearest cluster (by torso) that doesn't already
+       have a view from the same sensor */
+    int members[SKELETON_MAX_USERS][FUSION_MAX_SENSORS];
+    int nMembers[SKELETON_MAX_USERS];
+    int sensorMask[SKELETON_MAX_USERS];
+    int nClusters = 0;
+    const float radius2 = associationRadius_ * associationRadius_;
+
+    for (int i = 0; i < nCandidates; i++) {
+
+        const Candidate &c = candidates_[i];
+        int best = -1;
+        float bestDist = radius2;
+
+        for (int k = 0; k < nClusters; k++) {
+
+            if (sensorMask[k] & (1 << c.sensor))
+                continue;
+
+            const Candidate &seed = candidates_[members[k][0]];
+            float dx = c.x[SKEL_TORSO] - seed.x[SKEL_TORSO];
+            float dy = c.y[SKEL_TORSO] - seed.y[SKEL_TORSO];
+            float dz = c.z[SKEL_TORSO] - seed.z[SKEL_TORSO];
+            float dist = dx*dx + dy*dy + dz*dz;
+
+            if (dist < bestDist) {
+                bestDist = dist;
+                best = k;
+            }
+        }
+
+        if (best < 0) {
+            if (nClusters == SKELETON_MAX_USERS)
+                continue;
+            best = nClusters++;
+            nMembers[best] = 0;
+            sensorMask[best] = 0;
+        }
+
+        members[best][nMembers[best]++] = i;
+        sensorMask[best] |= 1 << c.sensor;
+    }
+
+    /* Merge each cluster by confidence-weighted averaging */
+    for (int i = 0; i < SKELETON_MAX_USERS; i++)
+        trackMatched_[i] = false;
+
+    for (int k = 0; k < nClusters; k++) {
+
+        SkeletonUser &user = out->users[out->nUsers];
+
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+
+            float wSum = 0, x = 0, y = 0, z = 0, cMax = 0;
+
+            for (int m = 0; m < nMembers[k]; m++) {
+                const Candidate &c = candidates_[members[k][m]];
+                float w = c.user->confidence[j];
+                x += w * c.x[j];
+                y += w * c.y[j];
+                z += w * c.z[j];
+                wSum += w;
+                cMax = w > cMax ? w : cMax;
+            }
+
+            /* No sensor has any confidence in this joint; take the seed view */
+            if (wSum <= 0) {
+                const Candidate &seed = candidates_[members[k][0]];
+                x = seed.x[j]; y = seed.y[j]; z = seed.z[j];
+                wSum = 1;
+            }
+
+            user.x[j] = x / wSum;
+            user.y[j] = y / wSum;
+            user.z[j] = z / wSum;
+            user.confidence[j] = cMax;
+
+            /* World frame is the reference sensor's frame, so project from its viewpoint */
+            projectToDepthImage(user.x[j], user.y[j], user.z[j], out->width, out->height,
+                                &user.u[j], &user.v[j]);
+        }
+
+        float torso[3] = {user.x[SKEL_TORSO], user.y[SKEL_TORSO], user.z[SKEL_TORSO]};
+        bool isNew;
+        int track = assignTrack(torso, &isNew);
+        if (track < 0)
+            continue;
+
+        user.id = tracks_[track].id;
+        user.flags = USER_VISIBLE | USER_TRACKED | (isNew ? USER_NEW : 0);
+        out->nUsers++;
+    }
+
+    /* Tracks nobody matched this frame are reported lost once */
+    for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+
+        if (!tracks_[i].active || trackMatched_[i])
+            continue;
+
+        tracks_[i].active = false;
+
+        /* The slot may still hold whoever was in it last time */
+        if (out->nUsers < SKELETON_MAX_USERS) {
+            SkeletonUser &user = out->users[out->nUsers++];
+            memset(&user, 0, sizeof(user));
+            user.id = tracks_[i].id;
+            user.flags = USER_LOST;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+//
+//  SkeletonFusion.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Merges skeleton frames from several sensors, already transformed into a shared
+//  world frame, into one frame with a single skeleton per performer.
+
+#ifndef __KinectOSC__SkeletonFusion__
+#define __KinectOSC__SkeletonFusion__
+
+#include <iostream>
+
+#include "SkeletonFrame.h"
+
+#define FUSION_MAX_SENSORS 4
+
+class SkeletonFusion {
+
+    /* One sensor's view of a user, aligned to the fusion time */
+    struct Candidate {
+        int sensor;
+        const SkeletonUser *user;
+        float x[SKELETON_NUM_JOINTS];
+        float y[SKELETON_NUM_JOINTS];
+        float z[SKELETON_NUM_JOINTS];
+        float meanConfidence;
+    };
+
+    /* Fused users persist across frames so their ids stay stable */
+    struct Track {
+        int id;
+        bool active;
+        float torso[3];
+    };
+
+public:
+
+    SkeletonFusion();
+
+    /* Setters */
+    void setAssociationRadius(float mm) { associationRadius_ = mm; }
+    void setAlignmentWindow(uint64_t micros) { alignmentWindow_ = micros; }
+
+    /* Fuse the latest frame from each sensor. previous[s] is that sensor's frame before
+       latest[s] (or NULL) and is used to extrapolate joints to a common time. Sensors
+       whose latest frame is older than the alignment window are left out. Fused frames
+       are numbered by the fusion and timestamped with the host time fused to, since the
+       sensors' own frame indices and clocks don't agree with each other. */
+    void fuse(const SkeletonFrame *const *latest, const SkeletonFrame *const *previous,
+              int nSensors, SkeletonFrame *out);
+
+    void reset();
+
+private:
+
+    void alignCandidate(Candidate *c, const SkeletonFrame *latest, const SkeletonFrame *previous, uint64_t fusionTime);
+    int assignTrack(const float *torso, bool *isNew);
+
+private:
+
+    float associationRadius_;
+    uint64_t alignmentWindow_;
+
+    Candidate candidates_[FUSION_MAX_SENSORS * SKELETON_MAX_USERS];
+    Track tracks_[SKELETON_MAX_USERS];
+    bool trackMatched_[SKELETON_MAX_USERS];
+    int nextId_;
+    int frameIndex_;                    // Of the next fused frame
+};
+
+#endif /* defined(__KinectOSC__SkeletonFusion__) */
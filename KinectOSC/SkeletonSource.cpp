@@ -0,0 +1,629 @@
+//
+//  SkeletonSource.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "SkeletonSource.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+static const char kRecordingMagic[8] = {'K', 'O', 'S', 'C', 'S', 'K', 'L', '1'};
+
+#pragma mark - NiteSkeletonSource
+
+/* One copy out of NiTE's frame into a pooled buffer, or an invalid buffer if none is free */
+static FrameBuffer copyImage(FrameBufferPool &pool, const uint16_t *pixels, int width, int height, int strideInPixels) {
+
+    FrameBuffer image = pool.acquire();
+    if (!image.isValid() || !pixels)
+        return FrameBuffer();
+
+    image.setSize(width, height);
+    for (int y = 0; y < image.height(); y++)
+        memcpy(image.data() + y * image.stride(), pixels + y * strideInPixels, image.width() * sizeof(uint16_t));
+
+    return image;
+}
+
+NiteSkeletonSource::NiteSkeletonSource() : imagePool_(NITE_IMAGE_BUFFERS), ring_(NITE_FRAME_RING) {
+
+    floorCal_ = NULL;
+    captureImages_ = false;
+    open_ = false;
+    timeoutMs_ = 100;
+}
+
+NiteSkeletonSource::~NiteSkeletonSource() {
+
+    close();
+}
+
+bool NiteSkeletonSource::open(const char *uri) {
+
+    close();
+
+    uri_ = uri ? uri : "";
+
+    if (device_.open(uri) != openni::STATUS_OK) {
+        printf("%s: Failed to open device\n%s\n",
+               __PRETTY_FUNCTION__, openni::OpenNI::getExtendedError());
+        return false;
+    }
+
+    if (userTracker_.create(&device_) != nite::STATUS_OK) {
+        printf("%s: Failed to create user tracker\n", __PRETTY_FUNCTION__);
+        device_.close();
+        return false;
+    }
+
+    userTracker_.addNewFrameListener(this);
+
+    open_ = true;
+    return true;
+}
+
+void NiteSkeletonSource::close() {
+
+    if (open_) {
+        userTracker_.removeNewFrameListener(this);
+
+        /* Give NiTE back any frames still queued before the tracker goes away */
+        ring_.clear();
+
+        depth_.release();
+        userMap_.release();
+        userTracker_.destroy();
+        device_.close();
+        open_ = false;
+    }
+}
+
+bool NiteSkeletonSource::reconnect() {
+
+    string uri = uri_;
+    close();
+
+    return open(uri.empty() ? NULL : uri.c_str());
+}
+
+/* Runs on NiTE's thread, so it only queues a reference; the skeletons are read out later */
+void NiteSkeletonSource::onNewFrame(nite::UserTracker &tracker) {
+
+    uint64_t arrival = hostTimeMicros();
+
+    nite::UserTrackerFrameRef niteFrame;
+    if (tracker.readFrame(&niteFrame) == nite::STATUS_OK)
+        ring_.push(niteFrame, arrival);
+}
+
+void NiteSkeletonSource::wake() {
+
+    ring_.wake();
+}
+
+/* Each joint is read from the NiTE skeleton exactly once, straight into the frame's arrays */
+bool NiteSkeletonSource::readFrame(SkeletonFrame *frame) {
+
+    if (!open_)
+        return false;
+
+    /* Wait for the listener to queue a frame */
+    nite::UserTrackerFrameRef niteFrame;
+    uint64_t arrival = 0;
+
+    if (!ring_.pop(&niteFrame, &arrival, timeoutMs_) || !niteFrame.isValid())
+        return false;
+
+    openni::VideoFrameRef depthFrame = niteFrame.getDepthFrame();
+
+    if (floorCal_ && floorCal_->wantsFrames())
+        floorCal_->addDepthFrame((const uint16_t *)depthFrame.getData(),
+                                 depthFrame.getWidth(), depthFrame.getHeight(),
+                                 depthFrame.getStrideInBytes() / sizeof(openni::DepthPixel));
+
+    /* Consumers share these copies; NiTE's frame goes back as soon as this returns */
+    depth_.release();
+    userMap_.release();
+
+    if (captureImages_) {
+
+        depth_ = copyImage(imagePool_, (const uint16_t *)depthFrame.getData(), depthFrame.getWidth(), depthFrame.getHeight(),
+                           depthFrame.getStrideInBytes() / sizeof(openni::DepthPixel));
+        depth_.setTimestamp(niteFrame.getTimestamp(), niteFrame.getFrameIndex());
+
+        const nite::UserMap &userMap = niteFrame.getUserMap();
+        userMap_ = copyImage(imagePool_, (const uint16_t *)userMap.getPixels(), userMap.getWidth(), userMap.getHeight(),
+                             userMap.getStride() / sizeof(nite::UserId));
+        userMap_.setTimestamp(niteFrame.getTimestamp(), niteFrame.getFrameIndex());
+    }
+
+    frame->timestamp = niteFrame.getTimestamp();
+    frame->hostTime = arrival;
+    frame->frameIndex = niteFrame.getFrameIndex();
+    frame->width = depthFrame.getWidth();
+    frame->height = depthFrame.getHeight();
+
+    const nite::Array<nite::UserData> &users = niteFrame.getUsers();
+
+    int n = 0;
+    for (int i = 0; i < users.getSize() && n < SKELETON_MAX_USERS; i++) {
+
+        const nite::UserData &user = users[i];
+        SkeletonUser &out = frame->users[n++];
+
+        out.id = user.getId();
+        out.flags = 0;
+        if (user.isVisible()) out.flags |= USER_VISIBLE;
+        if (user.isNew())     out.flags |= USER_NEW;
+        if (user.isLost())    out.flags |= USER_LOST;
+
+        if (user.isNew())
+            userTracker_.startSkeletonTracking(user.getId());
+
+        const nite::Skeleton &skeleton = user.getSkeleton();
+
+        if (skeleton.getState() != nite::SKELETON_TRACKED) {
+            memset(out.confidence, 0, sizeof(out.confidence));
+            continue;
+        }
+
+        out.flags |= USER_TRACKED;
+
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+
+            const nite::SkeletonJoint &joint = skeleton.getJoint((nite::JointType)j);
+            const nite::Point3f &p = joint.getPosition();
+
+            out.x[j] = p.x;
+            out.y[j] = p.y;
+            out.z[j] = p.z;
+            out.confidence[j] = joint.getPositionConfidence();
+
+            userTracker_.convertJointCoordinatesToDepth(p.x, p.y, p.z, &out.u[j], &out.v[j]);
+        }
+    }
+
+    frame->nUsers = n;
+    return true;
+}
+
+bool NiteSkeletonSource::readImages(FrameBuffer *depth, FrameBuffer *userMap) {
+
+    if (!depth_.isValid())
+        return false;
+
+    if (depth)
+        *depth = depth_.share();
+    if (userMap)
+        *userMap = userMap_.share();
+
+    return true;
+}
+
+#pragma mark - ReplaySkeletonSource
+
+ReplaySkeletonSource::ReplaySkeletonSource() {
+
+    position_ = 0;
+    realtime_ = false;
+    loop_ = false;
+    firstTimestamp_ = 0;
+    startTime_ = 0;
+}
+
+bool ReplaySkeletonSource::open(const char *path) {
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("%s: Can't open \"%s\"\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data_.resize(size > 0 ? size : 0);
+    size_t nRead = size > 0 ? fread(&data_[0], 1, size, file) : 0;
+    fclose(file);
+
+    if ((long)nRead != size || size < (long)sizeof(kRecordingMagic) ||
+        memcmp(&data_[0], kRecordingMagic, sizeof(kRecordingMagic)) != 0) {
+        printf("%s: \"%s\" is not a skeleton recording\n", __PRETTY_FUNCTION__, path);
+        data_.clear();
+        return false;
+    }
+
+    /* Index the length-prefixed records */
+    offsets_.clear();
+    size_t pos = sizeof(kRecordingMagic);
+
+    while (pos + 4 <= data_.size()) {
+        uint32_t length;
+        memcpy(&length, &data_[pos], 4);
+        if (pos + 4 + length > data_.size())
+            break;
+        offsets_.push_back(pos);
+        pos += 4 + length;
+    }
+
+    rewind();
+    return true;
+}
+
+void ReplaySkeletonSource::rewind() {
+
+    position_ = 0;
+    startTime_ = 0;
+}
+
+bool ReplaySkeletonSource::readFrame(SkeletonFrame *frame) {
+
+    if (position_ >= offsets_.size()) {
+        if (!loop_ || offsets_.empty())
+            return false;
+        rewind();
+    }
+
+    size_t pos = offsets_[position_++];
+    uint32_t length;
+    memcpy(&length, &data_[pos], 4);
+
+    if (!deserializeFrame(&data_[pos + 4], length, frame))
+        return false;
+
+    /* Pace by the recorded sensor timestamps */
+    if (realtime_) {
+        uint64_t now = hostTimeMicros();
+        if (startTime_ == 0) {
+            startTime_ = now;
+            firstTimestamp_ = frame->timestamp;
+        }
+
+        uint64_t due = startTime_ + (frame->timestamp - firstTimestamp_);
+        if (due > now)
+            usleep((useconds_t)(due - now));
+    }
+
+    frame->hostTime = hostTimeMicros();
+    return true;
+}
+
+#pragma mark - SkeletonFileWriter
+
+bool SkeletonFileWriter::open(const char *path) {
+
+    close();
+
+    file_ = fopen(path, "wb");
+    if (!file_) {
+        printf("%s: Can't create \"%s\"\n", __PRETTY_FUNCTION__, path);
+        return false;
+    }
+
+    fwrite(kRecordingMagic, 1, sizeof(kRecordingMagic), file_);
+    return true;
+}
+
+void SkeletonFileWriter::close() {
+
+    if (file_) {
+        fclose(file_);
+        file_ = NULL;
+    }
+}
+
+bool SkeletonFileWriter::writeFrame(const SkeletonFrame *frame) {
+
+    if (!file_)
+        return false;
+
+    int length = serializeFrame(frame, buffer_, sizeof(buffer_));
+    if (length < 0)
+        return false;
+
+    uint32_t prefix = (uint32_t)length;
+    return fwrite(&prefix, 4, 1, file_) == 1 && fwrite(buffer_, 1, length, file_) == (size_t)length;
+}
+
+#pragma mark - SyntheticSkeletonSource
+
+/* Joint offsets from the torso (mm) for a standing performer facing the sensor */
+const float kStandingPose[SKELETON_NUM_JOINTS][3] = {
+    {    0,  450, 0 },      // Head
+    {    0,  250, 0 },      // Neck
+    { -180,  230, 0 },      // Left shoulder
+    {  180,  230, 0 },      // Right shoulder
+    { -250,    0, 0 },      // Left elbow
+    {  250,    0, 0 },      // Right elbow
+    { -280, -250, 0 },      // Left hand
+    {  280, -250, 0 },      // Right hand
+    {    0,    0, 0 },      // Torso
+    { -100, -200, 0 },      // Left hip
+    {  100, -200, 0 },      // Right hip
+    { -110, -620, 0 },      // Left knee
+    {  110, -620, 0 },      // Right knee
+    { -120, -1020, 0 },     // Left foot
+    {  120, -1020, 0 }      // Right foot
+};
+
+SyntheticSkeletonSource::SyntheticSkeletonSource(int nUsers, float frameRate, unsigned int seed) {
+
+    nUsers_ = nUsers < SKELETON_MAX_USERS ? nUsers : SKELETON_MAX_USERS;
+    frameRate_ = frameRate;
+    seed_ = seed;
+    noise_ = 5;
+    confidence_ = 1;
+    realtime_ = true;
+
+    /* Spread users across the stage, 2.5 m from the sensor */
+    for (int i = 0; i < SKELETON_MAX_USERS; i++) {
+        position_[i][0] = (i - (nUsers_ - 1) / 2.0f) * 800;
+        position_[i][1] = 0;
+        position_[i][2] = 2500;
+    }
+
+    memset(worldToSensor_, 0, sizeof(worldToSensor_));
+    worldToSensor_[0][0] = worldToSensor_[1][1] = worldToSensor_[2][2] = 1;
+
+    frameIndex_ = 0;
+    startTime_ = 0;
+}
+
+void SyntheticSkeletonSource::setUserPosition(int user, float x, float y, float z) {
+
+    if (user < 0 || user >= SKELETON_MAX_USERS)
+        return;
+
+    position_[user][0] = x;
+    position_[user][1] = y;
+    position_[user][2] = z;
+}
+
+void SyntheticSkeletonSource::setSensorPose(const float worldToSensor[3][4]) {
+
+    memcpy(worldToSensor_, worldToSensor, sizeof(worldToSensor_));
+}
+
+/* Uniform noise in [-noise_, noise_] from a deterministic LCG */
+float SyntheticSkeletonSource::nextNoise() {
+
+    seed_ = seed_ * 1103515245u + 12345u;
+    return noise_ * (((seed_ >> 8) & 0xffff) / 32767.5f - 1);
+}
+
+bool SyntheticSkeletonSource::readFrame(SkeletonFrame *frame) {
+
+    /* Pace to the frame rate when standing in for a real device */
+    if (realtime_ && frameRate_ > 0) {
+        if (startTime_ == 0)
+            startTime_ = hostTimeMicros();
+
+        uint64_t due = startTime_ + (uint64_t)(frameIndex_ * 1e6 / frameRate_);
+        uint64_t now = hostTimeMicros();
+        if (due > now)
+            usleep((useconds_t)(due - now));
+    }
+
+    float t = frameRate_ > 0 ? frameIndex_ / frameRate_ : 0;
+
+    frame->timestamp = (uint64_t)(t * 1e6);
+    frame->hostTime = hostTimeMicros();
+    frame->frameIndex = frameIndex_;
+    frame->width = 640;
+    frame->height = 480;
+    frame->nUsers = nUsers_;
+
+    for (int i = 0; i < nUsers_; i++) {
+
+        SkeletonUser &user = frame->users[i];
+        user.id = i + 1;
+        user.flags = USER_VISIBLE | USER_TRACKED | (frameIndex_ == 0 ? USER_NEW : 0);
+
+        /* Gentle sway so consecutive frames differ */
+        float sway = 40 * sinf(2 * (float)M_PI * 0.5f * t + i);
+        const float (*m)[4] = worldToSensor_;
+
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+
+            float wx = position_[i][0] + kStandingPose[j][0] + sway + nextNoise();
+            float wy = position_[i][1] + kStandingPose[j][1] + nextNoise();
+            float wz = position_[i][2] + kStandingPose[j][2] + nextNoise();
+
+            user.x[j] = m[0][0]*wx + m[0][1]*wy + m[0][2]*wz + m[0][3];
+            user.y[j] = m[1][0]*wx + m[1][1]*wy + m[1][2]*wz + m[1][3];
+            user.z[j] = m[2][0]*wx + m[2][1]*wy + m[2][2]*wz + m[2][3];
+            user.confidence[j] = confidence_;
+
+            projectToDepthImage(user.x[j], user.y[j], user.z[j], frame->width, frame->height,
+                                &user.u[j], &user.v[j]);
+        }
+    }
+
+    frameIndex_++;
+    return true;
+}
+
+#pragma mark - UdpSkeletonSource
+
+UdpSkeletonSource::UdpSkeletonSource() {
+
+    socket_ = -1;
+    timeoutMs_ = 100;
+    width_ = 640;
+    height_ = 480;
+    running_ = false;
+    woken_ = false;
+    shouldStop_ = false;
+
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&arrived_, NULL);
+}
+
+UdpSkeletonSource::~UdpSkeletonSource() {
+
+    close();
+    pthread_cond_destroy(&arrived_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool UdpSkeletonSource::open(int port) {
+
+    close();
+
+    socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_ < 0) {
+        printf("%s: Can't create socket\n", __PRETTY_FUNCTION__);
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(socket_, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        printf("%s: Can't bind to port %d\n", __PRETTY_FUNCTION__, port);
+        close();
+        return false;
+    }
+
+    /* Don't block forever so the receive thread can notice it should stop */
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    jitter_.reset();
+    decoder_ = SkeletonStreamDecoder();
+    shouldStop_ = false;
+
+    if (pthread_create(&thread_, NULL, staticReceive, (void *)this) != 0) {
+        printf("%s: Error creating receive thread\n", __PRETTY_FUNCTION__);
+        close();
+        return false;
+    }
+
+    running_ = true;
+    return true;
+}
+
+void UdpSkeletonSource::close() {
+
+    if (running_) {
+        shouldStop_ = true;
+        pthread_join(thread_, NULL);
+        running_ = false;
+    }
+
+    if (socket_ >= 0) {
+        ::close(socket_);
+        socket_ = -1;
+    }
+}
+
+void UdpSkeletonSource::wake() {
+
+    pthread_mutex_lock(&mutex_);
+    woken_ = true;
+    pthread_cond_broadcast(&arrived_);
+    pthread_mutex_unlock(&mutex_);
+}
+
+JitterBuffer::Stats UdpSkeletonSource::stats() {
+
+    pthread_mutex_lock(&mutex_);
+    JitterBuffer::Stats stats = jitter_.stats();
+    pthread_mutex_unlock(&mutex_);
+
+    return stats;
+}
+
+void *UdpSkeletonSource::receive() {
+
+    while (!shouldStop_) {
+
+        ssize_t length = recv(socket_, receiveBuffer_, sizeof(receiveBuffer_), 0);
+        if (length <= 0)
+            continue;
+
+        uint64_t arrival = hostTimeMicros();
+        uint16_t sequence;
+        uint64_t sendTime;
+
+        if (!SkeletonStreamDecoder::readHeader(receiveBuffer_, (int)length, &sequence, &sendTime))
+            continue;
+
+        pthread_mutex_lock(&mutex_);
+        if (jitter_.push(sequence, sendTime, receiveBuffer_, (int)length, arrival))
+            pthread_cond_signal(&arrived_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    return 0;
+}
+
+bool UdpSkeletonSource::readFrame(SkeletonFrame *frame) {
+
+    if (!running_)
+        return false;
+
+    uint64_t deadline = hostTimeMicros() + (uint64_t)timeoutMs_ * 1000;
+
+    pthread_mutex_lock(&mutex_);
+
+    /* Packets a delta can't be applied to (after a loss, until the next keyframe) are
+       consumed here rather than reported as failed reads */
+    for (;;) {
+
+        uint64_t now = hostTimeMicros();
+        int length = jitter_.pop(packet_, sizeof(packet_), now);
+
+        if (length > 0) {
+            if (decoder_.decode(packet_, length, frame))
+                break;
+            continue;
+        }
+
+        if (now >= deadline || woken_) {
+            woken_ = false;
+            pthread_mutex_unlock(&mutex_);
+            return false;
+        }
+
+        /* Sleep until the next packet is due, a packet arrives, or the timeout */
+        uint64_t due = jitter_.nextDue();
+        uint64_t wake = (due && due < deadline) ? due : deadline;
+        uint64_t wait = wake > now ? wake - now : 0;
+
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        uint64_t usec = tv.tv_usec + wait;
+        struct timespec ts;
+        ts.tv_sec = tv.tv_sec + usec / 1000000;
+        ts.tv_nsec = (usec % 1000000) * 1000;
+
+        pthread_cond_timedwait(&arrived_, &mutex_, &ts);
+    }
+
+    pthread_mutex_unlock(&mutex_);
+
+    /* Remote joints are sensor space; project them for the depth-image regions */
+    frame->hostTime = hostTimeMicros();
+    frame->width = width_;
+    frame->height = height_;
+
+    for (int i = 0; i < frame->nUsers; i++) {
+        SkeletonUser &user = frame->users[i];
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+            projectToDepthImage(user.x[j], user.y[j], user.z[j], width_, height_, &user.u[j], &user.v[j]);
+    }
+
+    return true;
+}
@@ -0,0 +1,262 @@
+//
+//  SkeletonSource.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Producers of SkeletonFrames. NiteSkeletonSource reads a NiTE user tracker on an
+//  OpenNI device; ReplaySkeletonSource plays back recordings made with
+//  SkeletonFileWriter; SyntheticSkeletonSource generates standing performers and stands
+//  in for real devices; UdpSkeletonSource receives the skeleton stream of a remote capture host.
+//  SessionPlayer (SessionRecording.h) plays back sessions recorded with their depth images.
+
+#ifndef __KinectOSC__SkeletonSource__
+#define __KinectOSC__SkeletonSource__
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "NiTE.h"
+
+#include "SkeletonFrame.h"
+#include "FloorCalibration.h"
+#include "SkeletonStream.h"
+#include "JitterBuffer.h"
+#include "FrameBufferPool.h"
+#include "FrameRing.h"
+#include "Utility.h"
+
+#define NITE_FRAME_RING 4       // Frames NiTE may deliver ahead of the tracking thread
+#define NITE_IMAGE_BUFFERS 16   // Pooled depth and user-map images, in use or free
+
+using namespace std;
+
+class SkeletonSource {
+
+public:
+
+    virtual ~SkeletonSource() {}
+
+    /* Block until the next frame is available and copy it into frame. Returns false if no
+       frame could be read; callers may retry. */
+    virtual bool readFrame(SkeletonFrame *frame) = 0;
+
+    /* Depth and user map of the frame last read, shared rather than copied. Only sources
+       capturing images have them; either may be NULL. */
+    virtual bool readImages(FrameBuffer *, FrameBuffer *) { return false; }
+
+    /* Make a readFrame() blocked on another thread return promptly. Sources whose reads
+       already return within a frame period may ignore it. */
+    virtual void wake() {}
+
+    /* Sources that can lose their device reopen it here */
+    virtual bool canReconnect() { return false; }
+    virtual bool reconnect() { return false; }
+
+    virtual const char *name() = 0;
+};
+
+/* NiTE's new-frame listener only takes a reference to each frame into a preallocated ring;
+   readFrame() sleeps until one is there, so the tracking thread wakes once per frame and a
+   read can time out or be woken when the device stops delivering. If the ring fills, the
+   oldest frame is dropped. */
+class NiteSkeletonSource : public SkeletonSource, public nite::UserTracker::NewFrameListener {
+
+public:
+
+    NiteSkeletonSource();
+    ~NiteSkeletonSource();
+
+    bool open(const char *uri);
+    void close();
+    bool isOpen() { return open_; }
+
+    /* Setters */
+    void setTimeout(int ms) { timeoutMs_ = ms; }
+    void setCaptureImages(bool capture) { captureImages_ = capture; }  // Copy each frame's depth and user map into pooled buffers
+
+    /* Getters */
+    int numOverwritten() { return ring_.numOverwritten(); }     // Frames dropped because the ring was full
+    FrameBufferPool &imagePool() { return imagePool_; }
+
+    bool readFrame(SkeletonFrame *frame);
+    bool readImages(FrameBuffer *depth, FrameBuffer *userMap);
+    void wake();
+    bool canReconnect() { return true; }
+    bool reconnect();
+    const char *name() { return "NiTE"; }
+
+    /* NiTE's thread */
+    void onNewFrame(nite::UserTracker &tracker);
+
+    nite::UserTracker &userTracker() { return userTracker_; }
+
+    /* Depth frames are passed to the floor calibration while it's collecting */
+    void setFloorCalibration(FloorCalibration *floorCal) { floorCal_ = floorCal; }
+
+private:
+
+    openni::Device device_;
+    nite::UserTracker userTracker_;
+    FloorCalibration *floorCal_;
+    bool open_;
+    string uri_;                        // Empty for any device
+    int timeoutMs_;
+
+    /* Images of the last frame read, while capturing */
+    atomic<bool> captureImages_;        // Set from any thread
+    FrameBufferPool imagePool_;
+    FrameBuffer depth_;
+    FrameBuffer userMap_;
+
+    /* Filled by onNewFrame(), drained by readFrame() */
+    FrameRing<nite::UserTrackerFrameRef> ring_;
+};
+
+class ReplaySkeletonSource : public SkeletonSource {
+
+public:
+
+    ReplaySkeletonSource();
+
+    /* Load a recording into memory so playback never touches the disk */
+    bool open(const char *path);
+
+    /* Setters */
+    void setRealtime(bool realtime) { realtime_ = realtime; }   // Pace by recorded timestamps
+    void setLoop(bool loop) { loop_ = loop; }
+    void rewind();
+
+    /* Getters */
+    int numFrames() { return (int)offsets_.size(); }
+    bool atEnd() { return position_ >= offsets_.size(); }
+
+    bool readFrame(SkeletonFrame *frame);
+    const char *name() { return "Replay"; }
+
+private:
+
+    vector<uint8_t> data_;
+    vector<size_t> offsets_;        // Start of each serialized frame in data_
+    size_t position_;
+    bool realtime_;
+    bool loop_;
+
+    uint64_t firstTimestamp_;
+    uint64_t startTime_;
+};
+
+/* Writes frames in the format ReplaySkeletonSource reads */
+class SkeletonFileWriter {
+
+public:
+
+    SkeletonFileWriter() { file_ = NULL; }
+    ~SkeletonFileWriter() { close(); }
+
+    bool open(const char *path);
+    void close();
+    bool writeFrame(const SkeletonFrame *frame);
+
+private:
+
+    FILE *file_;
+    uint8_t buffer_[SKELETON_FRAME_MAX_BYTES];
+};
+
+/* Neutral pose shared by the synthetic sources (torso-relative, mm) */
+extern const float kStandingPose[SKELETON_NUM_JOINTS][3];
+
+class SyntheticSkeletonSource : public SkeletonSource {
+
+public:
+
+    SyntheticSkeletonSource(int nUsers = 1, float frameRate = 30, unsigned int seed = 1);
+
+    /* Setters */
+    void setUserPosition(int user, float x, float y, float z);
+    void setNoise(float mm) { noise_ = mm; }
+    void setConfidence(float confidence) { confidence_ = confidence; }
+    void setRealtime(bool realtime) { realtime_ = realtime; }
+    void setSensorPose(const float worldToSensor[3][4]);
+
+    bool readFrame(SkeletonFrame *frame);
+    const char *name() { return "Synthetic"; }
+
+private:
+
+    float nextNoise();
+
+private:
+
+    int nUsers_;
+    float frameRate_;
+    unsigned int seed_;
+    float noise_;
+    float confidence_;
+    bool realtime_;
+
+    float position_[SKELETON_MAX_USERS][3];     // Torso position of each user (world, mm)
+    float worldToSensor_[3][4];
+
+    int frameIndex_;
+    uint64_t startTime_;
+};
+
+/* Receives the compact stream a remote capture host sends with SkeletonStreamer
+   (STREAM_BINARY). A receive thread feeds a jitter buffer that restores packet order and
+   rides out loss; readFrame() decodes packets in order as they fall due. */
+class UdpSkeletonSource : public SkeletonSource {
+
+public:
+
+    UdpSkeletonSource();
+    ~UdpSkeletonSource();
+
+    bool open(int port);
+    void close();
+
+    /* Setters */
+    void setTimeout(int ms) { timeoutMs_ = ms; }
+    void setFrameSize(int width, int height) { width_ = width; height_ = height; }   // For u/v
+
+    /* Getters */
+    JitterBuffer::Stats stats();
+    int numUndecodable() { return decoder_.numDropped(); }
+
+    bool readFrame(SkeletonFrame *frame);
+    void wake();
+    const char *name() { return "UDP"; }
+
+private:
+
+    void *receive();
+    static void *staticReceive(void *arg) {
+        return ((UdpSkeletonSource *)arg)->receive();
+    }
+
+private:
+
+    int socket_;
+    int timeoutMs_;
+    int width_;
+    int height_;
+
+    pthread_t thread_;
+    atomic<bool> running_;
+    atomic<bool> shouldStop_;
+
+    pthread_mutex_t mutex_;             // Guards jitter_
+    pthread_cond_t arrived_;
+    bool woken_;
+    JitterBuffer jitter_;
+    SkeletonStreamDecoder decoder_;     // Playout side only
+
+    uint8_t receiveBuffer_[SKELETON_STREAM_MAX_BYTES];
+    uint8_t packet_[SKELETON_STREAM_MAX_BYTES];
+};
+
+#endif /* defined(__KinectOSC__SkeletonSource__) */
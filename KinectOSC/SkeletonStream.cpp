@@ -0,0 +1,465 @@
+//
+//  SkeletonStream.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "SkeletonStream.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+
+/* Packet flags */
+enum {
+    STREAM_KEYFRAME = 1 << 0
+};
+
+/* Added to a user's flags when its coordinates are absolute */
+#define STREAM_USER_ABSOLUTE 0x80
+
+static inline uint8_t *put(uint8_t *p, const void *data, int n) {
+    memcpy(p, data, n);
+    return p + n;
+}
+
+static inline const uint8_t *get(const uint8_t *p, void *data, int n) {
+    memcpy(data, p, n);
+    return p + n;
+}
+
+/* Zigzag varints: small differences of either sign take one byte */
+static inline uint8_t *putVarint(uint8_t *p, int value) {
+
+    uint32_t z = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+
+    while (z >= 0x80) {
+        *p++ = (uint8_t)(z | 0x80);
+        z >>= 7;
+    }
+    *p++ = (uint8_t)z;
+
+    return p;
+}
+
+static inline const uint8_t *getVarint(const uint8_t *p, const uint8_t *end, int *value) {
+
+    uint32_t z = 0;
+
+    for (int shift = 0; p < end && shift < 32; shift += 7) {
+        uint8_t b = *p++;
+        z |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = (int)(z >> 1) ^ -(int)(z & 1);
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/* 1 mm steps, clamped to +/- 32 m */
+static inline int16_t quantize(float mm) {
+
+    float q = roundf(mm);
+    if (q > 32767)
+        return 32767;
+    if (q < -32768)
+        return -32768;
+    return (int16_t)q;
+}
+
+#pragma mark - SkeletonStreamEncoder
+
+SkeletonStreamEncoder::SkeletonStreamEncoder(int jointMask, int keyframeInterval) {
+
+    jointMask_ = jointMask & SKELETON_STREAM_ALL_JOINTS;
+    keyframeInterval_ = keyframeInterval > 0 ? keyframeInterval : 1;
+    sinceKeyframe_ = keyframeInterval_;
+    sequence_ = 0;
+    nPrevious_ = 0;
+}
+
+int SkeletonStreamEncoder::encode(const SkeletonFrame *frame, float confThresh, uint8_t *buffer, int capacity) {
+
+    int nJoints = __builtin_popcount(jointMask_);
+    uint8_t nUsers = 0;
+
+    for (int i = 0; i < frame->nUsers; i++) {
+        if (frame->users[i].flags & USER_TRACKED)
+            nUsers++;
+    }
+
+    /* Worst case: three-byte varints for every coordinate */
+    if (SKELETON_STREAM_HEADER_BYTES + nUsers * (4 + nJoints * 9) > capacity)
+        return -1;
+
+    bool keyframe = sinceKeyframe_ >= keyframeInterval_;
+
+    uint8_t magic[2] = { 'K', 'S' };
+    uint8_t version = SKELETON_STREAM_VERSION;
+    uint8_t flags = keyframe ? STREAM_KEYFRAME : 0;
+    uint16_t mask = (uint16_t)jointMask_;
+
+    uint8_t *p = buffer;
+    p = put(p, magic, 2);
+    p = put(p, &version, 1);
+    p = put(p, &flags, 1);
+    p = put(p, &sequence_, 2);
+    p = put(p, &mask, 2);
+    p = put(p, &frame->timestamp, 8);
+    p = put(p, &frame->frameIndex, 4);
+    p = put(p, &nUsers, 1);
+
+    int nCurrent = 0;
+    int currentId[SKELETON_MAX_USERS];
+    int16_t current[SKELETON_MAX_USERS][SKELETON_NUM_JOINTS][3];
+
+    for (int i = 0; i < frame->nUsers; i++) {
+
+        const SkeletonUser &user = frame->users[i];
+        if (!(user.flags & USER_TRACKED))
+            continue;
+
+        /* Users missing from the previous packet are sent absolute */
+        int prev = -1;
+        for (int k = 0; k < nPrevious_ && !keyframe && prev < 0; k++) {
+            if (previousId_[k] == user.id)
+                prev = k;
+        }
+
+        int16_t (*q)[3] = current[nCurrent];
+        uint16_t confident = 0;
+
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+            if (!(jointMask_ & (1 << j)))
+                continue;
+            q[j][0] = quantize(user.x[j]);
+            q[j][1] = quantize(user.y[j]);
+            q[j][2] = quantize(user.z[j]);
+            if (user.confidence[j] > confThresh)
+                confident |= 1 << j;
+        }
+
+        uint8_t id = (uint8_t)user.id;
+        uint8_t userFlags = (uint8_t)(user.flags & 0x0f) | (prev < 0 ? STREAM_USER_ABSOLUTE : 0);
+
+        p = put(p, &id, 1);
+        p = put(p, &userFlags, 1);
+        p = put(p, &confident, 2);
+
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+            if (!(jointMask_ & (1 << j)))
+                continue;
+            for (int a = 0; a < 3; a++) {
+                if (prev < 0)
+                    p = put(p, &q[j][a], 2);
+                else
+                    p = putVarint(p, q[j][a] - previous_[prev][j][a]);
+            }
+        }
+
+        currentId[nCurrent++] = user.id;
+    }
+
+    /* The decoder's reference for the next delta packet */
+    nPrevious_ = nCurrent;
+    memcpy(previousId_, currentId, nCurrent * sizeof(int));
+    memcpy(previous_, current, nCurrent * sizeof(current[0]));
+
+    sinceKeyframe_ = keyframe ? 1 : sinceKeyframe_ + 1;
+    sequence_++;
+
+    return (int)(p - buffer);
+}
+
+#pragma mark - SkeletonStreamDecoder
+
+SkeletonStreamDecoder::SkeletonStreamDecoder() {
+
+    synced_ = false;
+    sequence_ = 0;
+    jointMask_ = 0;
+    nDropped_ = 0;
+    nPrevious_ = 0;
+}
+
+bool SkeletonStreamDecoder::decode(const uint8_t *buffer, int length, SkeletonFrame *frame) {
+
+    if (length < SKELETON_STREAM_HEADER_BYTES)
+        return false;
+
+    uint8_t magic[2], version, flags, nUsers;
+    uint16_t sequence, mask;
+    uint64_t timestamp;
+    int frameIndex;
+
+    const uint8_t *p = buffer;
+    const uint8_t *end = buffer + length;
+    p = get(p, magic, 2);
+    p = get(p, &version, 1);
+    p = get(p, &flags, 1);
+    p = get(p, &sequence, 2);
+    p = get(p, &mask, 2);
+    p = get(p, &timestamp, 8);
+    p = get(p, &frameIndex, 4);
+    p = get(p, &nUsers, 1);
+
+    if (magic[0] != 'K' || magic[1] != 'S' || version != SKELETON_STREAM_VERSION || nUsers > SKELETON_MAX_USERS)
+        return false;
+
+    bool keyframe = flags & STREAM_KEYFRAME;
+
+    /* A delta only applies on top of the packet right before it */
+    if (!keyframe && (!synced_ || sequence != (uint16_t)(sequence_ + 1) || mask != jointMask_)) {
+        synced_ = false;
+        nDropped_++;
+        return false;
+    }
+
+    clearSkeletonFrame(frame);
+    frame->timestamp = timestamp;
+    frame->frameIndex = frameIndex;
+    frame->nUsers = nUsers;
+
+    int16_t current[SKELETON_MAX_USERS][SKELETON_NUM_JOINTS][3];
+    int currentId[SKELETON_MAX_USERS];
+
+    for (int i = 0; i < nUsers; i++) {
+
+        uint8_t id, userFlags;
+        uint16_t confident;
+
+        if (end - p < 4) {
+            synced_ = false;
+            return false;
+        }
+
+        p = get(p, &id, 1);
+        p = get(p, &userFlags, 1);
+        p = get(p, &confident, 2);
+
+        int prev = -1;
+        if (!(userFlags & STREAM_USER_ABSOLUTE)) {
+            for (int k = 0; k < nPrevious_ && prev < 0; k++) {
+                if (previousId_[k] == id)
+                    prev = k;
+            }
+            if (prev < 0) {
+                synced_ = false;
+                return false;
+            }
+        }
+
+        SkeletonUser &user = frame->users[i];
+        user.id = id;
+        user.flags = userFlags & 0x0f;
+
+        int16_t (*q)[3] = current[i];
+
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+
+            if (!(mask & (1 << j)))
+                continue;
+
+            for (int a = 0; a < 3; a++) {
+                if (prev < 0) {
+                    if (end - p < 2) {
+                        synced_ = false;
+                        return false;
+                    }
+                    p = get(p, &q[j][a], 2);
+                }
+                else {
+                    int delta;
+                    p = getVarint(p, end, &delta);
+                    if (!p) {
+                        synced_ = false;
+                        return false;
+                    }
+                    q[j][a] = (int16_t)(previous_[prev][j][a] + delta);
+                }
+            }
+
+            user.x[j] = q[j][0];
+            user.y[j] = q[j][1];
+            user.z[j] = q[j][2];
+            user.confidence[j] = (confident & (1 << j)) ? 1 : 0;
+        }
+
+        currentId[i] = id;
+    }
+
+    nPrevious_ = nUsers;
+    memcpy(previousId_, currentId, nUsers * sizeof(int));
+    memcpy(previous_, current, nUsers * sizeof(current[0]));
+
+    synced_ = true;
+    sequence_ = sequence;
+    jointMask_ = mask;
+
+    return true;
+}
+
+bool SkeletonStreamDecoder::readHeader(const uint8_t *buffer, int length, uint16_t *sequence, uint64_t *timestamp) {
+
+    if (length < SKELETON_STREAM_HEADER_BYTES || buffer[0] != 'K' || buffer[1] != 'S' || buffer[2] != SKELETON_STREAM_VERSION)
+        return false;
+
+    get(buffer + 4, sequence, 2);
+    get(buffer + 8, timestamp, 8);
+
+    return true;
+}
+
+#pragma mark - SkeletonStreamer
+
+SkeletonStreamer::SkeletonStreamer() {
+
+    pthread_mutex_init(&mutex_, NULL);
+
+    /* Non-blocking, so a full send buffer costs a packet rather than stalling tracking */
+    socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_ >= 0)
+        fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL) | O_NONBLOCK);
+    else
+        printf("%s: Can't create socket\n", __PRETTY_FUNCTION__);
+}
+
+SkeletonStreamer::~SkeletonStreamer() {
+
+    removeAll();
+
+    if (socket_ >= 0)
+        close(socket_);
+
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool SkeletonStreamer::addSubscriber(const char *host, const char *port, SkeletonStreamFormat format,
+                                     int jointMask, int divisor, int keyframeInterval) {
+
+    if (divisor < 1 || !(jointMask & SKELETON_STREAM_ALL_JOINTS)) {
+        printf("%s: Bad joint mask or divisor\n", __PRETTY_FUNCTION__);
+        return false;
+    }
+
+    Subscriber *subscriber = new Subscriber(jointMask, keyframeInterval);
+    subscriber->host = host;
+    subscriber->port = port;
+    subscriber->format = format;
+    subscriber->divisor = divisor;
+    subscriber->countdown = 0;
+    subscriber->addrLength = 0;
+    subscriber->oscAddress = NULL;
+
+    /* Resolve before taking the lock */
+    if (format == STREAM_OSC_BLOB)
+        subscriber->oscAddress = lo_address_new(host, port);
+    else {
+        struct addrinfo hints, *result;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        if (getaddrinfo(host, port, &hints, &result) == 0) {
+            memcpy(&subscriber->addr, result->ai_addr, result->ai_addrlen);
+            subscriber->addrLength = result->ai_addrlen;
+            freeaddrinfo(result);
+        }
+    }
+
+    if (!subscriber->oscAddress && !subscriber->addrLength) {
+        printf("%s: Can't resolve %s:%s\n", __PRETTY_FUNCTION__, host, port);
+        freeSubscriber(subscriber);
+        return false;
+    }
+
+    removeSubscriber(host, port);
+
+    pthread_mutex_lock(&mutex_);
+    subscribers_.push_back(subscriber);
+    pthread_mutex_unlock(&mutex_);
+
+    printf("Streaming skeletons to %s:%s\n", host, port);
+    return true;
+}
+
+bool SkeletonStreamer::removeSubscriber(const char *host, const char *port) {
+
+    Subscriber *removed = NULL;
+
+    pthread_mutex_lock(&mutex_);
+    for (size_t i = 0; i < subscribers_.size() && !removed; i++) {
+        if (subscribers_[i]->host == host && subscribers_[i]->port == port) {
+            removed = subscribers_[i];
+            subscribers_.erase(subscribers_.begin() + i);
+        }
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    if (removed)
+        freeSubscriber(removed);
+
+    return removed != NULL;
+}
+
+void SkeletonStreamer::removeAll() {
+
+    pthread_mutex_lock(&mutex_);
+    vector<Subscriber *> removed;
+    removed.swap(subscribers_);
+    pthread_mutex_unlock(&mutex_);
+
+    for (size_t i = 0; i < removed.size(); i++)
+        freeSubscriber(removed[i]);
+}
+
+int SkeletonStreamer::numSubscribers() {
+
+    pthread_mutex_lock(&mutex_);
+    int n = (int)subscribers_.size();
+    pthread_mutex_unlock(&mutex_);
+
+    return n;
+}
+
+void SkeletonStreamer::freeSubscriber(Subscriber *subscriber) {
+
+    if (subscriber->oscAddress)
+        lo_address_free(subscriber->oscAddress);
+
+    delete subscriber;
+}
+
+void SkeletonStreamer::publish(const SkeletonFrame *frame, float confThresh) {
+
+    pthread_mutex_lock(&mutex_);
+
+    for (size_t i = 0; i < subscribers_.size(); i++) {
+
+        Subscriber *s = subscribers_[i];
+
+        if (s->countdown-- > 0)
+            continue;
+        s->countdown = s->divisor - 1;
+
+        int length = s->encoder.encode(frame, confThresh, buffer_, sizeof(buffer_));
+        if (length < 0)
+            continue;
+
+        if (s->format == STREAM_OSC_BLOB) {
+            lo_blob blob = lo_blob_new(length, buffer_);
+            lo_send(s->oscAddress, SKELETON_STREAM_OSC_ADDRESS, "b", blob);
+            lo_blob_free(blob);
+        }
+        else if (socket_ >= 0)
+            sendto(socket_, buffer_, length, 0, (struct sockaddr *)&s->addr, s->addrLength);
+    }
+
+    pthread_mutex_unlock(&mutex_);
+}
@@ -0,0 +1,150 @@
+//
+//  SkeletonStream.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Compact skeleton stream for consumers other than the piano (visuals, lighting, analytics).
+//  Each packet carries every tracked user's selected joints as positions quantized to 1 mm.
+//  Keyframes hold absolute int16 coordinates; the packets between them hold zigzag varint
+//  differences from the previous packet, usually one byte per coordinate. A packet is
+//
+//      magic "KS", version, flags, sequence, joint mask, timestamp, frame index, user count
+//      per user: id, flags, confident-joint mask, then x y z for each joint in the mask
+//
+//  little-endian. A user new to the stream is sent absolute inside a delta packet. Decoders
+//  drop delta packets after a gap in the sequence until the next keyframe.
+
+#ifndef __KinectOSC__SkeletonStream__
+#define __KinectOSC__SkeletonStream__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "lo/lo.h"
+
+#include "SkeletonFrame.h"
+
+using namespace std;
+
+#define SKELETON_STREAM_VERSION 1
+#define SKELETON_STREAM_ALL_JOINTS ((1 << SKELETON_NUM_JOINTS) - 1)
+#define SKELETON_STREAM_KEYFRAME_INTERVAL 30
+#define SKELETON_STREAM_HEADER_BYTES 21
+#define SKELETON_STREAM_MAX_BYTES (SKELETON_STREAM_HEADER_BYTES + SKELETON_MAX_USERS * (4 + SKELETON_NUM_JOINTS * 3 * 3))
+#define SKELETON_STREAM_OSC_ADDRESS "/kinectosc/skeleton"
+
+enum SkeletonStreamFormat {
+    STREAM_BINARY = 0,          // Bare packet, one per UDP datagram
+    STREAM_OSC_BLOB             // Packet as the blob argument of SKELETON_STREAM_OSC_ADDRESS
+};
+
+class SkeletonStreamEncoder {
+
+public:
+
+    SkeletonStreamEncoder(int jointMask = SKELETON_STREAM_ALL_JOINTS, int keyframeInterval = SKELETON_STREAM_KEYFRAME_INTERVAL);
+
+    /* Encode the frame's tracked users; joints above confThresh are marked confident.
+       Returns bytes written, or -1 if capacity is short. */
+    int encode(const SkeletonFrame *frame, float confThresh, uint8_t *buffer, int capacity);
+
+    /* Make the next packet a keyframe */
+    void reset() { sinceKeyframe_ = keyframeInterval_; }
+
+    int jointMask() { return jointMask_; }
+
+private:
+
+    int jointMask_;
+    int keyframeInterval_;
+    int sinceKeyframe_;
+    uint16_t sequence_;
+
+    /* Quantized positions sent in the previous packet */
+    int nPrevious_;
+    int previousId_[SKELETON_MAX_USERS];
+    int16_t previous_[SKELETON_MAX_USERS][SKELETON_NUM_JOINTS][3];
+};
+
+class SkeletonStreamDecoder {
+
+public:
+
+    SkeletonStreamDecoder();
+
+    /* Fill frame from a packet. Joints outside the packet's mask and unconfident joints get
+       zero confidence; u/v are left zero. Returns false for malformed packets and for delta
+       packets that can't be applied. */
+    bool decode(const uint8_t *buffer, int length, SkeletonFrame *frame);
+    
+    /* Sequence number and timestamp of a packet, without decoding it */
+    static bool readHeader(const uint8_t *buffer, int length, uint16_t *sequence, uint64_t *timestamp);
+
+    int jointMask() { return jointMask_; }
+    int numDropped() { return nDropped_; }      // Packets skipped while waiting for a keyframe
+
+private:
+
+    bool synced_;
+    uint16_t sequence_;
+    int jointMask_;
+    int nDropped_;
+
+    int nPrevious_;
+    int previousId_[SKELETON_MAX_USERS];
+    int16_t previous_[SKELETON_MAX_USERS][SKELETON_NUM_JOINTS][3];
+};
+
+/* Sends the stream to subscribers, each with its own joint subset, frame-rate divisor and
+   encoder. Subscribers may be added and removed from any thread while publishing. */
+class SkeletonStreamer {
+
+    struct Subscriber {
+        string host;
+        string port;
+        SkeletonStreamFormat format;
+        int divisor;                    // Send every divisor-th frame
+        int countdown;
+        SkeletonStreamEncoder encoder;
+        struct sockaddr_storage addr;   // STREAM_BINARY
+        socklen_t addrLength;
+        lo_address oscAddress;          // STREAM_OSC_BLOB
+
+        Subscriber(int jointMask, int keyframeInterval) : encoder(jointMask, keyframeInterval) {}
+    };
+
+public:
+
+    SkeletonStreamer();
+    ~SkeletonStreamer();
+
+    /* Replaces any subscription to the same host and port. Lossy links recover sooner with
+       a shorter keyframe interval. */
+    bool addSubscriber(const char *host, const char *port, SkeletonStreamFormat format,
+                       int jointMask = SKELETON_STREAM_ALL_JOINTS, int divisor = 1,
+                       int keyframeInterval = SKELETON_STREAM_KEYFRAME_INTERVAL);
+    bool removeSubscriber(const char *host, const char *port);
+    void removeAll();
+    int numSubscribers();
+
+    /* Tracking thread */
+    void publish(const SkeletonFrame *frame, float confThresh);
+
+private:
+
+    void freeSubscriber(Subscriber *subscriber);
+
+private:
+
+    vector<Subscriber *> subscribers_;
+    pthread_mutex_t mutex_;             // Guards subscribers_
+    int socket_;
+    uint8_t buffer_[SKELETON_STREAM_MAX_BYTES];
+};
+
+#endif /* defined(__KinectOSC__SkeletonStream__) */
@@ -0,0 +1,225 @@
+//
+//  VoiceManager.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "VoiceManager.h"
+#include "Utility.h"
+
+VoiceManager::VoiceManager() {
+
+    memset(voices_, 0, sizeof(voices_));
+    memset(slotUser_, 0, sizeof(slotUser_));
+    memset(noteCount_, 0, sizeof(noteCount_));
+
+    frameCount_ = 0;
+    timeoutFrames_ = 15;
+
+    callback_ = NULL;
+    context_ = NULL;
+}
+
+/* Slot holding a user's voices. With allocate set, a new user takes a free slot, or the
+   slot of the user seen least recently if the table is full. */
+int VoiceManager::userSlot(int userId, bool allocate) {
+
+    int freeSlot = -1;
+
+    for (int s = 0; s < SKELETON_MAX_USERS; s++) {
+        if (slotUser_[s] == userId)
+            return s;
+        if (slotUser_[s] == 0 && freeSlot < 0)
+            freeSlot = s;
+    }
+
+    if (!allocate || userId == 0)
+        return -1;
+
+    if (freeSlot < 0) {
+
+        uint64_t oldest = UINT64_MAX;
+        freeSlot = 0;
+
+        for (int s = 0; s < SKELETON_MAX_USERS; s++) {
+            for (int l = 0; l < NUM_LIMBS; l++) {
+                if (voices_[s][l].lastSeen < oldest) {
+                    oldest = voices_[s][l].lastSeen;
+                    freeSlot = s;
+                }
+            }
+        }
+
+        for (int l = 0; l < NUM_LIMBS; l++)
+            release(freeSlot, (Limb)l);
+    }
+
+    slotUser_[freeSlot] = userId;
+    return freeSlot;
+}
+
+void VoiceManager::release(int slot, Limb limb) {
+
+    Voice &voice = voices_[slot][limb];
+
+    if (!voice.active)
+        return;
+
+    voice.active = false;
+
+    if (--noteCount_[voice.note] == 0 && callback_)
+        callback_(context_, voice.note, 0);
+}
+
+bool VoiceManager::noteOn(int userId, Limb limb, int note, int velocity) {
+
+    if (limb < 0 || limb >= NUM_LIMBS || note < 0 || note >= VOICE_NUM_NOTES)
+        return false;
+
+    int slot = userSlot(userId, true);
+    if (slot < 0)
+        return false;
+
+    Voice &voice = voices_[slot][limb];
+    voice.lastSeen = frameCount_;
+
+    if (voice.active && voice.note == note)
+        return false;
+
+    release(slot, limb);
+
+    voice.active = true;
+    voice.note = note;
+    voice.velocity = velocity;
+    voice.onTime = hostTimeMicros();
+
+    if (noteCount_[note]++ == 0 && callback_)
+        callback_(context_, note, velocity);
+
+    return true;
+}
+
+void VoiceManager::noteOff(int userId, Limb limb) {
+
+    int slot = userSlot(userId, false);
+
+    if (slot >= 0 && limb >= 0 && limb < NUM_LIMBS)
+        release(slot, limb);
+}
+
+void VoiceManager::touch(int userId, Limb limb) {
+
+    int slot = userSlot(userId, false);
+
+    if (slot >= 0 && limb >= 0 && limb < NUM_LIMBS)
+        voices_[slot][limb].lastSeen = frameCount_;
+}
+
+int VoiceManager::heldNote(int userId, Limb limb) {
+
+    int slot = userSlot(userId, false);
+
+    if (slot < 0 || limb < 0 || limb >= NUM_LIMBS || !voices_[slot][limb].active)
+        return -1;
+
+    return voices_[slot][limb].note;
+}
+
+bool VoiceManager::heldByOtherLimb(int userId, Limb limb, int note) {
+
+    int slot = userSlot(userId, false);
+    if (slot < 0)
+        return false;
+
+    for (int l = 0; l < NUM_LIMBS; l++) {
+        if (l != limb && voices_[slot][l].active && voices_[slot][l].note == note)
+            return true;
+    }
+
+    return false;
+}
+
+uint64_t VoiceManager::noteOnTime(int userId, Limb limb) {
+
+    int slot = userSlot(userId, false);
+
+    if (slot < 0 || limb < 0 || limb >= NUM_LIMBS || !voices_[slot][limb].active)
+        return 0;
+
+    return voices_[slot][limb].onTime;
+}
+
+void VoiceManager::releaseUser(int userId) {
+
+    int slot = userSlot(userId, false);
+    if (slot < 0)
+        return;
+
+    for (int l = 0; l < NUM_LIMBS; l++)
+        release(slot, (Limb)l);
+
+    slotUser_[slot] = 0;
+}
+
+void VoiceManager::releaseAll() {
+
+    for (int s = 0; s < SKELETON_MAX_USERS; s++) {
+        for (int l = 0; l < NUM_LIMBS; l++)
+            release(s, (Limb)l);
+        slotUser_[s] = 0;
+    }
+}
+
+void VoiceManager::reset() {
+
+    memset(voices_, 0, sizeof(voices_));
+    memset(slotUser_, 0, sizeof(slotUser_));
+    memset(noteCount_, 0, sizeof(noteCount_));
+}
+
+int VoiceManager::endFrame() {
+
+    int nReleased = 0;
+
+    for (int s = 0; s < SKELETON_MAX_USERS; s++) {
+
+        if (slotUser_[s] == 0)
+            continue;
+
+        bool anyActive = false;
+
+        for (int l = 0; l < NUM_LIMBS; l++) {
+
+            Voice &voice = voices_[s][l];
+            if (!voice.active)
+                continue;
+
+            if (frameCount_ - voice.lastSeen >= (uint64_t)timeoutFrames_) {
+                release(s, (Limb)l);
+                nReleased++;
+            }
+            else
+                anyActive = true;
+        }
+
+        /* Free the slot once nothing is held, so departed users don't pin it */
+        if (!anyActive)
+            slotUser_[s] = 0;
+    }
+
+    frameCount_++;
+    return nReleased;
+}
+
+int VoiceManager::numActive() {
+
+    int n = 0;
+
+    for (int s = 0; s < SKELETON_MAX_USERS; s++) {
+        for (int l = 0; l < NUM_LIMBS; l++)
+            n += voices_[s][l].active;
+    }
+
+    return n;
+}
@@ -0,0 +1,109 @@
+//
+//  VoiceManager.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Tracks which note each limb of each user is holding. Voices live in a fixed table
+//  indexed by (user slot, limb), so note-on and note-off never search or allocate. Notes
+//  are reference counted, so two limbs sounding the same pitch don't cut each other off.
+//  A watchdog releases voices whose limb hasn't been seen confidently for a number of
+//  frames, sending a note-off for just that voice.
+
+#ifndef __KinectOSC__VoiceManager__
+#define __KinectOSC__VoiceManager__
+
+#include <iostream>
+#include <stdint.h>
+
+#include "SkeletonFrame.h"
+
+#define VOICE_NUM_NOTES 128
+
+enum Limb {
+    LIMB_FOOT_L = 0,
+    LIMB_FOOT_R,
+    LIMB_HAND_L,
+    LIMB_HAND_R,
+    NUM_LIMBS
+};
+
+class VoiceManager {
+
+public:
+
+    /* Called when a note starts (velocity > 0) or stops (velocity == 0) sounding */
+    typedef void (*NoteCallback)(void *context, int note, int velocity);
+
+private:
+
+    struct Voice {
+        bool active;
+        int note;
+        int velocity;
+        uint64_t onTime;        // Host time of the note-on (us)
+        uint64_t lastSeen;      // Frame count when the limb was last seen confidently
+    };
+
+public:
+
+    VoiceManager();
+
+    void setNoteCallback(NoteCallback callback, void *context) {
+        callback_ = callback;
+        context_ = context;
+    }
+
+    /* Release voices whose limb goes unseen for this many frames */
+    void setTimeoutFrames(int frames) { timeoutFrames_ = frames; }
+
+    /* Start a note on a limb, releasing whatever the limb was holding. Returns false if the
+       limb already holds the note. */
+    bool noteOn(int userId, Limb limb, int note, int velocity);
+    void noteOff(int userId, Limb limb);
+
+    /* The limb was tracked confidently this frame, so its voice stays alive */
+    void touch(int userId, Limb limb);
+
+    /* Note the limb holds, or -1 */
+    int heldNote(int userId, Limb limb);
+
+    /* True if another limb of the same user holds the note */
+    bool heldByOtherLimb(int userId, Limb limb, int note);
+
+    /* Release every voice of a user, e.g. when they leave the frame */
+    void releaseUser(int userId);
+
+    /* Send note-offs for everything held */
+    void releaseAll();
+
+    /* Forget every voice without sending anything, after a global all-notes-off */
+    void reset();
+
+    /* Run the watchdog and advance the frame count. Returns the number of voices released. */
+    int endFrame();
+
+    /* Getters */
+    int numActive();
+    bool noteIsSounding(int note) { return note >= 0 && note < VOICE_NUM_NOTES && noteCount_[note] > 0; }
+    uint64_t noteOnTime(int userId, Limb limb);
+
+private:
+
+    int userSlot(int userId, bool allocate);
+    void release(int slot, Limb limb);
+
+private:
+
+    Voice voices_[SKELETON_MAX_USERS][NUM_LIMBS];
+    int slotUser_[SKELETON_MAX_USERS];          // User id owning each slot, 0 if free
+    int noteCount_[VOICE_NUM_NOTES];            // Voices sounding each note
+
+    uint64_t frameCount_;
+    int timeoutFrames_;
+
+    NoteCallback callback_;
+    void *context_;
+};
+
+#endif /* defined(__KinectOSC__VoiceManager__) */
@@ -0,0 +1,82 @@
+//
+//  main.cpp
+//  KinectOSCAnalyze
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Command-line front end to BatchAnalyzer: replays recorded sessions through the
+//  mapping path for every parameter set and writes what each run would have sent.
+//
+//      kinectosc-analyze [-j threads] [-o dir] [-n] [-c config]... [-s name=values]... session...
+//
+//  -c adds a parameter set from a config file; -s sweeps a parameter over a list
+//  ("key=C,E,G") or a range ("threshold=0.4:0.8:0.05"). With no -c, the sweeps
+//  start from the default configuration.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BatchAnalysis.h"
+
+static void usage(const char *program) {
+
+    printf("Usage: %s [-j threads] [-o dir] [-n] [-c config]... [-s name=values]... session...\n"
+           "  -j threads   Runs at once (default: one per core)\n"
+           "  -o dir       Output directory (default: analysis)\n"
+           "  -n           Notes and summary only, no control curves\n"
+           "  -c config    Parameter set from a config file; may be repeated\n"
+           "  -s sweep     name=v1,v2,... or name=lo:hi:step; every combination is run\n",
+           program);
+}
+
+int main(int argc, char * const argv[])
+{
+    BatchAnalyzer analyzer;
+    const char *outputDir = "analysis";
+    long nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:o:nc:s:h")) != -1) {
+
+        switch (opt) {
+
+            case 'j':
+                nThreads = strtol(optarg, NULL, 10);
+                break;
+
+            case 'o':
+                outputDir = optarg;
+                break;
+
+            case 'n':
+                analyzer.setWriteCurves(false);
+                break;
+
+            case 'c':
+                if (!analyzer.addConfigFile(optarg))
+                    return 1;
+                break;
+
+            case 's':
+                if (!analyzer.addSweep(optarg))
+                    return 1;
+                break;
+
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++)
+        analyzer.addSession(argv[i]);
+
+    return analyzer.run(outputDir, nThreads > 0 ? (int)nThreads : 1) ? 0 : 1;
+}
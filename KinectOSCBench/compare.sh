@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+#  compare.sh
+#  KinectOSC
+#
+#  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+#
+#  Compares a kinectosc-bench report, or a FrameProfiler report, against a baseline from
+#  another build. Prints each row's median before and after and marks those that rose by
+#  more than the threshold (default 0.15 = 15%) and by more than the noise floor: 1 ns for
+#  benchmark rows, which are timed in batches, and 50 ns for profiler stages, which are
+#  timed one call at a time. Exits with the number of rows marked, or 255 if either report
+#  can't be read.
+#
+#      compare.sh baseline.csv current.csv [threshold]
+
+if [ $# -lt 2 ] || [ $# -gt 3 ]; then
+    echo "Usage: $0 baseline.csv current.csv [threshold]"
+    exit 255
+fi
+
+for report in "$1" "$2"; do
+    if [ ! -r "$report" ]; then
+        echo "Can't open $report"
+        exit 255
+    fi
+done
+
+awk -F, -v threshold="${3:-0.15}" '
+    # Past the comments, the first line of each report names the columns; the median is
+    # the fourth
+    /^#/ || NF < 7 { next }
+    !header[FILENAME]++ {
+        floor = $1 == "stage" ? 50 : 1
+        next
+    }
+
+    FILENAME == ARGV[1] {
+        baseline[$1] = $4
+        next
+    }
+
+    {
+        names[++n] = $1
+        current[$1] = $4
+    }
+
+    END {
+        nSlower = 0
+        for (i = 1; i <= n; i++) {
+            name = names[i]
+            if (!(name in baseline))
+                continue
+
+            change = baseline[name] > 0 ? (current[name] - baseline[name]) / baseline[name] : 0
+            slower = change > threshold && current[name] - baseline[name] > floor
+
+            printf "%-14s %10.1f ns -> %10.1f ns  %+6.1f%%%s\n", name, baseline[name], current[name],
+                   change * 100, slower ? "  SLOWER" : ""
+            nSlower += slower
+        }
+        exit nSlower > 254 ? 254 : nSlower
+    }
+' "$1" "$2"
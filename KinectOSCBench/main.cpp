@@ -0,0 +1,499 @@
+//
+//  main.cpp
+//  KinectOSCBench
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Times the hot functions of the mapping and display paths one at a time, over frames
+//  from a MotionGenerator performance or a recording, and writes one CSV row of nanosecond
+//  statistics per function. The rows have the same columns as a FrameProfiler report, so
+//  compare.sh compares either kind of report against a baseline.
+//
+//      kinectosc-bench [-u users] [-s seed] [-n frames] [-r recording] [-o report.csv]
+//
+//  Functions too short to time on their own are timed in batches, and each sample is the
+//  batch time divided by the number of calls in it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef __APPLE__
+#include <OpenGL/OpenGL.h>
+#endif
+
+#include "SkeletonController.h"
+#include "SessionRecording.h"
+#include "MotionGenerator.h"
+#include "JointGeometry.h"
+#include "KinectDisplay.h"
+#include "KeyboardDisplay.h"
+#include "OscController.h"
+#include "Utility.h"
+
+#define BENCH_DEFAULT_USERS 2
+#define BENCH_DEFAULT_FRAMES (30 * 60)
+#define BENCH_BATCH_REPEATS 16          // Passes over a frame's data per sample, for short functions
+#define BENCH_RENDER_WIDTH 1280
+#define BENCH_RENDER_HEIGHT 256
+
+using namespace std;
+
+static void usage(const char *program) {
+
+    printf("Usage: %s [-u users] [-s seed] [-n frames] [-r recording] [-o report.csv]\n"
+           "  -u users     Users in the MotionGenerator performance (default %d)\n"
+           "  -s seed      MotionGenerator seed (default 1)\n"
+           "  -n frames    Frames to run (default %d; all of a recording)\n"
+           "  -r recording Session or skeleton recording instead of a performance\n"
+           "  -o path      Write the CSV report here as well as printing it\n",
+           program, BENCH_DEFAULT_USERS, BENCH_DEFAULT_FRAMES);
+}
+
+/* Per-call durations of one function */
+class Benchmark {
+
+public:
+
+    Benchmark(const char *name) : name_(name) {}
+
+    void add(uint64_t ns, int nCalls) {
+        if (nCalls > 0)
+            samples_.push_back((double)ns / nCalls);
+    }
+
+    /* name,count,mean_ns,p50_ns,p90_ns,p99_ns,max_ns */
+    void write(FILE *file) {
+
+        if (samples_.empty())
+            return;
+
+        vector<double> sorted = samples_;
+        sort(sorted.begin(), sorted.end());
+
+        double total = 0;
+        for (size_t i = 0; i < sorted.size(); i++)
+            total += sorted[i];
+
+        fprintf(file, "%s,%llu,%.1f,%.1f,%.1f,%.1f,%.1f\n", name_, (unsigned long long)sorted.size(),
+                total / sorted.size(), percentile(sorted, 0.5f), percentile(sorted, 0.9f),
+                percentile(sorted, 0.99f), sorted.back());
+    }
+
+private:
+
+    static double percentile(const vector<double> &sorted, float p) {
+        return sorted[(size_t)(p * (sorted.size() - 1))];
+    }
+
+    const char *name_;
+    vector<double> samples_;
+};
+
+/* Replays frames held in memory, timing what the controller does between reads */
+class TimedSource : public SkeletonSource {
+
+public:
+
+    TimedSource(const vector<SkeletonFrame> &frames, Benchmark *benchmark)
+        : frames_(frames), benchmark_(benchmark), position_(0), readTime_(0) {}
+
+    bool readFrame(SkeletonFrame *frame) {
+
+        uint64_t now = hostTimeNanos();
+        if (readTime_)
+            benchmark_->add(now - readTime_, 1);
+
+        if (position_ == frames_.size())
+            return false;
+
+        *frame = frames_[position_++];
+        readTime_ = hostTimeNanos();
+        return true;
+    }
+
+    const char *name() { return "Timed"; }
+
+private:
+
+    const vector<SkeletonFrame> &frames_;
+    Benchmark *benchmark_;
+    size_t position_;
+    uint64_t readTime_;
+};
+
+static bool loadFrames(const char *recording, int nUsers, unsigned int seed, int limit,
+                       vector<SkeletonFrame> *frames) {
+
+    SessionPlayer player;
+    ReplaySkeletonSource replay;
+    MotionGenerator motion(nUsers, 30, seed);
+    SkeletonSource *source = &motion;
+
+    if (!recording) {
+        motion.setRealtime(false);
+        if (limit == 0)
+            limit = BENCH_DEFAULT_FRAMES;
+    }
+    else if (SessionPlayer::isSessionFile(recording)) {
+        player.setDecodeImages(false);
+        if (!player.open(recording, 1))
+            return false;
+        source = &player;
+    }
+    else {
+        if (!replay.open(recording))
+            return false;
+        source = &replay;
+    }
+
+    SkeletonFrame frame;
+    while ((limit == 0 || (int)frames->size() < limit) && source->readFrame(&frame))
+        frames->push_back(frame);
+
+    return !frames->empty();
+}
+
+/* Keeps results the compiler would otherwise drop */
+static volatile float gSink;
+
+/* The form SkeletonController::getJointDistance() had before JointGeometry, for comparison */
+static float getJointDistance(const SkeletonUser &user, int j1, int j2) {
+
+    return sqrt(    powf(abs(user.x[j1] - user.x[j2]), 2) +
+                    powf(abs(user.y[j1] - user.y[j2]), 2) +
+                    powf(abs(user.z[j1] - user.z[j2]), 2)
+                );
+}
+
+template <float (*jointDistanceFn)(const SkeletonUser &, int, int)>
+static void benchJointDistance(const vector<SkeletonFrame> &frames, Benchmark *benchmark) {
+
+    static const uint8_t kPairs[][2] = {
+        {SKEL_HEAD, SKEL_NECK}, {SKEL_NECK, SKEL_TORSO}, {SKEL_TORSO, SKEL_HIP_L}, {SKEL_TORSO, SKEL_HIP_R},
+        {SKEL_HIP_L, SKEL_KNEE_L}, {SKEL_HIP_R, SKEL_KNEE_R}, {SKEL_KNEE_L, SKEL_FOOT_L}, {SKEL_KNEE_R, SKEL_FOOT_R},
+        {SKEL_NECK, SKEL_SHOULDER_L}, {SKEL_NECK, SKEL_SHOULDER_R}, {SKEL_SHOULDER_L, SKEL_ELBOW_L},
+        {SKEL_SHOULDER_R, SKEL_ELBOW_R}, {SKEL_ELBOW_L, SKEL_HAND_L}, {SKEL_ELBOW_R, SKEL_HAND_R},
+        {SKEL_HAND_L, SKEL_HAND_R}, {SKEL_FOOT_L, SKEL_FOOT_R}
+    };
+    const int nPairs = sizeof(kPairs) / sizeof(kPairs[0]);
+
+    for (size_t f = 0; f < frames.size(); f++) {
+
+        const SkeletonFrame &frame = frames[f];
+        float sum = 0;
+
+        uint64_t start = hostTimeNanos();
+        for (int r = 0; r < BENCH_BATCH_REPEATS; r++) {
+            for (int u = 0; u < frame.nUsers; u++) {
+                for (int p = 0; p < nPairs; p++)
+                    sum += jointDistanceFn(frame.users[u], kPairs[p][0], kPairs[p][1]);
+            }
+        }
+        benchmark->add(hostTimeNanos() - start, BENCH_BATCH_REPEATS * frame.nUsers * nPairs);
+        gSink = sum;
+    }
+}
+
+/* As KinectDisplay scales depth-image coordinates */
+static void benchMapToInterval(const vector<SkeletonFrame> &frames, Benchmark *benchmark) {
+
+    for (size_t f = 0; f < frames.size(); f++) {
+
+        const SkeletonFrame &frame = frames[f];
+        float sum = 0;
+
+        uint64_t start = hostTimeNanos();
+        for (int r = 0; r < BENCH_BATCH_REPEATS; r++) {
+            for (int u = 0; u < frame.nUsers; u++) {
+                for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+                    float x = frame.users[u].u[j];
+                    float y = frame.users[u].v[j];
+                    sum += mapToInterval(x, 0, frame.width, -1, 1);
+                    sum += mapToInterval(y, 0, frame.height, -1, 1);
+                }
+            }
+        }
+        benchmark->add(hostTimeNanos() - start, BENCH_BATCH_REPEATS * frame.nUsers * SKELETON_NUM_JOINTS * 2);
+        gSink = sum;
+    }
+}
+
+static void benchUpdateJoint(const vector<SkeletonFrame> &frames, Benchmark *benchmark) {
+
+    KinectDisplay display;
+
+    for (size_t f = 0; f < frames.size(); f++) {
+
+        const SkeletonFrame &frame = frames[f];
+
+        uint64_t start = hostTimeNanos();
+        for (int u = 0; u < frame.nUsers; u++) {
+            const SkeletonUser &user = frame.users[u];
+            for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+                display.updateJoint((nite::JointType)j, user.u[j], user.v[j], frame.width, frame.height);
+        }
+        benchmark->add(hostTimeNanos() - start, frame.nUsers * SKELETON_NUM_JOINTS);
+    }
+}
+
+/* Region boundaries, as generateRegionBoundaries() computes them */
+static void benchLinspace(const vector<SkeletonFrame> &frames, Benchmark *benchmark) {
+
+    for (size_t f = 0; f < frames.size(); f++) {
+
+        double sum = 0;
+
+        uint64_t start = hostTimeNanos();
+        for (int r = 0; r < BENCH_BATCH_REPEATS; r++) {
+            vector<double> theta = linspace(2*M_PI/5, 3*M_PI/5, 13);
+            sum += theta.back();
+        }
+        benchmark->add(hostTimeNanos() - start, BENCH_BATCH_REPEATS);
+        gSink = (float)sum;
+    }
+}
+
+/* Bound UDP socket on the loopback interface, non-blocking so it can be drained between
+   frames; returns its port through port */
+static int openSink(char *port, size_t size) {
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &length) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    snprintf(port, size, "%d", ntohs(addr.sin_port));
+    return fd;
+}
+
+/* Intensity messages for both hands and feet of every user, sent over the loopback */
+static void benchSendMessage(const vector<SkeletonFrame> &frames, Benchmark *benchmark) {
+
+    char port[16];
+    int fd = openSink(port, sizeof(port));
+    if (fd < 0) {
+        printf("sendMessage: can't open a loopback socket, skipped\n");
+        return;
+    }
+
+    OscController sender;
+    sender.setServerAddress("127.0.0.1", port);
+
+    static const int kJoints[] = {SKEL_HAND_L, SKEL_HAND_R, SKEL_FOOT_L, SKEL_FOOT_R};
+    char buffer[2048];
+
+    for (size_t f = 0; f < frames.size(); f++) {
+
+        const SkeletonFrame &frame = frames[f];
+
+        uint64_t start = hostTimeNanos();
+        for (int u = 0; u < frame.nUsers; u++) {
+            for (int j = 0; j < 4; j++)
+                sender.sendMessage("/mrp/quality/intensity", "iif", 0, 60 + j, frame.users[u].y[kJoints[j]] * 1e-3f);
+        }
+        benchmark->add(hostTimeNanos() - start, frame.nUsers * 4);
+
+        while (recv(fd, buffer, sizeof(buffer), 0) > 0)
+            ;
+    }
+
+    close(fd);
+}
+
+/* Offscreen GL context with a framebuffer object to draw into. There's no portable way to
+   get a context without a window, so render is only timed on OS X. */
+#ifdef __APPLE__
+static bool makeRenderContext(CGLContextObj *context) {
+
+    CGLPixelFormatAttribute attributes[] = {kCGLPFAAccelerated, (CGLPixelFormatAttribute)0};
+    CGLPixelFormatObj format;
+    GLint nFormats;
+
+    if (CGLChoosePixelFormat(attributes, &format, &nFormats) != kCGLNoError || !format)
+        return false;
+
+    CGLError error = CGLCreateContext(format, NULL, context);
+    CGLDestroyPixelFormat(format);
+    if (error != kCGLNoError)
+        return false;
+
+    CGLSetCurrentContext(*context);
+
+    GLuint framebuffer, renderbuffer;
+    glGenFramebuffersEXT(1, &framebuffer);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, framebuffer);
+    glGenRenderbuffersEXT(1, &renderbuffer);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, renderbuffer);
+    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, BENCH_RENDER_WIDTH, BENCH_RENDER_HEIGHT);
+    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, renderbuffer);
+
+    return glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT;
+}
+#endif
+
+/* A full 88-key keyboard with analog values and highlighted keys following the users'
+   feet, as the controller drives it, timed through glFinish() */
+static void benchRender(const vector<SkeletonFrame> &frames, Benchmark *benchmark) {
+
+#ifdef __APPLE__
+    CGLContextObj context;
+    if (!makeRenderContext(&context)) {
+        printf("render: can't create an offscreen GL context, skipped\n");
+        return;
+    }
+
+    KeyboardDisplay keyboard;
+    keyboard.setKeyboardRange(21, 108);
+    keyboard.setDisplaySize(BENCH_RENDER_WIDTH, BENCH_RENDER_HEIGHT);
+    keyboard.setAnalogSensorsPresent(true);
+
+    for (size_t f = 0; f < frames.size(); f++) {
+
+        const SkeletonFrame &frame = frames[f];
+
+        keyboard.clearHighlightedKeys();
+        for (int u = 0; u < frame.nUsers && u < 2; u++) {
+            int key = 21 + (int)(frame.users[u].u[SKEL_FOOT_L] * 87 / max(frame.width, 1));
+            key = min(max(key, 21), 108);
+            keyboard.setHighlightedKey(key, true);
+            keyboard.setAnalogValueForKey(key, frame.users[u].confidence[SKEL_FOOT_L]);
+        }
+
+        uint64_t start = hostTimeNanos();
+        keyboard.render();
+        glFinish();
+        benchmark->add(hostTimeNanos() - start, 1);
+    }
+
+    CGLSetCurrentContext(NULL);
+    CGLDestroyContext(context);
+#else
+    printf("render: no offscreen GL context on this platform, skipped\n");
+#endif
+}
+
+/* Everything the tracking thread does per frame, through a controller with no display */
+static void benchFrame(const vector<SkeletonFrame> &frames, Benchmark *benchmark) {
+
+    OscController sink;                     // No address: messages are built but not sent
+
+    SkeletonController *controller = new SkeletonController();
+    controller->setOscSender(&sink);
+    controller->setParameter("transmit", "on");
+
+    TimedSource source(frames, benchmark);
+    controller->processSource(&source);
+
+    delete controller;
+}
+
+int main(int argc, char * const argv[])
+{
+    const char *recording = NULL;
+    const char *report = NULL;
+    int nUsers = BENCH_DEFAULT_USERS;
+    unsigned int seed = 1;
+    int limit = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "u:s:n:r:o:")) != -1) {
+
+        switch (opt) {
+
+            case 'u':
+                nUsers = atoi(optarg);
+                break;
+
+            case 's':
+                seed = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'n':
+                limit = atoi(optarg);
+                break;
+
+            case 'r':
+                recording = optarg;
+                break;
+
+            case 'o':
+                report = optarg;
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc || nUsers < 1 || nUsers > SKELETON_MAX_USERS || limit < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<SkeletonFrame> frames;
+    if (!loadFrames(recording, nUsers, seed, limit, &frames)) {
+        printf("No frames from %s\n", recording ? recording : "MotionGenerator");
+        return 1;
+    }
+
+    Benchmark frame("frame"), distance("jointDistance"), oldDistance("getJointDistance"),
+              interval("mapToInterval"), joint("updateJoint"), send("sendMessage"), spaced("linspace"),
+              render("render");
+
+    benchFrame(frames, &frame);
+    benchJointDistance<jointDistance>(frames, &distance);
+    benchJointDistance<getJointDistance>(frames, &oldDistance);
+    benchMapToInterval(frames, &interval);
+    benchUpdateJoint(frames, &joint);
+    benchSendMessage(frames, &send);
+    benchLinspace(frames, &spaced);
+    benchRender(frames, &render);
+
+    Benchmark *benchmarks[] = {&frame, &distance, &oldDistance, &interval, &joint, &send, &spaced, &render};
+    const int nBenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+    char label[256];
+    if (recording)
+        snprintf(label, sizeof(label), "%s, %d frames", recording, (int)frames.size());
+    else
+        snprintf(label, sizeof(label), "motion:%u, %d users, %d frames", seed, nUsers, (int)frames.size());
+
+    FILE *files[2] = {stdout, report ? fopen(report, "w") : NULL};
+    if (report && !files[1]) {
+        printf("Can't write %s\n", report);
+        return 1;
+    }
+
+    for (int i = 0; i < 2 && files[i]; i++) {
+        fprintf(files[i], "# KinectOSC benchmark: %s\n", label);
+        fprintf(files[i], "benchmark,count,mean_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+        for (int b = 0; b < nBenchmarks; b++)
+            benchmarks[b]->write(files[i]);
+    }
+
+    if (files[1])
+        fclose(files[1]);
+
+    return 0;
+}
@@ -0,0 +1,280 @@
+//
+//  main.cpp
+//  KinectOSCGolden
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Golden-output regression check for everything the controller sends. Each stream is
+//  run through SkeletonController::processSource() with an in-memory OSC sink, and the
+//  captured messages are recorded to, or compared with, a golden file (see OscCapture.h).
+//
+//      kinectosc-golden record [-c config] dir stream...
+//      kinectosc-golden check [-t tolerance] dir
+//
+//  A stream is a session or skeleton recording, or "motion:<seed>[:<seconds>]" for a
+//  MotionGenerator performance of two users (60 s by default). Golden files record their
+//  stream and config, so check reruns every *.golden in dir and exits non-zero if any
+//  frame differs.
+//
+//  The goldens in KinectOSCGolden/goldens are checked by "make golden" (and "make check").
+//  Rerecord them with "kinectosc-golden record KinectOSCGolden/goldens <stream>" only
+//  when a change to the output is intended.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+
+#include "SkeletonController.h"
+#include "SessionRecording.h"
+#include "MotionGenerator.h"
+#include "OscController.h"
+#include "OscCapture.h"
+#include "Utility.h"
+
+#define GOLDEN_MOTION_USERS 2
+#define GOLDEN_MOTION_SECONDS 60
+
+using namespace std;
+
+static void usage(const char *program) {
+
+    printf("Usage: %s record [-c config] dir stream...\n"
+           "       %s check [-t tolerance] dir\n"
+           "  stream       Session or skeleton recording, or motion:<seed>[:<seconds>]\n"
+           "  -c config    Config file applied before the run\n"
+           "  -t tolerance Largest difference allowed in a float argument (default %g)\n",
+           program, program, CAPTURE_DEFAULT_TOLERANCE);
+}
+
+/* Golden file name for a stream */
+static string goldenName(const string &stream) {
+
+    string name = stream;
+
+    size_t slash = name.find_last_of('/');
+    if (slash != string::npos)
+        name = name.substr(slash + 1);
+
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] == ':' || name[i] == '.')
+            name[i] = '-';
+    }
+
+    return name + ".golden";
+}
+
+/* Run a stream through a fresh controller, capturing what it sends */
+static bool runStream(const string &stream, const string &config, OscCapture *capture, int *nFrames) {
+
+    SessionPlayer player;
+    ReplaySkeletonSource replay;
+    MotionGenerator *motion = NULL;
+    SkeletonSource *source;
+    int limit = 0;
+
+    unsigned int seed;
+    int seconds = GOLDEN_MOTION_SECONDS;
+
+    if (sscanf(stream.c_str(), "motion:%u:%d", &seed, &seconds) >= 1) {
+        motion = new MotionGenerator(GOLDEN_MOTION_USERS, 30, seed);
+        motion->setRealtime(false);
+        limit = seconds * 30;
+        source = motion;
+    }
+    else if (SessionPlayer::isSessionFile(stream.c_str())) {
+        player.setDecodeImages(false);
+        if (!player.open(stream.c_str(), 1))
+            return false;
+        source = &player;
+    }
+    else {
+        if (!replay.open(stream.c_str()))
+            return false;
+        source = &replay;
+    }
+
+    FrameStampSource stamps(source);
+    stamps.setLimit(limit);
+
+    OscController sink;
+    capture->clear();
+    capture->attach(&sink, &stamps);
+
+    SkeletonController *controller = new SkeletonController();
+    controller->setOscSender(&sink);
+
+    bool ok = controller->setParameter("transmit", "on");
+    if (ok && !config.empty())
+        ok = controller->loadConfigFile(config.c_str());
+
+    *nFrames = ok ? controller->processSource(&stamps) : -1;
+
+    delete controller;
+    delete motion;
+
+    return *nFrames >= 0;
+}
+
+static int record(const char *dir, const char *config, char * const *streams, int nStreams) {
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        printf("Can't create %s\n", dir);
+        return 1;
+    }
+
+    OscCapture capture;
+    int nFailed = 0;
+
+    for (int i = 0; i < nStreams; i++) {
+
+        string stream = streams[i];
+        string path = string(dir) + "/" + goldenName(stream);
+        string header = "source " + stream;
+        if (config)
+            header += string("\nconfig ") + config;
+
+        int nFrames;
+        if (!runStream(stream, config ? config : "", &capture, &nFrames) ||
+            !capture.writeFile(path.c_str(), header.c_str())) {
+            printf("%s: failed\n", stream.c_str());
+            nFailed++;
+            continue;
+        }
+
+        printf("%s: %d frames, %d messages -> %s\n", stream.c_str(), nFrames,
+               (int)capture.messages().size(), path.c_str());
+    }
+
+    return nFailed ? 1 : 0;
+}
+
+/* The stream and config named in a golden file's header */
+static bool readHeader(const char *path, string *stream, string *config) {
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    char line[1024];
+    stream->clear();
+    config->clear();
+
+    while (fgets(line, sizeof(line), file) && line[0] == '#') {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!strncmp(line, "# source ", 9))
+            *stream = line + 9;
+        else if (!strncmp(line, "# config ", 9))
+            *config = line + 9;
+    }
+
+    fclose(file);
+    return !stream->empty();
+}
+
+static int check(const char *dir, float tolerance) {
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        printf("Can't open %s\n", dir);
+        return 1;
+    }
+
+    vector<string> goldens;
+    struct dirent *entry;
+
+    while ((entry = readdir(d))) {
+        size_t length = strlen(entry->d_name);
+        if (length > 7 && !strcmp(entry->d_name + length - 7, ".golden"))
+            goldens.push_back(string(dir) + "/" + entry->d_name);
+    }
+    closedir(d);
+
+    if (goldens.empty()) {
+        printf("No golden files in %s\n", dir);
+        return 1;
+    }
+
+    OscCapture capture;
+    int nFailed = 0;
+
+    for (size_t i = 0; i < goldens.size(); i++) {
+
+        const char *path = goldens[i].c_str();
+        string stream, config;
+        int nFrames;
+
+        if (!readHeader(path, &stream, &config)) {
+            printf("%s: no source\n", path);
+            nFailed++;
+            continue;
+        }
+
+        uint64_t start = hostTimeMicros();
+        bool ran = runStream(stream, config, &capture, &nFrames);
+        double ms = (hostTimeMicros() - start) * 1e-3;
+
+        int nDiffering = ran ? capture.compare(path, tolerance) : -1;
+
+        if (nDiffering != 0)
+            nFailed++;
+
+        printf("%s %s: %d frames, %d messages, %.1f ms\n", nDiffering == 0 ? "PASS" : "FAIL",
+               stream.c_str(), nFrames, (int)capture.messages().size(), ms);
+    }
+
+    printf("%d of %d streams match\n", (int)goldens.size() - nFailed, (int)goldens.size());
+    return nFailed ? 1 : 0;
+}
+
+int main(int argc, char * const argv[])
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bool recording = !strcmp(argv[1], "record");
+    if (!recording && strcmp(argv[1], "check")) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *config = NULL;
+    float tolerance = CAPTURE_DEFAULT_TOLERANCE;
+    int opt;
+
+    optind = 2;
+    while ((opt = getopt(argc, argv, recording ? "c:" : "t:")) != -1) {
+
+        switch (opt) {
+
+            case 'c':
+                config = optarg;
+                break;
+
+            case 't':
+                tolerance = strtof(optarg, NULL);
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc || (recording && optind + 1 >= argc)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (recording)
+        return record(argv[optind], config, argv + optind + 1, argc - optind - 1);
+
+    return check(argv[optind], tolerance);
+}
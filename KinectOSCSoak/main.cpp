@@ -0,0 +1,408 @@
+//
+//  main.cpp
+//  KinectOSCSoak
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Soak test of the whole tracking path: a MotionGenerator performance runs in real time
+//  through SkeletonController::beginTracking(), and the OscController sends everything to
+//  a UDP sink in this process, for as long as asked (two hours by default). Once per
+//  interval it reports and checks
+//
+//      memory      resident size, against the size after the first interval
+//      notes       notes held longer than any performer stands still, and any left held
+//                  after tracking stops. An all-notes-off doesn't count as releasing them:
+//                  every note must have had its own note-off by the time one arrives.
+//      throughput  frames tracked per second, against the performance's frame rate, and
+//                  messages received, which must not stop
+//
+//  and exits non-zero if any check failed.
+//
+//      kinectosc-soak [-u users] [-s seed] [-m minutes] [-f rate] [-i seconds] [-p port] [-c config]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+#include "SkeletonController.h"
+#include "MotionGenerator.h"
+#include "OscController.h"
+#include "Utility.h"
+
+#define SOAK_DEFAULT_USERS 4
+#define SOAK_DEFAULT_MINUTES 120
+#define SOAK_DEFAULT_INTERVAL 60        // Seconds between reports
+#define SOAK_DEFAULT_PORT "57140"
+#define SOAK_MAX_GROWTH_KB 8192         // Resident growth allowed after the first interval
+#define SOAK_STUCK_SECONDS 120          // Longer than a performer's foot stays down
+#define SOAK_MIN_RATE 0.9f              // Fraction of the frame rate that must be tracked
+#define SOAK_SINK_POLL_MS 100
+
+using namespace std;
+
+static void usage(const char *program) {
+
+    printf("Usage: %s [-u users] [-s seed] [-m minutes] [-f rate] [-i seconds] [-p port] [-c config]\n"
+           "  -u users     Users in the MotionGenerator performance (default %d)\n"
+           "  -s seed      MotionGenerator seed (default 1)\n"
+           "  -m minutes   Length of the run (default %d)\n"
+           "  -f rate      Frame rate (default 30)\n"
+           "  -i seconds   Time between reports (default %d)\n"
+           "  -p port      UDP port of the OSC sink (default %s)\n"
+           "  -c config    Config file applied before tracking starts\n",
+           program, SOAK_DEFAULT_USERS, SOAK_DEFAULT_MINUTES, SOAK_DEFAULT_INTERVAL, SOAK_DEFAULT_PORT);
+}
+
+/* Counts the frames the tracking thread reads */
+class CountingSource : public SkeletonSource {
+
+public:
+
+    CountingSource(SkeletonSource *source) : source_(source), nFrames_(0) {}
+
+    bool readFrame(SkeletonFrame *frame) {
+        if (!source_->readFrame(frame))
+            return false;
+        nFrames_++;
+        return true;
+    }
+    void wake() { source_->wake(); }
+    const char *name() { return source_->name(); }
+
+    int numFrames() { return nFrames_; }
+
+private:
+
+    SkeletonSource *source_;
+    atomic<int> nFrames_;
+};
+
+/* Receives what the controller sends and keeps the notes it holds, reference counted per
+   pitch as VoiceManager counts them */
+class OscSink {
+
+public:
+
+    OscSink() : server_(NULL), nMessages_(0), shouldStop_(false) {
+        pthread_mutex_init(&mutex_, NULL);
+        memset(noteCount_, 0, sizeof(noteCount_));
+        memset(noteOnTime_, 0, sizeof(noteOnTime_));
+        nHeldAtAllNotesOff_ = 0;
+    }
+
+    ~OscSink() {
+        stop();
+        pthread_mutex_destroy(&mutex_);
+    }
+
+    bool start(const char *port) {
+
+        server_ = lo_server_new(port, NULL);
+        if (!server_) {
+            printf("%s: Can't listen on port %s\n", __PRETTY_FUNCTION__, port);
+            return false;
+        }
+        lo_server_add_method(server_, NULL, NULL, staticMessage, this);
+
+        if (pthread_create(&thread_, NULL, staticReceive, this) != 0) {
+            printf("%s: Error creating receive thread\n", __PRETTY_FUNCTION__);
+            lo_server_free(server_);
+            server_ = NULL;
+            return false;
+        }
+
+        return true;
+    }
+
+    void stop() {
+
+        if (!server_)
+            return;
+
+        shouldStop_ = true;
+        pthread_join(thread_, NULL);
+        lo_server_free(server_);
+        server_ = NULL;
+    }
+
+    long numMessages() { return nMessages_; }
+
+    /* Notes still held when an all-notes-off arrived, over every one received */
+    int numHeldAtAllNotesOff() {
+
+        pthread_mutex_lock(&mutex_);
+        int n = nHeldAtAllNotesOff_;
+        pthread_mutex_unlock(&mutex_);
+
+        return n;
+    }
+
+    /* Notes held now, and how long the longest of them has been (s) */
+    int heldNotes(double *longest) {
+
+        uint64_t now = hostTimeMicros();
+        int nHeld = 0;
+        *longest = 0;
+
+        pthread_mutex_lock(&mutex_);
+        for (int note = 0; note < 128; note++) {
+            if (!noteCount_[note])
+                continue;
+            nHeld++;
+            double held = (now - noteOnTime_[note]) * 1e-6;
+            *longest = held > *longest ? held : *longest;
+        }
+        pthread_mutex_unlock(&mutex_);
+
+        return nHeld;
+    }
+
+private:
+
+    static void *staticReceive(void *arg) {
+        OscSink *sink = (OscSink *)arg;
+        while (!sink->shouldStop_)
+            lo_server_recv_noblock(sink->server_, SOAK_SINK_POLL_MS);
+        return 0;
+    }
+
+    static int staticMessage(const char *path, const char *types, lo_arg **argv, int argc, lo_message message,
+                             void *context) {
+        ((OscSink *)context)->message(path, types, argv, argc);
+        return 0;
+    }
+
+    void message(const char *path, const char *types, lo_arg **argv, int argc) {
+
+        nMessages_++;
+
+        pthread_mutex_lock(&mutex_);
+
+        if (!strcmp(path, "/mrp/midi") && argc == 3 && !strcmp(types, "iii")) {
+            int note = argv[1]->i & 127;
+            if (argv[2]->i == 0) {
+                if (noteCount_[note] > 0)
+                    noteCount_[note]--;
+            }
+            else if (noteCount_[note]++ == 0)
+                noteOnTime_[note] = hostTimeMicros();
+        }
+        else if (!strcmp(path, "/mrp/allnotesoff")) {
+            for (int note = 0; note < 128; note++)
+                nHeldAtAllNotesOff_ += noteCount_[note] > 0;
+        }
+
+        pthread_mutex_unlock(&mutex_);
+    }
+
+private:
+
+    lo_server server_;
+    pthread_t thread_;
+    pthread_mutex_t mutex_;             // Guards the notes
+    int noteCount_[128];                // Note-ons not yet matched by a note-off
+    uint64_t noteOnTime_[128];          // Host time each held note was first turned on
+    int nHeldAtAllNotesOff_;
+    atomic<long> nMessages_;
+    atomic<bool> shouldStop_;
+};
+
+/* Resident set size (KB), or -1 */
+static long residentKB() {
+
+#ifdef __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return -1;
+    return (long)(info.resident_size / 1024);
+#else
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return -1;
+
+    long size, resident;
+    int nRead = fscanf(file, "%ld %ld", &size, &resident);
+    fclose(file);
+
+    return nRead == 2 ? resident * (sysconf(_SC_PAGESIZE) / 1024) : -1;
+#endif
+}
+
+int main(int argc, char * const argv[])
+{
+    const char *config = NULL;
+    const char *port = SOAK_DEFAULT_PORT;
+    int nUsers = SOAK_DEFAULT_USERS;
+    unsigned int seed = 1;
+    float minutes = SOAK_DEFAULT_MINUTES;
+    float frameRate = 30;
+    int interval = SOAK_DEFAULT_INTERVAL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "u:s:m:f:i:p:c:")) != -1) {
+
+        switch (opt) {
+
+            case 'u':
+                nUsers = atoi(optarg);
+                break;
+
+            case 's':
+                seed = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'm':
+                minutes = atof(optarg);
+                break;
+
+            case 'f':
+                frameRate = atof(optarg);
+                break;
+
+            case 'i':
+                interval = atoi(optarg);
+                break;
+
+            case 'p':
+                port = optarg;
+                break;
+
+            case 'c':
+                config = optarg;
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc || nUsers < 1 || nUsers > SKELETON_MAX_USERS || minutes <= 0 || frameRate <= 0 ||
+        interval < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    OscSink sink;
+    if (!sink.start(port))
+        return 1;
+
+    MotionGenerator motion(nUsers, frameRate, seed);
+    motion.setRealtime(true);
+    CountingSource source(&motion);
+
+    OscController osc;
+    osc.setServerAddress("127.0.0.1", port);
+
+    SkeletonController *controller = new SkeletonController();
+    controller->setOscSender(&osc);
+    controller->setSkeletonSource(&source);
+
+    if (!controller->setParameter("transmit", "on") || (config && !controller->loadConfigFile(config)) ||
+        !controller->beginTracking()) {
+        delete controller;
+        return 1;
+    }
+
+    printf("Soaking %d users at %g fps for %g minutes, reporting every %d s\n", nUsers, frameRate, minutes, interval);
+    printf("%8s %10s %12s %6s %10s %10s\n", "minutes", "frames/s", "messages/s", "held", "longest s", "rss KB");
+
+    uint64_t start = hostTimeMicros();
+    uint64_t end = start + (uint64_t)(minutes * 60e6);
+    uint64_t last = start;
+    int lastFrames = 0;
+    long lastMessages = 0;
+    long baselineKB = -1;
+    long peakGrowthKB = 0;
+    int nFailures = 0;
+
+    while (last < end) {
+
+        /* Sleep out the interval a second at a time, watching for stalls */
+        uint64_t due = last + (uint64_t)interval * 1000000;
+        if (due > end)
+            due = end;
+
+        bool stalled = false;
+        for (uint64_t now = hostTimeMicros(); now < due; now = hostTimeMicros()) {
+            usleep((useconds_t)(due - now > 1000000 ? 1000000 : due - now));
+            stalled = stalled || controller->trackingState() != SkeletonController::TRACKING_RUNNING;
+        }
+
+        uint64_t now = hostTimeMicros();
+        double seconds = (now - last) * 1e-6;
+        int frames = source.numFrames();
+        long messages = sink.numMessages();
+        double longest;
+        int held = sink.heldNotes(&longest);
+        long rss = residentKB();
+
+        float fps = (frames - lastFrames) / seconds;
+        float mps = (messages - lastMessages) / seconds;
+
+        printf("%8.1f %10.1f %12.0f %6d %10.1f %10ld\n", (now - start) / 60e6, fps, mps, held, longest, rss);
+
+        if (baselineKB < 0)
+            baselineKB = rss;
+        else if (rss >= 0 && rss - baselineKB > peakGrowthKB)
+            peakGrowthKB = rss - baselineKB;
+
+        if (stalled) {
+            printf("  FAIL: tracking stalled\n");
+            nFailures++;
+        }
+        if (fps < SOAK_MIN_RATE * frameRate) {
+            printf("  FAIL: tracked %.1f frames/s of %g\n", fps, frameRate);
+            nFailures++;
+        }
+        if (messages == lastMessages) {
+            printf("  FAIL: no messages received\n");
+            nFailures++;
+        }
+        if (longest > SOAK_STUCK_SECONDS) {
+            printf("  FAIL: a note has been held for %.0f s\n", longest);
+            nFailures++;
+        }
+        if (peakGrowthKB > SOAK_MAX_GROWTH_KB) {
+            printf("  FAIL: resident size grew %ld KB since the first interval\n", peakGrowthKB);
+            nFailures++;
+        }
+
+        fflush(stdout);
+
+        last = now;
+        lastFrames = frames;
+        lastMessages = messages;
+    }
+
+    controller->stopTracking();
+
+    /* Let the last note-offs arrive */
+    usleep(SOAK_SINK_POLL_MS * 2000);
+    double longest;
+    int stuck = sink.heldNotes(&longest);
+    if (stuck) {
+        printf("FAIL: %d notes held after tracking stopped\n", stuck);
+        nFailures++;
+    }
+    int unreleased = sink.numHeldAtAllNotesOff();
+    if (unreleased) {
+        printf("FAIL: %d notes were left to an all-notes-off\n", unreleased);
+        nFailures++;
+    }
+
+    delete controller;
+    sink.stop();
+
+    printf("%d frames, %ld messages, resident size grew %ld KB after the first interval: %s\n", source.numFrames(),
+           sink.numMessages(), peakGrowthKB, nFailures ? "FAILED" : "ok");
+
+    return nFailures ? 1 : 0;
+}
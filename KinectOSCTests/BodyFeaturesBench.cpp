@@ -0,0 +1,74 @@
+//
+//  BodyFeaturesBench.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Time per user per frame of FeatureExtractor::extract() on a MotionGenerator
+//  performance, against computeLimbMetrics() alone, which it includes.
+
+#include <stdlib.h>
+#include <vector>
+
+#include "MotionGenerator.h"
+#include "BodyFeatures.h"
+#include "Utility.h"
+
+#define BENCH_FRAMES 1000
+#define BENCH_REPEATS 200
+
+using namespace std;
+
+static void report(const char *name, uint64_t ns) {
+
+    printf("%-20s %6.0f ns/user-frame\n", name, (double)ns / (BENCH_FRAMES * BENCH_REPEATS));
+}
+
+int main(int argc, const char *argv[]) {
+
+    MotionGenerator generator(1, 30, 3);
+    generator.setRealtime(false);
+    generator.setExitRate(0);
+    generator.setDropoutRate(0);
+
+    vector<SkeletonFrame> frames(BENCH_FRAMES);
+    for (int n = 0; n < BENCH_FRAMES; ) {
+        generator.readFrame(&frames[n]);
+        if (frames[n].nUsers > 0 && (frames[n].users[0].flags & USER_TRACKED))
+            n++;
+    }
+
+    FeatureExtractor extractor;
+    BodyFeatures features;
+    LimbMetrics limbs;
+    volatile float sink = 0;        // Keeps the results live
+
+    /* The first pass warms up; the second is reported */
+    for (int pass = 0; pass < 2; pass++) {
+
+        uint64_t start = hostTimeNanos();
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            for (int i = 0; i < BENCH_FRAMES; i++) {
+                extractor.extract(frames[i].users[0], frames[i].timestamp + r * 100000000ull, &features);
+                sink += features.x[SKEL_HAND_R];
+            }
+        }
+        uint64_t extractNs = hostTimeNanos() - start;
+
+        start = hostTimeNanos();
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            for (int i = 0; i < BENCH_FRAMES; i++) {
+                computeLimbMetrics(frames[i].users[0], &limbs);
+                sink += limbs.height;
+            }
+        }
+        uint64_t limbsNs = hostTimeNanos() - start;
+
+        if (pass) {
+            report("extract", extractNs);
+            report("computeLimbMetrics", limbsNs);
+        }
+    }
+
+    return 0;
+}
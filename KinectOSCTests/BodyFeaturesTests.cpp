@@ -0,0 +1,180 @@
+//
+//  BodyFeaturesTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  FeatureExtractor on MotionGenerator performances seen by sensors at random poses: body
+//  coordinates must not depend on where the sensor is or which way it points, body
+//  velocities must not depend on the sensor moving, sensor-space speeds must not depend
+//  on its orientation, and a taller or shorter performer must give the same body
+//  coordinates.
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "MotionGenerator.h"
+#include "BodyFeatures.h"
+#include "TestCheck.h"
+
+#define POSES 8
+#define POSE_FRAMES 3000
+
+static void rotation(float yaw, float pitch, float roll, float R[3][3]) {
+
+    float cy = cosf(yaw), sy = sinf(yaw), cp = cosf(pitch), sp = sinf(pitch), cr = cosf(roll), sr = sinf(roll);
+    float Y[3][3] = {{cy, 0, sy}, {0, 1, 0}, {-sy, 0, cy}};
+    float P[3][3] = {{1, 0, 0}, {0, cp, -sp}, {0, sp, cp}};
+    float Q[3][3] = {{cr, -sr, 0}, {sr, cr, 0}, {0, 0, 1}};
+    float YP[3][3];
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++)
+            YP[i][j] = Y[i][0] * P[0][j] + Y[i][1] * P[1][j] + Y[i][2] * P[2][j];
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++)
+            R[i][j] = YP[i][0] * Q[0][j] + YP[i][1] * Q[1][j] + YP[i][2] * Q[2][j];
+    }
+}
+
+/* The user as seen by a sensor at another pose: scale, rotate, then translate */
+static void transformUser(const SkeletonUser &in, const float R[3][3], Vec3 t, float scale, SkeletonUser *out) {
+
+    *out = in;
+
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+        out->x[j] = scale * (R[0][0] * in.x[j] + R[0][1] * in.y[j] + R[0][2] * in.z[j]) + t.x;
+        out->y[j] = scale * (R[1][0] * in.x[j] + R[1][1] * in.y[j] + R[1][2] * in.z[j]) + t.y;
+        out->z[j] = scale * (R[2][0] * in.x[j] + R[2][1] * in.y[j] + R[2][2] * in.z[j]) + t.z;
+    }
+}
+
+static float maxDifference(const float *a, const float *b) {
+
+    float max = 0;
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+        max = fmaxf(max, fabsf(a[j] - b[j]));
+
+    return max;
+}
+
+static void testInvariance() {
+
+    const float identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    float maxPosition = 0, maxVelocity = 0, maxSpeed = 0, maxScaled = 0;
+    long nFrames = 0;
+
+    srand(7);
+
+    for (unsigned int seed = 1; seed <= POSES; seed++) {
+
+        float R[3][3];
+        rotation((rand() % 360) * (float)M_PI / 180, ((rand() % 60) - 30) * (float)M_PI / 180,
+                 ((rand() % 60) - 30) * (float)M_PI / 180, R);
+        Vec3 t = vec3((rand() % 4000) - 2000, (rand() % 1000) - 500, rand() % 3000);
+        Vec3 drift = vec3((rand() % 600) - 300, 0, (rand() % 600) - 300);     // mm/s
+        float scale = 0.8f + (rand() % 40) / 100.0f;
+
+        MotionGenerator generator(1, 30, seed);
+        generator.setRealtime(false);
+        generator.setExitRate(0);
+        generator.setDropoutRate(0);
+
+        FeatureExtractor reference, rotated, moving, scaled;
+        SkeletonFrame frame;
+
+        for (int f = 0; f < POSE_FRAMES; f++) {
+
+            generator.readFrame(&frame);
+            if (frame.nUsers < 1 || !(frame.users[0].flags & USER_TRACKED))
+                continue;
+
+            const SkeletonUser &user = frame.users[0];
+            SkeletonUser a, b, c;
+            transformUser(user, R, t, 1, &a);
+            transformUser(user, R, t + drift * (frame.timestamp * 1e-6f), 1, &b);
+            transformUser(user, identity, vec3(0, 0, 0), scale, &c);
+
+            BodyFeatures fr, fa, fb, fc;
+            reference.extract(user, frame.timestamp, &fr);
+            rotated.extract(a, frame.timestamp, &fa);
+            moving.extract(b, frame.timestamp, &fb);
+            scaled.extract(c, frame.timestamp, &fc);
+
+            CHECK(fr.hasFrame && fa.hasFrame && fb.hasFrame && fc.hasFrame);
+
+            maxPosition = fmaxf(maxPosition, maxDifference(fr.x, fa.x));
+            maxPosition = fmaxf(maxPosition, maxDifference(fr.y, fa.y));
+            maxPosition = fmaxf(maxPosition, maxDifference(fr.z, fa.z));
+            maxPosition = fmaxf(maxPosition, maxDifference(fr.x, fb.x));
+            maxPosition = fmaxf(maxPosition, maxDifference(fr.y, fb.y));
+            maxPosition = fmaxf(maxPosition, maxDifference(fr.z, fb.z));
+
+            maxVelocity = fmaxf(maxVelocity, maxDifference(fr.vx, fb.vx));
+            maxVelocity = fmaxf(maxVelocity, maxDifference(fr.vy, fb.vy));
+            maxVelocity = fmaxf(maxVelocity, maxDifference(fr.vz, fb.vz));
+            maxVelocity = fmaxf(maxVelocity, maxDifference(fr.bodySpeed, fb.bodySpeed));
+
+            for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+                maxSpeed = fmaxf(maxSpeed, fabsf(fr.speed[j] - fa.speed[j]) / fmaxf(1, fr.speed[j]));
+
+            maxScaled = fmaxf(maxScaled, maxDifference(fr.x, fc.x));
+            maxScaled = fmaxf(maxScaled, maxDifference(fr.y, fc.y));
+            maxScaled = fmaxf(maxScaled, maxDifference(fr.z, fc.z));
+
+            nFrames++;
+        }
+    }
+
+    printf("%ld frames: body coordinates within %.1e heights, velocities %.1e heights/s, speeds %.1e, "
+           "scaled %.1e heights\n", nFrames, maxPosition, maxVelocity, maxSpeed, maxScaled);
+
+    CHECK(nFrames > POSES * POSE_FRAMES / 2);
+    CHECK(maxPosition < 1e-4f);
+    CHECK(maxVelocity < 5e-3f);
+    CHECK(maxSpeed < 2e-2f);
+    CHECK(maxScaled < 1e-5f);
+}
+
+/* No velocity on a user's first frame, or on the first frame after the id is reused */
+static void testFirstFrame() {
+
+    MotionGenerator generator(1, 30, 1);
+    generator.setRealtime(false);
+    generator.setExitRate(0);
+    generator.setDropoutRate(0);
+
+    FeatureExtractor extractor;
+    SkeletonFrame frame;
+    BodyFeatures features;
+    bool first = true;
+
+    for (int f = 0; f < 300; f++) {
+
+        generator.readFrame(&frame);
+        if (frame.nUsers < 1 || !(frame.users[0].flags & USER_TRACKED))
+            continue;
+
+        SkeletonUser user = frame.users[0];
+        if (f == 200)
+            user.flags |= USER_NEW;
+
+        extractor.extract(user, frame.timestamp, &features);
+
+        if (first || f == 200) {
+            for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+                CHECK(features.vx[j] == 0 && features.vy[j] == 0 && features.vz[j] == 0 && features.speed[j] == 0);
+        }
+        first = false;
+    }
+}
+
+int main(int argc, const char *argv[]) {
+
+    testInvariance();
+    testFirstFrame();
+
+    return testResult("BodyFeaturesTests");
+}
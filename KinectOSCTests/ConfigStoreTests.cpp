@@ -0,0 +1,268 @@
+//
+//  ConfigStoreTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Snapshot reclamation step by step, then several writers committing every few tens of
+//  microseconds while readers acquire a snapshot per synthetic frame and another registers,
+//  reads and unregisters over and over. Every snapshot a reader sees must be whole and match
+//  its version, no reader's version may go backwards, and replaced snapshots must be freed
+//  as readers move on. Run under ASan or TSan to see that no reader touches a freed one.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "ConfigStore.h"
+#include "TestCheck.h"
+
+#define STRESS_WRITERS 3
+#define STRESS_READERS 3                // Plus one registering and unregistering
+#define STRESS_COMMITS 5000             // Per writer
+#define STRESS_WRITE_PAUSE_US 20        // Far more often than any UI, but readers get a turn
+
+using namespace std;
+
+/* Every field follows from a stamp, which each commit advances by one */
+static void stampConfig(Config *config, int stamp) {
+
+    config->voiceTimeoutFrames = stamp;
+    config->confThresh = stamp * 0.5f;
+    config->stageWidth = (float)(stamp % 5000);
+    config->scale = stamp % NUM_BUILTIN_SCALES;
+    config->key = stamp % NUM_KEYS;
+    config->octave = stamp % 9;
+    for (int i = 0; i < NOTE_MAP_SIZE; i++)
+        config->noteMap.notes[i] = (stamp + i) & 127;
+    snprintf(config->oscPort, sizeof(config->oscPort), "%d", stamp);
+    config->controlRate = stamp & 511;
+}
+
+static bool isWhole(const Config *config) {
+
+    int stamp = config->voiceTimeoutFrames;
+    char port[16];
+    snprintf(port, sizeof(port), "%d", stamp);
+
+    bool whole = config->confThresh == stamp * 0.5f && config->stageWidth == (float)(stamp % 5000) &&
+                 config->scale == stamp % NUM_BUILTIN_SCALES && config->key == stamp % NUM_KEYS &&
+                 config->octave == stamp % 9 && !strcmp(config->oscPort, port) &&
+                 config->controlRate == (stamp & 511);
+    for (int i = 0; i < NOTE_MAP_SIZE; i++)
+        whole = whole && config->noteMap.notes[i] == ((stamp + i) & 127);
+
+    /* Version 1 has stamp 0 and no commit is lost */
+    return whole && config->version == (uint64_t)stamp + 1;
+}
+
+static Config initialConfig() {
+
+    Config config;
+    memset(&config, 0, sizeof(config));
+    stampConfig(&config, 0);
+    return config;
+}
+
+/* Retired snapshots are kept exactly as long as some reader may hold them */
+static void testReclaim() {
+
+    ConfigStore store(initialConfig());
+
+    int a = store.registerReader();
+    int b = store.registerReader();
+    CHECK(a >= 0 && b >= 0 && a != b);
+
+    const Config *held = store.acquire(a);
+    CHECK(held->version == 1);
+
+    for (int i = 1; i <= 5; i++) {
+        Config *config = store.beginUpdate();
+        stampConfig(config, config->voiceTimeoutFrames + 1);
+        CHECK(store.commitUpdate() == (uint64_t)i + 1);
+        store.acquire(b);
+    }
+
+    /* a still holds version 1, so nothing could be freed */
+    CHECK(store.numRetired() == 5);
+    CHECK(isWhole(held));
+
+    /* An aborted update publishes nothing */
+    store.beginUpdate()->voiceTimeoutFrames = -1;
+    store.abortUpdate();
+    CHECK(store.version() == 6 && isWhole(store.acquire(b)));
+
+    /* Once a moves on, all but the version it now holds go at the next commit */
+    CHECK(store.acquire(a)->version == 6);
+    Config *config = store.beginUpdate();
+    stampConfig(config, config->voiceTimeoutFrames + 1);
+    store.commitUpdate();
+    CHECK(store.numRetired() == 1);
+
+    store.unregisterReader(a);
+    store.unregisterReader(b);
+    CHECK(store.numRetired() == 0);
+
+    /* Registration is limited, and a freed slot is reused */
+    int readers[CONFIG_MAX_READERS + 1];
+    for (int r = 0; r <= CONFIG_MAX_READERS; r++)
+        readers[r] = store.registerReader();
+    CHECK(readers[CONFIG_MAX_READERS - 1] >= 0 && readers[CONFIG_MAX_READERS] == -1);
+    store.unregisterReader(readers[1]);
+    CHECK(store.registerReader() == readers[1]);
+}
+
+struct Stress {
+    ConfigStore *store;
+    atomic<int> nWritersDone;
+    atomic<long> nAcquired;
+    atomic<int> nTorn;
+    atomic<int> nBackwards;
+    atomic<int> maxRetired;
+};
+
+static void *writerThread(void *arg) {
+
+    Stress *stress = (Stress *)arg;
+
+    for (int i = 0; i < STRESS_COMMITS; i++) {
+
+        Config *config = stress->store->beginUpdate();
+        int stamp = config->voiceTimeoutFrames + 1;
+
+        /* Now and then a writer changes its mind halfway */
+        if (i % 50 == 49) {
+            stampConfig(config, -stamp);
+            stress->store->abortUpdate();
+            continue;
+        }
+
+        stampConfig(config, stamp);
+        stress->store->commitUpdate();
+        usleep(STRESS_WRITE_PAUSE_US);
+
+        if (i % 100 == 0) {
+            int nRetired = stress->store->numRetired();
+            if (nRetired > stress->maxRetired)
+                stress->maxRetired = nRetired;
+        }
+    }
+
+    stress->nWritersDone++;
+    return 0;
+}
+
+/* One acquire per frame, reading the snapshot through the frame */
+static void *readerThread(void *arg) {
+
+    Stress *stress = (Stress *)arg;
+    int reader = stress->store->registerReader();
+    if (reader < 0) {
+        stress->nTorn++;
+        return 0;
+    }
+
+    uint64_t last = 0;
+
+    while (stress->nWritersDone < STRESS_WRITERS) {
+
+        const Config *config = stress->store->acquire(reader);
+        if (config->version < last)
+            stress->nBackwards++;
+        last = config->version;
+
+        for (int pass = 0; pass < 4; pass++) {
+            if (!isWhole(config))
+                stress->nTorn++;
+        }
+        stress->nAcquired++;
+    }
+
+    stress->store->unregisterReader(reader);
+    return 0;
+}
+
+/* A reader that comes and goes, like the controller's offline passes */
+static void *visitorThread(void *arg) {
+
+    Stress *stress = (Stress *)arg;
+
+    while (stress->nWritersDone < STRESS_WRITERS) {
+
+        int reader = stress->store->registerReader();
+        if (reader < 0) {
+            stress->nTorn++;
+            return 0;
+        }
+
+        uint64_t last = 0;
+        for (int frame = 0; frame < 100; frame++) {
+            const Config *config = stress->store->acquire(reader);
+            if (config->version < last)
+                stress->nBackwards++;
+            if (!isWhole(config))
+                stress->nTorn++;
+            last = config->version;
+            stress->nAcquired++;
+        }
+
+        stress->store->unregisterReader(reader);
+    }
+
+    return 0;
+}
+
+static void testConcurrentUpdates() {
+
+    ConfigStore store(initialConfig());
+
+    Stress stress;
+    stress.store = &store;
+    stress.nWritersDone = 0;
+    stress.nAcquired = 0;
+    stress.nTorn = 0;
+    stress.nBackwards = 0;
+    stress.maxRetired = 0;
+
+    pthread_t writers[STRESS_WRITERS], readers[STRESS_READERS], visitor;
+
+    for (int i = 0; i < STRESS_READERS; i++)
+        pthread_create(&readers[i], NULL, readerThread, &stress);
+    pthread_create(&visitor, NULL, visitorThread, &stress);
+    for (int i = 0; i < STRESS_WRITERS; i++)
+        pthread_create(&writers[i], NULL, writerThread, &stress);
+
+    for (int i = 0; i < STRESS_WRITERS; i++)
+        pthread_join(writers[i], NULL);
+    for (int i = 0; i < STRESS_READERS; i++)
+        pthread_join(readers[i], NULL);
+    pthread_join(visitor, NULL);
+
+    int nCommits = STRESS_WRITERS * (STRESS_COMMITS - STRESS_COMMITS / 50);
+    Config last = store.current();
+
+    printf("%d commits, %ld snapshots read, %d torn, %d backwards, at most %d retired\n", nCommits,
+           (long)stress.nAcquired, (int)stress.nTorn, (int)stress.nBackwards, (int)stress.maxRetired);
+
+    CHECK(last.version == (uint64_t)nCommits + 1 && isWhole(&last));
+    CHECK(stress.nAcquired > nCommits);
+    CHECK(stress.nTorn == 0);
+    CHECK(stress.nBackwards == 0);
+    CHECK(stress.maxRetired < nCommits / 20);
+
+    /* With every reader gone, the next commit frees the rest */
+    Config *config = store.beginUpdate();
+    stampConfig(config, config->voiceTimeoutFrames + 1);
+    store.commitUpdate();
+    CHECK(store.numRetired() == 0);
+}
+
+int main(int argc, const char *argv[]) {
+
+    testReclaim();
+    testConcurrentUpdates();
+
+    return testResult("ConfigStoreTests");
+}
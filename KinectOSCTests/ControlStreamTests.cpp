@@ -0,0 +1,331 @@
+//
+//  ControlStreamTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  ControlStream against a local sink: 30 Hz targets handed over with random latency, as
+//  the tracking thread would, and every message caught by the sender's callback. Ticks
+//  must keep their period at 100 and 500 Hz, interpolated output must ramp between steps
+//  without turning back, predicted output must never leave the range of its targets, and
+//  a channel left out of a frame must stop sending.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "ControlStream.h"
+#include "Utility.h"
+#include "TestCheck.h"
+
+#define FRAME_US 33333
+#define LATENCY_MIN_US 3000
+#define LATENCY_RANGE_US 12000
+
+using namespace std;
+
+struct Sample {
+    uint64_t time;              // Host us, when the output thread handed it over
+    char path[32];
+    char types[4];
+    int note;
+    float value;
+};
+
+struct Sink {
+    pthread_mutex_t mutex;
+    vector<Sample> samples;
+};
+
+static void sinkMessage(void *context, const char *path, const char *types, lo_message message) {
+
+    Sink *sink = (Sink *)context;
+    lo_arg **argv = lo_message_get_argv(message);
+    int argc = lo_message_get_argc(message);
+
+    Sample sample;
+    sample.time = hostTimeMicros();
+    snprintf(sample.path, sizeof(sample.path), "%s", path);
+    snprintf(sample.types, sizeof(sample.types), "%s", types);
+    sample.note = argc == 3 ? argv[1]->i : -1;
+    sample.value = argv[argc-1]->f;
+
+    pthread_mutex_lock(&sink->mutex);
+    sink->samples.push_back(sample);
+    pthread_mutex_unlock(&sink->mutex);
+}
+
+static void sleepUntil(uint64_t time) {
+
+    uint64_t now = hostTimeMicros();
+    if (time > now)
+        usleep((useconds_t)(time - now));
+}
+
+/* Targets for frame k */
+typedef void (*TargetFunction)(ControlStream *stream, int frame);
+
+/* Frames captured at 30 Hz, each handed over LATENCY_MIN_US to LATENCY_MIN_US +
+   LATENCY_RANGE_US later, in order. Returns the host time the last frame was handed over. */
+static uint64_t feed(ControlStream *stream, int nFrames, TargetFunction targets, int firstFrame = 0) {
+
+    uint64_t start = hostTimeMicros();
+    uint64_t handedOver = start;
+
+    for (int k = 0; k < nFrames; k++) {
+
+        uint64_t capture = start + (uint64_t)k * FRAME_US;
+        uint64_t due = capture + LATENCY_MIN_US + rand() % LATENCY_RANGE_US;
+        sleepUntil(max(due, handedOver));
+
+        stream->beginFrame(capture);
+        targets(stream, firstFrame + k);
+        stream->endFrame();
+        handedOver = hostTimeMicros();
+    }
+
+    return handedOver;
+}
+
+static void startSink(ControlStream *stream, Sink *sink) {
+
+    pthread_mutex_init(&sink->mutex, NULL);
+    sink->samples.clear();
+    stream->sender().setMessageCallback(sinkMessage, sink);
+}
+
+/* The samples on one path, in order */
+static vector<Sample> samplesOn(Sink *sink, const char *path) {
+
+    vector<Sample> on;
+
+    pthread_mutex_lock(&sink->mutex);
+    for (size_t i = 0; i < sink->samples.size(); i++) {
+        if (!strcmp(sink->samples[i].path, path))
+            on.push_back(sink->samples[i]);
+    }
+    pthread_mutex_unlock(&sink->mutex);
+
+    return on;
+}
+
+/* Rises at a steady 0.01 per frame, so every interpolated tick is a change */
+static void rampTargets(ControlStream *stream, int frame) {
+    stream->setTarget("/ramp", -1, frame * 0.01f);
+}
+
+static void testTiming(int rate) {
+
+    const int nFrames = 45;
+    const int periodUs = 1000000 / rate;
+
+    ControlStream stream;
+    Sink sink;
+    startSink(&stream, &sink);
+    CHECK(stream.start(rate, false));
+
+    uint64_t start = hostTimeMicros();
+    feed(&stream, nFrames, rampTargets);
+    uint64_t elapsed = hostTimeMicros() - start;
+    stream.stop();
+
+    vector<Sample> ramp = samplesOn(&sink, "/ramp");
+
+    /* From the second target on, when the ramp starts moving */
+    vector<double> intervals;
+    for (size_t i = 1; i < ramp.size(); i++) {
+        if (ramp[i-1].time > start + 2 * FRAME_US)
+            intervals.push_back((double)(ramp[i].time - ramp[i-1].time));
+    }
+    CHECK(intervals.size() > 10);
+    if (intervals.size() <= 10)
+        return;
+
+    double sum = 0, sumSquares = 0;
+    for (size_t i = 0; i < intervals.size(); i++) {
+        sum += intervals[i];
+        sumSquares += intervals[i] * intervals[i];
+    }
+    double mean = sum / intervals.size();
+    double jitter = sqrt(fmax(0, sumSquares / intervals.size() - mean * mean));
+
+    vector<double> sorted = intervals;
+    sort(sorted.begin(), sorted.end());
+    double median = sorted[sorted.size() / 2];
+
+    double expectedTicks = elapsed * 1e-6 * rate;
+
+    printf("%d Hz: %llu ticks (%.0f expected), %llu late; message gap median %.2f ms, mean %.2f ms, "
+           "sd %.2f ms\n", rate, (unsigned long long)stream.numTicks(), expectedTicks,
+           (unsigned long long)stream.numLateTicks(), median * 1e-3, mean * 1e-3, jitter * 1e-3);
+
+    CHECK(stream.numTicks() > 0.9 * expectedTicks && stream.numTicks() < 1.02 * expectedTicks + 2);
+    CHECK(stream.numLateTicks() < 0.05 * stream.numTicks());
+    CHECK(fabs(median - periodUs) < 0.1 * periodUs);
+    CHECK(mean < 1.1 * periodUs);
+    CHECK(jitter < 1500);
+
+    /* Every tick sent the ramp, each in its own bundle */
+    CHECK(stream.numMessages() == ramp.size() && stream.numBundles() == ramp.size());
+}
+
+/* Random steps up for 30 frames, then down for 30, then held */
+static float gSteps[90];
+
+static void stepTargets(ControlStream *stream, int frame) {
+    stream->setTarget("/steps", -1, gSteps[frame]);
+}
+
+static void testInterpolatedRamps() {
+
+    gSteps[0] = 0.5f;
+    for (int k = 1; k < 90; k++) {
+        float step = 0.005f + (rand() % 100) * 0.001f;
+        gSteps[k] = k < 30 ? gSteps[k-1] + step : k < 60 ? gSteps[k-1] - step : gSteps[k-1];
+    }
+
+    float lo = *min_element(gSteps, gSteps + 90), hi = *max_element(gSteps, gSteps + 90);
+    float largestStep = 0;
+    for (int k = 1; k < 90; k++)
+        largestStep = fmaxf(largestStep, fabsf(gSteps[k] - gSteps[k-1]));
+
+    ControlStream stream;
+    Sink sink;
+    startSink(&stream, &sink);
+    CHECK(stream.start(500, false));
+    feed(&stream, 90, stepTargets);
+    usleep(100000);
+    stream.stop();
+
+    vector<Sample> steps = samplesOn(&sink, "/steps");
+
+    int nReversals = 0, direction = 0;
+    float largestMove = 0;
+    bool inRange = true;
+
+    for (size_t i = 0; i < steps.size(); i++) {
+
+        inRange = inRange && steps[i].value >= lo - 1e-6f && steps[i].value <= hi + 1e-6f;
+        if (i == 0)
+            continue;
+
+        float move = steps[i].value - steps[i-1].value;
+        largestMove = fmaxf(largestMove, fabsf(move));
+
+        int d = move > 0 ? 1 : move < 0 ? -1 : 0;
+        if (d && direction && d != direction)
+            nReversals++;
+        if (d)
+            direction = d;
+    }
+
+    printf("interpolated: %d messages for 90 targets, largest move %.4f of a largest step %.4f, "
+           "%d reversals\n", (int)steps.size(), largestMove, largestStep, nReversals);
+
+    /* Ramps of several ticks per step, turning back only where the targets do */
+    CHECK(steps.size() > 5 * 60);
+    CHECK(inRange);
+    CHECK(nReversals == 1);
+    CHECK(largestMove <= largestStep + 1e-6f);
+    CHECK(largestMove < 0.5f * largestStep);
+
+    /* Settled on the last target, short of anything under the deadband */
+    CHECK(!steps.empty() && fabsf(steps.back().value - gSteps[89]) < CONTROL_DEADBAND);
+}
+
+/* Up to 1 over 20 frames, held, down to 0 over 20 frames, held */
+static void plateauTargets(ControlStream *stream, int frame) {
+
+    float value = frame < 20 ? frame / 20.0f : frame < 40 ? 1 : frame < 60 ? 1 - (frame - 40) / 20.0f : 0;
+    stream->setTarget("/plateau", -1, value);
+}
+
+static void testPredictionStaysInRange() {
+
+    ControlStream stream;
+    Sink sink;
+    startSink(&stream, &sink);
+    CHECK(stream.start(500, true));
+
+    uint64_t start = hostTimeMicros();
+    feed(&stream, 80, plateauTargets);
+    usleep(100000);
+    stream.stop();
+
+    vector<Sample> plateau = samplesOn(&sink, "/plateau");
+
+    float lo = 1, hi = 0, atTop = -1;
+    for (size_t i = 0; i < plateau.size(); i++) {
+        lo = fminf(lo, plateau[i].value);
+        hi = fmaxf(hi, plateau[i].value);
+        if (plateau[i].time < start + 40 * FRAME_US)
+            atTop = plateau[i].value;
+    }
+
+    printf("predicted: %d messages, range %.5f to %.5f, %.5f before the fall\n", (int)plateau.size(), lo, hi, atTop);
+
+    /* Extrapolating the ramps would carry past both plateaus */
+    CHECK(plateau.size() > 100);
+    CHECK(lo >= 0 && hi <= 1);
+    CHECK(fabsf(atTop - 1) < 1e-3f);
+    CHECK(!plateau.empty() && fabsf(plateau.back().value) < 1e-3f);
+}
+
+static int gDropAfter;
+
+static void twoChannelTargets(ControlStream *stream, int frame) {
+
+    stream->setTarget("/kept", -1, frame * 0.01f);
+    if (frame < gDropAfter)
+        stream->setTarget("/mrp/quality/intensity", 60, 0.2f + frame * 0.01f);
+}
+
+static void testDroppedChannel() {
+
+    const int periodUs = 1000000 / 200;
+
+    ControlStream stream;
+    Sink sink;
+    startSink(&stream, &sink);
+    CHECK(stream.start(200, false));
+
+    gDropAfter = 20;
+    uint64_t dropped = feed(&stream, gDropAfter + 1, twoChannelTargets);
+    feed(&stream, 15, twoChannelTargets, gDropAfter + 1);
+    stream.stop();
+
+    vector<Sample> kept = samplesOn(&sink, "/kept");
+    vector<Sample> intensity = samplesOn(&sink, "/mrp/quality/intensity");
+
+    int nAfter = 0;
+    bool formed = true;
+    for (size_t i = 0; i < intensity.size(); i++) {
+        formed = formed && !strcmp(intensity[i].types, "iif") && intensity[i].note == 60;
+        if (intensity[i].time > dropped + 2 * periodUs)
+            nAfter++;
+    }
+
+    printf("dropped channel: %d messages before, %d after; kept channel %d\n", (int)intensity.size() - nAfter,
+           nAfter, (int)kept.size());
+
+    CHECK(intensity.size() > 20 && formed);
+    CHECK(nAfter == 0);
+    CHECK(!kept.empty() && kept.back().time > dropped + 100000);
+    CHECK(!kept.empty() && !strcmp(kept.back().types, "f"));
+}
+
+int main(int argc, const char *argv[]) {
+
+    srand(5);
+
+    testTiming(100);
+    testTiming(500);
+    testInterpolatedRamps();
+    testPredictionStaysInRange();
+    testDroppedChannel();
+
+    return testResult("ControlStreamTests");
+}
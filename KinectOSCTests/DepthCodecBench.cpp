@@ -0,0 +1,80 @@
+//
+//  DepthCodecBench.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Compression ratio and time per 640x480 frame of DepthCodec on a synthetic depth
+//  sequence, for keyframes alone, delta frames alone, and GOPs of SESSION_KEYFRAME_INTERVAL
+//  as the recorder writes them. The recorder has a frame period, 33 ms, to encode each.
+
+#include <stdlib.h>
+#include <vector>
+
+#include "DepthCodec.h"
+#include "DepthSynthesis.h"
+#include "SessionRecording.h"
+#include "Utility.h"
+
+#define BENCH_WIDTH 640
+#define BENCH_HEIGHT 480
+#define BENCH_FRAMES 150
+
+using namespace std;
+
+static void report(const char *name, uint64_t compressedBytes, uint64_t encodeNs, uint64_t decodeNs) {
+
+    double raw = (double)BENCH_WIDTH * BENCH_HEIGHT * 2 * BENCH_FRAMES;
+    printf("%-12s %6.1f:1  encode %6.3f ms/frame  decode %6.3f ms/frame\n", name, raw / compressedBytes,
+           encodeNs * 1e-6 / BENCH_FRAMES, decodeNs * 1e-6 / BENCH_FRAMES);
+}
+
+int main(int argc, const char *argv[]) {
+
+    DepthSynthesis scene(BENCH_WIDTH, BENCH_HEIGHT, 1);
+    vector<vector<uint16_t> > frames(BENCH_FRAMES, vector<uint16_t>(BENCH_WIDTH * BENCH_HEIGHT));
+    for (int f = 0; f < BENCH_FRAMES; f++)
+        scene.render(f, &frames[f][0], BENCH_WIDTH);
+
+    const char *names[] = { "keyframes", "delta", "gop" };
+
+    DepthCodec encoder, decoder;
+    vector<uint8_t> compressed(DEPTH_CODEC_MAX_BYTES(BENCH_WIDTH, BENCH_HEIGHT));
+    vector<uint16_t> decoded(BENCH_WIDTH * BENCH_HEIGHT);
+    volatile int sink = 0;          // Keeps the results live
+
+    /* The first pass warms up; the rest are reported */
+    for (int pass = 0; pass < 4; pass++) {
+
+        int mode = pass ? pass - 1 : 0;
+        uint64_t bytes = 0, encodeNs = 0, decodeNs = 0;
+
+        for (int f = 0; f < BENCH_FRAMES; f++) {
+
+            /* Delta frames are coded against the frame before; the first against the last */
+            bool keyframe = mode == 0 || (mode == 2 && f % SESSION_KEYFRAME_INTERVAL == 0);
+            const uint16_t *prev = keyframe ? NULL : &frames[(f + BENCH_FRAMES - 1) % BENCH_FRAMES][0];
+
+            uint64_t start = hostTimeNanos();
+            int length = encoder.encode(&frames[f][0], prev, BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH, &compressed[0],
+                                        (int)compressed.size());
+            uint64_t encoded = hostTimeNanos();
+            bool ok = decoder.decode(&compressed[0], length, prev, BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH, &decoded[0]);
+            decodeNs += hostTimeNanos() - encoded;
+            encodeNs += encoded - start;
+
+            if (!ok) {
+                printf("%s: frame %d didn't decode\n", names[mode], f);
+                return 1;
+            }
+
+            bytes += length;
+            sink += decoded[f];
+        }
+
+        if (pass)
+            report(names[mode], bytes, encodeNs, decodeNs);
+    }
+
+    return 0;
+}
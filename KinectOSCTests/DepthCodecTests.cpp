@@ -0,0 +1,265 @@
+//
+//  DepthCodecTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  DepthCodec round trips: keyframes and chains of delta frames from a synthetic scene,
+//  images inside wider buffers and with widths that aren't a whole number of blocks, frames
+//  with no depth at all, and frames where every pixel is a different value. Every round
+//  trip must be exact. Truncated frames and delta frames decoded against the wrong
+//  reference must be refused, and no single flipped bit may decode to a wrong image.
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "DepthCodec.h"
+#include "DepthSynthesis.h"
+#include "TestCheck.h"
+
+#define SCENE_WIDTH 640
+#define SCENE_HEIGHT 480
+#define SCENE_FRAMES 45
+#define PADDING_VALUE 0xbeef
+
+using namespace std;
+
+/* Encodes cur against prev and decodes it back into an image of the same stride, whose
+   padding must be left alone. Returns the compressed length, or -1 if the trip failed. */
+static int roundTrip(DepthCodec *codec, const uint16_t *cur, const uint16_t *prev, int width, int height,
+                     int strideInPixels, vector<uint8_t> *compressed = NULL) {
+
+    vector<uint8_t> buffer(DEPTH_CODEC_MAX_BYTES(width, height));
+    int length = codec->encode(cur, prev, width, height, strideInPixels, &buffer[0], (int)buffer.size());
+    CHECK(length > 0);
+    if (length <= 0)
+        return -1;
+
+    vector<uint16_t> decoded(strideInPixels * height, PADDING_VALUE);
+    DepthCodec decoder;
+    bool ok = decoder.decode(&buffer[0], length, prev, width, height, strideInPixels, &decoded[0]);
+    CHECK(ok);
+
+    bool exact = true, untouched = true;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < strideInPixels; x++) {
+            if (x < width)
+                exact = exact && decoded[y * strideInPixels + x] == cur[y * strideInPixels + x];
+            else
+                untouched = untouched && decoded[y * strideInPixels + x] == PADDING_VALUE;
+        }
+    }
+    CHECK(exact);
+    CHECK(untouched);
+
+    if (compressed)
+        compressed->assign(buffer.begin(), buffer.begin() + length);
+    return ok && exact && untouched ? length : -1;
+}
+
+static void testSceneSequence() {
+
+    DepthSynthesis scene(SCENE_WIDTH, SCENE_HEIGHT, 1);
+    vector<uint16_t> prev(SCENE_WIDTH * SCENE_HEIGHT), cur(SCENE_WIDTH * SCENE_HEIGHT);
+    DepthCodec codec;
+
+    long keyBytes = 0, deltaBytes = 0;
+    int nKeyframes = 0, nDeltas = 0;
+
+    /* One codec for the whole sequence, as the recorder uses it */
+    for (int f = 0; f < SCENE_FRAMES; f++) {
+
+        scene.render(f, &cur[0], SCENE_WIDTH);
+        bool keyframe = f % 15 == 0;
+
+        int length = roundTrip(&codec, &cur[0], keyframe ? NULL : &prev[0], SCENE_WIDTH, SCENE_HEIGHT, SCENE_WIDTH);
+        if (keyframe) {
+            keyBytes += length;
+            nKeyframes++;
+        }
+        else {
+            deltaBytes += length;
+            nDeltas++;
+        }
+
+        prev.swap(cur);
+    }
+
+    double raw = SCENE_WIDTH * SCENE_HEIGHT * 2;
+    printf("scene: keyframes %.1f:1, delta frames %.1f:1\n", raw * nKeyframes / keyBytes, raw * nDeltas / deltaBytes);
+
+    /* Far better than raw, and predicting from the last frame must pay */
+    CHECK(raw * nKeyframes / keyBytes > 4);
+    CHECK((double)deltaBytes / nDeltas < (double)keyBytes / nKeyframes);
+}
+
+/* Odd sizes inside wider buffers, with the padding full of values that aren't in the image */
+static void testStrided() {
+
+    const int sizes[][3] = { {37, 23, 40}, {16, 3, 48}, {1, 1, 7}, {17, 9, 17}, {100, 50, 128} };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+
+        int width = sizes[s][0], height = sizes[s][1], stride = sizes[s][2];
+        DepthSynthesis scene(stride, height, (unsigned)s);
+        vector<uint16_t> prev(stride * height), cur(stride * height);
+        scene.render(0, &prev[0], stride);
+        scene.render(7, &cur[0], stride);
+
+        for (int y = 0; y < height; y++) {
+            for (int x = width; x < stride; x++) {
+                prev[y * stride + x] = (uint16_t)(60000 + x);
+                cur[y * stride + x] = (uint16_t)(61000 + y);
+            }
+        }
+
+        DepthCodec codec;
+        CHECK(roundTrip(&codec, &prev[0], NULL, width, height, stride) > 0);
+        CHECK(roundTrip(&codec, &cur[0], &prev[0], width, height, stride) > 0);
+    }
+}
+
+static void testAllHoles() {
+
+    vector<uint16_t> holes(SCENE_WIDTH * SCENE_HEIGHT, 0), scene(SCENE_WIDTH * SCENE_HEIGHT);
+    DepthSynthesis(SCENE_WIDTH, SCENE_HEIGHT, 2).render(0, &scene[0], SCENE_WIDTH);
+
+    DepthCodec codec;
+    int keyframe = roundTrip(&codec, &holes[0], NULL, SCENE_WIDTH, SCENE_HEIGHT, SCENE_WIDTH);
+    int fromHoles = roundTrip(&codec, &holes[0], &holes[0], SCENE_WIDTH, SCENE_HEIGHT, SCENE_WIDTH);
+    int toHoles = roundTrip(&codec, &holes[0], &scene[0], SCENE_WIDTH, SCENE_HEIGHT, SCENE_WIDTH);
+    int fromNothing = roundTrip(&codec, &scene[0], &holes[0], SCENE_WIDTH, SCENE_HEIGHT, SCENE_WIDTH);
+
+    printf("all holes: %d byte keyframe, %d and %d byte delta frames, %d bytes back from nothing\n", keyframe,
+           fromHoles, toHoles, fromNothing);
+
+    /* Holes are only predicted from the last frame: elsewhere each costs a bit. Against an
+       empty frame, an empty one is runs and the block modes. */
+    int oneBitEach = 400 + SCENE_WIDTH * SCENE_HEIGHT / 8;
+    CHECK(keyframe > 0 && keyframe < oneBitEach);
+    CHECK(fromHoles > 0 && fromHoles < 200 + SCENE_WIDTH * SCENE_HEIGHT / DEPTH_CODEC_BLOCK / 8);
+    CHECK(toHoles > 0 && toHoles < oneBitEach + SCENE_WIDTH * SCENE_HEIGHT / DEPTH_CODEC_BLOCK / 8);
+    CHECK(fromNothing > 0);
+}
+
+/* Every pixel a different value, in no order, so nearly every pixel is escaped */
+static void testAllUnique() {
+
+    const int width = 255, height = 257;
+    vector<uint16_t> cur(width * height), prev(width * height);
+
+    for (int i = 0; i < width * height; i++) {
+        cur[i] = (uint16_t)(i + 1);
+        prev[i] = (uint16_t)(i + 1);
+    }
+    for (int i = width * height - 1; i > 0; i--) {
+        swap(cur[i], cur[rand() % (i + 1)]);
+        swap(prev[i], prev[rand() % (i + 1)]);
+    }
+
+    DepthCodec codec;
+    int keyframe = roundTrip(&codec, &cur[0], NULL, width, height, width);
+    int delta = roundTrip(&codec, &cur[0], &prev[0], width, height, width);
+
+    printf("all unique: %d byte keyframe, %d byte delta frame for %d raw\n", keyframe, delta, width * height * 2);
+    CHECK(keyframe > 0 && keyframe <= DEPTH_CODEC_MAX_BYTES(width, height));
+    CHECK(delta > 0 && delta <= DEPTH_CODEC_MAX_BYTES(width, height));
+
+    /* Too little room is refused, not overrun */
+    vector<uint8_t> small(keyframe - 1);
+    CHECK(codec.encode(&cur[0], NULL, width, height, width, &small[0], (int)small.size()) == -1);
+}
+
+/* A decode that returns false may have written anything, so only accepted ones are compared */
+static bool decodesTo(const vector<uint8_t> &compressed, int length, const uint16_t *prev, int width, int height,
+                      const vector<uint16_t> &expected) {
+
+    vector<uint16_t> decoded(width * height);
+    DepthCodec decoder;
+    if (!decoder.decode(&compressed[0], length, prev, width, height, width, &decoded[0]))
+        return false;
+    return decoded == expected;
+}
+
+static void testCorruptInput() {
+
+    const int width = 48, height = 36;
+    DepthSynthesis scene(width, height, 3);
+    vector<uint16_t> prev(width * height), cur(width * height), other(width * height);
+    scene.render(0, &prev[0], width);
+    scene.render(2, &cur[0], width);
+    scene.render(40, &other[0], width);
+
+    DepthCodec codec;
+    vector<uint8_t> keyframe, delta;
+    CHECK(roundTrip(&codec, &prev[0], NULL, width, height, width, &keyframe) > 0);
+    CHECK(roundTrip(&codec, &cur[0], &prev[0], width, height, width, &delta) > 0);
+
+    vector<uint16_t> decoded(width * height);
+    DepthCodec decoder;
+
+    /* Every truncation */
+    int nAccepted = 0;
+    for (size_t length = 0; length < keyframe.size(); length++)
+        nAccepted += decoder.decode(&keyframe[0], (int)length, NULL, width, height, width, &decoded[0]);
+    for (size_t length = 0; length < delta.size(); length++)
+        nAccepted += decoder.decode(&delta[0], (int)length, &prev[0], width, height, width, &decoded[0]);
+    CHECK(nAccepted == 0);
+
+    /* Every single bit flipped. A flip may go unnoticed only where it can't change the image:
+       padding, or the predictor of a block both predictors get right. */
+    const vector<uint8_t> *frames[] = { &keyframe, &delta };
+    const vector<uint16_t> *images[] = { &prev, &cur };
+    int nFlips = 0, nRejected = 0, nHarmless = 0, nWrong = 0;
+
+    for (int k = 0; k < 2; k++) {
+
+        vector<uint8_t> flipped = *frames[k];
+        const uint16_t *reference = k ? &prev[0] : NULL;
+
+        for (size_t bit = 0; bit < 8 * flipped.size(); bit++) {
+
+            flipped[bit / 8] ^= 1 << (bit % 8);
+
+            bool accepted = decoder.decode(&flipped[0], (int)flipped.size(), reference, width, height, width,
+                                           &decoded[0]);
+            if (!accepted)
+                nRejected++;
+            else if (decodesTo(flipped, (int)flipped.size(), reference, width, height, *images[k]))
+                nHarmless++;
+            else
+                nWrong++;
+            nFlips++;
+
+            flipped[bit / 8] ^= 1 << (bit % 8);
+        }
+    }
+
+    printf("corrupt input: %d of %d bit flips refused, %d harmless, %d accepted wrongly\n", nRejected, nFlips,
+           nHarmless, nWrong);
+    CHECK(nWrong == 0);
+    CHECK(nRejected > 0.95 * nFlips);
+
+    /* A delta frame needs its own reference, and a keyframe none */
+    CHECK(!decoder.decode(&delta[0], (int)delta.size(), &other[0], width, height, width, &decoded[0]));
+    CHECK(!decoder.decode(&delta[0], (int)delta.size(), NULL, width, height, width, &decoded[0]));
+    CHECK(decodesTo(keyframe, (int)keyframe.size(), &other[0], width, height, prev));
+
+    /* Nor may a frame be read at another size */
+    CHECK(!decoder.decode(&keyframe[0], (int)keyframe.size(), NULL, width - 1, height, width, &decoded[0]));
+    CHECK(!decoder.decode(&keyframe[0], (int)keyframe.size(), NULL, width, height - 1, width, &decoded[0]));
+}
+
+int main(int argc, const char *argv[]) {
+
+    srand(3);
+
+    testSceneSequence();
+    testStrided();
+    testAllHoles();
+    testAllUnique();
+    testCorruptInput();
+
+    return testResult("DepthCodecTests");
+}
@@ -0,0 +1,92 @@
+//
+//  DepthHistogramBench.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Time per 640x480 frame of calculateHistogram()'s loops against DepthHistogram, rebuilt
+//  on one to four threads and updated incrementally, and of a histogram of a single row,
+//  where the prefix scan and normalization are nearly all the work there is.
+
+#include <stdlib.h>
+#include <vector>
+
+#include "DepthHistogram.h"
+#include "ReferenceHistogram.h"
+#include "Utility.h"
+
+#define BENCH_WIDTH 640
+#define BENCH_HEIGHT 480
+#define BENCH_HISTOGRAM_SIZE 10000
+#define BENCH_FRAMES 300
+
+using namespace std;
+
+/* Frames of a scene with sensor noise on about one pixel in a hundred */
+static void makeFrames(vector<vector<uint16_t> > *frames) {
+
+    vector<uint16_t> depth(BENCH_WIDTH * BENCH_HEIGHT);
+    for (int y = 0; y < BENCH_HEIGHT; y++) {
+        for (int x = 0; x < BENCH_WIDTH; x++)
+            depth[y * BENCH_WIDTH + x] = (uint16_t)(rand() % 10 ? 800 + y * 5 + (x & 15) : 0);
+    }
+
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        for (int k = 0; k < BENCH_WIDTH * BENCH_HEIGHT / 100; k++)
+            depth[rand() % depth.size()] = (uint16_t)(rand() % 10 ? 700 + rand() % 4000 : 0);
+        frames->push_back(depth);
+    }
+}
+
+static void report(const char *name, uint64_t ns) {
+
+    printf("%-26s %8.3f ms/frame\n", name, ns * 1e-6 / BENCH_FRAMES);
+}
+
+int main(int argc, const char *argv[]) {
+
+    srand(1);
+
+    vector<vector<uint16_t> > frames;
+    makeFrames(&frames);
+    vector<float> histogram(BENCH_HISTOGRAM_SIZE);
+    ReferenceHistogram reference;
+
+    uint64_t start = hostTimeNanos();
+    for (int f = 0; f < BENCH_FRAMES; f++)
+        reference.calculate(&histogram[0], BENCH_HISTOGRAM_SIZE, &frames[f][0], BENCH_WIDTH, BENCH_HEIGHT,
+                            BENCH_WIDTH);
+    report("calculateHistogram", hostTimeNanos() - start);
+
+    for (int nThreads = 1; nThreads <= 4; nThreads *= 2) {
+
+        DepthHistogram depthHistogram(BENCH_HISTOGRAM_SIZE, nThreads);
+
+        start = hostTimeNanos();
+        for (int f = 0; f < BENCH_FRAMES; f++)
+            depthHistogram.calculate(&histogram[0], &frames[f][0], BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH);
+
+        char name[64];
+        snprintf(name, sizeof(name), "DepthHistogram, %d thread%s", nThreads, nThreads > 1 ? "s" : "");
+        report(name, hostTimeNanos() - start);
+    }
+
+    DepthHistogram incremental(BENCH_HISTOGRAM_SIZE, 4);
+    incremental.setIncrementalThreshold(0.05f);
+
+    start = hostTimeNanos();
+    for (int f = 0; f < BENCH_FRAMES; f++)
+        incremental.calculate(&histogram[0], &frames[f][0], BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH);
+    report("DepthHistogram, incremental", hostTimeNanos() - start);
+
+    /* A single row: counting is negligible, leaving the scan */
+    DepthHistogram scan(BENCH_HISTOGRAM_SIZE, 1);
+    vector<uint16_t> row(BENCH_WIDTH, 1000);
+
+    start = hostTimeNanos();
+    for (int f = 0; f < BENCH_FRAMES; f++)
+        scan.calculate(&histogram[0], &row[0], BENCH_WIDTH, 1, BENCH_WIDTH);
+    report("Prefix scan alone", hostTimeNanos() - start);
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+//
+//  DepthHistogramTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  DepthHistogram against calculateHistogram() from NiteSampleUtilities.h, bit for bit:
+//  over every thread count, padded strides, odd widths and histogram sizes, empty frames,
+//  depths past the end of the histogram, and incremental updates of a changing scene.
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "DepthHistogram.h"
+#include "ReferenceHistogram.h"
+#include "TestCheck.h"
+
+using namespace std;
+
+/* A floor sloping away from the sensor, a performer in front of it, dropouts and noise */
+static void makeScene(vector<uint16_t> *depth, int width, int height, int stride, int maxDepth, int frame) {
+
+    depth->assign(stride * height, 0xBEEF);             // Padding the histogram must never read
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int d = 800 + y * 5;
+            if (abs(x - (width / 2 + frame * 3)) < width / 8 && y > height / 4)
+                d = 1500 + (x & 7);
+            d += rand() % 5;
+            if (rand() % 10 == 0)
+                d = 0;
+            (*depth)[y * stride + x] = (uint16_t)(d < maxDepth ? d : rand() % maxDepth);
+        }
+    }
+}
+
+static bool sameHistogram(DepthHistogram *histogram, int size, const vector<uint16_t> &depth, int width, int height,
+                          int stride) {
+
+    vector<float> expected(size), actual(size, -1.0f);
+    ReferenceHistogram reference;
+
+    reference.calculate(&expected[0], size, &depth[0], width, height, stride);
+    histogram->calculate(&actual[0], &depth[0], width, height, stride);
+
+    return memcmp(&expected[0], &actual[0], size * sizeof(float)) == 0;
+}
+
+static void testFullFrames() {
+
+    const int sizes[] = {10000, 4097, 13, 1};
+    vector<uint16_t> depth;
+
+    for (int nThreads = 1; nThreads <= DEPTH_HIST_MAX_THREADS; nThreads++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+
+            DepthHistogram histogram(sizes[s], nThreads);
+
+            makeScene(&depth, 640, 480, 640, 5000, 0);
+            CHECK(sameHistogram(&histogram, sizes[s], depth, 640, 480, 640));
+
+            makeScene(&depth, 317, 7, 333, 5000, 1);
+            CHECK(sameHistogram(&histogram, sizes[s], depth, 317, 7, 333));
+
+            depth.assign(160 * 120, 0);
+            CHECK(sameHistogram(&histogram, sizes[s], depth, 160, 120, 160));
+        }
+    }
+}
+
+/* Depths the histogram doesn't bin still count as points */
+static void testOutOfRange() {
+
+    vector<uint16_t> depth;
+    DepthHistogram histogram(2048, 3);
+
+    makeScene(&depth, 640, 480, 656, 65535, 0);
+    for (size_t i = 0; i < depth.size(); i += 7)
+        depth[i] = 60000;
+
+    CHECK(sameHistogram(&histogram, 2048, depth, 640, 480, 656));
+}
+
+/* The performer moves a little each frame and the scene sometimes cuts, so frames are
+   served both incrementally and by rebuilding */
+static void testIncremental() {
+
+    vector<uint16_t> depth;
+    DepthHistogram histogram(10000, 4);
+    histogram.setIncrementalThreshold(0.05f);
+
+    makeScene(&depth, 640, 480, 640, 10000, 0);
+    int nIncremental = 0;
+    int nMismatches = 0;
+
+    for (int frame = 0; frame < 60; frame++) {
+
+        if (frame % 20 == 19)
+            makeScene(&depth, 640, 480, 640, 10000, frame);
+        else if (frame == 30)
+            depth.assign(depth.size(), 0);
+        else {
+            for (int k = 0; k < 3000; k++)
+                depth[rand() % depth.size()] = (uint16_t)(rand() % 5 ? 700 + rand() % 4000 : 0);
+        }
+
+        if (!sameHistogram(&histogram, 10000, depth, 640, 480, 640))
+            nMismatches++;
+        nIncremental += histogram.lastWasIncremental();
+    }
+
+    CHECK(nMismatches == 0);
+    CHECK(nIncremental > 40);
+}
+
+int main(int argc, const char *argv[]) {
+
+    srand(1);
+
+    testFullFrames();
+    testOutOfRange();
+    testIncremental();
+
+    return testResult("DepthHistogramTests");
+}
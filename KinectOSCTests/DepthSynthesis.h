@@ -0,0 +1,133 @@
+//
+//  DepthSynthesis.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Synthetic depth sequences for the depth codec's tests and benchmark. A tilted back
+//  wall and a floor with a performer walking across in front of them, swinging an arm,
+//  quantized through the Kinect's disparity table the way OpenNI reports it. The sensor's
+//  artifacts are there too: the IR shadow beside the performer, holes where the pattern
+//  is lost, and pixels flickering between neighbouring disparity levels.
+
+#ifndef __KinectOSC__DepthSynthesis__
+#define __KinectOSC__DepthSynthesis__
+
+#include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
+
+using namespace std;
+
+class DepthSynthesis {
+
+public:
+
+    DepthSynthesis(int width, int height, unsigned seed) : width_(width), height_(height), seed_(seed) {}
+
+    /* Depth in mm of the nearest disparity level, as the sensor would report z */
+    static uint16_t quantize(float z) {
+
+        if (z < 500 || z > 8000)
+            return 0;
+        float disparity = roundf((1000.0f / z - 3.3309495f) / -0.0030711016f);
+        return (uint16_t)lroundf(1000.0f / (3.3309495f - 0.0030711016f * disparity));
+    }
+
+    /* Frame k of the sequence; frames are independent, so any can be rendered alone */
+    void render(int frame, uint16_t *out, int strideInPixels) {
+
+        unsigned state = seed_ * 2654435761u + (unsigned)frame * 40503u + 1;
+
+        float t = frame / 30.0f;
+        float performerX = width_ * (0.2f + 0.6f * fmodf(t / 8, 1));
+        float performerZ = 2200 + 300 * sinf(t * 0.7f);
+        float armAngle = 1.2f * sinf(t * 3);
+
+        /* Body proportions in pixels at the performer's depth */
+        float scale = height_ / 480.0f * 2000 / performerZ;
+        float torsoTop = height_ * 0.3f, torsoBottom = height_ * 0.7f;
+        float halfWidth = 35 * scale;
+        float headY = torsoTop - 30 * scale, headR = 22 * scale;
+        float legBottom = height_ * 0.95f;
+        float armLength = 110 * scale;
+        float shoulderX = performerX + halfWidth, shoulderY = torsoTop + 10 * scale;
+        float handX = shoulderX + armLength * cosf(armAngle), handY = shoulderY - armLength * sinf(armAngle);
+        float shadow = 12 * scale;
+
+        for (int y = 0; y < height_; y++) {
+
+            uint16_t *row = out + y * strideInPixels;
+            float fy = (float)y / height_;
+
+            for (int x = 0; x < width_; x++) {
+
+                float fx = (float)x / width_;
+                float z = 4000 + 600 * fx - 200 * fy;
+
+                /* The floor meets the wall two thirds of the way down */
+                if (fy > 0.66f)
+                    z = fminf(z, 4000 - 5000 * (fy - 0.66f));
+
+                bool body = onPerformer(x, y, performerX, halfWidth, torsoTop, torsoBottom, headY, headR,
+                                        legBottom, shoulderX, shoulderY, handX, handY, 8 * scale);
+                if (body)
+                    z = performerZ - 80 * cosf((x - performerX) / (halfWidth * 2));
+
+                uint16_t depth = quantize(z);
+
+                /* Shadow to the left of the performer, where the projector can't reach */
+                if (!body && x < performerX - halfWidth && x > performerX - halfWidth - shadow &&
+                    y > torsoTop && y < legBottom)
+                    depth = 0;
+
+                /* Lost pattern on about one pixel in two hundred, and flicker to a neighbouring
+                   level that gets more likely with distance, one pixel in ten at 4 m */
+                unsigned r = next(&state);
+                if (depth && r % 200 == 0)
+                    depth = 0;
+                else if (depth && (r >> 8) % 1000 < depth / 40u)
+                    depth = quantize(depth * (r & 0x80 ? 1.012f : 0.988f));
+
+                row[x] = depth;
+            }
+        }
+    }
+
+private:
+
+    static unsigned next(unsigned *state) {
+
+        *state ^= *state << 13;
+        *state ^= *state >> 17;
+        *state ^= *state << 5;
+        return *state;
+    }
+
+    static bool onPerformer(float x, float y, float cx, float halfWidth, float top, float bottom, float headY,
+                            float headR, float legBottom, float shoulderX, float shoulderY, float handX,
+                            float handY, float armRadius) {
+
+        if (fabsf(x - cx) < halfWidth && y > top && y < bottom)
+            return true;
+        if ((x - cx) * (x - cx) + (y - headY) * (y - headY) < headR * headR)
+            return true;
+        if (y >= bottom && y < legBottom && fabsf(fabsf(x - cx) - halfWidth * 0.5f) < halfWidth * 0.3f)
+            return true;
+
+        /* Distance from the arm's segment */
+        float dx = handX - shoulderX, dy = handY - shoulderY;
+        float along = ((x - shoulderX) * dx + (y - shoulderY) * dy) / (dx * dx + dy * dy);
+        along = fminf(fmaxf(along, 0), 1);
+        float ex = x - shoulderX - along * dx, ey = y - shoulderY - along * dy;
+        return ex * ex + ey * ey < armRadius * armRadius;
+    }
+
+private:
+
+    int width_;
+    int height_;
+    unsigned seed_;
+};
+
+#endif /* defined(__KinectOSC__DepthSynthesis__) */
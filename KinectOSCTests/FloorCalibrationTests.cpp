@@ -0,0 +1,262 @@
+//
+//  FloorCalibrationTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  FloorCalibration on synthetic depth images of a known floor seen by a tilted sensor,
+//  with noise and a performer walking through the calibration window: the estimated
+//  plane, and floor coordinates of points at known heights. Recalibrating abandons an
+//  estimate still running, and while another thread projects joints must hand it one
+//  whole transform or the other.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cmath>
+#include <vector>
+#include <set>
+#include <atomic>
+
+#include "FloorCalibration.h"
+#include "Utility.h"
+#include "TestCheck.h"
+
+#define DEPTH_WIDTH 640
+#define DEPTH_HEIGHT 480
+
+using namespace std;
+
+struct Floor {
+    float n[3];     // Unit normal, pointing up
+    float d;        // Sensor height above the floor (mm)
+};
+
+static Floor makeFloor(float pitch, float roll, float height) {
+
+    Floor floor;
+    floor.n[0] = sinf(roll);
+    floor.n[1] = cosf(roll) * cosf(pitch);
+    floor.n[2] = -cosf(roll) * sinf(pitch);
+    floor.d = height;
+    return floor;
+}
+
+/* Rays through each pixel, as depthToWorld() inverts them: the floor where a ray meets it
+   within range, and a back wall everywhere else. A performer occludes a band of columns
+   that moves from frame to frame. */
+static void renderDepth(const Floor &floor, int frame, vector<uint16_t> *depth) {
+
+    const float xzFactor = tanf(1.0144686f / 2) * 2;
+    const float yzFactor = tanf(0.7898385f / 2) * 2;
+
+    depth->assign(DEPTH_WIDTH * DEPTH_HEIGHT, 0);
+    int performer = (frame * 97) % DEPTH_WIDTH;
+
+    for (int v = 0; v < DEPTH_HEIGHT; v++) {
+        for (int u = 0; u < DEPTH_WIDTH; u++) {
+
+            float ray[3] = {((float)u / DEPTH_WIDTH - 0.5f) * xzFactor, (0.5f - (float)v / DEPTH_HEIGHT) * yzFactor, 1};
+            float along = floor.n[0]*ray[0] + floor.n[1]*ray[1] + floor.n[2]*ray[2];
+            float z = along < 0 ? -floor.d / along : 0;
+
+            if (z <= 0 || z > 5000)
+                z = 5000 + (u % 7);
+            z += (rand() % 5) - 2;
+
+            if (abs(u - performer) < 40 && z > 1500)
+                z = 1500 + (rand() % 20);           // Nearer than the floor behind, so it's ignored
+            if (rand() % 50 == 0)
+                z = 0;
+
+            (*depth)[v * DEPTH_WIDTH + u] = (uint16_t)z;
+        }
+    }
+}
+
+static bool calibrate(FloorCalibration *calibration, const Floor &floor, int nFrames) {
+
+    vector<uint16_t> depth;
+    calibration->beginCalibration(nFrames);
+
+    for (int frame = 0; calibration->wantsFrames(); frame++) {
+        renderDepth(floor, frame, &depth);
+        calibration->addDepthFrame(&depth[0], DEPTH_WIDTH, DEPTH_HEIGHT, DEPTH_WIDTH);
+    }
+
+    while (calibration->isEstimating())
+        usleep(1000);
+
+    return calibration->isCalibrated();
+}
+
+/* A point height mm above the floor, under sensor-space (x, z) */
+static void pointAbove(const Floor &floor, float x, float z, float height, float *p) {
+
+    float y = -(floor.n[0]*x + floor.n[2]*z + floor.d) / floor.n[1];
+    p[0] = x + height * floor.n[0];
+    p[1] = y + height * floor.n[1];
+    p[2] = z + height * floor.n[2];
+}
+
+static void testPlanes() {
+
+    const float poses[][3] = {{0.2f, 0.05f, 1200}, {0.35f, -0.08f, 900}, {0.05f, 0, 1600}, {0.25f, 0.12f, 2000}};
+
+    for (size_t i = 0; i < sizeof(poses) / sizeof(poses[0]); i++) {
+
+        Floor floor = makeFloor(poses[i][0], poses[i][1], poses[i][2]);
+        FloorCalibration calibration;
+        CHECK(!calibration.isCalibrated());
+
+        if (!calibrate(&calibration, floor, 10)) {
+            CHECK(false);
+            continue;
+        }
+
+        float n[3], d;
+        calibration.floorPlane(n, &d);
+        CHECK(fabsf(n[0] - floor.n[0]) < 0.01f && fabsf(n[1] - floor.n[1]) < 0.01f && fabsf(n[2] - floor.n[2]) < 0.01f);
+        CHECK_NEAR(d, floor.d, 15);
+
+        /* Heights above the floor, and distances along it */
+        float a[3], b[3], fa[3], fb[3];
+        pointAbove(floor, -400, 2500, 500, a);
+        pointAbove(floor, 600, 3500, 0, b);
+        calibration.projectToFloor(a[0], a[1], a[2], &fa[0], &fa[1], &fa[2]);
+        calibration.projectToFloor(b[0], b[1], b[2], &fb[0], &fb[1], &fb[2]);
+
+        CHECK_NEAR(fa[1], 500, 15);
+        CHECK_NEAR(fb[1], 0, 15);
+
+        float along = hypotf(fa[0] - fb[0], fa[2] - fb[2]);
+        float expected = sqrtf(powf(a[0] - b[0], 2) + powf(a[1] - b[1], 2) + powf(a[2] - b[2], 2) - 500 * 500);
+        CHECK_NEAR(along, expected, 20);
+
+        /* Left of the sensor is negative, farther from it positive */
+        CHECK(fa[0] < fb[0]);
+        CHECK(fa[2] < fb[2]);
+    }
+}
+
+/* A wall facing the sensor is no floor */
+static void testNoFloor() {
+
+    FloorCalibration calibration;
+    vector<uint16_t> depth(DEPTH_WIDTH * DEPTH_HEIGHT, 3000);
+
+    calibration.beginCalibration(2);
+    calibration.addDepthFrame(&depth[0], DEPTH_WIDTH, DEPTH_HEIGHT, DEPTH_WIDTH);
+    calibration.addDepthFrame(&depth[0], DEPTH_WIDTH, DEPTH_HEIGHT, DEPTH_WIDTH);
+
+    while (calibration.isEstimating())
+        usleep(1000);
+
+    CHECK(!calibration.isCalibrated());
+
+    float fx, fy, fz;
+    calibration.projectToFloor(100, 200, 300, &fx, &fy, &fz);
+    CHECK(fx == 0 && fy == 0 && fz == 0);
+}
+
+/* Beginning a calibration abandons an estimate still running instead of waiting it out */
+static void testAbandon() {
+
+    Floor floor = makeFloor(0.2f, 0.05f, 1200);
+    vector<uint16_t> depth;
+
+    FloorCalibration calibration;
+    calibration.setIterations(1 << 22);     // Seconds of RANSAC
+    calibration.beginCalibration(2);
+    for (int frame = 0; calibration.wantsFrames(); frame++) {
+        renderDepth(floor, frame, &depth);
+        calibration.addDepthFrame(&depth[0], DEPTH_WIDTH, DEPTH_HEIGHT, DEPTH_WIDTH);
+    }
+    usleep(20000);
+    CHECK(calibration.isEstimating());
+
+    uint64_t start = hostTimeMicros();
+    calibration.beginCalibration(2);
+    CHECK(hostTimeMicros() - start < 500000);
+    CHECK(!calibration.isEstimating() && !calibration.isCalibrated());
+
+    /* The new calibration runs as usual */
+    calibration.setIterations(256);
+    CHECK(calibrate(&calibration, floor, 2));
+}
+
+struct Projection {
+    float f[3];
+    bool operator<(const Projection &other) const {
+        return memcmp(f, other.f, sizeof(f)) < 0;
+    }
+};
+
+static bool sameProjection(const Projection &a, const Projection &b) {
+    return !(a < b) && !(b < a);
+}
+
+struct Reader {
+    FloorCalibration *calibration;
+    atomic<bool> stop;
+    set<Projection> seen;
+};
+
+static void *readerThread(void *arg) {
+
+    Reader *reader = (Reader *)arg;
+
+    while (!reader->stop) {
+        Projection p;
+        reader->calibration->projectToFloor(250, -300, 2800, &p.f[0], &p.f[1], &p.f[2]);
+        reader->seen.insert(p);
+    }
+
+    return 0;
+}
+
+/* Every projection during a recalibration comes from the old transform or the new one */
+static void testRecalibrationWhileTracking() {
+
+    Floor before = makeFloor(0.2f, 0.05f, 1200);
+    Floor after = makeFloor(0.3f, -0.1f, 1400);
+
+    FloorCalibration calibration;
+    CHECK(calibrate(&calibration, before, 5));
+
+    Projection old;
+    calibration.projectToFloor(250, -300, 2800, &old.f[0], &old.f[1], &old.f[2]);
+
+    Reader reader;
+    reader.calibration = &calibration;
+    reader.stop = false;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, readerThread, &reader);
+
+    CHECK(calibrate(&calibration, after, 5));
+    usleep(2000);
+
+    reader.stop = true;
+    pthread_join(thread, NULL);
+
+    Projection current;
+    calibration.projectToFloor(250, -300, 2800, &current.f[0], &current.f[1], &current.f[2]);
+
+    CHECK(!sameProjection(current, old));
+    CHECK(!reader.seen.empty());
+    for (set<Projection>::iterator it = reader.seen.begin(); it != reader.seen.end(); ++it)
+        CHECK(sameProjection(*it, old) || sameProjection(*it, current));
+}
+
+int main(int argc, const char *argv[]) {
+
+    srand(1);
+
+    testPlanes();
+    testNoFloor();
+    testAbandon();
+    testRecalibrationWhileTracking();
+
+    return testResult("FloorCalibrationTests");
+}
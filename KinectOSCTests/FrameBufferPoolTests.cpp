@@ -0,0 +1,240 @@
+//
+//  FrameBufferPoolTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  FrameBuffer handles (move, share, release, alignment, exhaustion), then a capture loop
+//  at several times the sensor's frame rate handing each depth image to the recorder, a
+//  histogram for display and an analysis thread without copying it. Once warmed up, the
+//  capture and analysis threads must not allocate at all and the pool must not grow.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <new>
+#include <atomic>
+
+#include "FrameBufferPool.h"
+#include "DepthHistogram.h"
+#include "SessionRecording.h"
+#include "TestCheck.h"
+
+#define PIPELINE_FRAMES 300
+#define PIPELINE_WARM_UP 30
+#define PIPELINE_PERIOD_US 8000         // 125 Hz
+#define ANALYSIS_QUEUE 8
+
+using namespace std;
+
+/* operator new calls made by threads that asked to be counted */
+static atomic<long> gAllocations(0);
+static __thread bool tCounted = false;
+
+void *operator new(size_t size) {
+
+    if (tCounted)
+        gAllocations++;
+
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+static void testHandles() {
+
+    FrameBufferPool pool(4);
+
+    FrameBuffer a = pool.acquire();
+    CHECK(a.isValid() && a.useCount() == 1);
+    CHECK((uintptr_t)a.data() % FRAME_BUFFER_ALIGNMENT == 0);
+    CHECK(a.width() == FRAME_BUFFER_WIDTH && a.height() == FRAME_BUFFER_HEIGHT && a.stride() == FRAME_BUFFER_WIDTH);
+
+    FrameBuffer b = a.share();
+    CHECK(a.useCount() == 2 && b.data() == a.data());
+
+    FrameBuffer c = std::move(a);
+    CHECK(!a.isValid() && c.useCount() == 2);
+
+    b.release();
+    CHECK(!b.isValid() && c.useCount() == 1);
+
+    /* Three more fill the pool; a fifth is refused rather than allocated */
+    FrameBuffer x = pool.acquire(), y = pool.acquire(), z = pool.acquire();
+    FrameBuffer w = pool.acquire();
+    CHECK(x.isValid() && y.isValid() && z.isValid());
+    CHECK(!w.isValid() && pool.numExhausted() == 1);
+
+    uint16_t *pixels = c.data();
+    c.release();
+    FrameBuffer v = pool.acquire();
+    CHECK(v.isValid() && v.data() == pixels);
+    CHECK(pool.numAllocations() == 4 && pool.numFree() == 0);
+
+    /* Rows of odd widths are padded out to the alignment */
+    FrameBufferPool odd(1, 317, 7);
+    FrameBuffer o = odd.acquire();
+    CHECK(o.stride() >= 317 && (o.stride() * sizeof(uint16_t)) % FRAME_BUFFER_ALIGNMENT == 0);
+    CHECK((uintptr_t)(o.data() + o.stride()) % FRAME_BUFFER_ALIGNMENT == 0);
+}
+
+struct Analysis {
+    pthread_mutex_t mutex;
+    FrameBuffer queue[ANALYSIS_QUEUE];
+    int head;
+    int count;
+    atomic<bool> done;
+    atomic<int> nAnalyzed;
+    atomic<bool> counting;
+};
+
+static void *analysisThread(void *arg) {
+
+    Analysis *analysis = (Analysis *)arg;
+    DepthHistogram histogram(10000, 1);
+    float bins[10000];
+
+    for (;;) {
+
+        FrameBuffer depth;
+
+        pthread_mutex_lock(&analysis->mutex);
+        if (analysis->count > 0) {
+            depth = std::move(analysis->queue[analysis->head]);
+            analysis->head = (analysis->head + 1) % ANALYSIS_QUEUE;
+            analysis->count--;
+        }
+        pthread_mutex_unlock(&analysis->mutex);
+
+        if (!depth.isValid()) {
+            if (analysis->done)
+                break;
+            usleep(1000);
+            continue;
+        }
+
+        tCounted = analysis->counting;
+        histogram.calculate(bins, depth.data(), depth.width(), depth.height(), depth.stride());
+        analysis->nAnalyzed++;
+        usleep(5000);
+    }
+
+    return 0;
+}
+
+/* Each frame goes to the recorder, a display histogram and the analysis thread */
+static void testPipeline() {
+
+    char path[] = "/tmp/FrameBufferPoolTests-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        CHECK(false);
+        return;
+    }
+    close(fd);
+
+    FrameBufferPool pool(16);
+    SessionRecorder recorder;
+    CHECK(recorder.open(path));
+
+    DepthHistogram display(10000, 2);
+    static float bins[10000];
+
+    /* Warm up: every buffer the pool may hand out, allocated once */
+    {
+        FrameBuffer held[16];
+        for (int i = 0; i < 16; i++)
+            held[i] = pool.acquire();
+    }
+    CHECK(pool.numAllocations() == 16 && pool.numFree() == 16);
+
+    Analysis analysis;
+    pthread_mutex_init(&analysis.mutex, NULL);
+    analysis.head = 0;
+    analysis.count = 0;
+    analysis.done = false;
+    analysis.nAnalyzed = 0;
+    analysis.counting = false;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, analysisThread, &analysis);
+
+    SkeletonFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.width = FRAME_BUFFER_WIDTH;
+    frame.height = FRAME_BUFFER_HEIGHT;
+
+    int nDropped = 0;
+
+    for (int i = 0; i < PIPELINE_FRAMES; i++) {
+
+        if (i == PIPELINE_WARM_UP) {
+            tCounted = true;
+            analysis.counting = true;
+        }
+
+        FrameBuffer depth = pool.acquire();
+        if (!depth.isValid()) {
+            nDropped++;
+            usleep(PIPELINE_PERIOD_US);
+            continue;
+        }
+
+        for (int y = 0; y < depth.height(); y++) {
+            uint16_t *row = depth.data() + y * depth.stride();
+            for (int x = 0; x < depth.width(); x++)
+                row[x] = (uint16_t)(800 + y * 5 + ((x + i) & 15));
+        }
+        depth.setTimestamp((uint64_t)i * 33333, i);
+
+        frame.timestamp = (uint64_t)i * 33333;
+        frame.hostTime = frame.timestamp;
+        frame.frameIndex = i;
+
+        recorder.writeFrame(&frame, depth.share());
+        display.calculate(bins, depth.data(), depth.width(), depth.height(), depth.stride());
+
+        pthread_mutex_lock(&analysis.mutex);
+        if (analysis.count < ANALYSIS_QUEUE) {
+            analysis.queue[(analysis.head + analysis.count) % ANALYSIS_QUEUE] = depth.share();
+            analysis.count++;
+        }
+        pthread_mutex_unlock(&analysis.mutex);
+
+        usleep(PIPELINE_PERIOD_US);
+    }
+
+    tCounted = false;
+    long allocations = gAllocations;
+
+    analysis.done = true;
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&analysis.mutex);
+
+    recorder.close();
+    unlink(path);
+
+    SessionRecorder::Stats stats = recorder.stats();
+    printf("%d frames, %d without a free buffer, %d recorded with depth, %d analyzed; "
+           "%ld allocations after warm-up\n", PIPELINE_FRAMES, nDropped, stats.nDepthFrames, (int)analysis.nAnalyzed,
+           allocations);
+
+    CHECK(allocations == 0);
+    CHECK(pool.numAllocations() == 16);
+    CHECK(stats.nDepthFrames > PIPELINE_FRAMES / 2);
+    CHECK(analysis.nAnalyzed > PIPELINE_FRAMES / 4);
+    CHECK(pool.numFree() == pool.numAllocations());
+}
+
+int main(int argc, const char *argv[]) {
+
+    testHandles();
+    testPipeline();
+
+    return testResult("FrameBufferPoolTests");
+}
@@ -0,0 +1,214 @@
+//
+//  FrameClockTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  FrameClock on a simulated sensor whose clock runs 50 ppm fast, delivering 30 Hz frames
+//  after a delay of at least 2 ms plus exponential jitter and the odd 15 ms stall, with
+//  frames dropped and repeated along the way. Drops and repeats must be counted exactly,
+//  with and without frame indices, the drift must settle near 50 ppm, capture times must
+//  land on the least-delayed arrivals far more steadily than arrivals do, and a jump of
+//  more than a second in the sensor clock must restart the filter.
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "FrameClock.h"
+#include "TestCheck.h"
+
+#define FRAME_US 33333
+#define SENSOR_PPM 50.0
+#define MIN_DELAY_US 2000
+#define MEAN_JITTER_US 1500
+#define STALL_US 15000
+
+using namespace std;
+
+class SimulatedSensor {
+
+public:
+
+    SimulatedSensor(bool indexed, unsigned seed) : indexed_(indexed), seed_(seed) {
+        hostStart_ = 5000000000ull;
+        sensorStart_ = 123456789;
+        k_ = 0;
+    }
+
+    /* Host time frame k was captured at */
+    uint64_t captureTime(int k) { return hostStart_ + (uint64_t)k * FRAME_US; }
+
+    /* The next frame, skipping nDrop first; hostTime is its arrival */
+    void next(SkeletonFrame *frame, int nDrop = 0) {
+
+        k_ += nDrop;
+        clearSkeletonFrame(frame);
+        frame->timestamp = sensorStart_ + (uint64_t)llround((double)k_ * FRAME_US * (1 + SENSOR_PPM * 1e-6));
+        frame->hostTime = captureTime(k_) + delay();
+        frame->frameIndex = indexed_ ? k_ : 0;
+        k_++;
+    }
+
+    /* The same frame again, a little later */
+    void repeat(SkeletonFrame *frame) {
+        frame->hostTime += 500 + uniform() * 2000;
+    }
+
+    /* The sensor clock jumps by jumpUs from the next frame on */
+    void jump(int64_t jumpUs) { sensorStart_ += jumpUs; }
+
+    int frame() { return k_ - 1; }
+
+private:
+
+    double uniform() {
+        seed_ = seed_ * 1103515245u + 12345u;
+        return ((seed_ >> 8) & 0xffff) / 65536.0;
+    }
+
+    uint64_t delay() {
+        double jitter = -log(1 - uniform()) * MEAN_JITTER_US;
+        if (uniform() < 0.01)
+            jitter += STALL_US;
+        return MIN_DELAY_US + (uint64_t)jitter;
+    }
+
+    bool indexed_;
+    unsigned seed_;
+    uint64_t hostStart_;
+    uint64_t sensorStart_;
+    int k_;
+};
+
+struct Spread {
+    double sum, sumSquares, worst;
+    int n;
+    Spread() : sum(0), sumSquares(0), worst(0), n(0) {}
+    void add(double x) { sum += x; sumSquares += x * x; worst = fmax(worst, fabs(x)); n++; }
+    double mean() { return sum / n; }
+    double sd() { return sqrt(fmax(0, sumSquares / n - mean() * mean())); }
+};
+
+/* Two minutes of frames with drops and repeats. Capture time errors are measured from
+   the least-delayed arrival, once the filter has had ten seconds to settle. */
+static void testDriftingSensor(bool indexed) {
+
+    SimulatedSensor sensor(indexed, indexed ? 7 : 8);
+    FrameClock clock;
+    SkeletonFrame frame;
+
+    int nDropped = 0, nRepeated = 0, nFrames = 0, nMiscounted = 0;
+    Spread arrival, capture;
+
+    while (sensor.frame() < 3600) {
+
+        /* One in forty preceded by a drop of one to three frames */
+        int nDrop = rand() % 40 == 0 ? 1 + rand() % 3 : 0;
+        sensor.next(&frame, nDrop);
+        nDropped += nDrop;
+        nFrames++;
+
+        FrameTiming timing = clock.update(&frame);
+        nMiscounted += timing.dropped != nDrop || timing.duplicate;
+
+        if (sensor.frame() > 300) {
+            double truth = (double)(sensor.captureTime(sensor.frame()) + MIN_DELAY_US);
+            capture.add((double)timing.captureTime - truth);
+            arrival.add((double)frame.hostTime - truth);
+        }
+
+        /* One in fifty delivered twice */
+        if (rand() % 50 == 0) {
+            sensor.repeat(&frame);
+            FrameTiming again = clock.update(&frame);
+            nMiscounted += !again.duplicate || again.dropped;
+            nRepeated++;
+        }
+    }
+
+    printf("%s: %d frames, %d dropped, %d repeated; drift %.1f ppm, jitter %.0f us; arrival %.0f +/- %.0f us, "
+           "capture %.0f +/- %.0f us (worst %.0f)\n", indexed ? "indexed" : "unindexed", clock.numFrames(),
+           clock.numDropped(), clock.numDuplicates(), clock.drift(), clock.jitter(), arrival.mean(), arrival.sd(),
+           capture.mean(), capture.sd(), capture.worst);
+
+    CHECK(nMiscounted == 0);
+    CHECK(clock.numFrames() == nFrames);
+    CHECK(clock.numDropped() == nDropped);
+    CHECK(clock.numDuplicates() == nRepeated);
+
+    FrameClockStats stats = clock.stats();
+    CHECK(stats.nFrames == nFrames && stats.nDropped == nDropped && stats.nDuplicates == nRepeated);
+
+    /* Offset is host minus sensor time, so a fast sensor clock drifts negative */
+    CHECK_NEAR(clock.drift(), -SENSOR_PPM, 5);
+    CHECK_NEAR(clock.framePeriod(), FRAME_US * 1e-6 * (1 + SENSOR_PPM * 1e-6), 1e-5);
+
+    /* Close to the earliest arrivals and several times steadier than arrivals */
+    CHECK(fabs(capture.mean()) < 600);
+    CHECK(capture.sd() < arrival.sd() / 4);
+    CHECK(capture.worst < 1500);
+}
+
+/* Jumps in the sensor clock: past FRAME_CLOCK_RESET_GAP_US the filter starts over from the
+   next arrival, short of it the gap is taken as dropped frames */
+static void testClockJumps() {
+
+    SimulatedSensor sensor(true, 9);
+    FrameClock clock;
+    SkeletonFrame frame;
+    FrameTiming timing;
+
+    for (int k = 0; k < 900; k++) {
+        sensor.next(&frame);
+        clock.update(&frame);
+    }
+    double settledDrift = clock.drift();
+
+    /* 27 frames lost, 0.9 s: counted, and the filter carries on */
+    sensor.next(&frame, 27);
+    timing = clock.update(&frame);
+    CHECK(timing.dropped == 27);
+    CHECK(fabs(clock.drift() - settledDrift) < 5);
+    CHECK(fabs((double)timing.captureTime - (double)(sensor.captureTime(sensor.frame()) + MIN_DELAY_US)) < 1500);
+
+    /* The sensor clock jumps 5 s ahead, as after a firmware reset: the next frame is placed at
+       its arrival, drift starts again from zero, and no frames are taken as lost */
+    int nDropped = clock.numDropped();
+    sensor.jump(5000000);
+    sensor.next(&frame);
+    timing = clock.update(&frame);
+    CHECK(timing.captureTime == frame.hostTime);
+    CHECK(clock.drift() == 0);
+    CHECK(timing.dropped == 0 && clock.numDropped() == nDropped);
+
+    for (int k = 0; k < 300; k++) {
+        sensor.next(&frame);
+        timing = clock.update(&frame);
+    }
+    double error = (double)timing.captureTime - (double)(sensor.captureTime(sensor.frame()) + MIN_DELAY_US);
+    printf("after a 5 s jump: capture %.0f us from the earliest arrivals after 300 frames\n", error);
+    CHECK(fabs(error) < 1500);
+
+    /* And backwards, well past the gap */
+    sensor.jump(-20000000);
+    sensor.next(&frame);
+    timing = clock.update(&frame);
+    CHECK(timing.captureTime == frame.hostTime && clock.drift() == 0);
+
+    /* Just over the gap, though the frame index carries on by one */
+    sensor.jump(FRAME_CLOCK_RESET_GAP_US + 1000);
+    sensor.next(&frame);
+    timing = clock.update(&frame);
+    CHECK(timing.captureTime == frame.hostTime);
+}
+
+int main(int argc, const char *argv[]) {
+
+    srand(11);
+
+    testDriftingSensor(true);
+    testDriftingSensor(false);
+    testClockJumps();
+
+    return testResult("FrameClockTests");
+}
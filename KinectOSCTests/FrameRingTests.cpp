@@ -0,0 +1,247 @@
+//
+//  FrameRingTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  FrameRing, the queue between NiTE's listener and NiteSkeletonSource::readFrame(), on
+//  counted references standing in for NiTE's frames: frames come out oldest first with
+//  their arrival times, a full ring releases its oldest frame and counts it, a read times
+//  out, is woken, or returns as soon as a frame is pushed, and no reference is kept once
+//  the ring is cleared. Then a producer pushing faster than the reader reads.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+
+#include "FrameRing.h"
+#include "Utility.h"
+#include "TestCheck.h"
+
+#define MAX_FRAMES 20000
+#define STRESS_FRAMES 20000
+
+using namespace std;
+
+/* References outstanding to each frame, as NiTE counts them */
+static atomic<int> gRefs[MAX_FRAMES];
+
+class TestFrameRef {
+
+public:
+
+    TestFrameRef() : id_(-1) {}
+    explicit TestFrameRef(int id) : id_(id) { gRefs[id_]++; }
+    TestFrameRef(const TestFrameRef &other) : id_(other.id_) { if (id_ >= 0) gRefs[id_]++; }
+    ~TestFrameRef() { release(); }
+
+    TestFrameRef &operator=(const TestFrameRef &other) {
+        if (other.id_ >= 0)
+            gRefs[other.id_]++;
+        release();
+        id_ = other.id_;
+        return *this;
+    }
+
+    void release() {
+        if (id_ >= 0)
+            gRefs[id_]--;
+        id_ = -1;
+    }
+
+    int id() const { return id_; }
+
+private:
+
+    int id_;
+};
+
+static int outstanding(int nFrames) {
+
+    int n = 0;
+    for (int i = 0; i < nFrames; i++)
+        n += gRefs[i];
+
+    return n;
+}
+
+static void testOrderAndOverwrite() {
+
+    FrameRing<TestFrameRef> ring(4);
+    TestFrameRef frame;
+    uint64_t arrival = 0;
+
+    /* Pushed references are the ring's own */
+    for (int i = 0; i < 3; i++)
+        ring.push(TestFrameRef(i), 1000 + i * 33333);
+    CHECK(outstanding(3) == 3);
+
+    bool ordered = true;
+    for (int i = 0; i < 3; i++)
+        ordered = ordered && ring.pop(&frame, &arrival, 0) && frame.id() == i && arrival == 1000 + (uint64_t)i * 33333;
+    CHECK(ordered);
+    CHECK(!ring.pop(&frame, &arrival, 0));
+    frame.release();
+    CHECK(outstanding(3) == 0);
+
+    /* Six into four: 3 and 4 are released as soon as they're overwritten */
+    for (int i = 3; i < 9; i++)
+        ring.push(TestFrameRef(i), 1000 + i * 33333);
+    CHECK(ring.numOverwritten() == 2);
+    CHECK(gRefs[3] == 0 && gRefs[4] == 0 && outstanding(9) == 4);
+
+    ordered = true;
+    for (int i = 5; i < 9; i++)
+        ordered = ordered && ring.pop(&frame, &arrival, 0) && frame.id() == i && arrival == 1000 + (uint64_t)i * 33333;
+    CHECK(ordered);
+    frame.release();
+    CHECK(outstanding(9) == 0);
+
+    /* Clearing gives every queued reference back */
+    for (int i = 9; i < 12; i++)
+        ring.push(TestFrameRef(i), i);
+    ring.clear();
+    CHECK(outstanding(12) == 0);
+    CHECK(!ring.pop(&frame, &arrival, 0));
+}
+
+struct Reader {
+    FrameRing<TestFrameRef> *ring;
+    int timeoutMs;
+    bool popped;
+    int id;
+    uint64_t arrival;
+    uint64_t waitedUs;
+};
+
+static void *readThread(void *arg) {
+
+    Reader *reader = (Reader *)arg;
+    TestFrameRef frame;
+
+    uint64_t start = hostTimeMicros();
+    reader->popped = reader->ring->pop(&frame, &reader->arrival, reader->timeoutMs);
+    reader->waitedUs = hostTimeMicros() - start;
+    reader->id = frame.id();
+
+    return 0;
+}
+
+/* A blocked read returns on a push or a wake, and otherwise after its timeout */
+static void testWaits() {
+
+    FrameRing<TestFrameRef> ring(4);
+    TestFrameRef frame;
+    uint64_t arrival;
+    pthread_t thread;
+
+    uint64_t start = hostTimeMicros();
+    CHECK(!ring.pop(&frame, &arrival, 50));
+    uint64_t waited = hostTimeMicros() - start;
+    CHECK(waited >= 45000 && waited < 500000);
+
+    Reader reader = { &ring, 10000, false, -1, 0, 0 };
+    pthread_create(&thread, NULL, readThread, &reader);
+    usleep(20000);
+    ring.push(TestFrameRef(20), 777);
+    pthread_join(thread, NULL);
+    CHECK(reader.popped && reader.id == 20 && reader.arrival == 777);
+    CHECK(reader.waitedUs >= 15000 && reader.waitedUs < 1000000);
+
+    reader.popped = true;
+    pthread_create(&thread, NULL, readThread, &reader);
+    usleep(20000);
+    ring.wake();
+    pthread_join(thread, NULL);
+    CHECK(!reader.popped && reader.waitedUs >= 15000 && reader.waitedUs < 1000000);
+
+    /* A wake with no reader waiting cuts the next read short, once; a queued frame is
+       still returned */
+    ring.wake();
+    start = hostTimeMicros();
+    CHECK(!ring.pop(&frame, &arrival, 10000));
+    CHECK(hostTimeMicros() - start < 1000000);
+    start = hostTimeMicros();
+    CHECK(!ring.pop(&frame, &arrival, 20));
+    CHECK(hostTimeMicros() - start >= 15000);
+
+    ring.push(TestFrameRef(21), 888);
+    ring.wake();
+    CHECK(ring.pop(&frame, &arrival, 10000) && frame.id() == 21 && arrival == 888);
+
+    frame.release();
+    CHECK(outstanding(22) == 0);
+}
+
+struct Producer {
+    FrameRing<TestFrameRef> *ring;
+    atomic<bool> done;
+};
+
+/* Bursts of frames with pauses between, so the ring both fills and drains */
+static void *produceThread(void *arg) {
+
+    Producer *producer = (Producer *)arg;
+
+    for (int i = 0; i < STRESS_FRAMES; i++) {
+        producer->ring->push(TestFrameRef(i), i);
+        if (i % 16 == 15)
+            usleep(100);
+    }
+    producer->done = true;
+    producer->ring->wake();
+
+    return 0;
+}
+
+static void testProducer() {
+
+    for (int i = 0; i < MAX_FRAMES; i++)
+        gRefs[i] = 0;
+
+    FrameRing<TestFrameRef> ring(4);
+    Producer producer;
+    producer.ring = &ring;
+    producer.done = false;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, produceThread, &producer);
+
+    TestFrameRef frame;
+    uint64_t arrival;
+    int nRead = 0, last = -1;
+    bool ordered = true;
+
+    /* A slow reader: every so often it stops for longer than a burst takes */
+    while (true) {
+        bool wasDone = producer.done;
+        if (ring.pop(&frame, &arrival, 100)) {
+            ordered = ordered && frame.id() > last && arrival == (uint64_t)frame.id();
+            last = frame.id();
+            if (++nRead % 8 == 0)
+                usleep(200);
+        }
+        else if (wasDone)
+            break;
+    }
+    pthread_join(thread, NULL);
+    frame.release();
+
+    printf("producer: %d pushed, %d read, %d overwritten\n", STRESS_FRAMES, nRead, ring.numOverwritten());
+
+    CHECK(ordered);
+    CHECK(last == STRESS_FRAMES - 1);
+    CHECK(nRead + ring.numOverwritten() == STRESS_FRAMES);
+    CHECK(ring.numOverwritten() > 0);
+    CHECK(outstanding(STRESS_FRAMES) == 0);
+}
+
+int main(int argc, const char *argv[]) {
+
+    testOrderAndOverwrite();
+    testWaits();
+    testProducer();
+
+    return testResult("FrameRingTests");
+}
@@ -0,0 +1,76 @@
+//
+//  GestureRecognizerBench.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Cost of GestureRecognizer::process() per user per frame with the synthetic library
+//  (36 templates, see GestureSynthesis.h), and how much of the DTW the pruning skips.
+//
+//      GestureRecognizerBench [minutes] [seed] [noise mm]
+
+#include <unistd.h>
+#include <chrono>
+
+#include "GestureRecognizer.h"
+#include "GestureSynthesis.h"
+
+int main(int argc, const char *argv[]) {
+
+    int minutes = argc > 1 ? atoi(argv[1]) : 10;
+    unsigned int seed = argc > 2 ? atoi(argv[2]) : 1;
+    float noise = argc > 3 ? atof(argv[3]) : 10;
+
+    char path[] = "/tmp/GestureRecognizerBench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return 1;
+    close(fd);
+    unlink(path);
+
+    GestureSynthesis synthesis(seed, noise);
+    GestureRecognizer recognizer;
+    bool loaded = synthesis.writeLibrary(path, 0.2f) && recognizer.loadFile(path);
+    unlink(path);
+    if (!loaded)
+        return 1;
+
+    int nFrames = minutes * 60 * 30;
+    synthesis.perform(nFrames);
+
+    FeatureExtractor extractor;
+    JointStates joints;
+    memset(joints.state, JOINT_FRESH, sizeof(joints.state));
+    joints.fresh = joints.valid = (1 << SKELETON_NUM_JOINTS) - 1;
+
+    SkeletonUser user;
+    memset(&user, 0, sizeof(user));
+    user.id = 1;
+
+    GestureEvent events[GESTURE_MAX_TEMPLATES];
+    uint64_t timestamp = 1000000;
+    double nanos = 0;
+    int nEvents = 0;
+
+    for (int i = 0; i < nFrames; i++, timestamp += 33333) {
+
+        synthesis.frame(i, &user);
+        user.flags = USER_VISIBLE | USER_TRACKED | (i == 0 ? USER_NEW : 0);
+
+        BodyFeatures features;
+        extractor.extract(user, timestamp, &features);
+
+        recognizer.beginFrame();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        nEvents += recognizer.process(user, joints, features, timestamp, events, GESTURE_MAX_TEMPLATES);
+        nanos += chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    }
+
+    int nCells = GestureSynthesis::numCells();
+    printf("GestureRecognizerBench: %d templates, %d cells, %d frames, %d events\n", recognizer.numTemplates(),
+           nCells, nFrames, nEvents);
+    printf("  process %.2f us per user per frame, %.1f%% of cells evaluated\n", nanos / nFrames * 1e-3,
+           100.0 * recognizer.cellsEvaluated() / ((double)nFrames * nCells));
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+//
+//  GestureRecognizerTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Precision and recall over synthetic performances (see GestureSynthesis.h), and library
+//  reloads between and during frames.
+
+#include <unistd.h>
+
+#include "GestureRecognizer.h"
+#include "GestureSynthesis.h"
+#include "TestCheck.h"
+
+static JointStates allFresh() {
+
+    JointStates joints;
+    memset(joints.state, JOINT_FRESH, sizeof(joints.state));
+    joints.fresh = joints.valid = (1 << SKELETON_NUM_JOINTS) - 1;
+    return joints;
+}
+
+/* Five minutes per seed at 10 mm of joint noise */
+static void testPrecisionRecall(unsigned int seed) {
+
+    char path[] = "/tmp/GestureRecognizerTests-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    close(fd);
+    unlink(path);
+
+    GestureSynthesis synthesis(seed, 10);
+    CHECK(synthesis.writeLibrary(path, 0.2f));
+
+    GestureRecognizer recognizer;
+    CHECK(recognizer.loadFile(path));
+    CHECK(recognizer.numTemplates() == 3 * GestureSynthesis::kNumGestures);
+    unlink(path);
+
+    const int nFrames = 5 * 60 * 30;
+    synthesis.perform(nFrames);
+
+    FeatureExtractor extractor;
+    JointStates joints = allFresh();
+    SkeletonUser user;
+    memset(&user, 0, sizeof(user));
+    user.id = 3;
+
+    GestureEvent events[GESTURE_MAX_TEMPLATES];
+    uint64_t timestamp = 5000000;
+    int nTrue = 0, nFalse = 0;
+
+    for (int i = 0; i < nFrames; i++, timestamp += 33333) {
+
+        synthesis.frame(i, &user);
+        user.flags = USER_VISIBLE | USER_TRACKED | (i == 0 ? USER_NEW : 0);
+
+        BodyFeatures features;
+        extractor.extract(user, timestamp, &features);
+
+        recognizer.beginFrame();
+        int n = recognizer.process(user, joints, features, timestamp, events, GESTURE_MAX_TEMPLATES);
+        for (int e = 0; e < n; e++) {
+            if (synthesis.score(events[e], i))
+                nTrue++;
+            else
+                nFalse++;
+        }
+    }
+
+    double precision = nTrue / (double)(nTrue + nFalse);
+    double recall = synthesis.numFound() / (double)synthesis.performed.size();
+
+    printf("seed %u: %d gestures, %d distractors: precision %.3f, recall %.3f\n", seed,
+           (int)synthesis.performed.size(), synthesis.nDistractors, precision, recall);
+
+    CHECK(synthesis.performed.size() > 80);
+    CHECK(precision >= 0.9);
+    CHECK(recall >= 0.95);
+}
+
+/* Libraries of different shapes, each replacing the last, with a user tracked throughout.
+   Built with -fsanitize=address this catches state laid out for one library being used
+   with another. */
+static void testReloads() {
+
+    GestureRecognizer recognizer;
+    FeatureExtractor extractor;
+    JointStates joints = allFresh();
+    GestureSynthesis synthesis(7, 0);
+    synthesis.perform(600);
+
+    SkeletonUser user;
+    memset(&user, 0, sizeof(user));
+    user.id = 1;
+    user.flags = USER_VISIBLE | USER_TRACKED;
+
+    GestureEvent events[GESTURE_MAX_TEMPLATES];
+    uint64_t timestamp = 1000000;
+
+    for (int i = 0; i < 600; i++, timestamp += 33333) {
+
+        /* One to four templates of two to five frames, swapped every few frames and
+           sometimes twice within a frame */
+        if (i % 3 == 0) {
+            int nTemplates = 1 + (i / 3) % 4;
+            string text;
+            for (int g = 0; g < nTemplates; g++) {
+                char line[128];
+                snprintf(line, sizeof(line), "gesture g%d /g 0.5 hand_r\n", g);
+                text += line;
+                for (int k = 0; k < 2 + (i + g) % 4; k++)
+                    text += "0.1 0.2 0.3\n";
+                text += "end\n";
+            }
+            CHECK(recognizer.loadString(text.c_str(), "test"));
+        }
+
+        synthesis.frame(i, &user);
+        BodyFeatures features;
+        extractor.extract(user, timestamp, &features);
+
+        recognizer.beginFrame();
+        if (i % 5 == 0)
+            CHECK(recognizer.loadString("gesture big /g 0.5 hand_l hand_r\n0 0 0 0 0 0\n0 0 0 0 0 0\n0 0 0 0 0 0\nend\n", "test"));
+
+        int n = recognizer.process(user, joints, features, timestamp, events, GESTURE_MAX_TEMPLATES);
+        CHECK(n >= 0 && n <= GESTURE_MAX_TEMPLATES);
+    }
+}
+
+int main(int argc, const char *argv[]) {
+
+    testPrecisionRecall(1);
+    testPrecisionRecall(2);
+    testReloads();
+
+    return testResult("GestureRecognizerTests");
+}
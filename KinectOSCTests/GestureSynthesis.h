@@ -0,0 +1,368 @@
+//
+//  GestureSynthesis.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Synthetic performances for the gesture recognizer's tests and benchmark. Twelve
+//  gestures are recorded as three templates each, at different speeds and sizes, from a
+//  user facing the sensor. The performance then repeats them at random, time-warped,
+//  rescaled, bent in phase and with joint noise, by a user who sways, wanders and turns up
+//  to 45 degrees, with partial low-amplitude gestures in the gaps between them as
+//  distractors. Every event the recognizer reports is scored against the script.
+
+#ifndef __KinectOSC__GestureSynthesis__
+#define __KinectOSC__GestureSynthesis__
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include "GestureRecognizer.h"
+#include "BodyFeatures.h"
+
+using namespace std;
+
+class GestureSynthesis {
+
+    struct Gesture {
+        const char *name;
+        int frames;                     // Template length at normal speed
+        const char *channels;
+    };
+
+    struct Placement {
+        float yaw;
+        float x, y, z;
+    };
+
+public:
+
+    struct Performed {
+        int gesture;
+        int start;                      // First and last frames
+        int end;
+        bool found;
+    };
+
+    static const int kNumGestures = 12;
+
+    GestureSynthesis(unsigned int seed, float noise) : rng_(seed), noise_(noise) {}
+
+    /* Three templates per gesture, each with a threshold of thresholdScale times its mean
+       distance from its first frame, plus a small floor */
+    bool writeLibrary(const char *path, float thresholdScale) {
+
+        const float speeds[3] = {0.85f, 1.0f, 1.2f};
+        const float sizes[3] = {0.95f, 1.0f, 1.05f};
+
+        for (int g = 0; g < kNumGestures; g++) {
+
+            vector<int> channels;
+            char text[64];
+            strcpy(text, gestures()[g].channels);
+            for (char *word = strtok(text, " "); word; word = strtok(NULL, " "))
+                channels.push_back(GestureRecognizer::parseChannel(word));
+
+            for (int v = 0; v < 3; v++) {
+
+                FeatureExtractor extractor;
+                Placement placement = {0, 0, 0, 2500};
+                int length = (int)lroundf(gestures()[g].frames / speeds[v]);
+                vector<BodyFeatures> frames(length);
+                float pose[SKELETON_NUM_JOINTS][3];
+                SkeletonUser user;
+                BodyFeatures features;
+                uint64_t timestamp = 1000000;
+
+                /* A second standing still first, so the resting height has settled */
+                memset(&user, 0, sizeof(user));
+                user.id = 1;
+                user.flags = USER_NEW;
+                makePose(-1, 0, 0, pose);
+                place(pose, placement, 0, &user);
+                for (int i = 0; i < 30; i++, timestamp += 33333) {
+                    extractor.extract(user, timestamp, &features);
+                    user.flags = 0;
+                }
+
+                for (int i = 0; i < length; i++, timestamp += 33333) {
+                    makePose(g, (i + 0.5f) / length, sizes[v], pose);
+                    place(pose, placement, 0, &user);
+                    extractor.extract(user, timestamp, &frames[i]);
+                }
+
+                double excursion = 0;
+                for (int i = 0; i < length; i++)
+                    excursion += distance(channels, frames[i], frames[0]) / length;
+
+                char address[64];
+                snprintf(address, sizeof(address), "/gesture/%s", gestures()[g].name);
+                if (!GestureRecognizer::appendTemplate(path, gestures()[g].name, address,
+                                                       thresholdScale * excursion + 0.02f, channels, &frames[0], length))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    /* Script about nFrames of performance */
+    void perform(int nFrames) {
+
+        uniform_real_distribution<float> uniform(0, 1);
+
+        gesture_.assign(nFrames, -1);
+        phase_.assign(nFrames, 0);
+        size_.assign(nFrames, 0);
+        performed.clear();
+        nDistractors = 0;
+
+        int f = 0;
+        while (f < nFrames) {
+
+            int gap = 30 + (int)(uniform(rng_) * 60);
+
+            /* Sometimes part of a gesture at a third of its size */
+            if (uniform(rng_) < 0.3f && f + gap < nFrames) {
+                int g = (int)(uniform(rng_) * kNumGestures);
+                int length = (int)(gestures()[g].frames * (0.7f + 0.7f * uniform(rng_)));
+                float size = 0.25f + 0.15f * uniform(rng_);
+                for (int i = 0, s = f + 10; i < length && s + i < f + gap; i++)
+                    script(s + i, g, (i + 0.5f) / length, size);
+                nDistractors++;
+            }
+            f += gap;
+
+            int g = (int)(uniform(rng_) * kNumGestures);
+            int length = (int)lroundf(gestures()[g].frames * (0.7f + 0.7f * uniform(rng_)));
+            float size = 0.85f + 0.3f * uniform(rng_);
+            float bend = (uniform(rng_) - 0.5f) * 0.3f;
+            if (f + length >= nFrames)
+                break;
+
+            for (int i = 0; i < length; i++) {
+                float q = (i + 0.5f) / length;
+                script(f + i, g, q + bend * sinf(M_PI * q) / M_PI, size);
+            }
+
+            Performed p = {g, f, f + length - 1, false};
+            performed.push_back(p);
+            f += length;
+        }
+    }
+
+    /* The performer at frame i, in sensor space */
+    void frame(int i, SkeletonUser *user) {
+
+        float pose[SKELETON_NUM_JOINTS][3];
+        makePose(gesture_[i], phase_[i], size_[i], pose);
+
+        /* Sway, and drift around the stage turning between +-45 degrees */
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+            pose[j][0] += 25 * sinf(i * 0.05f);
+
+        Placement placement = {0.785f * sinf(i * 0.0007f), 400 + 800 * sinf(i * 0.0003f), -200,
+                               2800 + 600 * sinf(i * 0.0005f)};
+        place(pose, placement, noise_, user);
+    }
+
+    /* Whether an event reported at frame i is a performed gesture not found before */
+    bool score(const GestureEvent &event, int i) {
+
+        int g = -1;
+        for (int k = 0; k < kNumGestures; k++) {
+            if (event.gesture->name == gestures()[k].name)
+                g = k;
+        }
+
+        /* Reported a few frames after the gesture ends */
+        int start = i - event.frames + 1;
+        for (size_t k = 0; k < performed.size(); k++) {
+            Performed &p = performed[k];
+            if (p.gesture == g && !p.found && p.end >= start - 45 && p.start <= i) {
+                p.found = true;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    int numFound() {
+
+        int n = 0;
+        for (size_t k = 0; k < performed.size(); k++)
+            n += performed[k].found;
+        return n;
+    }
+
+    /* Total template frames in the library */
+    static int numCells() {
+
+        const float speeds[3] = {0.85f, 1.0f, 1.2f};
+        int n = 0;
+        for (int g = 0; g < kNumGestures; g++) {
+            for (int v = 0; v < 3; v++)
+                n += (int)lroundf(gestures()[g].frames / speeds[v]);
+        }
+        return n;
+    }
+
+    vector<Performed> performed;
+    int nDistractors;
+
+private:
+
+    static const Gesture *gestures() {
+
+        static const Gesture kGestures[kNumGestures] = {
+            {"kick_r", 24, "foot_r knee_r"}, {"kick_l", 24, "foot_l knee_l"},
+            {"clap", 18, "hand_l hand_r"}, {"arms_up", 36, "hand_l hand_r"},
+            {"jump", 21, "rise"}, {"punch_r", 15, "hand_r elbow_r"},
+            {"punch_l", 15, "hand_l elbow_l"}, {"wave_r", 45, "hand_r elbow_r"},
+            {"knee_r", 30, "knee_r foot_r"}, {"knee_l", 30, "knee_l foot_l"},
+            {"squat", 42, "knee_l knee_r rise"}, {"t_pose", 36, "hand_l hand_r"}
+        };
+        return kGestures;
+    }
+
+    void script(int i, int g, float phase, float size) {
+
+        gesture_[i] = g;
+        phase_[i] = phase;
+        size_[i] = size;
+    }
+
+    static void move(float pose[][3], int joint, float x, float y, float z) {
+
+        pose[joint][0] += x;
+        pose[joint][1] += y;
+        pose[joint][2] += z;
+    }
+
+    /* Torso-relative pose (mm; x right, y up, z away from the sensor) of gesture g at phase
+       q, or standing for g < 0 */
+    static void makePose(int g, float q, float size, float pose[][3]) {
+
+        static const float kStanding[SKELETON_NUM_JOINTS][3] = {
+            {0, 450, 0}, {0, 300, 0}, {-170, 280, 0}, {170, 280, 0}, {-200, 20, 0}, {200, 20, 0},
+            {-220, -220, 0}, {220, -220, 0}, {0, 0, 0}, {-100, -180, 0}, {100, -180, 0},
+            {-110, -600, 0}, {110, -600, 0}, {-110, -1000, 0}, {110, -1000, 0}
+        };
+
+        memcpy(pose, kStanding, sizeof(kStanding));
+
+        float b = sinf(M_PI * q) * size;
+
+        switch (g) {
+            case 0:
+                move(pose, SKEL_FOOT_R, 0, 350 * b, -600 * b);
+                move(pose, SKEL_KNEE_R, 0, 250 * b, -300 * b);
+                break;
+            case 1:
+                move(pose, SKEL_FOOT_L, 0, 350 * b, -600 * b);
+                move(pose, SKEL_KNEE_L, 0, 250 * b, -300 * b);
+                break;
+            case 2:
+                move(pose, SKEL_HAND_L, 220 * b, 450 * b, -350 * b);
+                move(pose, SKEL_HAND_R, -220 * b, 450 * b, -350 * b);
+                move(pose, SKEL_ELBOW_L, 50 * b, 150 * b, -200 * b);
+                move(pose, SKEL_ELBOW_R, -50 * b, 150 * b, -200 * b);
+                break;
+            case 3:
+                move(pose, SKEL_HAND_L, -50 * b, 900 * b, 0);
+                move(pose, SKEL_HAND_R, 50 * b, 900 * b, 0);
+                move(pose, SKEL_ELBOW_L, 0, 450 * b, 0);
+                move(pose, SKEL_ELBOW_R, 0, 450 * b, 0);
+                break;
+            case 4:
+                for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+                    move(pose, j, 0, 300 * b, 0);
+                move(pose, SKEL_FOOT_L, 0, 120 * b, 0);
+                move(pose, SKEL_FOOT_R, 0, 120 * b, 0);
+                break;
+            case 5:
+                move(pose, SKEL_HAND_R, -200 * b, 450 * b, -550 * b);
+                move(pose, SKEL_ELBOW_R, -50 * b, 250 * b, -250 * b);
+                break;
+            case 6:
+                move(pose, SKEL_HAND_L, 200 * b, 450 * b, -550 * b);
+                move(pose, SKEL_ELBOW_L, 50 * b, 250 * b, -250 * b);
+                break;
+            case 7: {
+                float e = sqrtf(fmaxf(0, sinf(M_PI * q))) * size;
+                move(pose, SKEL_HAND_R, 130 * e + 120 * e * sinf(4 * M_PI * q), 720 * e, 0);
+                move(pose, SKEL_ELBOW_R, 100 * e, 230 * e, 0);
+                break;
+            }
+            case 8:
+                move(pose, SKEL_KNEE_R, 0, 400 * b, -300 * b);
+                move(pose, SKEL_FOOT_R, 0, 350 * b, -50 * b);
+                break;
+            case 9:
+                move(pose, SKEL_KNEE_L, 0, 400 * b, -300 * b);
+                move(pose, SKEL_FOOT_L, 0, 350 * b, -50 * b);
+                break;
+            case 10:
+                for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+                    if (j != SKEL_FOOT_L && j != SKEL_FOOT_R)
+                        move(pose, j, 0, -400 * b, 0);
+                }
+                move(pose, SKEL_KNEE_L, 0, 150 * b, -250 * b);
+                move(pose, SKEL_KNEE_R, 0, 150 * b, -250 * b);
+                break;
+            case 11:
+                move(pose, SKEL_HAND_L, -580 * b, 500 * b, 0);
+                move(pose, SKEL_HAND_R, 580 * b, 500 * b, 0);
+                move(pose, SKEL_ELBOW_L, -280 * b, 260 * b, 0);
+                move(pose, SKEL_ELBOW_R, 280 * b, 260 * b, 0);
+                break;
+        }
+    }
+
+    void place(const float pose[][3], const Placement &placement, float noise, SkeletonUser *user) {
+
+        normal_distribution<float> jitter(0, noise > 0 ? noise : 1);
+        float c = cosf(placement.yaw), s = sinf(placement.yaw);
+
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+            float x = pose[j][0], z = pose[j][2];
+            user->x[j] = placement.x + c * x + s * z + (noise > 0 ? jitter(rng_) : 0);
+            user->y[j] = placement.y + pose[j][1] + (noise > 0 ? jitter(rng_) : 0);
+            user->z[j] = placement.z - s * x + c * z + (noise > 0 ? jitter(rng_) : 0);
+            user->confidence[j] = 1;
+            user->u[j] = 320;
+            user->v[j] = 240;
+        }
+    }
+
+    static double distance(const vector<int> &channels, const BodyFeatures &a, const BodyFeatures &b) {
+
+        double d2 = 0;
+        for (size_t i = 0; i < channels.size(); i++) {
+            int ch = channels[i];
+            if (ch == GESTURE_RISE_CHANNEL) {
+                double d = a.rise - b.rise;
+                d2 += d * d;
+            }
+            else {
+                double dx = a.x[ch] - b.x[ch], dy = a.y[ch] - b.y[ch], dz = a.z[ch] - b.z[ch];
+                d2 += dx * dx + dy * dy + dz * dz;
+            }
+        }
+        return sqrt(d2);
+    }
+
+private:
+
+    mt19937 rng_;
+    float noise_;
+    vector<int> gesture_;
+    vector<float> phase_;
+    vector<float> size_;
+};
+
+#endif /* defined(__KinectOSC__GestureSynthesis__) */
@@ -0,0 +1,394 @@
+//
+//  JitterBufferTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  JitterBuffer on hand-timed packets: in-order packets go straight through, a reordered
+//  packet is waited for, a gap is given up once the playout delay has passed and its
+//  packet is then refused as late, duplicates are refused, and sequence numbers wrap.
+//  Then a SkeletonStreamEncoder stream sent over loopback UDP to a UdpSkeletonSource with
+//  packets dropped, swapped, reversed, repeated and held back: frames must come out in
+//  order, every frame that could be decoded must be, and the counts must match.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <atomic>
+
+#include "JitterBuffer.h"
+#include "SkeletonSource.h"
+#include "TestCheck.h"
+
+#define PACKET_US 33333
+#define TEST_UDP_PORT 57132           // Clear of OscControlServerTests and the soak sink
+#define LOOPBACK_FRAMES 150
+#define LOOPBACK_KEYFRAME_INTERVAL 10
+#define LOOPBACK_PACKET_US 4000
+#define LOOPBACK_HOLD_US 100000         // Long past any playout delay
+
+using namespace std;
+
+/* A packet whose payload is its own sequence number, sent on the sender's 30 Hz clock */
+static bool push(JitterBuffer *buffer, uint16_t sequence, uint64_t arrival) {
+
+    uint8_t data[2];
+    memcpy(data, &sequence, 2);
+    return buffer->push(sequence, (uint64_t)sequence * PACKET_US, data, 2, arrival);
+}
+
+/* The sequence number of the next packet due at now, or -1 */
+static int pop(JitterBuffer *buffer, uint64_t now) {
+
+    uint8_t data[SKELETON_STREAM_MAX_BYTES];
+    int length = buffer->pop(data, sizeof(data), now);
+    if (length != 2)
+        return -1;
+
+    uint16_t sequence;
+    memcpy(&sequence, data, 2);
+    return sequence;
+}
+
+static void testInOrder() {
+
+    JitterBuffer buffer;
+    uint64_t t = 1000000;
+    bool ordered = true;
+
+    CHECK(pop(&buffer, t) == -1 && buffer.nextDue() == 0);
+
+    for (int i = 0; i < 100; i++, t += PACKET_US) {
+        CHECK(push(&buffer, (uint16_t)(1000 + i), t));
+        CHECK(buffer.nextDue() == t);
+        ordered = ordered && pop(&buffer, t) == 1000 + i;
+        ordered = ordered && pop(&buffer, t) == -1;
+    }
+    CHECK(ordered);
+
+    JitterBuffer::Stats stats = buffer.stats();
+    CHECK(stats.received == 100 && stats.lost == 0 && stats.reordered == 0 && stats.late == 0);
+    CHECK(stats.duplicates == 0 && stats.delay == JITTER_MIN_DELAY_US);
+
+    /* Too little room leaves the packet where it is */
+    uint8_t small[1];
+    CHECK(push(&buffer, 1100, t));
+    CHECK(buffer.pop(small, sizeof(small), t) == 0);
+    CHECK(pop(&buffer, t) == 1100);
+}
+
+static void testReorder() {
+
+    JitterBuffer buffer;
+    uint64_t t = 1000000;
+
+    push(&buffer, 0, t);
+    CHECK(pop(&buffer, t) == 0);
+
+    /* 2 arrives before 1 and waits for it, since 1 comes within the playout delay */
+    CHECK(push(&buffer, 2, t + PACKET_US));
+    CHECK(pop(&buffer, t + PACKET_US) == -1);
+    CHECK(pop(&buffer, t + PACKET_US + JITTER_MIN_DELAY_US / 2) == -1);
+    CHECK(push(&buffer, 1, t + PACKET_US + 1000));
+    CHECK(pop(&buffer, t + PACKET_US + 1000) == 1);
+    CHECK(pop(&buffer, t + PACKET_US + 1000) == 2);
+
+    /* Three reversed */
+    t += 3 * PACKET_US;
+    CHECK(push(&buffer, 5, t) && push(&buffer, 4, t + 300) && push(&buffer, 3, t + 600));
+    CHECK(pop(&buffer, t + 600) == 3 && pop(&buffer, t + 600) == 4 && pop(&buffer, t + 600) == 5);
+
+    JitterBuffer::Stats stats = buffer.stats();
+    CHECK(stats.lost == 0 && stats.late == 0);
+    CHECK(stats.reordered == 3);
+
+    /* The playout delay has grown to cover the reordering seen */
+    CHECK(stats.delay >= JITTER_MIN_DELAY_US && stats.delay <= JITTER_MAX_DELAY_US);
+}
+
+static void testGapAndLate() {
+
+    JitterBuffer buffer;
+    uint64_t t = 1000000;
+
+    push(&buffer, 10, t);
+    CHECK(pop(&buffer, t) == 10);
+
+    /* 11 never comes: 12 and 13 are held for the delay from 12's arrival, then played */
+    uint64_t arrival = t + 2 * PACKET_US;
+    push(&buffer, 12, arrival);
+    push(&buffer, 13, arrival + PACKET_US / 2);
+    uint64_t delay = buffer.stats().delay;
+
+    CHECK(buffer.nextDue() == arrival + delay);
+    CHECK(pop(&buffer, arrival + delay - 1) == -1);
+    CHECK(pop(&buffer, arrival + delay) == 12);
+    CHECK(pop(&buffer, arrival + delay) == 13);
+    CHECK(buffer.stats().lost == 1);
+
+    /* 11 turns up after its gap was given up */
+    CHECK(!push(&buffer, 11, arrival + delay + 1000));
+    CHECK(pop(&buffer, arrival + delay + 1000) == -1);
+
+    /* A run of losses is given up all at once */
+    push(&buffer, 20, arrival + PACKET_US);
+    delay = buffer.stats().delay;
+    CHECK(pop(&buffer, arrival + PACKET_US + delay - 1) == -1);
+    CHECK(pop(&buffer, arrival + PACKET_US + delay) == 20);
+
+    JitterBuffer::Stats stats = buffer.stats();
+    CHECK(stats.late == 1);
+    CHECK(stats.lost == 1 + 6);
+}
+
+static void testDuplicates() {
+
+    JitterBuffer buffer;
+    uint64_t t = 1000000;
+
+    push(&buffer, 0, t);
+    CHECK(pop(&buffer, t) == 0);
+
+    /* Held behind a gap, a repeat is refused as a duplicate */
+    CHECK(push(&buffer, 2, t + PACKET_US));
+    CHECK(!push(&buffer, 2, t + PACKET_US + 100));
+    CHECK(push(&buffer, 1, t + PACKET_US + 200));
+    CHECK(pop(&buffer, t + PACKET_US + 200) == 1);
+    CHECK(pop(&buffer, t + PACKET_US + 200) == 2);
+    CHECK(pop(&buffer, t + PACKET_US + 200) == -1);
+
+    /* Once played, a repeat is refused as late */
+    CHECK(!push(&buffer, 2, t + 2 * PACKET_US));
+
+    JitterBuffer::Stats stats = buffer.stats();
+    CHECK(stats.duplicates == 1 && stats.late == 1 && stats.lost == 0);
+}
+
+static void testWraparound() {
+
+    JitterBuffer buffer;
+    uint64_t t = 1000000;
+    vector<int> played;
+
+    /* Across 65535 to 0, with 0 arriving before 65535 and 3 lost */
+    const int order[] = { 65532, 65533, 65534, 0, 65535, 1, 2, 4, 5 };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++, t += 1000) {
+        push(&buffer, (uint16_t)order[i], t);
+        for (int s; (s = pop(&buffer, t)) >= 0; )
+            played.push_back(s);
+    }
+    for (int s; (s = pop(&buffer, t + JITTER_MAX_DELAY_US)) >= 0; )
+        played.push_back(s);
+
+    const int expected[] = { 65532, 65533, 65534, 65535, 0, 1, 2, 4, 5 };
+    CHECK(played.size() == sizeof(expected) / sizeof(expected[0]) &&
+          equal(played.begin(), played.end(), expected));
+
+    JitterBuffer::Stats stats = buffer.stats();
+    CHECK(stats.lost == 1 && stats.reordered == 1 && stats.late == 0);
+
+    /* A sender that restarts far from where it was is followed from its first packet */
+    CHECK(push(&buffer, 30000, t + PACKET_US));
+    CHECK(pop(&buffer, t + PACKET_US) == 30000);
+}
+
+/* Arrivals with more and more jitter push the delay up, but never past the maximum */
+static void testDelayAdapts() {
+
+    JitterBuffer buffer;
+    uint64_t t = 1000000;
+    uint64_t previous = 0;
+    bool bounded = true;
+
+    const int spreads[] = { 0, 15000, 30000, 60000, 120000 };
+    for (int j = 0; j < 5; j++) {
+
+        int spread = spreads[j];
+        for (int i = 0; i < 200; i++) {
+            uint16_t sequence = (uint16_t)(j * 200 + i);
+            uint64_t arrival = t + (uint64_t)sequence * PACKET_US + (spread ? rand() % spread : 0);
+            push(&buffer, sequence, arrival);
+            while (pop(&buffer, arrival + JITTER_MAX_DELAY_US) >= 0)
+                ;
+            uint64_t delay = buffer.stats().delay;
+            bounded = bounded && delay >= JITTER_MIN_DELAY_US && delay <= JITTER_MAX_DELAY_US;
+        }
+
+        uint64_t delay = buffer.stats().delay;
+        printf("arrival spread %3d ms: playout delay %.1f ms\n", spread / 1000, delay * 1e-3);
+        CHECK(delay >= previous);
+        previous = delay;
+    }
+
+    CHECK(bounded);
+    CHECK(buffer.stats().delay == JITTER_MAX_DELAY_US);
+}
+
+struct Receiver {
+    UdpSkeletonSource *source;
+    atomic<bool> sending;
+    vector<int> frames;             // Frame indices in the order read
+};
+
+static void *receiveThread(void *arg) {
+
+    Receiver *receiver = (Receiver *)arg;
+    SkeletonFrame frame;
+    int nIdle = 0;
+
+    /* Until the sender is done and nothing more has come for half a second */
+    while (receiver->sending || nIdle < 5) {
+        if (receiver->source->readFrame(&frame)) {
+            receiver->frames.push_back(frame.frameIndex);
+            nIdle = 0;
+        }
+        else if (!receiver->sending)
+            nIdle++;
+    }
+
+    return 0;
+}
+
+struct Send {
+    int frame;
+    int afterUs;                    // Pause before sending
+    Send(int frame, int afterUs) : frame(frame), afterUs(afterUs) {}
+};
+
+static void testUdpLoopback() {
+
+    UdpSkeletonSource source;
+    source.setTimeout(100);
+    if (!source.open(TEST_UDP_PORT)) {
+        CHECK(false);
+        return;
+    }
+
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(TEST_UDP_PORT);
+
+    /* Every frame's packet, in sequence */
+    SkeletonStreamEncoder encoder(SKELETON_STREAM_ALL_JOINTS, LOOPBACK_KEYFRAME_INTERVAL);
+    SyntheticSkeletonSource synthetic(2, 30, 4);
+    synthetic.setRealtime(false);
+    vector<vector<uint8_t> > packets(LOOPBACK_FRAMES);
+
+    for (int k = 0; k < LOOPBACK_FRAMES; k++) {
+        SkeletonFrame frame;
+        synthetic.readFrame(&frame);
+        uint8_t packet[SKELETON_STREAM_MAX_BYTES];
+        int n = encoder.encode(&frame, 0.5f, packet, sizeof(packet));
+        packets[k].assign(packet, packet + n);
+    }
+
+    /* What the network does to them: 25 lost, 95 and 96 lost together, 120 held far too
+       long. Packets sent out of turn follow half a millisecond after the one before, well
+       inside the playout delay. */
+    bool arrives[LOOPBACK_FRAMES];
+    for (int k = 0; k < LOOPBACK_FRAMES; k++)
+        arrives[k] = k != 25 && k != 95 && k != 96 && k != 120;
+
+    vector<Send> sends;
+    for (int k = 0; k < LOOPBACK_FRAMES; k++) {
+
+        /* 40 and 41 swapped, 60 to 62 reversed, 75 twice ahead of 74 */
+        if (k == 40) {
+            sends.push_back(Send(41, LOOPBACK_PACKET_US));
+            sends.push_back(Send(40, 500));
+            k++;
+        }
+        else if (k == 60) {
+            sends.push_back(Send(62, LOOPBACK_PACKET_US));
+            sends.push_back(Send(61, 500));
+            sends.push_back(Send(60, 500));
+            k += 2;
+        }
+        else if (k == 74) {
+            sends.push_back(Send(75, LOOPBACK_PACKET_US));
+            sends.push_back(Send(75, 500));
+            sends.push_back(Send(74, 500));
+            k++;
+        }
+        else if (arrives[k])
+            sends.push_back(Send(k, LOOPBACK_PACKET_US));
+    }
+    sends.push_back(Send(120, LOOPBACK_HOLD_US));
+
+    Receiver receiver;
+    receiver.source = &source;
+    receiver.sending = true;
+    pthread_t thread;
+    pthread_create(&thread, NULL, receiveThread, &receiver);
+
+    for (size_t i = 0; i < sends.size(); i++) {
+        const vector<uint8_t> &packet = packets[sends[i].frame];
+        usleep(sends[i].afterUs);
+        sendto(sender, &packet[0], packet.size(), 0, (struct sockaddr *)&addr, sizeof(addr));
+    }
+
+    receiver.sending = false;
+    pthread_join(thread, NULL);
+    close(sender);
+
+    /* Decodable: every packet that arrived in time, unless a delta came after a loss with no
+       keyframe since */
+    set<int> expected;
+    bool synced = true;
+    for (int k = 0; k < LOOPBACK_FRAMES; k++) {
+        bool keyframe = k % LOOPBACK_KEYFRAME_INTERVAL == 0;
+        if (!arrives[k])
+            synced = false;
+        else if (keyframe || synced) {
+            synced = true;
+            expected.insert(k);
+        }
+    }
+
+    bool ordered = true;
+    for (size_t i = 1; i < receiver.frames.size(); i++)
+        ordered = ordered && receiver.frames[i] > receiver.frames[i - 1];
+
+    set<int> delivered(receiver.frames.begin(), receiver.frames.end());
+    JitterBuffer::Stats stats = source.stats();
+
+    printf("loopback: %d of %d frames read, %d expected; %d lost, %d late, %d reordered, %d duplicates, "
+           "%d undecodable, delay %.1f ms\n", (int)receiver.frames.size(), LOOPBACK_FRAMES, (int)expected.size(),
+           stats.lost, stats.late, stats.reordered, stats.duplicates, source.numUndecodable(), stats.delay * 1e-3);
+
+    CHECK(ordered);
+    CHECK(delivered == expected);
+    CHECK(stats.received == (int)sends.size());
+    CHECK(stats.lost == 4);
+    CHECK(stats.late == 1);
+    CHECK(stats.reordered == 1 + 2 + 1 + 1);
+    CHECK(stats.duplicates == 1);
+    CHECK(source.numUndecodable() == LOOPBACK_FRAMES - 4 - (int)expected.size());
+
+    source.close();
+}
+
+int main(int argc, const char *argv[]) {
+
+    srand(2);
+
+    testInOrder();
+    testReorder();
+    testGapAndLate();
+    testDuplicates();
+    testWraparound();
+    testDelayAdapts();
+    testUdpLoopback();
+
+    return testResult("JitterBufferTests");
+}
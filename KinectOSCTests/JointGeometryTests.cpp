@@ -0,0 +1,285 @@
+//
+//  JointGeometryTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  jointDistances(), jointAngles() and computeLimbMetrics() against a double-precision
+//  reference on random skeletons, and jointAngles() on nearly straight and nearly folded
+//  limbs, where an acos of the normalized dot product would lose most of its precision,
+//  and on limbs of zero length.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "JointGeometry.h"
+#include "TestCheck.h"
+
+#define RANDOM_USERS 4096
+#define DISTANCE_TOLERANCE 3e-7         // Relative
+#define ANGLE_TOLERANCE 1e-6            // Radians
+
+static float uniform(float lo, float hi) {
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+/* Joints anywhere in the sensor's view, nothing like a body */
+static void randomUser(SkeletonUser *user) {
+
+    memset(user, 0, sizeof(*user));
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+        user->x[j] = uniform(-2000, 2000);
+        user->y[j] = uniform(-1500, 1500);
+        user->z[j] = uniform(500, 4500);
+    }
+}
+
+static double referenceDistance(const SkeletonUser &user, int a, int b) {
+
+    double dx = (double)user.x[a] - user.x[b];
+    double dy = (double)user.y[a] - user.y[b];
+    double dz = (double)user.z[a] - user.z[b];
+    return sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+static double referenceAngle(const SkeletonUser &user, int a, int vertex, int c) {
+
+    double u[3] = { (double)user.x[a] - user.x[vertex], (double)user.y[a] - user.y[vertex],
+                    (double)user.z[a] - user.z[vertex] };
+    double w[3] = { (double)user.x[c] - user.x[vertex], (double)user.y[c] - user.y[vertex],
+                    (double)user.z[c] - user.z[vertex] };
+    double cx = u[1] * w[2] - u[2] * w[1];
+    double cy = u[2] * w[0] - u[0] * w[2];
+    double cz = u[0] * w[1] - u[1] * w[0];
+    return atan2(sqrt(cx*cx + cy*cy + cz*cz), u[0] * w[0] + u[1] * w[1] + u[2] * w[2]);
+}
+
+/* Every pair and every triple of joints */
+static void testRandom() {
+
+    uint8_t pairs[SKELETON_NUM_JOINTS * SKELETON_NUM_JOINTS][2];
+    int nPairs = 0;
+    for (int a = 0; a < SKELETON_NUM_JOINTS; a++) {
+        for (int b = 0; b < SKELETON_NUM_JOINTS; b++) {
+            pairs[nPairs][0] = a;
+            pairs[nPairs][1] = b;
+            nPairs++;
+        }
+    }
+
+    uint8_t triples[SKELETON_NUM_JOINTS * SKELETON_NUM_JOINTS * SKELETON_NUM_JOINTS][3];
+    int nTriples = 0;
+    for (int v = 0; v < SKELETON_NUM_JOINTS; v++) {
+        for (int a = 0; a < SKELETON_NUM_JOINTS; a++) {
+            for (int c = a + 1; c < SKELETON_NUM_JOINTS; c++) {
+                if (a == v || c == v)
+                    continue;
+                triples[nTriples][0] = a;
+                triples[nTriples][1] = v;
+                triples[nTriples][2] = c;
+                nTriples++;
+            }
+        }
+    }
+
+    double worstDistance = 0, worstSquared = 0, worstAngle = 0;
+    int nSelf = 0;
+
+    for (int n = 0; n < RANDOM_USERS; n++) {
+
+        SkeletonUser user;
+        randomUser(&user);
+
+        float distances[SKELETON_NUM_JOINTS * SKELETON_NUM_JOINTS];
+        float squared[SKELETON_NUM_JOINTS * SKELETON_NUM_JOINTS];
+        jointDistances(user, pairs, nPairs, distances);
+        jointDistancesSquared(user, pairs, nPairs, squared);
+
+        for (int i = 0; i < nPairs; i++) {
+            double truth = referenceDistance(user, pairs[i][0], pairs[i][1]);
+            if (truth == 0) {
+                nSelf += distances[i] == 0 && squared[i] == 0;
+                continue;
+            }
+            worstDistance = fmax(worstDistance, fabs(distances[i] - truth) / truth);
+            worstSquared = fmax(worstSquared, fabs(squared[i] - truth * truth) / (truth * truth));
+
+            /* The single-pair form agrees exactly with the batch */
+            if (i % 17 == 0 && jointDistance(user, pairs[i][0], pairs[i][1]) != distances[i])
+                worstDistance = 1;
+        }
+
+        float angles[SKELETON_NUM_JOINTS * SKELETON_NUM_JOINTS * SKELETON_NUM_JOINTS];
+        jointAngles(user, triples, nTriples, angles);
+        for (int i = 0; i < nTriples; i++) {
+            double truth = referenceAngle(user, triples[i][0], triples[i][1], triples[i][2]);
+            worstAngle = fmax(worstAngle, fabs(angles[i] - truth));
+        }
+    }
+
+    printf("random: distance %.2g, squared %.2g relative; angle %.2g rad\n", worstDistance, worstSquared,
+           worstAngle);
+
+    CHECK(nSelf == RANDOM_USERS * SKELETON_NUM_JOINTS);
+    CHECK(worstDistance < DISTANCE_TOLERANCE);
+    CHECK(worstSquared < 2 * DISTANCE_TOLERANCE);
+    CHECK(worstAngle < ANGLE_TOLERANCE);
+}
+
+/* A limb from a shoulder out along a random direction, bent at the elbow by a tiny angle
+   off straight or off folded back on itself */
+static void testNearDegenerate() {
+
+    static const uint8_t kArm[1][3] = { { SKEL_SHOULDER_R, SKEL_ELBOW_R, SKEL_HAND_R } };
+    double worst[2] = { 0, 0 };
+    double smallest = M_PI;
+
+    for (int n = 0; n < RANDOM_USERS; n++) {
+
+        bool straight = n % 2 == 0;
+        double bend = pow(10, -1 - 5 * (double)rand() / RAND_MAX);    // 1e-6 to 0.1 rad
+
+        /* Upper arm along d, forearm along d (or -d) turned by bend towards e, which is
+           perpendicular to d */
+        double d[3] = { uniform(-1, 1), uniform(-1, 1), uniform(-1, 1) };
+        double e[3] = { -d[1], d[0], 0 };
+        double dLen = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]), eLen = sqrt(e[0]*e[0] + e[1]*e[1]);
+        double upper = uniform(250, 350), fore = uniform(200, 300);
+        double sign = straight ? 1 : -1;
+
+        SkeletonUser user;
+        randomUser(&user);
+        for (int k = 0; k < 3; k++) {
+            double dk = d[k] / dLen, ek = e[k] / eLen;
+            float *axis = k == 0 ? user.x : k == 1 ? user.y : user.z;
+            axis[SKEL_ELBOW_R] = (float)(axis[SKEL_SHOULDER_R] + upper * dk);
+            axis[SKEL_HAND_R] = (float)(axis[SKEL_ELBOW_R] + fore * (sign * cos(bend) * dk + sin(bend) * ek));
+        }
+
+        /* Rounding the joints to float moves the true angle, so compare against the angle
+           between the rounded joints */
+        double truth = referenceAngle(user, SKEL_SHOULDER_R, SKEL_ELBOW_R, SKEL_HAND_R);
+        float angle;
+        jointAngles(user, kArm, 1, &angle);
+
+        worst[straight] = fmax(worst[straight], fabs(angle - truth));
+        smallest = fmin(smallest, straight ? M_PI - truth : truth);
+    }
+
+    printf("near pi: %.2g rad, near 0: %.2g rad, down to %.2g rad from either\n", worst[1], worst[0], smallest);
+
+    CHECK(smallest < 1e-4);
+    CHECK(worst[1] < ANGLE_TOLERANCE);
+    CHECK(worst[0] < ANGLE_TOLERANCE);
+}
+
+/* A joint on top of the vertex leaves the angle undefined: it must come out 0, not NaN */
+static void testZeroLength() {
+
+    static const uint8_t kTriples[3][3] = {
+        { SKEL_SHOULDER_L, SKEL_ELBOW_L, SKEL_HAND_L },
+        { SKEL_HIP_L, SKEL_KNEE_L, SKEL_FOOT_L },
+        { SKEL_HIP_R, SKEL_KNEE_R, SKEL_FOOT_R }
+    };
+
+    SkeletonUser user;
+    randomUser(&user);
+
+    /* Hand on the elbow; knee on the hip; all three together */
+    user.x[SKEL_HAND_L] = user.x[SKEL_ELBOW_L];
+    user.y[SKEL_HAND_L] = user.y[SKEL_ELBOW_L];
+    user.z[SKEL_HAND_L] = user.z[SKEL_ELBOW_L];
+    user.x[SKEL_KNEE_L] = user.x[SKEL_HIP_L];
+    user.y[SKEL_KNEE_L] = user.y[SKEL_HIP_L];
+    user.z[SKEL_KNEE_L] = user.z[SKEL_HIP_L];
+    const int kRight[] = { SKEL_HIP_R, SKEL_KNEE_R, SKEL_FOOT_R };
+    for (int i = 0; i < 3; i++) {
+        user.x[kRight[i]] = 100;
+        user.y[kRight[i]] = -200;
+        user.z[kRight[i]] = 3000;
+    }
+
+    float angles[3];
+    jointAngles(user, kTriples, 3, angles);
+    CHECK(angles[0] == 0 && angles[1] == 0 && angles[2] == 0);
+
+    LimbMetrics metrics;
+    computeLimbMetrics(user, &metrics);
+    CHECK(metrics.length[SEG_FOREARM_L] == 0 && metrics.length[SEG_THIGH_L] == 0);
+    CHECK(metrics.angle[ANGLE_ELBOW_L] == 0 && metrics.angle[ANGLE_KNEE_L] == 0);
+    CHECK(!isnan(metrics.height));
+}
+
+/* Each segment, angle and the height against the joints they're documented to use */
+static void testLimbMetrics() {
+
+    static const int kSegments[SKELETON_NUM_SEGMENTS][2] = {
+        { SKEL_HEAD, SKEL_NECK },              // SEG_HEAD_NECK
+        { SKEL_NECK, SKEL_TORSO },             // SEG_NECK_TORSO
+        { SKEL_SHOULDER_L, SKEL_ELBOW_L },     // SEG_UPPER_ARM_L
+        { SKEL_SHOULDER_R, SKEL_ELBOW_R },     // SEG_UPPER_ARM_R
+        { SKEL_ELBOW_L, SKEL_HAND_L },         // SEG_FOREARM_L
+        { SKEL_ELBOW_R, SKEL_HAND_R },         // SEG_FOREARM_R
+        { SKEL_TORSO, SKEL_HIP_L },            // SEG_TORSO_HIP_L
+        { SKEL_TORSO, SKEL_HIP_R },            // SEG_TORSO_HIP_R
+        { SKEL_HIP_L, SKEL_KNEE_L },           // SEG_THIGH_L
+        { SKEL_HIP_R, SKEL_KNEE_R },           // SEG_THIGH_R
+        { SKEL_KNEE_L, SKEL_FOOT_L },          // SEG_SHIN_L
+        { SKEL_KNEE_R, SKEL_FOOT_R },          // SEG_SHIN_R
+        { SKEL_SHOULDER_L, SKEL_SHOULDER_R },  // SEG_SHOULDER_WIDTH
+        { SKEL_HIP_L, SKEL_HIP_R },            // SEG_HIP_WIDTH
+        { SKEL_HAND_L, SKEL_HAND_R },          // SEG_HAND_SPREAD
+        { SKEL_FOOT_L, SKEL_FOOT_R }           // SEG_FOOT_SPREAD
+    };
+    static const int kAngles[SKELETON_NUM_ANGLES][3] = {
+        { SKEL_SHOULDER_L, SKEL_ELBOW_L, SKEL_HAND_L },    // ANGLE_ELBOW_L
+        { SKEL_SHOULDER_R, SKEL_ELBOW_R, SKEL_HAND_R },    // ANGLE_ELBOW_R
+        { SKEL_HIP_L, SKEL_KNEE_L, SKEL_FOOT_L },          // ANGLE_KNEE_L
+        { SKEL_HIP_R, SKEL_KNEE_R, SKEL_FOOT_R }           // ANGLE_KNEE_R
+    };
+
+    double worstLength = 0, worstAngle = 0, worstHeight = 0;
+
+    for (int n = 0; n < RANDOM_USERS; n++) {
+
+        SkeletonUser user;
+        randomUser(&user);
+        LimbMetrics metrics;
+        computeLimbMetrics(user, &metrics);
+
+        double length[SKELETON_NUM_SEGMENTS];
+        for (int s = 0; s < SKELETON_NUM_SEGMENTS; s++) {
+            length[s] = referenceDistance(user, kSegments[s][0], kSegments[s][1]);
+            worstLength = fmax(worstLength, fabs(metrics.length[s] - length[s]) / length[s]);
+        }
+        for (int a = 0; a < SKELETON_NUM_ANGLES; a++) {
+            double truth = referenceAngle(user, kAngles[a][0], kAngles[a][1], kAngles[a][2]);
+            worstAngle = fmax(worstAngle, fabs(metrics.angle[a] - truth));
+        }
+
+        /* Head to right foot, torso to hip counted twice as the estimate always has */
+        double height = length[SEG_HEAD_NECK] + length[SEG_NECK_TORSO] + 2 * length[SEG_TORSO_HIP_R] +
+                        length[SEG_THIGH_R] + length[SEG_SHIN_R];
+        worstHeight = fmax(worstHeight, fabs(metrics.height - height) / height);
+    }
+
+    printf("limb metrics: length %.2g, height %.2g relative; angle %.2g rad\n", worstLength, worstHeight,
+           worstAngle);
+
+    CHECK(worstLength < DISTANCE_TOLERANCE);
+    CHECK(worstHeight < 4 * DISTANCE_TOLERANCE);
+    CHECK(worstAngle < ANGLE_TOLERANCE);
+}
+
+int main(int argc, const char *argv[]) {
+
+    srand(5);
+
+    testRandom();
+    testNearDegenerate();
+    testZeroLength();
+    testLimbMetrics();
+
+    return testResult("JointGeometryTests");
+}
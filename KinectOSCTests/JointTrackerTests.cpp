@@ -0,0 +1,235 @@
+//
+//  JointTrackerTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  JointTracker replaying MotionGenerator performances with joints knocked out for one to
+//  ten frames at a time, garbage positions and all, as NiTE reports them: estimates must
+//  beat holding the last confident position, bones must keep their length, and each
+//  joint's state must follow its gap. Then a hand missing for longer than the tracker
+//  extrapolates, and a user id reused for a new user.
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "MotionGenerator.h"
+#include "JointTracker.h"
+#include "TestCheck.h"
+
+#define REPLAY_SEEDS 3
+#define REPLAY_FRAMES (30 * 120)
+#define REPLAY_CONFIDENCE 0.5f
+
+/* Gaps of 1-3, 4-6 and 7-10 frames */
+static int gapBucket(int gap) {
+
+    return gap <= 3 ? 0 : gap <= JOINT_EXTRAPOLATE_FRAMES ? 1 : 2;
+}
+
+static int expectedState(int gap, bool seen) {
+
+    if (!seen)
+        return JOINT_LOST;
+    if (gap == 0)
+        return JOINT_FRESH;
+    if (gap <= JOINT_EXTRAPOLATE_FRAMES)
+        return JOINT_EXTRAPOLATED;
+    return gap <= JOINT_STALE_FRAMES ? JOINT_STALE : JOINT_LOST;
+}
+
+static void testDropoutReplay() {
+
+    double trackerError[3] = {0}, heldError[3] = {0};
+    long nErrors[3] = {0};
+    double trackerBone = 0, heldBone = 0;
+    long nBones = 0;
+    int nStateMismatches = 0;
+    int nMaskMismatches = 0;
+
+    for (unsigned int seed = 1; seed <= REPLAY_SEEDS; seed++) {
+
+        MotionGenerator generator(1, 30, seed);
+        generator.setRealtime(false);
+        generator.setDropoutRate(0);
+        generator.setExitRate(0);
+        generator.setNoise(5);
+
+        JointTracker tracker;
+        srand(seed);
+
+        int gapLeft[SKELETON_NUM_JOINTS] = {0};
+        int gap[SKELETON_NUM_JOINTS] = {0};
+        bool seen[SKELETON_NUM_JOINTS] = {false};
+        bool relative[SKELETON_NUM_JOINTS] = {false};   // Parent valid when last seen
+        Vec3 held[SKELETON_NUM_JOINTS];
+        SkeletonFrame frame;
+
+        for (int f = 0; f < REPLAY_FRAMES; f++) {
+
+            generator.readFrame(&frame);
+            if (frame.nUsers < 1 || !(frame.users[0].flags & USER_TRACKED))
+                continue;
+
+            const SkeletonUser &truth = frame.users[0];
+            SkeletonUser in = truth;
+
+            for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+
+                if (gapLeft[j] == 0 && rand() % 100 < 2)
+                    gapLeft[j] = 1 + rand() % 10;
+
+                if (gapLeft[j] > 0) {
+                    gapLeft[j]--;
+                    in.confidence[j] = 0;
+                    in.x[j] += (rand() % 400) - 200;
+                    in.y[j] += (rand() % 400) - 200;
+                }
+
+                if (in.confidence[j] > REPLAY_CONFIDENCE) {
+                    held[j] = jointPosition(truth, j);
+                    seen[j] = true;
+                    gap[j] = 0;
+                }
+                else
+                    gap[j]++;
+            }
+
+            SkeletonUser filled;
+            JointStates states;
+            tracker.update(in, REPLAY_CONFIDENCE, frame.timestamp, frame.width, frame.height, &filled, &states);
+
+            for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+
+                int state = states.state[j];
+                int expected = expectedState(gap[j], seen[j]);
+
+                /* A joint placed relative to its parent can't be extrapolated once the
+                   parent is gone too */
+                int p = JointTracker::parent(j);
+                bool parentValid = p >= 0 && states.state[p] >= JOINT_EXTRAPOLATED;
+                if (gap[j] == 0)
+                    relative[j] = parentValid;
+                else if (expected == JOINT_EXTRAPOLATED && relative[j] && !parentValid)
+                    expected = JOINT_STALE;
+
+                nStateMismatches += state != expected;
+                nMaskMismatches += ((states.fresh >> j) & 1) != (state == JOINT_FRESH);
+                nMaskMismatches += ((states.valid >> j) & 1) != (state >= JOINT_EXTRAPOLATED);
+
+                if (gap[j] == 0 || !seen[j])
+                    continue;
+
+                Vec3 actual = jointPosition(truth, j);
+                int b = gapBucket(gap[j]);
+                trackerError[b] += distanceSquared(jointPosition(filled, j), actual);
+                heldError[b] += distanceSquared(held[j], actual);
+                nErrors[b]++;
+
+                /* A bone to a confident parent keeps its measured length */
+                if (p >= 0 && state == JOINT_EXTRAPOLATED && states.state[p] == JOINT_FRESH) {
+                    float bone = distance(actual, jointPosition(truth, p));
+                    trackerBone += fabsf(distance(jointPosition(filled, j), jointPosition(filled, p)) - bone);
+                    heldBone += fabsf(distance(held[j], jointPosition(truth, p)) - bone);
+                    nBones++;
+                }
+            }
+        }
+    }
+
+    for (int b = 0; b < 3; b++) {
+        CHECK(nErrors[b] > 1000);
+        printf("gap bucket %d: %ld joints, rms %.1f mm, holding last %.1f mm\n", b, nErrors[b],
+               sqrt(trackerError[b] / nErrors[b]), sqrt(heldError[b] / nErrors[b]));
+    }
+
+    /* Short gaps barely move, so only the longer ones have to be clearly better */
+    CHECK(trackerError[0] <= heldError[0]);
+    CHECK(trackerError[1] < 0.7 * heldError[1]);
+    CHECK(trackerError[2] < 0.7 * heldError[2]);
+
+    CHECK(nBones > 1000);
+    CHECK(trackerBone < heldBone);
+
+    CHECK(nStateMismatches == 0);
+    CHECK(nMaskMismatches == 0);
+}
+
+static void makeUser(int id, float x, SkeletonUser *user) {
+
+    memset(user, 0, sizeof(SkeletonUser));
+    user->id = id;
+    user->flags = USER_VISIBLE | USER_TRACKED;
+
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+        user->x[j] = x + (j % 3) * 100;
+        user->y[j] = 1000 - j * 100;
+        user->z[j] = 2500;
+        user->confidence[j] = 1;
+    }
+}
+
+/* A hand missing for longer than extrapolation lasts, while the performer walks */
+static void testLongDropout() {
+
+    JointTracker tracker;
+    SkeletonUser user, filled;
+    JointStates states;
+    uint64_t timestamp = 0;
+
+    for (int f = 0; f < 10; f++, timestamp += 33333) {
+        makeUser(1, 0, &user);
+        tracker.update(user, REPLAY_CONFIDENCE, timestamp, 640, 480, &filled, &states);
+    }
+    CHECK(states.state[SKEL_HAND_R] == JOINT_FRESH);
+
+    float handOffset = filled.x[SKEL_HAND_R] - filled.x[SKEL_ELBOW_R];
+
+    for (int gap = 1; gap <= JOINT_STALE_FRAMES + 5; gap++, timestamp += 33333) {
+
+        makeUser(1, gap * 10.0f, &user);
+        user.confidence[SKEL_HAND_R] = 0;
+        tracker.update(user, REPLAY_CONFIDENCE, timestamp, 640, 480, &filled, &states);
+
+        CHECK(states.state[SKEL_HAND_R] == expectedState(gap, true));
+        CHECK(states.state[SKEL_ELBOW_R] == JOINT_FRESH);
+
+        /* The hand goes where its elbow goes */
+        if (states.state[SKEL_HAND_R] == JOINT_EXTRAPOLATED)
+            CHECK_NEAR(filled.x[SKEL_HAND_R] - filled.x[SKEL_ELBOW_R], handOffset, 1);
+    }
+
+    CHECK(!(states.valid & (1 << SKEL_HAND_R)));
+
+    makeUser(1, 0, &user);
+    tracker.update(user, REPLAY_CONFIDENCE, timestamp, 640, 480, &filled, &states);
+    CHECK(states.state[SKEL_HAND_R] == JOINT_FRESH);
+}
+
+/* A new user under an old id starts with nothing to extrapolate from */
+static void testNewUser() {
+
+    JointTracker tracker;
+    SkeletonUser user, filled;
+    JointStates states;
+
+    makeUser(3, 0, &user);
+    tracker.update(user, REPLAY_CONFIDENCE, 0, 640, 480, &filled, &states);
+
+    makeUser(3, 500, &user);
+    user.flags |= USER_NEW;
+    user.confidence[SKEL_HEAD] = 0;
+    tracker.update(user, REPLAY_CONFIDENCE, 33333, 640, 480, &filled, &states);
+
+    CHECK(states.state[SKEL_HEAD] == JOINT_LOST);
+    CHECK(states.state[SKEL_TORSO] == JOINT_FRESH);
+}
+
+int main(int argc, const char *argv[]) {
+
+    testDropoutReplay();
+    testLongDropout();
+    testNewUser();
+
+    return testResult("JointTrackerTests");
+}
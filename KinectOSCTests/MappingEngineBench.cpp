@@ -0,0 +1,122 @@
+//
+//  MappingEngineBench.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Time per user per frame of MappingEngine::evaluate() running the default program,
+//  against the same two mappings, hand spacing to intensity and right-knee height to
+//  brightness, written out inline as they were before the engine. Both run on the same
+//  MotionGenerator performance, and must give the same values.
+
+#include <stdlib.h>
+#include <vector>
+
+#include "MotionGenerator.h"
+#include "MappingEngine.h"
+#include "JointTracker.h"
+#include "BodyFeatures.h"
+#include "Utility.h"
+
+#define BENCH_FRAMES 1000
+#define BENCH_REPEATS 200
+
+using namespace std;
+
+static void report(const char *name, uint64_t ns) {
+
+    printf("%-20s %6.1f ns/user-frame\n", name, (double)ns / (BENCH_FRAMES * BENCH_REPEATS));
+}
+
+/* The default program by hand: each value only if its joints are valid */
+static inline int handWritten(const SkeletonUser &user, const JointStates &joints, const BodyFeatures &features,
+                              float *out) {
+
+    const int handJoints = (1 << SKEL_HAND_L) | (1 << SKEL_HAND_R);
+    const int kneeJoints = (1 << SKEL_KNEE_R) | (1 << SKEL_FOOT_L) | BODY_FRAME_JOINTS;
+    int n = 0;
+
+    if ((joints.valid & handJoints) == handJoints)
+        out[n++] = jointDistance(user, SKEL_HAND_L, SKEL_HAND_R) / 1800;
+
+    if ((joints.valid & kneeJoints) == kneeJoints) {
+        float value = 3 * fabsf(features.y[SKEL_KNEE_R] - features.y[SKEL_FOOT_L]);
+        out[n++] = 1 - fmaxf(0, fminf(1, value));
+    }
+
+    return n;
+}
+
+int main(int argc, const char *argv[]) {
+
+    MotionGenerator generator(1, 30, 3);
+    generator.setRealtime(false);
+    generator.setExitRate(0);
+
+    /* Each frame as the controller would have it when the mappings run */
+    vector<SkeletonUser> users(BENCH_FRAMES);
+    vector<JointStates> joints(BENCH_FRAMES);
+    vector<BodyFeatures> features(BENCH_FRAMES);
+    JointTracker tracker;
+    FeatureExtractor extractor;
+
+    for (int n = 0; n < BENCH_FRAMES; ) {
+        SkeletonFrame frame;
+        generator.readFrame(&frame);
+        if (frame.nUsers == 0 || !(frame.users[0].flags & USER_TRACKED))
+            continue;
+        tracker.update(frame.users[0], 0.6f, frame.timestamp, frame.width, frame.height, &users[n], &joints[n]);
+        extractor.extract(users[n], frame.timestamp, &features[n]);
+        n++;
+    }
+
+    MappingEngine engine;
+    engine.beginFrame();
+    MappingOutput outputs[MAPPING_MAX_OUTPUTS];
+    float values[MAPPING_MAX_OUTPUTS];
+
+    /* Same values from both, frame for frame */
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        int n = engine.evaluate(users[i], joints[i], features[i], features[i].height, outputs, MAPPING_MAX_OUTPUTS);
+        int m = handWritten(users[i], joints[i], features[i], values);
+        bool same = n == m;
+        for (int k = 0; same && k < n; k++)
+            same = fabsf(outputs[k].value - values[k]) < 1e-6f;
+        if (!same) {
+            printf("frame %d: the default program and the hand-written mappings differ\n", i);
+            return 1;
+        }
+    }
+
+    volatile float sink = 0;        // Keeps the results live
+
+    /* The first pass warms up; the second is reported */
+    for (int pass = 0; pass < 2; pass++) {
+
+        uint64_t start = hostTimeNanos();
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            for (int i = 0; i < BENCH_FRAMES; i++) {
+                int n = engine.evaluate(users[i], joints[i], features[i], features[i].height, outputs,
+                                        MAPPING_MAX_OUTPUTS);
+                sink += n ? outputs[n - 1].value : 0;
+            }
+        }
+        uint64_t engineNs = hostTimeNanos() - start;
+
+        start = hostTimeNanos();
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            for (int i = 0; i < BENCH_FRAMES; i++) {
+                int n = handWritten(users[i], joints[i], features[i], values);
+                sink += n ? values[n - 1] : 0;
+            }
+        }
+        uint64_t handNs = hostTimeNanos() - start;
+
+        if (pass) {
+            report("default program", engineNs);
+            report("hand-written", handNs);
+        }
+    }
+
+    return 0;
+}
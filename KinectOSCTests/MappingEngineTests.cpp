@@ -0,0 +1,153 @@
+//
+//  MappingEngineTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Reloads while the tracking thread holds a program: the frame's program must stay intact
+//  however many newer ones are published before the next beginFrame(). Most useful built
+//  with -fsanitize=address, which reports a program freed too early even when its memory
+//  still reads back correctly.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "MappingEngine.h"
+#include "TestCheck.h"
+
+static SkeletonUser gUser;
+static JointStates gJoints;
+static BodyFeatures gFeatures;
+
+static void setUp() {
+
+    memset(&gUser, 0, sizeof(gUser));
+    gUser.id = 1;
+    gUser.flags = USER_VISIBLE | USER_TRACKED;
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+        gUser.x[j] = 10 * j;
+        gUser.confidence[j] = 1;
+    }
+
+    memset(&gJoints, 0, sizeof(gJoints));
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++)
+        gJoints.state[j] = JOINT_FRESH;
+    gJoints.fresh = gJoints.valid = (1 << SKELETON_NUM_JOINTS) - 1;
+
+    memset(&gFeatures, 0, sizeof(gFeatures));
+}
+
+/* Program k sends the constant k to /p<k>: hand_l is at x = 60, so the range maps it to 0 */
+static bool loadProgram(MappingEngine *engine, int k) {
+
+    char text[128];
+    snprintf(text, sizeof(text), "/p%d value: x hand_l | range 60 61 | scale %d %d\n", k, k, k + 1);
+    return engine->loadString(text, "test");
+}
+
+/* The single output matches the program that produced it */
+static bool consistent(const MappingOutput *out, int n, int *k) {
+
+    if (n != 1)
+        return false;
+
+    *k = atoi(out[0].target->address.c_str() + 2);
+    char expected[16];
+    snprintf(expected, sizeof(expected), "/p%d", *k);
+    return out[0].target->address == expected && out[0].value == (float)*k;
+}
+
+static void testBurstDuringFrame() {
+
+    MappingEngine engine;
+    MappingOutput out[MAPPING_MAX_OUTPUTS];
+    int k = -1;
+
+    CHECK(loadProgram(&engine, 1));
+    engine.beginFrame();
+
+    /* Far more reloads than a frame ever sees */
+    for (int i = 2; i < 100; i++)
+        CHECK(loadProgram(&engine, i));
+
+    int n = engine.evaluate(gUser, gJoints, gFeatures, 1700, out, MAPPING_MAX_OUTPUTS);
+    CHECK(consistent(out, n, &k) && k == 1);
+
+    engine.beginFrame();
+    n = engine.evaluate(gUser, gJoints, gFeatures, 1700, out, MAPPING_MAX_OUTPUTS);
+    CHECK(consistent(out, n, &k) && k == 99);
+    CHECK(engine.numMappings() == 1);
+}
+
+struct Loader {
+    MappingEngine *engine;
+    atomic<bool> stop;
+    int nLoads;
+};
+
+static void *load(void *arg) {
+
+    Loader *loader = (Loader *)arg;
+    while (!loader->stop) {
+        loadProgram(loader->engine, loader->nLoads + 1);
+        loader->nLoads++;
+    }
+    return NULL;
+}
+
+static void testConcurrentReloads() {
+
+    MappingEngine engine;
+    Loader loader;
+    loader.engine = &engine;
+    loader.stop = false;
+    loader.nLoads = 0;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, load, &loader);
+
+    MappingOutput out[MAPPING_MAX_OUTPUTS];
+    int nBad = 0, last = 0;
+
+    for (int frame = 0; frame < 2000; frame++) {
+
+        engine.beginFrame();
+
+        /* Several users per frame, with reloads landing between them. Every user in a frame
+           runs the same program, and as programs are numbered in publication order, a
+           frame never runs an older one than the frame before. */
+        int first = -1;
+        for (int user = 0; user < 4; user++) {
+            int n = engine.evaluate(gUser, gJoints, gFeatures, 1700, out, MAPPING_MAX_OUTPUTS);
+            int k = 0;
+            if (n > 0 && out[0].target->address.compare(0, 4, "/mrp") == 0)
+                k = 0;                      // The default program, before the first reload
+            else if (!consistent(out, n, &k))
+                nBad++;
+
+            if (first < 0)
+                first = k;
+            if (k != first || k < last)
+                nBad++;
+            usleep(10);
+        }
+
+        last = first;
+    }
+
+    loader.stop = true;
+    pthread_join(thread, NULL);
+
+    CHECK(nBad == 0);
+    CHECK(loader.nLoads > 0);
+}
+
+int main(int argc, const char *argv[]) {
+
+    setUp();
+    testBurstDuringFrame();
+    testConcurrentReloads();
+
+    return testResult("MappingEngineTests");
+}
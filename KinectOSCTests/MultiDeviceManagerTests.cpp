@@ -0,0 +1,76 @@
+//
+//  MultiDeviceManagerTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  MultiDeviceManager with a sensor whose reads fail at once: its capture thread backs off
+//  instead of spinning, the other sensor keeps delivering, and stop() doesn't wait out the
+//  backoff. Fused frames are numbered by the fusion and timestamped in host time.
+
+#include <atomic>
+
+#include "MultiDeviceManager.h"
+#include "TestCheck.h"
+
+using namespace std;
+
+/* An unplugged sensor: every read fails without blocking */
+class FailingSource : public SkeletonSource {
+
+public:
+
+    FailingSource(atomic<int> *nReads) : nReads_(nReads) {}
+
+    bool readFrame(SkeletonFrame *frame) { (*nReads_)++; return false; }
+    const char *name() { return "Failing"; }
+
+private:
+
+    atomic<int> *nReads_;
+};
+
+static void testFailingSensor() {
+
+    atomic<int> nReads(0);
+
+    MultiDeviceManager manager;
+    SyntheticSkeletonSource *synthetic = new SyntheticSkeletonSource(1, 30, 1);
+    synthetic->setRealtime(true);
+    manager.addSource(synthetic);
+    manager.addSource(new FailingSource(&nReads));
+    CHECK(manager.start());
+
+    SkeletonFrame frame;
+    int nFrames = 0;
+    int lastIndex = -1;
+    bool ordered = true;
+    uint64_t start = hostTimeMicros();
+
+    while (hostTimeMicros() - start < 500000) {
+
+        if (!manager.readFusedFrame(&frame, 100))
+            continue;
+
+        nFrames++;
+        ordered = ordered && frame.frameIndex == lastIndex + 1;
+        ordered = ordered && frame.timestamp == frame.hostTime && frame.hostTime <= hostTimeMicros();
+        lastIndex = frame.frameIndex;
+    }
+
+    /* Half a second of 30 Hz frames, and a retry every 100 ms once backed off */
+    CHECK(nFrames >= 10);
+    CHECK(ordered);
+    CHECK(nReads < 20);
+
+    uint64_t stopStart = hostTimeMicros();
+    manager.stop();
+    CHECK(hostTimeMicros() - stopStart < 50000);
+}
+
+int main(int argc, const char *argv[]) {
+
+    testFailingSensor();
+
+    return testResult("MultiDeviceManagerTests");
+}
@@ -0,0 +1,235 @@
+//
+//  NoteMapTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Every built-in scale and tonality in every key spelling and every octave from well
+//  below MIDI 0 to well above 127. Each map that fits must start on the key, rise, and
+//  walk the scale's pitch classes in order; each that doesn't must be refused without
+//  touching the map. Then scale files: repetition up the octave, replacement and bad
+//  lines.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "NoteMap.h"
+#include "TestCheck.h"
+
+#define LOWEST_OCTAVE -2
+#define HIGHEST_OCTAVE 11
+
+struct ScaleCase {
+    const char *name;
+    const char *tonality;
+    int pitchClasses[NOTE_MAP_SIZE];    // Semitones above the key in one octave, -1 terminated
+};
+
+/* Written out from the theory rather than copied from NoteMap.cpp */
+static const ScaleCase kScales[] = {
+    { "Diatonic",   "Major", { 0, 2, 4, 5, 7, 9, 11, -1 } },
+    { "Diatonic",   "Minor", { 0, 2, 3, 5, 7, 8, 10, -1 } },
+    { "Pentatonic", "Major", { 0, 2, 4, 7, 9, -1 } },
+    { "Pentatonic", "Minor", { 0, 3, 5, 7, 10, -1 } },
+    { "Chromatic",  "Major", { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 } },
+    { "Chromatic",  "Minor", { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 } }
+};
+
+struct KeySpelling {
+    const char *name;
+    int key;
+};
+
+static const KeySpelling kKeys[] = {
+    { "C", 0 }, { "B#", 0 }, { "C#", 1 }, { "Db", 1 }, { "D", 2 }, { "D#", 3 }, { "Eb", 3 },
+    { "E", 4 }, { "Fb", 4 }, { "F", 5 }, { "E#", 5 }, { "F#", 6 }, { "Gb", 6 }, { "G", 7 },
+    { "G#", 8 }, { "Ab", 8 }, { "A", 9 }, { "A#", 10 }, { "Bb", 10 }, { "B", 11 }, { "Cb", 11 },
+    { "c", 0 }, { "db", 1 }, { "GB", 6 }, { "a#", 10 }
+};
+
+/* The regions of a scale, rising from base through its pitch classes */
+static void expectedMap(const int *pitchClasses, int base, int notes[NOTE_MAP_SIZE]) {
+
+    int nClasses = 0;
+    while (nClasses < NOTE_MAP_SIZE && pitchClasses[nClasses] >= 0)
+        nClasses++;
+
+    for (int i = 0; i < NOTE_MAP_SIZE; i++)
+        notes[i] = base + pitchClasses[i % nClasses] + 12 * (i / nClasses);
+}
+
+static void testBuiltinScales() {
+
+    ScaleLibrary library;
+    int nBuilt = 0, nRefused = 0;
+
+    for (size_t s = 0; s < sizeof(kScales) / sizeof(kScales[0]); s++) {
+
+        Tonality tonality;
+        int scale;
+        CHECK(ScaleLibrary::parseTonality(kScales[s].tonality, &tonality));
+        CHECK(library.parseScale(kScales[s].name, tonality, &scale));
+
+        for (size_t k = 0; k < sizeof(kKeys) / sizeof(kKeys[0]); k++) {
+
+            int key = -1;
+            CHECK(ScaleLibrary::parseKey(kKeys[k].name, &key));
+            CHECK(key == kKeys[k].key);
+
+            for (int octave = LOWEST_OCTAVE; octave <= HIGHEST_OCTAVE; octave++) {
+
+                int expected[NOTE_MAP_SIZE];
+                expectedMap(kScales[s].pitchClasses, key + 12 * octave, expected);
+                bool fits = expected[0] >= 0 && expected[NOTE_MAP_SIZE-1] <= 127;
+
+                NoteMap map;
+                memset(&map, 0xff, sizeof(map));
+                bool built = library.build(scale, key, octave, &map);
+                CHECK(built == fits);
+
+                if (!built) {
+                    /* Refused maps are left alone */
+                    for (int i = 0; i < NOTE_MAP_SIZE; i++)
+                        CHECK(map.notes[i] == -1);
+                    nRefused++;
+                    continue;
+                }
+
+                CHECK(map.notes[0] == key + 12 * octave);
+                for (int i = 0; i < NOTE_MAP_SIZE; i++) {
+                    CHECK(map.notes[i] == expected[i]);
+                    CHECK(map.notes[i] >= 0 && map.notes[i] <= 127);
+                    if (i > 0)
+                        CHECK(map.notes[i] > map.notes[i-1]);
+                }
+                nBuilt++;
+            }
+        }
+    }
+
+    printf("%d maps built, %d refused\n", nBuilt, nRefused);
+    CHECK(nBuilt > 0 && nRefused > 0);
+}
+
+static void testNames() {
+
+    ScaleLibrary library;
+    int scale = -1;
+
+    /* Full labels ignore the tonality; chromatic has none */
+    CHECK(library.parseScale("Diatonic Minor", TONALITY_MAJOR, &scale) && scale == SCALE_DIATONIC_MINOR);
+    CHECK(library.parseScale("pentatonic major", TONALITY_MINOR, &scale) && scale == SCALE_PENTATONIC_MAJOR);
+    CHECK(library.parseScale("CHROMATIC", TONALITY_MINOR, &scale) && scale == SCALE_CHROMATIC);
+    CHECK(library.hasTonality(SCALE_DIATONIC_MAJOR) && !library.hasTonality(SCALE_CHROMATIC));
+
+    for (int s = 0; s < NUM_BUILTIN_SCALES; s++) {
+        int parsed = -1;
+        CHECK(library.scaleName(s) && library.parseScale(library.scaleName(s), TONALITY_MAJOR, &parsed));
+        CHECK(parsed == s);
+    }
+
+    Tonality tonality;
+    int key;
+    CHECK(!library.parseScale("Lydian", TONALITY_MAJOR, &scale));
+    CHECK(!library.parseScale(NULL, TONALITY_MAJOR, &scale));
+    CHECK(!ScaleLibrary::parseTonality("Dorian", &tonality));
+    CHECK(!ScaleLibrary::parseKey("H", &key));
+    CHECK(!ScaleLibrary::parseKey("C##", &key));
+    CHECK(!ScaleLibrary::parseKey(NULL, &key));
+    CHECK(library.scaleName(NUM_BUILTIN_SCALES) == NULL && library.scaleName(-1) == NULL);
+
+    /* keyName gives a spelling that parses back to the same key */
+    for (int k = 0; k < NUM_KEYS; k++) {
+        int parsed = -1;
+        CHECK(ScaleLibrary::keyName(k) && ScaleLibrary::parseKey(ScaleLibrary::keyName(k), &parsed));
+        CHECK(parsed == k);
+    }
+    CHECK(ScaleLibrary::keyName(NUM_KEYS) == NULL);
+
+    /* Unknown scales and keys are refused */
+    NoteMap map;
+    CHECK(!library.build(-1, KEY_C, 4, &map));
+    CHECK(!library.build(NUM_BUILTIN_SCALES, KEY_C, 4, &map));
+    CHECK(!library.build(SCALE_CHROMATIC, -1, 4, &map));
+    CHECK(!library.build(SCALE_CHROMATIC, NUM_KEYS, 4, &map));
+
+    /* The controller's default map before scales were tables */
+    const int oldDefault[NOTE_MAP_SIZE] = { 52, 55, 57, 59, 62, 64, 67, 69, 71, 74, 76, 79 };
+    CHECK(library.build(SCALE_PENTATONIC_MINOR, KEY_E, 4, &map));
+    CHECK(!memcmp(map.notes, oldDefault, sizeof(oldDefault)));
+}
+
+static void testScaleFile() {
+
+    char path[] = "/tmp/NoteMapTests-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        CHECK(false);
+        return;
+    }
+
+    const char *text =
+        "# name: steps\n"
+        "Whole Tone: 0 2 4 6 8 10\n"
+        "\n"
+        "Blues: 0 3 5 6 7 10   # six notes\n"
+        "Falling: 0 5 3\n"
+        "no colon here\n"
+        "Octaves: 0\n"
+        "blues: 0 3 5 7 10\n";
+    CHECK(write(fd, text, strlen(text)) == (ssize_t)strlen(text));
+    close(fd);
+
+    ScaleLibrary library;
+    int nRead = library.loadFile(path);
+    unlink(path);
+
+    /* Falling and the line without a colon are skipped; the second blues replaces the first */
+    CHECK(nRead == 4);
+    CHECK(library.numScales() == NUM_BUILTIN_SCALES + 3);
+    CHECK(library.loadFile(path) == -1);
+
+    const int wholeTone[] = { 0, 2, 4, 6, 8, 10, -1 };
+    const int blues[] = { 0, 3, 5, 7, 10, -1 };
+    const int octaves[] = { 0, -1 };
+    const char *names[] = { "whole tone", "Blues", "Octaves" };
+    const int *pitchClasses[] = { wholeTone, blues, octaves };
+    int nBuilt = 0;
+
+    for (int s = 0; s < 3; s++) {
+
+        int scale = -1;
+        CHECK(library.parseScale(names[s], TONALITY_MINOR, &scale));
+        CHECK(scale >= NUM_BUILTIN_SCALES && !library.hasTonality(scale));
+
+        for (int key = 0; key < NUM_KEYS; key++) {
+            for (int octave = LOWEST_OCTAVE; octave <= HIGHEST_OCTAVE; octave++) {
+
+                int expected[NOTE_MAP_SIZE];
+                expectedMap(pitchClasses[s], key + 12 * octave, expected);
+                bool fits = expected[0] >= 0 && expected[NOTE_MAP_SIZE-1] <= 127;
+
+                NoteMap map;
+                bool built = library.build(scale, key, octave, &map);
+                CHECK(built == fits);
+                if (built) {
+                    CHECK(!memcmp(map.notes, expected, sizeof(expected)));
+                    nBuilt++;
+                }
+            }
+        }
+    }
+
+    CHECK(nBuilt > 0);
+    CHECK(!strcmp(library.scaleName(NUM_BUILTIN_SCALES), "Whole Tone"));
+}
+
+int main(int argc, const char *argv[]) {
+
+    testBuiltinScales();
+    testNames();
+    testScaleFile();
+
+    return testResult("NoteMapTests");
+}
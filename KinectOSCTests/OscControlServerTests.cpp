@@ -0,0 +1,258 @@
+//
+//  OscControlServerTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  OscControlServer's address matching, dispatched directly, then the server under UDP
+//  load: tens of thousands of messages at several thousand a second from another socket,
+//  all of which must reach their handler in order, with queries answered in between and
+//  stop() returning within a poll period.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "OscControlServer.h"
+#include "Utility.h"
+#include "TestCheck.h"
+
+#define TEST_SERVER_PORT "57130"
+#define TEST_CLIENT_PORT "57131"
+#define TEST_LOAD_MESSAGES 20000
+#define TEST_LOAD_RATE 8000             // Messages per second
+#define TEST_LOAD_BURST 40              // Sent back to back, then paced
+
+using namespace std;
+
+enum {
+    METHOD_START,
+    METHOD_STOP,
+    METHOD_NOTEMAP,
+    METHOD_THRESHOLD,
+    METHOD_FAIL,
+    METHOD_QUERY_TRACKING,
+    METHOD_QUERY_NOTEMAP,
+    METHOD_QUERY_THRESHOLD,
+    METHOD_NOTE,
+    METHOD_QUERY_COUNT,
+    NUM_METHODS
+};
+
+struct Server {
+    atomic<int> calls[NUM_METHODS];
+    atomic<int> nNotes;
+    atomic<int> lastNote;
+    atomic<bool> ordered;
+};
+
+static bool handle(void *context, int method, const char *types, lo_arg **argv, int argc, lo_message reply) {
+
+    Server *server = (Server *)context;
+    server->calls[method]++;
+
+    switch (method) {
+
+        case METHOD_NOTE:
+            if (argv[0]->i != server->lastNote + 1)
+                server->ordered = false;
+            server->lastNote = argv[0]->i;
+            server->nNotes++;
+            return true;
+
+        case METHOD_QUERY_COUNT:
+            lo_message_add_int32(reply, server->nNotes);
+            return true;
+
+        case METHOD_QUERY_TRACKING:
+        case METHOD_QUERY_NOTEMAP:
+        case METHOD_QUERY_THRESHOLD:
+            lo_message_add_int32(reply, 1);
+            return true;
+    }
+
+    return method != METHOD_FAIL;
+}
+
+static void addMethods(OscControlServer *control, Server *server) {
+
+    const char *addresses[] = {"/start", "/stop", "/notemap", "/threshold", "/fail", "/query/tracking",
+                               "/query/notemap", "/query/threshold"};
+
+    for (int m = 0; m < METHOD_NOTE; m++)
+        control->addMethod(addresses[m], "", handle, server, m);
+
+    control->addMethod("/notemap", "ssi", handle, server, METHOD_NOTEMAP);
+    control->addMethod("/note", "if", handle, server, METHOD_NOTE);
+    control->addMethod("/count", "", handle, server, METHOD_QUERY_COUNT);
+}
+
+static void resetServer(Server *server) {
+
+    for (int m = 0; m < NUM_METHODS; m++)
+        server->calls[m] = 0;
+    server->nNotes = 0;
+    server->lastNote = -1;
+    server->ordered = true;
+}
+
+/* Handlers run for each address, pattern or not, without a socket */
+static void testDispatch() {
+
+    Server server;
+    resetServer(&server);
+
+    OscControlServer control("/kinectosc");
+    addMethods(&control, &server);
+    control.start(TEST_SERVER_PORT);
+
+    struct {
+        const char *path;
+        const char *types;
+        int nHandlers;
+    } cases[] = {
+        {"/kinectosc/start", "", 1},
+        {"/kinectosc/stop", "", 1},
+        {"/kinectosc/query/*", "", 3},
+        {"/kinectosc/query/t*", "", 2},
+        {"/kinectosc/query/{tracking,notemap}", "", 2},
+        {"/kinectosc/query/[a-s]*", "", 1},
+        {"/kinectosc/query/[!a-s]*", "", 2},
+        {"/kinectosc/query/*threshold", "", 1},
+        {"/kinectosc/query/*o*", "", 2},
+        {"/*/sta?t", "", 1},
+        {"/kinectosc/notemap", "ssi", 1},
+        {"/kinectosc/notemap", "f", 0},
+        {"/kinectosc/nope", "", 0},
+        {"/kinectosc", "", 0},
+        {"/kinectosc/fail", "", 1},
+        {"/kinectosc/start/x", "", 0},
+        {"bad", "", 0},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int nHandlers = control.dispatch(cases[i].path, cases[i].types, NULL, 0, NULL);
+        if (nHandlers != cases[i].nHandlers)
+            printf("%s \"%s\": %d handlers, expected %d\n", cases[i].path, cases[i].types, nHandlers, cases[i].nHandlers);
+        CHECK(nHandlers == cases[i].nHandlers);
+    }
+
+    control.stop();
+}
+
+struct Client {
+    int nReplies;
+    int lastCount;
+};
+
+static int clientReply(const char *path, const char *types, lo_arg **argv, int argc, lo_message message, void *context) {
+
+    Client *client = (Client *)context;
+    if (argc == 1 && types[0] == 'i') {
+        client->nReplies++;
+        client->lastCount = argv[0]->i;
+    }
+
+    return 0;
+}
+
+/* Ask for the count of notes received and wait up to timeoutMs for the answer */
+static int queryCount(lo_address address, lo_server replies, Client *client, int timeoutMs) {
+
+    int nReplies = client->nReplies;
+    lo_send_from(address, replies, LO_TT_IMMEDIATE, "/kinectosc/count", "");
+
+    uint64_t deadline = hostTimeMicros() + (uint64_t)timeoutMs * 1000;
+    while (client->nReplies == nReplies && hostTimeMicros() < deadline)
+        lo_server_recv_noblock(replies, 10);
+
+    return client->nReplies > nReplies ? client->lastCount : -1;
+}
+
+static void testUdpLoad() {
+
+    Server server;
+    resetServer(&server);
+
+    OscControlServer control("/kinectosc");
+    addMethods(&control, &server);
+
+    if (!control.start(TEST_SERVER_PORT)) {
+        CHECK(false);
+        return;
+    }
+
+    Client client = {0, 0};
+    lo_server replies = lo_server_new(TEST_CLIENT_PORT, NULL);
+    if (!replies) {
+        CHECK(false);
+        control.stop();
+        return;
+    }
+    lo_server_add_method(replies, NULL, NULL, clientReply, &client);
+    lo_address address = lo_address_new("127.0.0.1", TEST_SERVER_PORT);
+
+    /* Paced in bursts, as a controller streaming at a high rate would; a query every so
+       often must be answered with no more than was sent */
+    uint64_t start = hostTimeMicros();
+    bool countsValid = true;
+
+    for (int i = 0; i < TEST_LOAD_MESSAGES; i++) {
+
+        lo_send(address, "/kinectosc/note", "if", i, (float)i / TEST_LOAD_MESSAGES);
+
+        if ((i + 1) % TEST_LOAD_BURST)
+            continue;
+
+        if ((i + 1) % (TEST_LOAD_MESSAGES / 10) == 0) {
+            int count = queryCount(address, replies, &client, 500);
+            countsValid = countsValid && count >= 0 && count <= i + 1;
+        }
+
+        uint64_t due = start + (uint64_t)(i + 1) * 1000000 / TEST_LOAD_RATE;
+        uint64_t now = hostTimeMicros();
+        if (due > now)
+            usleep((useconds_t)(due - now));
+    }
+
+    double seconds = (hostTimeMicros() - start) * 1e-6;
+
+    /* Let the server drain what's still queued */
+    int count = -1;
+    for (int tries = 0; tries < 20 && count != TEST_LOAD_MESSAGES; tries++)
+        count = queryCount(address, replies, &client, 100);
+
+    printf("%d messages in %.2f s (%.0f/s), %d received, %d queries answered\n", TEST_LOAD_MESSAGES, seconds,
+           TEST_LOAD_MESSAGES / seconds, (int)server.nNotes, client.nReplies);
+
+    CHECK(countsValid);
+    CHECK(count == TEST_LOAD_MESSAGES);
+    CHECK(server.nNotes == TEST_LOAD_MESSAGES);
+    CHECK(server.ordered);
+    CHECK(TEST_LOAD_MESSAGES / seconds > TEST_LOAD_RATE / 2);
+
+    /* Patterns over the network too */
+    lo_send_from(address, replies, LO_TT_IMMEDIATE, "/kinectosc/query/*", "");
+    uint64_t deadline = hostTimeMicros() + 500000;
+    while (server.calls[METHOD_QUERY_THRESHOLD] == 0 && hostTimeMicros() < deadline)
+        usleep(1000);
+    CHECK(server.calls[METHOD_QUERY_TRACKING] == 1);
+    CHECK(server.calls[METHOD_QUERY_NOTEMAP] == 1);
+    CHECK(server.calls[METHOD_QUERY_THRESHOLD] == 1);
+
+    uint64_t stopStart = hostTimeMicros();
+    control.stop();
+    CHECK(hostTimeMicros() - stopStart < (OSC_CONTROL_POLL_MS + 50) * 1000);
+    CHECK(!control.isRunning());
+
+    lo_address_free(address);
+    lo_server_free(replies);
+}
+
+int main(int argc, const char *argv[]) {
+
+    testDispatch();
+    testUdpLoad();
+
+    return testResult("OscControlServerTests");
+}
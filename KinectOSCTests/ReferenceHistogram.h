@@ -0,0 +1,62 @@
+//
+//  ReferenceHistogram.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  calculateHistogram() from NiteSampleUtilities.h, for the depth histogram's tests and
+//  benchmark: the same loops on a raw buffer instead of an openni::VideoFrameRef. The
+//  original bins straight into the caller's histogram, so a depth past its end writes out
+//  of bounds; this one bins into room for every depth, which it keeps zeroed between
+//  calls, and clears only what a frame touched, so it costs what the original does.
+
+#ifndef __KinectOSC__ReferenceHistogram__
+#define __KinectOSC__ReferenceHistogram__
+
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+class ReferenceHistogram {
+
+public:
+
+    ReferenceHistogram() : bins_(65536, 0.0f) {}
+
+    void calculate(float *pHistogram, int histogramSize, const uint16_t *pDepth, int width, int height,
+                   int strideInPixels) {
+
+        float *bins = &bins_[0];
+        int restOfRow = strideInPixels - width;
+        int top = 0;
+
+        unsigned int nNumberOfPoints = 0;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x, ++pDepth) {
+                if (*pDepth != 0) {
+                    bins[*pDepth]++;
+                    top = *pDepth > top ? *pDepth : top;
+                    nNumberOfPoints++;
+                }
+            }
+            pDepth += restOfRow;
+        }
+        for (int nIndex = 1; nIndex < histogramSize; nIndex++)
+            bins[nIndex] += bins[nIndex-1];
+        if (nNumberOfPoints) {
+            for (int nIndex = 1; nIndex < histogramSize; nIndex++)
+                bins[nIndex] = (256 * (1.0f - (bins[nIndex] / nNumberOfPoints)));
+        }
+
+        memcpy(pHistogram, bins, histogramSize * sizeof(float));
+        memset(bins, 0, (top + 1 > histogramSize ? top + 1 : histogramSize) * sizeof(float));
+    }
+
+private:
+
+    vector<float> bins_;                // Zero outside calculate()
+};
+
+#endif /* defined(__KinectOSC__ReferenceHistogram__) */
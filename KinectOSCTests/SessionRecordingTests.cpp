@@ -0,0 +1,100 @@
+//
+//  SessionRecordingTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Frames the recorder can't serialize are counted as dropped and never start a GOP, so
+//  the index only points at GOPs that have frames in them.
+
+#include <unistd.h>
+
+#include "SessionRecording.h"
+#include "TestCheck.h"
+
+static void makeFrame(SkeletonFrame *frame, int index, bool valid) {
+
+    clearSkeletonFrame(frame);
+    frame->timestamp = 1000000 + (uint64_t)index * 33333;
+    frame->frameIndex = index;
+    frame->width = 640;
+    frame->height = 480;
+    frame->nUsers = valid ? 1 : SKELETON_MAX_USERS + 1;
+    frame->users[0].id = 1;
+    frame->users[0].flags = USER_VISIBLE | USER_TRACKED;
+}
+
+/* Until the writer has written or dropped nHandled frames, or two seconds have gone by */
+static bool waitForWriter(SessionRecorder *recorder, int nHandled) {
+
+    for (int i = 0; i < 2000; i++) {
+        SessionRecorder::Stats stats = recorder->stats();
+        if (stats.nFrames + stats.nDropped >= nHandled)
+            return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+static void testUnserializableFrames() {
+
+    char path[] = "/tmp/SessionRecordingTests-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    close(fd);
+
+    /* Two GOPs of four, with bad frames where each GOP would otherwise start */
+    const int keyframeInterval = 4;
+    const bool valid[] = {false, true, true, true, true, false, true, true, true, true, false};
+    const int nFrames = sizeof(valid) / sizeof(valid[0]);
+
+    SessionRecorder recorder;
+    CHECK(recorder.open(path, keyframeInterval));
+
+    for (int i = 0; i < nFrames; i++) {
+        SkeletonFrame frame;
+        makeFrame(&frame, i, valid[i]);
+        CHECK(recorder.writeFrame(&frame, FrameBuffer()));
+
+        /* One frame queued at a time, so only bad frames are dropped */
+        CHECK(waitForWriter(&recorder, i + 1));
+    }
+
+    recorder.close();
+
+    SessionRecorder::Stats stats = recorder.stats();
+    CHECK(stats.nFrames == 8);
+    CHECK(stats.nDropped == 3);
+
+    SessionPlayer player;
+    player.setRealtime(false);
+    CHECK(player.open(path));
+    CHECK(player.numGops() == 2);
+
+    /* Every GOP starts on a frame that was written */
+    player.seek(0);
+    SkeletonFrame frame;
+    CHECK(player.readFrame(&frame) && frame.frameIndex == 1);
+    player.seek(5 * 33333e-6);
+    CHECK(player.readFrame(&frame) && frame.frameIndex == 6);
+
+    player.seek(0);
+    int n = 0;
+    while (player.readFrame(&frame)) {
+        CHECK(valid[frame.frameIndex]);
+        n++;
+    }
+    CHECK(n == 8);
+
+    player.close();
+    unlink(path);
+}
+
+int main(int argc, const char *argv[]) {
+
+    testUnserializableFrames();
+
+    return testResult("SessionRecordingTests");
+}
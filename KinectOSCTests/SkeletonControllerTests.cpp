@@ -0,0 +1,502 @@
+//
+//  SkeletonControllerTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  The controller's note output over a MotionGenerator performance, captured from its
+//  OSC sender: every note-on is matched by a note-off, including when transmission is
+//  turned off while notes are held. Notes, mappings and gestures must run with no OSC
+//  sender set at all. Then the tracking thread against a source that blocks
+//  until woken, fails at once or can't reconnect: stopTracking() must return promptly
+//  while running, stalled or backing off, tracking must resume when frames do, and
+//  reconnection must back off on schedule.
+
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+
+#include "SkeletonController.h"
+#include "MotionGenerator.h"
+#include "OscController.h"
+#include "Utility.h"
+#include "GestureSynthesis.h"
+#include "TestCheck.h"
+
+#define STOP_BOUND_US 50000             // stopTracking() from any state
+#define BLOCK_TIMEOUT_US 2000000        // A blocked read gives up, so a missed wake fails rather than hangs
+#define BACKOFF_TOLERANCE_US 40000
+
+using namespace std;
+
+static int gSounding[128];
+static int gUnbalanced;
+
+static int numSounding() {
+
+    int n = 0;
+    for (int note = 0; note < 128; note++)
+        n += gSounding[note];
+    return n;
+}
+
+static void capture(void *context, const char *path, const char *types, lo_message message) {
+
+    if (strcmp(path, "/mrp/midi") || strcmp(types, "iii"))
+        return;
+
+    lo_arg **argv = lo_message_get_argv(message);
+    int note = argv[1]->i & 127;
+    bool on = argv[2]->i > 0;
+
+    if (on == (gSounding[note] > 0))
+        gUnbalanced++;
+    gSounding[note] = on;
+}
+
+/* Turns transmission off the first time a note is held after a warm-up, and on again
+   later, from the tracking thread between frames */
+class ToggleSource : public SkeletonSource {
+
+public:
+
+    ToggleSource(SkeletonController *controller, SkeletonSource *source, int nFrames) {
+        controller_ = controller;
+        source_ = source;
+        nFrames_ = nFrames;
+        frame_ = 0;
+        offFrame_ = -1;
+        heldWhenOff = 0;
+        heldAfterOff = -1;
+    }
+
+    bool readFrame(SkeletonFrame *frame) {
+
+        if (frame_ == nFrames_ || !source_->readFrame(frame))
+            return false;
+
+        if (offFrame_ < 0 && frame_ > 60 && numSounding() > 0) {
+            heldWhenOff = numSounding();
+            controller_->setParameter("transmit", "off");
+            offFrame_ = frame_;
+        }
+        else if (offFrame_ >= 0 && frame_ == offFrame_ + 1)
+            heldAfterOff = numSounding();
+        else if (offFrame_ >= 0 && frame_ == offFrame_ + 90)
+            controller_->setParameter("transmit", "on");
+
+        frame_++;
+        return true;
+    }
+
+    const char *name() { return "Toggle"; }
+
+    int heldWhenOff;
+    int heldAfterOff;
+
+private:
+
+    SkeletonController *controller_;
+    SkeletonSource *source_;
+    int nFrames_;
+    int frame_;
+    int offFrame_;
+};
+
+static void testTransmitOff(unsigned int seed) {
+
+    memset(gSounding, 0, sizeof(gSounding));
+    gUnbalanced = 0;
+
+    MotionGenerator motion(2, 30, seed);
+    motion.setRealtime(false);
+
+    OscController sink;
+    sink.setMessageCallback(capture, NULL);
+
+    SkeletonController *controller = new SkeletonController();
+    controller->setOscSender(&sink);
+    CHECK(controller->setParameter("transmit", "on"));
+
+    ToggleSource toggle(controller, &motion, 30 * 30);
+    CHECK(controller->processSource(&toggle) == 30 * 30);
+    delete controller;
+
+    CHECK(toggle.heldWhenOff > 0);
+    CHECK(toggle.heldAfterOff == 0);
+    CHECK(gUnbalanced == 0);
+    CHECK(numSounding() == 0);
+}
+
+/* Messages of each kind the controller sends */
+struct Counts {
+    int notes;
+    int values;
+    int intensities;
+    int gestures;
+};
+
+static void count(void *context, const char *path, const char *types, lo_message message) {
+
+    Counts *counts = (Counts *)context;
+
+    if (!strcmp(path, "/mrp/midi"))
+        counts->notes++;
+    else if (!strcmp(path, "/test/spread"))
+        counts->values++;
+    else if (!strcmp(path, "/mrp/quality/intensity"))
+        counts->intensities++;
+    else if (!strncmp(path, "/gesture/", 9))
+        counts->gestures++;
+}
+
+/* A GestureSynthesis performance, one tracked user */
+class GestureSource : public SkeletonSource {
+
+public:
+
+    GestureSource(GestureSynthesis *synthesis, int nFrames) {
+        synthesis_ = synthesis;
+        nFrames_ = nFrames;
+        frame_ = 0;
+        synthesis_->perform(nFrames);
+    }
+
+    bool readFrame(SkeletonFrame *frame) {
+
+        if (frame_ == nFrames_)
+            return false;
+
+        clearSkeletonFrame(frame);
+        frame->timestamp = frame->hostTime = 5000000 + (uint64_t)frame_ * 33333;
+        frame->frameIndex = frame_;
+        frame->width = 640;
+        frame->height = 480;
+        frame->nUsers = 1;
+
+        SkeletonUser &user = frame->users[0];
+        synthesis_->frame(frame_, &user);
+        user.id = 3;
+        user.flags = USER_VISIBLE | USER_TRACKED | (frame_ == 0 ? USER_NEW : 0);
+
+        frame_++;
+        return true;
+    }
+
+    const char *name() { return "Gestures"; }
+
+private:
+
+    GestureSynthesis *synthesis_;
+    int nFrames_;
+    int frame_;
+};
+
+/* The same performances with and without a sender: with one, every path that sends
+   must have sent something; without, the controller must get through them all */
+static void testNoSender() {
+
+    char mappingsPath[] = "/tmp/SkeletonControllerTests-XXXXXX";
+    char gesturesPath[] = "/tmp/SkeletonControllerTests-XXXXXX";
+    int fd = mkstemp(mappingsPath);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    const char *mappings =
+        "/mrp/quality/intensity held: distance hand_l hand_r | range 0 1800\n"
+        "/test/spread value: distance hand_l hand_r | range 0 1800\n";
+    CHECK(write(fd, mappings, strlen(mappings)) == (ssize_t)strlen(mappings));
+    close(fd);
+
+    fd = mkstemp(gesturesPath);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    close(fd);
+    unlink(gesturesPath);
+    GestureSynthesis synthesis(3, 0);
+    CHECK(synthesis.writeLibrary(gesturesPath, 0.2f));
+
+    for (int withSender = 1; withSender >= 0; withSender--) {
+
+        Counts counts;
+        memset(&counts, 0, sizeof(counts));
+        OscController sink;
+        sink.setMessageCallback(count, &counts);
+
+        SkeletonController *controller = new SkeletonController();
+        if (withSender)
+            controller->setOscSender(&sink);
+        CHECK(controller->setParameter("transmit", "on"));
+        CHECK(controller->loadMappings(mappingsPath));
+        CHECK(controller->loadGestures(gesturesPath));
+
+        MotionGenerator motion(2, 30, 1);
+        motion.setRealtime(false);
+        ToggleSource performance(controller, &motion, 30 * 30);
+        CHECK(controller->processSource(&performance) == 30 * 30);
+
+        GestureSource gestures(&synthesis, 60 * 30);
+        CHECK(controller->processSource(&gestures) == 60 * 30);
+        delete controller;
+
+        if (withSender) {
+            printf("with a sender: %d notes, %d values, %d intensities, %d gestures\n", counts.notes, counts.values,
+                   counts.intensities, counts.gestures);
+            CHECK(counts.notes > 0 && counts.values > 0 && counts.intensities > 0 && counts.gestures > 0);
+        }
+    }
+
+    unlink(mappingsPath);
+    unlink(gesturesPath);
+}
+
+/* Delivers empty frames, blocks until woken, or fails at once, as set from the test; and
+   reconnects after a given number of failed attempts */
+class StallingSource : public SkeletonSource {
+
+public:
+
+    enum Mode {
+        MODE_FRAMES = 0,
+        MODE_BLOCK,
+        MODE_FAIL
+    };
+
+    StallingSource(bool canReconnect, int failedReconnects) {
+        mode = MODE_FRAMES;
+        canReconnect_ = canReconnect;
+        failedReconnects_ = failedReconnects;
+        frameIndex_ = 0;
+        woken_ = false;
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&cond_, NULL);
+    }
+
+    ~StallingSource() {
+        pthread_cond_destroy(&cond_);
+        pthread_mutex_destroy(&mutex_);
+    }
+
+    bool readFrame(SkeletonFrame *frame) {
+
+        if (mode == MODE_FAIL)
+            return false;
+
+        if (mode == MODE_BLOCK) {
+
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += BLOCK_TIMEOUT_US / 1000000;
+
+            pthread_mutex_lock(&mutex_);
+            while (!woken_ && mode == MODE_BLOCK) {
+                if (pthread_cond_timedwait(&cond_, &mutex_, &deadline) != 0)
+                    break;
+            }
+            woken_ = false;
+            pthread_mutex_unlock(&mutex_);
+
+            return false;
+        }
+
+        usleep(10000);
+        clearSkeletonFrame(frame);
+        frame->hostTime = frame->timestamp = hostTimeMicros();
+        frame->frameIndex = frameIndex_++;
+        frame->width = 640;
+        frame->height = 480;
+        return true;
+    }
+
+    void wake() {
+        pthread_mutex_lock(&mutex_);
+        woken_ = true;
+        pthread_cond_broadcast(&cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    bool canReconnect() { return canReconnect_; }
+
+    bool reconnect() {
+
+        pthread_mutex_lock(&mutex_);
+        attempts_.push_back(hostTimeMicros());
+        bool reconnected = (int)attempts_.size() > failedReconnects_;
+        pthread_mutex_unlock(&mutex_);
+
+        if (reconnected)
+            mode = MODE_FRAMES;
+        return reconnected;
+    }
+
+    vector<uint64_t> attempts() {
+        pthread_mutex_lock(&mutex_);
+        vector<uint64_t> attempts = attempts_;
+        pthread_mutex_unlock(&mutex_);
+        return attempts;
+    }
+
+    const char *name() { return "Stalling"; }
+
+    atomic<int> mode;
+
+private:
+
+    bool canReconnect_;
+    int failedReconnects_;
+    int frameIndex_;                    // Tracking thread
+    bool woken_;
+    vector<uint64_t> attempts_;         // Host time of each reconnect() (us)
+    pthread_mutex_t mutex_;             // Guards woken_ and attempts_
+    pthread_cond_t cond_;
+};
+
+/* Wait up to timeoutUs for the controller to reach state */
+static bool waitForState(SkeletonController *controller, SkeletonController::TrackingState state,
+                         uint64_t timeoutUs) {
+
+    uint64_t deadline = hostTimeMicros() + timeoutUs;
+    while (controller->trackingState() != state && hostTimeMicros() < deadline)
+        usleep(1000);
+
+    return controller->trackingState() == state;
+}
+
+static uint64_t timedStop(SkeletonController *controller) {
+
+    uint64_t start = hostTimeMicros();
+    CHECK(controller->stopTracking());
+    uint64_t elapsed = hostTimeMicros() - start;
+
+    CHECK(controller->trackingState() == SkeletonController::TRACKING_STOPPED);
+    return elapsed;
+}
+
+/* A read blocked on a silent device is woken by stopTracking() */
+static void testStopWhileBlocked() {
+
+    StallingSource source(false, 0);
+    source.mode = StallingSource::MODE_BLOCK;
+
+    SkeletonController *controller = new SkeletonController();
+    controller->setSkeletonSource(&source);
+    CHECK(controller->beginTracking());
+
+    usleep(100000);
+    CHECK(controller->trackingState() == SkeletonController::TRACKING_RUNNING);
+
+    uint64_t elapsed = timedStop(controller);
+    printf("stop with a read blocked: %.1f ms\n", elapsed * 1e-3);
+    CHECK(elapsed < STOP_BOUND_US);
+
+    delete controller;
+}
+
+/* Failing reads stall tracking, frames resume it, and a stop while stalled is prompt */
+static void testStallAndResume() {
+
+    StallingSource source(false, 0);
+
+    SkeletonController *controller = new SkeletonController();
+    controller->setSkeletonSource(&source);
+    CHECK(controller->beginTracking());
+
+    CHECK(waitForState(controller, SkeletonController::TRACKING_RUNNING, 100000));
+    source.mode = StallingSource::MODE_FAIL;
+
+    /* TRACKING_STALL_READS failures, TRACKING_RETRY_MS apart */
+    uint64_t start = hostTimeMicros();
+    CHECK(waitForState(controller, SkeletonController::TRACKING_STALLED, 1000000));
+    uint64_t toStall = hostTimeMicros() - start;
+
+    source.mode = StallingSource::MODE_FRAMES;
+    start = hostTimeMicros();
+    CHECK(waitForState(controller, SkeletonController::TRACKING_RUNNING, 200000));
+    uint64_t toResume = hostTimeMicros() - start;
+
+    source.mode = StallingSource::MODE_FAIL;
+    CHECK(waitForState(controller, SkeletonController::TRACKING_STALLED, 1000000));
+    usleep(50000);
+
+    uint64_t elapsed = timedStop(controller);
+    printf("stalled after %.0f ms, resumed after %.1f ms, stop while stalled %.1f ms\n", toStall * 1e-3,
+           toResume * 1e-3, elapsed * 1e-3);
+
+    CHECK(toStall >= (TRACKING_STALL_READS - 1) * TRACKING_RETRY_MS * 1000);
+    CHECK(elapsed < STOP_BOUND_US);
+
+    delete controller;
+}
+
+/* Reconnection attempts 250, 500 and 1000 ms apart, then frames again */
+static void testBackoff() {
+
+    StallingSource source(true, 3);
+    source.mode = StallingSource::MODE_FAIL;
+
+    SkeletonController *controller = new SkeletonController();
+    controller->setSkeletonSource(&source);
+    CHECK(controller->beginTracking());
+
+    CHECK(waitForState(controller, SkeletonController::TRACKING_STALLED, 1000000));
+    CHECK(waitForState(controller, SkeletonController::TRACKING_RUNNING, 3000000));
+
+    vector<uint64_t> attempts = source.attempts();
+    CHECK(attempts.size() == 4);
+
+    int expected = TRACKING_RECONNECT_MIN_MS;
+    for (size_t i = 1; i < attempts.size(); i++) {
+        int64_t gap = (int64_t)(attempts[i] - attempts[i-1]);
+        printf("reconnect %d after %.1f ms\n", (int)i + 1, gap * 1e-3);
+        CHECK(gap >= expected * 1000 && gap < expected * 1000 + BACKOFF_TOLERANCE_US);
+        expected *= 2;
+    }
+
+    /* Frames keep coming after the reconnect */
+    usleep(100000);
+    CHECK(controller->trackingState() == SkeletonController::TRACKING_RUNNING);
+    CHECK(timedStop(controller) < STOP_BOUND_US);
+
+    delete controller;
+}
+
+/* A stop during the wait between reconnection attempts doesn't wait it out */
+static void testStopMidBackoff() {
+
+    StallingSource source(true, 1000);
+    source.mode = StallingSource::MODE_FAIL;
+
+    SkeletonController *controller = new SkeletonController();
+    controller->setSkeletonSource(&source);
+    CHECK(controller->beginTracking());
+
+    /* Into the 500 ms wait after the second attempt */
+    uint64_t deadline = hostTimeMicros() + 2000000;
+    while (source.attempts().size() < 2 && hostTimeMicros() < deadline)
+        usleep(1000);
+    CHECK(source.attempts().size() == 2);
+    usleep(100000);
+
+    CHECK(controller->trackingState() == SkeletonController::TRACKING_STALLED);
+    uint64_t elapsed = timedStop(controller);
+    printf("stop mid-backoff: %.1f ms\n", elapsed * 1e-3);
+    CHECK(elapsed < STOP_BOUND_US);
+    CHECK(source.attempts().size() == 2);
+
+    delete controller;
+}
+
+int main(int argc, const char *argv[]) {
+
+    for (unsigned int seed = 1; seed <= 3; seed++)
+        testTransmitOff(seed);
+    testNoSender();
+
+    testStopWhileBlocked();
+    testStallAndResume();
+    testBackoff();
+    testStopMidBackoff();
+
+    return testResult("SkeletonControllerTests");
+}
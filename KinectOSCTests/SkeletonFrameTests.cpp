@@ -0,0 +1,132 @@
+//
+//  SkeletonFrameTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Serialized frames at the size limit: a frame of SKELETON_MAX_USERS users must fit in
+//  SKELETON_FRAME_MAX_BYTES and come back bit-identical, directly and through a recording.
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "SkeletonFrame.h"
+#include "SkeletonSource.h"
+#include "TestCheck.h"
+
+static void fillFrame(SkeletonFrame *frame, int nUsers, int seed) {
+
+    clearSkeletonFrame(frame);
+    frame->timestamp = 0x0123456789abcdefULL + seed;
+    frame->hostTime = 0xfedcba9876543210ULL - seed;
+    frame->frameIndex = 100000 + seed;
+    frame->sensorId = 3;
+    frame->width = 640;
+    frame->height = 480;
+    frame->nUsers = nUsers;
+
+    for (int i = 0; i < nUsers; i++) {
+        SkeletonUser &user = frame->users[i];
+        user.id = i + 1;
+        user.flags = USER_VISIBLE | USER_TRACKED | (i == 0 ? USER_NEW : 0);
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+            float k = (float)(seed * 1000 + i * SKELETON_NUM_JOINTS + j);
+            user.x[j] = k * 1.5f - 700;
+            user.y[j] = -k * 0.25f;
+            user.z[j] = 2000 + k;
+            user.confidence[j] = (j % 3) * 0.5f;
+            user.u[j] = k / 7;
+            user.v[j] = k / 11;
+        }
+    }
+}
+
+static bool sameFrame(const SkeletonFrame &a, const SkeletonFrame &b) {
+
+    if (a.timestamp != b.timestamp || a.hostTime != b.hostTime || a.frameIndex != b.frameIndex ||
+        a.sensorId != b.sensorId || a.width != b.width || a.height != b.height || a.nUsers != b.nUsers)
+        return false;
+
+    for (int i = 0; i < a.nUsers; i++) {
+        if (memcmp(&a.users[i], &b.users[i], sizeof(SkeletonUser)))
+            return false;
+    }
+
+    return true;
+}
+
+static void testFullFrame() {
+
+    SkeletonFrame frame, decoded;
+    fillFrame(&frame, SKELETON_MAX_USERS, 1);
+
+    uint8_t buffer[SKELETON_FRAME_MAX_BYTES];
+    int length = serializeFrame(&frame, buffer, sizeof(buffer));
+
+    CHECK(length == SKELETON_FRAME_MAX_BYTES);
+    CHECK(length == serializedFrameSize(&frame));
+    CHECK(deserializeFrame(buffer, length, &decoded));
+    CHECK(sameFrame(frame, decoded));
+
+    /* One byte short either way fails cleanly */
+    CHECK(serializeFrame(&frame, buffer, length - 1) == -1);
+    CHECK(!deserializeFrame(buffer, length - 1, &decoded));
+    CHECK(!deserializeFrame(buffer, SKELETON_FRAME_HEADER_BYTES - 1, &decoded));
+}
+
+static void testEveryUserCount() {
+
+    for (int n = 0; n <= SKELETON_MAX_USERS; n++) {
+        SkeletonFrame frame, decoded;
+        fillFrame(&frame, n, n);
+
+        uint8_t buffer[SKELETON_FRAME_MAX_BYTES];
+        int length = serializeFrame(&frame, buffer, sizeof(buffer));
+        CHECK(length == SKELETON_FRAME_HEADER_BYTES + n * SKELETON_FRAME_USER_BYTES);
+        CHECK(deserializeFrame(buffer, length, &decoded) && sameFrame(frame, decoded));
+    }
+}
+
+static void testRecording() {
+
+    char path[] = "/tmp/SkeletonFrameTests-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    close(fd);
+
+    const int nFrames = 4;
+    SkeletonFileWriter writer;
+    CHECK(writer.open(path));
+    for (int k = 0; k < nFrames; k++) {
+        SkeletonFrame frame;
+        fillFrame(&frame, SKELETON_MAX_USERS, k);
+        CHECK(writer.writeFrame(&frame));
+    }
+    writer.close();
+
+    ReplaySkeletonSource replay;
+    CHECK(replay.open(path));
+    CHECK(replay.numFrames() == nFrames);
+    replay.setRealtime(false);
+
+    for (int k = 0; k < nFrames; k++) {
+        SkeletonFrame expected, frame;
+        fillFrame(&expected, SKELETON_MAX_USERS, k);
+        CHECK(replay.readFrame(&frame));
+        expected.hostTime = frame.hostTime;         // Replay stamps its own
+        CHECK(sameFrame(expected, frame));
+    }
+
+    unlink(path);
+}
+
+int main(int argc, const char *argv[]) {
+
+    testFullFrame();
+    testEveryUserCount();
+    testRecording();
+
+    return testResult("SkeletonFrameTests");
+}
@@ -0,0 +1,81 @@
+//
+//  SkeletonFusionBench.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Time per fused frame of SkeletonFusion::fuse() for one to FUSION_MAX_SENSORS sensors,
+//  each seeing the same performers, with two performers and with a full stage. Every
+//  sensor's previous frame is given, so each view is also carried forward in time.
+
+#include <stdlib.h>
+#include <vector>
+
+#include "SkeletonFusion.h"
+#include "SkeletonSource.h"
+#include "Utility.h"
+
+#define BENCH_FRAMES 300
+#define BENCH_REPEATS 20
+
+using namespace std;
+
+static void report(int nSensors, int nUsers, uint64_t ns) {
+
+    double perFrame = (double)ns / (BENCH_FRAMES * BENCH_REPEATS);
+    printf("%d sensors, %d users  %8.0f ns/frame  %5.0f ns/view\n", nSensors, nUsers, perFrame,
+           perFrame / (nSensors * nUsers));
+}
+
+int main(int argc, const char *argv[]) {
+
+    volatile float sink = 0;        // Keeps the results live
+    const int users[] = { 2, SKELETON_MAX_USERS };
+
+    for (int u = 0; u < 2; u++) {
+
+        int nUsers = users[u];
+
+        /* Each sensor's own noise, with its frames a few ms apart as unsynchronized devices are */
+        vector<vector<SkeletonFrame> > frames(FUSION_MAX_SENSORS, vector<SkeletonFrame>(BENCH_FRAMES));
+        for (int s = 0; s < FUSION_MAX_SENSORS; s++) {
+            SyntheticSkeletonSource source(nUsers, 30, s + 1);
+            source.setRealtime(false);
+            for (int f = 0; f < BENCH_FRAMES; f++) {
+                source.readFrame(&frames[s][f]);
+                frames[s][f].hostTime = 1000000 + (uint64_t)f * 33333 + s * 4000;
+            }
+        }
+
+        for (int nSensors = 1; nSensors <= FUSION_MAX_SENSORS; nSensors++) {
+
+            SkeletonFusion fusion;
+            SkeletonFrame out;
+
+            /* The first pass warms up; the second is reported */
+            for (int pass = 0; pass < 2; pass++) {
+
+                uint64_t start = hostTimeNanos();
+                for (int r = 0; r < BENCH_REPEATS; r++) {
+                    for (int f = 0; f < BENCH_FRAMES; f++) {
+
+                        const SkeletonFrame *latest[FUSION_MAX_SENSORS];
+                        const SkeletonFrame *previous[FUSION_MAX_SENSORS];
+                        for (int s = 0; s < nSensors; s++) {
+                            latest[s] = &frames[s][f];
+                            previous[s] = f ? &frames[s][f - 1] : NULL;
+                        }
+
+                        fusion.fuse(latest, previous, nSensors, &out);
+                        sink += out.users[0].x[SKEL_TORSO];
+                    }
+                }
+
+                if (pass)
+                    report(nSensors, nUsers, hostTimeNanos() - start);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,353 @@
+//
+//  SkeletonFusionTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  SkeletonFusion on hand-built frames: views of one performer from several sensors merge
+//  by confidence, performers and views too far apart stay separate, ids hold from frame to
+//  frame, and a performer who leaves is reported lost once with nothing left over from the
+//  slot's last occupant. Then one performer seen by two sensors set at right angles,
+//  through MultiDeviceManager, must come out as one user only once the second sensor's
+//  extrinsics are set.
+
+#include <math.h>
+
+#include "SkeletonFusion.h"
+#include "MultiDeviceManager.h"
+#include "TestCheck.h"
+
+#define FRAME_US 33333
+
+/* Joints stacked above the torso, 50 mm apart, all with the same confidence */
+static void placeUser(SkeletonFrame *frame, int id, float x, float y, float z, float confidence) {
+
+    SkeletonUser &user = frame->users[frame->nUsers++];
+    memset(&user, 0, sizeof(user));
+    user.id = id;
+    user.flags = USER_VISIBLE | USER_TRACKED;
+
+    for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+        user.x[j] = x;
+        user.y[j] = y + (j - SKEL_TORSO) * 50;
+        user.z[j] = z;
+        user.confidence[j] = confidence;
+    }
+}
+
+static void startFrame(SkeletonFrame *frame, uint64_t hostTime) {
+
+    clearSkeletonFrame(frame);
+    frame->timestamp = hostTime;
+    frame->hostTime = hostTime;
+    frame->width = 640;
+    frame->height = 480;
+}
+
+static int numTracked(const SkeletonFrame *frame) {
+
+    int n = 0;
+    for (int i = 0; i < frame->nUsers; i++)
+        n += (frame->users[i].flags & USER_TRACKED) != 0;
+    return n;
+}
+
+static const SkeletonUser *findUser(const SkeletonFrame *frame, int id) {
+
+    for (int i = 0; i < frame->nUsers; i++) {
+        if (frame->users[i].id == id)
+            return &frame->users[i];
+    }
+    return NULL;
+}
+
+static void testConfidenceWeighting() {
+
+    SkeletonFusion fusion;
+    SkeletonFrame a, b, out;
+    startFrame(&a, 1000000);
+    startFrame(&b, 1000000);
+    placeUser(&a, 1, 0, 0, 2500, 1);
+    placeUser(&b, 7, 100, 0, 2600, 0.25f);
+
+    /* Only the second sensor sees the right hand; neither sees the head */
+    a.users[0].confidence[SKEL_HAND_R] = 0;
+    a.users[0].confidence[SKEL_HEAD] = 0;
+    b.users[0].confidence[SKEL_HEAD] = 0;
+
+    const SkeletonFrame *latest[] = { &a, &b };
+    const SkeletonFrame *previous[] = { NULL, NULL };
+    fusion.fuse(latest, previous, 2, &out);
+
+    CHECK(out.nUsers == 1 && numTracked(&out) == 1);
+    const SkeletonUser &user = out.users[0];
+
+    /* Four parts of the first view to one of the second */
+    CHECK_NEAR(user.x[SKEL_TORSO], 20, 1e-3f);
+    CHECK_NEAR(user.z[SKEL_TORSO], 2520, 1e-3f);
+    CHECK_NEAR(user.confidence[SKEL_TORSO], 1, 1e-6f);
+
+    /* Joints seen by one sensor come from it; joints seen by none from the surer view */
+    CHECK_NEAR(user.x[SKEL_HAND_R], 100, 1e-3f);
+    CHECK_NEAR(user.confidence[SKEL_HAND_R], 0.25f, 1e-6f);
+    CHECK_NEAR(user.x[SKEL_HEAD], 0, 1e-3f);
+    CHECK(user.confidence[SKEL_HEAD] == 0);
+
+    /* Fused ids are the fusion's own, and the u/v follow the fused joints */
+    CHECK(user.id == 1 && (user.flags & USER_NEW));
+    float u, v;
+    projectToDepthImage(user.x[SKEL_TORSO], user.y[SKEL_TORSO], user.z[SKEL_TORSO], 640, 480, &u, &v);
+    CHECK_NEAR(user.u[SKEL_TORSO], u, 1e-3f);
+    CHECK_NEAR(user.v[SKEL_TORSO], v, 1e-3f);
+}
+
+static void testAssociation() {
+
+    const SkeletonFrame *previous[] = { NULL, NULL };
+    SkeletonFrame a, b, out;
+
+    /* Two performers a metre apart, each seen by both sensors with 150 mm of calibration error */
+    SkeletonFusion fusion;
+    startFrame(&a, 1000000);
+    startFrame(&b, 1000000);
+    placeUser(&a, 1, -500, 0, 2500, 1);
+    placeUser(&a, 2, 500, 0, 2500, 1);
+    placeUser(&b, 1, 650, 0, 2500, 0.8f);
+    placeUser(&b, 2, -350, 0, 2500, 0.8f);
+
+    const SkeletonFrame *latest[] = { &a, &b };
+    fusion.fuse(latest, previous, 2, &out);
+    CHECK(out.nUsers == 2 && numTracked(&out) == 2);
+
+    float left = fminf(out.users[0].x[SKEL_TORSO], out.users[1].x[SKEL_TORSO]);
+    float right = fmaxf(out.users[0].x[SKEL_TORSO], out.users[1].x[SKEL_TORSO]);
+    CHECK_NEAR(left, (-500 - 350 * 0.8f) / 1.8f, 1e-2f);
+    CHECK_NEAR(right, (500 + 650 * 0.8f) / 1.8f, 1e-2f);
+
+    /* Two performers 200 mm apart in one sensor's view are never merged */
+    SkeletonFusion close;
+    startFrame(&a, 1000000);
+    placeUser(&a, 1, 0, 0, 2500, 1);
+    placeUser(&a, 2, 200, 0, 2500, 1);
+    close.fuse(latest, previous, 1, &out);
+    CHECK(numTracked(&out) == 2);
+
+    /* Views of one performer further apart than the association radius stay two */
+    SkeletonFusion apart;
+    apart.setAssociationRadius(400);
+    startFrame(&a, 1000000);
+    startFrame(&b, 1000000);
+    placeUser(&a, 1, 0, 0, 2500, 1);
+    placeUser(&b, 1, 450, 0, 2500, 1);
+    apart.fuse(latest, previous, 2, &out);
+    CHECK(numTracked(&out) == 2);
+
+    /* A sensor whose frame is outside the alignment window is left out */
+    SkeletonFusion stale;
+    stale.setAlignmentWindow(100000);
+    startFrame(&a, 1000000);
+    startFrame(&b, 1000000 - 150000);
+    placeUser(&a, 1, 0, 0, 2500, 1);
+    placeUser(&b, 1, 100, 0, 2500, 1);
+    stale.fuse(latest, previous, 2, &out);
+    CHECK(out.nUsers == 1 && out.hostTime == 1000000);
+    CHECK_NEAR(out.users[0].x[SKEL_TORSO], 0, 1e-3f);
+}
+
+/* A sensor's view is carried forward from its last two frames to the newest sensor's time */
+static void testAlignment() {
+
+    SkeletonFusion fusion;
+    SkeletonFrame a, b, bBefore, out;
+
+    startFrame(&a, 1000000);
+    placeUser(&a, 1, 0, 0, 2500, 1);
+
+    /* Walking right at 30 mm a frame, last seen 10 ms before the other sensor's frame */
+    startFrame(&bBefore, 1000000 - 10000 - FRAME_US);
+    startFrame(&b, 1000000 - 10000);
+    placeUser(&bBefore, 4, 70, 0, 2500, 1);
+    placeUser(&b, 4, 100, 0, 2500, 1);
+
+    const SkeletonFrame *latest[] = { &a, &b };
+    const SkeletonFrame *previous[] = { NULL, &bBefore };
+    fusion.fuse(latest, previous, 2, &out);
+
+    float carried = 100 + 30 * 10000.0f / FRAME_US;
+    CHECK(out.nUsers == 1);
+    CHECK_NEAR(out.users[0].x[SKEL_TORSO], carried / 2, 1e-2f);
+}
+
+static void testIdsAndLoss() {
+
+    SkeletonFusion fusion;
+    SkeletonFrame a, b, out;
+    const SkeletonFrame *latest[] = { &a, &b };
+    const SkeletonFrame *previous[] = { NULL, NULL };
+    int firstIds[2] = {0, 0};
+    bool stable = true, newOnlyFirst = true;
+
+    /* Two performers walking slowly towards each other, seen by both sensors */
+    for (int f = 0; f < 60; f++) {
+
+        uint64_t t = 1000000 + (uint64_t)f * FRAME_US;
+        startFrame(&a, t);
+        startFrame(&b, t);
+        placeUser(&a, 1, -800 + f * 5, 0, 2500, 1);
+        placeUser(&a, 2, 800 - f * 5, 0, 2500, 1);
+        placeUser(&b, 3, 800 - f * 5 + 40, 0, 2480, 0.5f);
+        placeUser(&b, 4, -800 + f * 5 + 40, 0, 2480, 0.5f);
+        fusion.fuse(latest, previous, 2, &out);
+
+        CHECK(out.nUsers == 2 && numTracked(&out) == 2);
+        for (int i = 0; i < out.nUsers; i++) {
+            int side = out.users[i].x[SKEL_TORSO] < 0 ? 0 : 1;
+            if (f == 0)
+                firstIds[side] = out.users[i].id;
+            stable = stable && out.users[i].id == firstIds[side];
+            newOnlyFirst = newOnlyFirst && ((out.users[i].flags & USER_NEW) != 0) == (f == 0);
+        }
+    }
+
+    CHECK(stable && newOnlyFirst);
+    CHECK(firstIds[0] != firstIds[1] && firstIds[0] > 0 && firstIds[1] > 0);
+
+    /* The performer on the right leaves both views. The frame is reused, so the slot the
+       lost entry lands in held a tracked user last time. */
+    int lostId = firstIds[1];
+    uint64_t t = 1000000 + 60ull * FRAME_US;
+    startFrame(&a, t);
+    startFrame(&b, t);
+    placeUser(&a, 1, -500, 0, 2500, 1);
+    placeUser(&b, 4, -460, 0, 2480, 0.5f);
+    fusion.fuse(latest, previous, 2, &out);
+
+    CHECK(out.nUsers == 2 && numTracked(&out) == 1);
+    const SkeletonUser *lost = findUser(&out, lostId);
+    CHECK(lost && lost->flags == USER_LOST);
+
+    if (lost) {
+        SkeletonUser cleared;
+        memset(&cleared, 0, sizeof(cleared));
+        cleared.id = lostId;
+        cleared.flags = USER_LOST;
+        CHECK(!memcmp(lost, &cleared, sizeof(cleared)));
+    }
+
+    /* Lost is reported once */
+    startFrame(&a, t + FRAME_US);
+    startFrame(&b, t + FRAME_US);
+    placeUser(&a, 1, -500, 0, 2500, 1);
+    fusion.fuse(latest, previous, 2, &out);
+    CHECK(out.nUsers == 1 && out.users[0].id == firstIds[0]);
+
+    /* Someone coming back where the lost performer was is someone new */
+    startFrame(&a, t + 2 * FRAME_US);
+    placeUser(&a, 1, -500, 0, 2500, 1);
+    placeUser(&a, 2, 500, 0, 2500, 1);
+    fusion.fuse(latest, previous, 2, &out);
+    const SkeletonUser *returned = NULL;
+    for (int i = 0; i < out.nUsers; i++) {
+        if (out.users[i].x[SKEL_TORSO] > 0)
+            returned = &out.users[i];
+    }
+    CHECK(returned && returned->id != lostId && returned->id != firstIds[0] && (returned->flags & USER_NEW));
+}
+
+/* Sensor 1 stands 2.8 m to the right of the origin, 2.5 m out, looking back along -x */
+static const float kSideWorldToSensor[3][4] = {
+    {  0, 0, 1, -2500 },
+    {  0, 1, 0,     0 },
+    { -1, 0, 0,  2800 }
+};
+static const float kSideSensorToWorld[3][4] = {
+    {  0, 0, -1, 2800 },
+    {  0, 1,  0,    0 },
+    {  1, 0,  0, 2500 }
+};
+
+/* Fused frames over about half a second. Returns the number of frames read. */
+static int runOffsetSensors(bool calibrated, int *maxUsers, int *nIds, float *worstError) {
+
+    MultiDeviceManager manager;
+
+    for (int s = 0; s < 2; s++) {
+        SyntheticSkeletonSource *source = new SyntheticSkeletonSource(1, 30, s + 1);
+        source->setUserPosition(0, -500, 0, 3000);
+        if (s == 1)
+            source->setSensorPose(kSideWorldToSensor);
+        manager.addSource(source);
+    }
+    if (calibrated)
+        manager.setExtrinsics(1, kSideSensorToWorld);
+
+    if (!manager.start())
+        return 0;
+
+    SkeletonFrame frame;
+    int nFrames = 0, ids[64], nSeen = 0;
+    uint64_t start = hostTimeMicros();
+    *maxUsers = 0;
+    *worstError = 0;
+
+    while (hostTimeMicros() - start < 500000) {
+
+        if (!manager.readFusedFrame(&frame, 100))
+            continue;
+
+        nFrames++;
+        *maxUsers = frame.nUsers > *maxUsers ? frame.nUsers : *maxUsers;
+
+        for (int i = 0; i < frame.nUsers; i++) {
+
+            const SkeletonUser &user = frame.users[i];
+            bool seen = false;
+            for (int k = 0; k < nSeen; k++)
+                seen = seen || ids[k] == user.id;
+            if (!seen && nSeen < 64)
+                ids[nSeen++] = user.id;
+
+            /* The synthetic performer sways up to 40 mm along x and has 5 mm of noise */
+            if (user.flags & USER_TRACKED) {
+                float error = fmaxf(fabsf(user.x[SKEL_TORSO] + 500) - 40, 0);
+                error = fmaxf(error, fabsf(user.y[SKEL_TORSO]));
+                error = fmaxf(error, fabsf(user.z[SKEL_TORSO] - 3000));
+                *worstError = fmaxf(*worstError, error);
+            }
+        }
+    }
+
+    manager.stop();
+    *nIds = nSeen;
+    return nFrames;
+}
+
+static void testOffsetSensors() {
+
+    int maxUsers, nIds;
+    float worstError;
+
+    int nFrames = runOffsetSensors(true, &maxUsers, &nIds, &worstError);
+    printf("calibrated: %d fused frames, at most %d users, %d ids, torso within %.1f mm\n", nFrames, maxUsers,
+           nIds, worstError);
+    CHECK(nFrames >= 10);
+    CHECK(maxUsers == 1 && nIds == 1);
+    CHECK(worstError < 15);
+
+    /* Left in its own frame, the side sensor's view lands a metre away: a second performer */
+    nFrames = runOffsetSensors(false, &maxUsers, &nIds, &worstError);
+    printf("uncalibrated: %d fused frames, at most %d users, %d ids\n", nFrames, maxUsers, nIds);
+    CHECK(nFrames >= 10);
+    CHECK(maxUsers == 2 && nIds == 2);
+}
+
+int main(int argc, const char *argv[]) {
+
+    testConfidenceWeighting();
+    testAssociation();
+    testAlignment();
+    testIdsAndLoss();
+    testOffsetSensors();
+
+    return testResult("SkeletonFusionTests");
+}
@@ -0,0 +1,296 @@
+//
+//  SkeletonStreamTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Encoder/decoder round trips of MotionGenerator performances: every joint back within
+//  the 0.5 mm of 1 mm quantization, with ids, flags, confidences and timing intact, at a
+//  fraction of the bandwidth of sending each joint as its own float OSC message. Then
+//  joint subsets, packet loss, which must cost only the packets up to the next keyframe,
+//  and truncated, corrupt and foreign packets, which must be refused without crashing.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SkeletonStream.h"
+#include "MotionGenerator.h"
+#include "TestCheck.h"
+
+#define STREAM_USERS 3
+#define STREAM_FRAMES 9000              // Five minutes at 30 fps
+#define STREAM_CONF_THRESH 0.6f
+#define STREAM_MAX_ERROR 0.5f
+#define NAIVE_OSC_ADDRESS "/kinectosc/joint"
+#define NAIVE_OSC_TYPES ",iifff"        // User id, joint, x y z
+
+/* Bytes of an OSC message: address and type tags padded to four bytes, then the arguments */
+static int oscMessageBytes(const char *address, const char *types) {
+
+    int nArgs = (int)strlen(types) - 1;
+    return (((int)strlen(address) + 4) & ~3) + (((int)strlen(types) + 4) & ~3) + nArgs * 4;
+}
+
+static int numTracked(const SkeletonFrame &frame) {
+
+    int n = 0;
+    for (int i = 0; i < frame.nUsers; i++) {
+        if (frame.users[i].flags & USER_TRACKED)
+            n++;
+    }
+    return n;
+}
+
+/* Decode from a heap copy of exactly length bytes, so ASan sees any read past the end */
+static bool decodeExact(SkeletonStreamDecoder *decoder, const uint8_t *packet, int length, SkeletonFrame *frame) {
+
+    uint8_t *exact = (uint8_t *)malloc(length ? length : 1);
+    memcpy(exact, packet, length);
+    bool decoded = decoder->decode(exact, length, frame);
+    free(exact);
+
+    return decoded;
+}
+
+/* Compare a decoded frame with the tracked users of the original. Returns the largest
+   coordinate error over the joints in the mask, and adds up all of them. */
+static float compareFrames(const SkeletonFrame &in, const SkeletonFrame &out, int jointMask, double *sumError,
+                           long *nErrors) {
+
+    CHECK(out.timestamp == in.timestamp && out.frameIndex == in.frameIndex);
+    CHECK(out.nUsers == numTracked(in));
+
+    float maxError = 0;
+    int k = 0;
+
+    for (int i = 0; i < in.nUsers && k < out.nUsers; i++) {
+
+        const SkeletonUser &a = in.users[i];
+        if (!(a.flags & USER_TRACKED))
+            continue;
+        const SkeletonUser &b = out.users[k++];
+
+        CHECK(b.id == a.id && b.flags == (a.flags & 0x0f));
+
+        for (int j = 0; j < SKELETON_NUM_JOINTS; j++) {
+
+            if (!(jointMask & (1 << j))) {
+                CHECK(b.confidence[j] == 0 && b.x[j] == 0 && b.y[j] == 0 && b.z[j] == 0);
+                continue;
+            }
+
+            float error = fmaxf(fabsf(a.x[j] - b.x[j]), fmaxf(fabsf(a.y[j] - b.y[j]), fabsf(a.z[j] - b.z[j])));
+            maxError = fmaxf(maxError, error);
+            *sumError += error;
+            (*nErrors)++;
+
+            CHECK((a.confidence[j] > STREAM_CONF_THRESH) == (b.confidence[j] > 0));
+        }
+    }
+
+    return maxError;
+}
+
+static void testRoundTrip() {
+
+    MotionGenerator generator(STREAM_USERS, 30, 7);
+    generator.setRealtime(false);
+    generator.setNoise(3);
+
+    const int subsetMask = (1 << SKEL_HAND_L) | (1 << SKEL_HAND_R) | (1 << SKEL_HEAD);
+    SkeletonStreamEncoder encoder, subsetEncoder(subsetMask);
+    SkeletonStreamDecoder decoder, subsetDecoder;
+
+    uint8_t packet[SKELETON_STREAM_MAX_BYTES];
+    SkeletonFrame frame, decoded;
+    long bytes = 0, subsetBytes = 0, naiveBytes = 0, userFrames = 0, nErrors = 0;
+    double sumError = 0;
+    float maxError = 0;
+    int nFailed = 0;
+
+    for (int f = 0; f < STREAM_FRAMES; f++) {
+
+        generator.readFrame(&frame);
+
+        int n = encoder.encode(&frame, STREAM_CONF_THRESH, packet, sizeof(packet));
+        CHECK(n > 0);
+        if (n <= 0 || !decoder.decode(packet, n, &decoded)) {
+            nFailed++;
+            continue;
+        }
+        maxError = fmaxf(maxError, compareFrames(frame, decoded, SKELETON_STREAM_ALL_JOINTS, &sumError, &nErrors));
+
+        uint16_t sequence;
+        uint64_t timestamp;
+        CHECK(SkeletonStreamDecoder::readHeader(packet, n, &sequence, &timestamp));
+        CHECK(sequence == (uint16_t)f && timestamp == frame.timestamp);
+
+        int m = subsetEncoder.encode(&frame, STREAM_CONF_THRESH, packet, sizeof(packet));
+        double subsetSum = 0;
+        long nSubset = 0;
+        CHECK(m > 0 && subsetDecoder.decode(packet, m, &decoded));
+        CHECK(compareFrames(frame, decoded, subsetMask, &subsetSum, &nSubset) <= STREAM_MAX_ERROR);
+        CHECK(subsetDecoder.jointMask() == subsetMask);
+
+        int tracked = numTracked(frame);
+        bytes += n;
+        subsetBytes += m;
+        naiveBytes += tracked * SKELETON_NUM_JOINTS * oscMessageBytes(NAIVE_OSC_ADDRESS, NAIVE_OSC_TYPES);
+        userFrames += tracked;
+    }
+
+    double perUser = (double)bytes / userFrames;
+    double subsetPerUser = (double)subsetBytes / userFrames;
+    double naivePerUser = (double)naiveBytes / userFrames;
+
+    printf("%ld user-frames: error max %.3f mm, mean %.3f mm\n", userFrames, maxError, sumError / nErrors);
+    printf("bytes per user per frame: stream %.1f, three joints %.1f, float OSC per joint %.1f (%.1fx the stream)\n",
+           perUser, subsetPerUser, naivePerUser, naivePerUser / perUser);
+
+    CHECK(nFailed == 0 && decoder.numDropped() == 0);
+    CHECK(userFrames > STREAM_FRAMES * STREAM_USERS / 2);
+    CHECK(maxError <= STREAM_MAX_ERROR);
+    CHECK_NEAR(sumError / nErrors, 0.375, 0.02);      // Largest of three errors uniform in +/- 0.5 mm
+    CHECK(perUser * 8 < naivePerUser);
+    CHECK(subsetPerUser * 2 < perUser);
+}
+
+/* Lost packets cost the deltas up to the next keyframe and nothing else */
+static void testLoss() {
+
+    const int keyframeInterval = 10;
+
+    MotionGenerator generator(STREAM_USERS, 30, 11);
+    generator.setRealtime(false);
+
+    SkeletonStreamEncoder encoder(SKELETON_STREAM_ALL_JOINTS, keyframeInterval);
+    SkeletonStreamDecoder decoder;
+    uint8_t packet[SKELETON_STREAM_MAX_BYTES];
+    SkeletonFrame frame, decoded;
+    double sumError = 0;
+    long nErrors = 0;
+    int nLost = 0, nDecoded = 0, nExpectedDrops = 0;
+    bool synced = true;
+
+    srand(3);
+
+    for (int f = 0; f < 3000; f++) {
+
+        generator.readFrame(&frame);
+        int n = encoder.encode(&frame, STREAM_CONF_THRESH, packet, sizeof(packet));
+        bool keyframe = f % keyframeInterval == 0;
+
+        if (rand() % 100 < 5) {
+            nLost++;
+            synced = false;
+            continue;
+        }
+
+        bool ok = decoder.decode(packet, n, &decoded);
+        if (keyframe)
+            synced = true;
+        else if (!synced)
+            nExpectedDrops++;
+
+        CHECK(ok == synced);
+        if (ok) {
+            CHECK(compareFrames(frame, decoded, SKELETON_STREAM_ALL_JOINTS, &sumError, &nErrors) <= STREAM_MAX_ERROR);
+            nDecoded++;
+        }
+    }
+
+    printf("5%% loss: %d lost, %d dropped waiting for a keyframe, %d decoded\n", nLost, decoder.numDropped(), nDecoded);
+    CHECK(nLost > 0 && nExpectedDrops > 0);
+    CHECK(decoder.numDropped() == nExpectedDrops);
+
+    /* A decoder joining mid-stream waits for a keyframe; reset() sends one at once */
+    SkeletonStreamDecoder late;
+    generator.readFrame(&frame);
+    encoder.encode(&frame, STREAM_CONF_THRESH, packet, sizeof(packet));
+    generator.readFrame(&frame);
+    int n = encoder.encode(&frame, STREAM_CONF_THRESH, packet, sizeof(packet));
+    CHECK(!late.decode(packet, n, &decoded) && late.numDropped() == 1);
+    encoder.reset();
+    generator.readFrame(&frame);
+    n = encoder.encode(&frame, STREAM_CONF_THRESH, packet, sizeof(packet));
+    CHECK(late.decode(packet, n, &decoded));
+}
+
+static void testMalformed() {
+
+    MotionGenerator generator(SKELETON_MAX_USERS, 30, 5);
+    generator.setRealtime(false);
+
+    SkeletonStreamEncoder encoder;
+    uint8_t keyframe[SKELETON_STREAM_MAX_BYTES], delta[SKELETON_STREAM_MAX_BYTES], copy[SKELETON_STREAM_MAX_BYTES];
+    SkeletonFrame frame, decoded;
+
+    /* A keyframe and the delta after it, both with users */
+    int nKeyframe = 0, nDelta = 0;
+    while (nKeyframe <= SKELETON_STREAM_HEADER_BYTES || nDelta <= SKELETON_STREAM_HEADER_BYTES) {
+        generator.readFrame(&frame);
+        encoder.reset();
+        nKeyframe = encoder.encode(&frame, STREAM_CONF_THRESH, keyframe, sizeof(keyframe));
+        generator.readFrame(&frame);
+        nDelta = encoder.encode(&frame, STREAM_CONF_THRESH, delta, sizeof(delta));
+    }
+
+    /* Too little room is refused up front */
+    CHECK(encoder.encode(&frame, STREAM_CONF_THRESH, copy, SKELETON_STREAM_HEADER_BYTES) == -1);
+
+    /* Every truncation is refused */
+    for (int length = 0; length < nKeyframe; length++) {
+        SkeletonStreamDecoder decoder;
+        CHECK(!decodeExact(&decoder, keyframe, length, &decoded));
+    }
+    for (int length = 0; length < nDelta; length++) {
+        SkeletonStreamDecoder decoder;
+        CHECK(decoder.decode(keyframe, nKeyframe, &decoded));
+        CHECK(!decodeExact(&decoder, delta, length, &decoded));
+    }
+
+    /* Foreign headers */
+    SkeletonStreamDecoder decoder;
+    uint16_t sequence;
+    uint64_t timestamp;
+    const int badBytes[] = { 0, 1, 2, 20 };       // Magic, version, user count
+    const uint8_t badValues[] = { 'X', 'X', SKELETON_STREAM_VERSION + 1, SKELETON_MAX_USERS + 1 };
+    for (int i = 0; i < 4; i++) {
+        memcpy(copy, keyframe, nKeyframe);
+        copy[badBytes[i]] = badValues[i];
+        CHECK(!decoder.decode(copy, nKeyframe, &decoded));
+    }
+    CHECK(!SkeletonStreamDecoder::readHeader(keyframe, SKELETON_STREAM_HEADER_BYTES - 1, &sequence, &timestamp));
+
+    /* A delta with another joint mask than its keyframe is refused */
+    memcpy(copy, delta, nDelta);
+    copy[6] ^= 1 << SKEL_HEAD;
+    CHECK(decoder.decode(keyframe, nKeyframe, &decoded));
+    CHECK(!decoder.decode(copy, nDelta, &decoded));
+
+    /* Flipped bits either decode or are refused; run under ASan to see that nothing is
+       read out of bounds */
+    srand(9);
+    int nRefused = 0;
+    for (int k = 0; k < 5000; k++) {
+        const uint8_t *source = k & 1 ? delta : keyframe;
+        int n = k & 1 ? nDelta : nKeyframe;
+        memcpy(copy, source, n);
+        for (int flips = 1 + rand() % 3; flips > 0; flips--)
+            copy[rand() % n] ^= 1 << (rand() % 8);
+        CHECK(decoder.decode(keyframe, nKeyframe, &decoded));
+        if (!decodeExact(&decoder, copy, n - rand() % 4, &decoded))
+            nRefused++;
+    }
+    CHECK(nRefused > 0);
+}
+
+int main(int argc, const char *argv[]) {
+
+    testRoundTrip();
+    testLoss();
+    testMalformed();
+
+    return testResult("SkeletonStreamTests");
+}
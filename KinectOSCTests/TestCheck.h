@@ -0,0 +1,44 @@
+//
+//  TestCheck.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Minimal checks for the command-line tests in this directory. Each test is its own
+//  program that returns testResult() from main(), so "make check" stops at the first
+//  one that fails.
+
+#ifndef __KinectOSC__TestCheck__
+#define __KinectOSC__TestCheck__
+
+#include <stdio.h>
+#include <math.h>
+
+static int gTestFailures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        gTestFailures++; \
+    } \
+} while (0)
+
+#define CHECK_NEAR(a, b, tolerance) do { \
+    double a_ = (a), b_ = (b); \
+    if (!(fabs(a_ - b_) <= (tolerance))) { \
+        printf("%s:%d: CHECK_NEAR(%s, %s) failed: %g vs %g\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+        gTestFailures++; \
+    } \
+} while (0)
+
+inline int testResult(const char *name) {
+
+    if (gTestFailures)
+        printf("%s: %d check%s failed\n", name, gTestFailures, gTestFailures == 1 ? "" : "s");
+    else
+        printf("%s: ok\n", name);
+
+    return gTestFailures ? 1 : 0;
+}
+
+#endif /* defined(__KinectOSC__TestCheck__) */
@@ -0,0 +1,305 @@
+//
+//  VoiceManagerTests.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Model-based fuzzing of VoiceManager. Random note-ons, note-offs, touches, departures
+//  and frames are applied both to the manager and to a plain model of what each limb
+//  holds, and after every operation the two must agree on the notes held and on the
+//  note-ons and note-offs sent. With more users than slots, where users are evicted, the
+//  note messages are checked for balance instead.
+
+#include <stdlib.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "VoiceManager.h"
+#include "TestCheck.h"
+
+using namespace std;
+
+struct NoteEvent {
+    int note;
+    int velocity;
+    bool operator<(const NoteEvent &other) const {
+        return note != other.note ? note < other.note : velocity < other.velocity;
+    }
+    bool operator==(const NoteEvent &other) const {
+        return note == other.note && velocity == other.velocity;
+    }
+};
+
+static vector<NoteEvent> gEvents;
+
+static void noteCallback(void *context, int note, int velocity) {
+
+    NoteEvent event = {note, velocity};
+    gEvents.push_back(event);
+}
+
+/* What the manager should do, without slots or reference counts */
+class VoiceModel {
+
+    struct Held {
+        int note;
+        uint64_t lastSeen;
+    };
+
+public:
+
+    VoiceModel(int timeoutFrames) : timeoutFrames_(timeoutFrames), frame_(0) {}
+
+    void noteOn(int user, int limb, int note) {
+
+        map<pair<int, int>, Held>::iterator it = held_.find(make_pair(user, limb));
+        if (it != held_.end()) {
+            it->second.lastSeen = frame_;
+            if (it->second.note == note)
+                return;
+            release(it);
+        }
+
+        if (count(note) == 0)
+            emit(note, 90);
+        Held h = {note, frame_};
+        held_[make_pair(user, limb)] = h;
+    }
+
+    void noteOff(int user, int limb) {
+
+        map<pair<int, int>, Held>::iterator it = held_.find(make_pair(user, limb));
+        if (it != held_.end())
+            release(it);
+    }
+
+    void touch(int user, int limb) {
+
+        map<pair<int, int>, Held>::iterator it = held_.find(make_pair(user, limb));
+        if (it != held_.end())
+            it->second.lastSeen = frame_;
+    }
+
+    void releaseUser(int user) {
+
+        for (int limb = 0; limb < NUM_LIMBS; limb++)
+            noteOff(user, limb);
+    }
+
+    void releaseAll() {
+
+        while (!held_.empty())
+            release(held_.begin());
+    }
+
+    void endFrame() {
+
+        for (map<pair<int, int>, Held>::iterator it = held_.begin(); it != held_.end(); ) {
+            map<pair<int, int>, Held>::iterator next = it;
+            ++next;
+            if (frame_ - it->second.lastSeen >= (uint64_t)timeoutFrames_)
+                release(it);
+            it = next;
+        }
+        frame_++;
+    }
+
+    int heldNote(int user, int limb) {
+
+        map<pair<int, int>, Held>::iterator it = held_.find(make_pair(user, limb));
+        return it == held_.end() ? -1 : it->second.note;
+    }
+
+    int count(int note) {
+
+        int n = 0;
+        for (map<pair<int, int>, Held>::iterator it = held_.begin(); it != held_.end(); ++it)
+            n += it->second.note == note;
+        return n;
+    }
+
+    int numActive() { return (int)held_.size(); }
+
+    vector<NoteEvent> events;
+
+private:
+
+    void release(map<pair<int, int>, Held>::iterator it) {
+
+        int note = it->second.note;
+        held_.erase(it);
+        if (count(note) == 0)
+            emit(note, 0);
+    }
+
+    void emit(int note, int velocity) {
+
+        NoteEvent event = {note, velocity};
+        events.push_back(event);
+    }
+
+    map<pair<int, int>, Held> held_;
+    int timeoutFrames_;
+    uint64_t frame_;
+};
+
+/* Same events in any order, since the manager walks its slots rather than user ids */
+static bool sameEvents(vector<NoteEvent> a, vector<NoteEvent> b) {
+
+    sort(a.begin(), a.end());
+    sort(b.begin(), b.end());
+    return a == b;
+}
+
+static void testAgainstModel(unsigned int seed, int nFrames) {
+
+    const int timeoutFrames = 10;
+
+    VoiceManager voices;
+    voices.setNoteCallback(noteCallback, NULL);
+    voices.setTimeoutFrames(timeoutFrames);
+    VoiceModel model(timeoutFrames);
+    srand(seed);
+
+    int nMismatches = 0;
+
+    for (int frame = 0; frame < nFrames && nMismatches < 10; frame++) {
+
+        int nOps = rand() % 6;
+
+        for (int op = 0; op < nOps + 1; op++) {
+
+            /* No more users than slots, so nobody is evicted */
+            int user = 1 + rand() % SKELETON_MAX_USERS;
+            Limb limb = (Limb)(rand() % NUM_LIMBS);
+            int note = 60 + rand() % 8;             // Few notes, so limbs often share one
+
+            gEvents.clear();
+            model.events.clear();
+
+            switch (op == nOps ? 6 : rand() % 6) {
+                case 0:
+                case 1:
+                    voices.noteOn(user, limb, note, 90);
+                    model.noteOn(user, limb, note);
+                    break;
+                case 2:
+                    voices.touch(user, limb);
+                    model.touch(user, limb);
+                    break;
+                case 3:
+                    voices.noteOff(user, limb);
+                    model.noteOff(user, limb);
+                    break;
+                case 4:
+                    if (rand() % 20 == 0) {
+                        voices.releaseUser(user);
+                        model.releaseUser(user);
+                    }
+                    else if (rand() % 200 == 0) {
+                        voices.releaseAll();
+                        model.releaseAll();
+                    }
+                    break;
+                case 5: {
+                    bool other = false;
+                    for (int l = 0; l < NUM_LIMBS; l++)
+                        other = other || (l != limb && model.heldNote(user, l) == note);
+                    if (voices.heldByOtherLimb(user, limb, note) != other)
+                        nMismatches++;
+                    break;
+                }
+                case 6:
+                    voices.endFrame();
+                    model.endFrame();
+                    break;
+            }
+
+            if (!sameEvents(gEvents, model.events))
+                nMismatches++;
+        }
+
+        bool same = voices.numActive() == model.numActive();
+        for (int user = 1; user <= SKELETON_MAX_USERS; user++) {
+            for (int limb = 0; limb < NUM_LIMBS; limb++)
+                same = same && voices.heldNote(user, (Limb)limb) == model.heldNote(user, limb);
+        }
+        for (int note = 0; note < VOICE_NUM_NOTES; note++)
+            same = same && voices.noteIsSounding(note) == (model.count(note) > 0);
+
+        if (!same) {
+            printf("seed %u: manager and model disagree at frame %d\n", seed, frame);
+            nMismatches++;
+        }
+    }
+
+    CHECK(nMismatches == 0);
+}
+
+/* More users than slots: whatever is evicted, every note-on is matched by one note-off
+   and nothing is left sounding once every limb goes quiet */
+static void testBalanceWithEviction(unsigned int seed, int nFrames) {
+
+    VoiceManager voices;
+    voices.setNoteCallback(noteCallback, NULL);
+    voices.setTimeoutFrames(10);
+    srand(seed);
+
+    int sounding[VOICE_NUM_NOTES] = {0};
+    int nUnbalanced = 0;
+    gEvents.clear();
+
+    for (int frame = 0; frame < nFrames; frame++) {
+
+        int nOps = rand() % 6;
+        for (int op = 0; op < nOps; op++) {
+            int user = 1 + rand() % (SKELETON_MAX_USERS + 3);
+            Limb limb = (Limb)(rand() % NUM_LIMBS);
+            switch (rand() % 5) {
+                case 0:
+                case 1: voices.noteOn(user, limb, 60 + rand() % 12, 90); break;
+                case 2: voices.touch(user, limb); break;
+                case 3: voices.noteOff(user, limb); break;
+                case 4: if (rand() % 20 == 0) voices.releaseUser(user); break;
+            }
+        }
+        voices.endFrame();
+
+        for (size_t e = 0; e < gEvents.size(); e++) {
+            int &s = sounding[gEvents[e].note];
+            if ((gEvents[e].velocity > 0) == (s > 0))
+                nUnbalanced++;                  // A second note-on, or an unmatched note-off
+            s = gEvents[e].velocity > 0;
+        }
+        gEvents.clear();
+
+        for (int note = 0; note < VOICE_NUM_NOTES; note++) {
+            if ((sounding[note] > 0) != voices.noteIsSounding(note))
+                nUnbalanced++;
+        }
+    }
+
+    for (int frame = 0; frame < 11; frame++)
+        voices.endFrame();
+    for (size_t e = 0; e < gEvents.size(); e++)
+        sounding[gEvents[e].note] = gEvents[e].velocity > 0;
+
+    int nLeft = 0;
+    for (int note = 0; note < VOICE_NUM_NOTES; note++)
+        nLeft += sounding[note];
+
+    CHECK(nUnbalanced == 0);
+    CHECK(nLeft == 0);
+    CHECK(voices.numActive() == 0);
+}
+
+int main(int argc, const char *argv[]) {
+
+    for (unsigned int seed = 1; seed <= 8; seed++)
+        testAgainstModel(seed, 20000);
+
+    testBalanceWithEviction(5, 200000);
+
+    return testResult("VoiceManagerTests");
+}
@@ -0,0 +1,588 @@
+//
+//  DepthCodec.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "DepthCodec.h"
+
+#include <string.h>
+#include <algorithm>
+
+/* Frame header flags */
+#define TEMPORAL_FLAG 0x01
+#define HEADER_BYTES 19
+
+/* Per-pixel codes while choosing a block's predictor, above any zigzagged residual */
+#define CODE_HOLE 0x10000
+#define CODE_ESCAPE 0x20000
+
+#define TABLE_SIZE (1 << DEPTH_CODEC_MAX_CODE_BITS)
+#define NUM_VALUES 65536
+
+static inline uint32_t zigzag(uint16_t residual) {
+    return (uint16_t)((residual << 1) ^ -(residual >> 15));
+}
+
+static inline uint16_t unzigzag(uint32_t z) {
+    return (uint16_t)((z >> 1) ^ -(z & 1));
+}
+
+/* Rough bit cost of a code, for picking the cheaper predictor */
+static inline int codeCost(uint32_t code) {
+
+    if (code == 0)
+        return 0;
+    if (code == CODE_HOLE)
+        return 2;
+    if (code >= DEPTH_TOKEN_HOLE)
+        return 18;
+    return 34 - __builtin_clz(code);
+}
+
+/* Median edge detector (LOCO-I) from the left, above and above-left pixels, falling back
+   to the left where the row above has no depth */
+static inline uint16_t predictSpatial(uint16_t left, const uint16_t *above, int x) {
+
+    if (!above || !above[x])
+        return left;
+
+    uint16_t a = left ? left : above[x];
+    uint16_t b = above[x];
+    uint16_t c = x > 0 && above[x - 1] ? above[x - 1] : b;
+
+    uint16_t lo = a < b ? a : b;
+    uint16_t hi = a < b ? b : a;
+
+    if (c >= hi)
+        return lo;
+    if (c <= lo)
+        return hi;
+    return (uint16_t)(a + b - c);
+}
+
+/* Of the decoded image, so a corrupt frame or the wrong reference can't pass for a good
+   one: a running sum and a sum of the running sums, which also catches pixels swapped */
+static inline uint32_t imageChecksum(uint64_t sum, uint64_t sumOfSums) {
+    return (uint32_t)sum ^ (uint32_t)((sumOfSums * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+static inline void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#pragma mark - Huffman Tables
+
+/* Code lengths from token counts, flattening the counts until no code is longer than
+   DEPTH_CODEC_MAX_CODE_BITS. Works in fixed arrays so encoding doesn't allocate. */
+void DepthCodec::buildLengths(const uint32_t *counts, uint8_t *lengths) {
+
+    uint32_t scaled[DEPTH_NUM_TOKENS];
+    memcpy(scaled, counts, sizeof(scaled));
+
+    while (true) {
+
+        memset(lengths, 0, DEPTH_NUM_TOKENS);
+
+        /* Leaves sorted by count; internal nodes are made in nondecreasing order, so the
+           two smallest are always at the front of one queue or the other */
+        uint64_t weight[2 * DEPTH_NUM_TOKENS];
+        int symbol[DEPTH_NUM_TOKENS];
+        int parent[2 * DEPTH_NUM_TOKENS];
+        int depth[2 * DEPTH_NUM_TOKENS];
+        int n = 0;
+
+        for (int i = 0; i < DEPTH_NUM_TOKENS; i++)
+            if (scaled[i])
+                symbol[n++] = i;
+
+        if (n == 0)
+            return;
+        if (n == 1) {
+            lengths[symbol[0]] = 1;
+            return;
+        }
+
+        std::sort(symbol, symbol + n, [&scaled](int a, int b) { return scaled[a] < scaled[b]; });
+        for (int i = 0; i < n; i++)
+            weight[i] = scaled[symbol[i]];
+
+        int leaf = 0, node = n;
+        for (int next = n; next < 2 * n - 1; next++) {
+            uint64_t sum = 0;
+            for (int k = 0; k < 2; k++) {
+                int pick = leaf < n && (node >= next || weight[leaf] <= weight[node]) ? leaf++ : node++;
+                parent[pick] = next;
+                sum += weight[pick];
+            }
+            weight[next] = sum;
+        }
+
+        /* Parents always come after their children */
+        int maxDepth = 0;
+        depth[2 * n - 2] = 0;
+        for (int i = 2 * n - 3; i >= 0; i--) {
+            depth[i] = depth[parent[i]] + 1;
+            if (i < n && depth[i] > maxDepth)
+                maxDepth = depth[i];
+        }
+
+        if (maxDepth <= DEPTH_CODEC_MAX_CODE_BITS) {
+            for (int i = 0; i < n; i++)
+                lengths[symbol[i]] = (uint8_t)depth[i];
+            return;
+        }
+
+        for (int i = 0; i < DEPTH_NUM_TOKENS; i++)
+            if (scaled[i])
+                scaled[i] = (scaled[i] + 1) >> 1;
+    }
+}
+
+/* Canonical codes from lengths, bit-reversed because the bitstream is written LSB first */
+void DepthCodec::buildCodes(const uint8_t *lengths, uint16_t *codes) {
+
+    int lengthCounts[DEPTH_CODEC_MAX_CODE_BITS + 1] = {0};
+    int nextCode[DEPTH_CODEC_MAX_CODE_BITS + 1];
+
+    for (int i = 0; i < DEPTH_NUM_TOKENS; i++)
+        lengthCounts[lengths[i]]++;
+    lengthCounts[0] = 0;
+
+    int code = 0;
+    for (int len = 1; len <= DEPTH_CODEC_MAX_CODE_BITS; len++) {
+        code = (code + lengthCounts[len - 1]) << 1;
+        nextCode[len] = code;
+    }
+
+    for (int i = 0; i < DEPTH_NUM_TOKENS; i++) {
+
+        int len = lengths[i];
+        codes[i] = 0;
+        if (!len)
+            continue;
+
+        int c = nextCode[len]++;
+        for (int b = 0; b < len; b++)
+            codes[i] |= ((c >> (len - 1 - b)) & 1) << b;
+    }
+}
+
+#pragma mark - Palette
+
+/* Rank of every possible value among the palette's, from 1; values between palette
+   entries get the rank of the next one up, which is still a fine prediction */
+void DepthCodec::buildRanks() {
+
+    ranks_.resize(NUM_VALUES);
+
+    int count = 0;
+    for (int v = 0; v < NUM_VALUES; v++) {
+        ranks_[v] = (uint16_t)(count + 1);
+        if (present_[v >> 6] >> (v & 63) & 1)
+            count++;
+    }
+    ranks_[0] = 0;
+}
+
+void DepthCodec::toRanks(const uint16_t *image, int width, int height, int strideInPixels, uint16_t *out) {
+
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            out[y * width + x] = ranks_[image[y * strideInPixels + x]];
+}
+
+#pragma mark - Encoding
+
+/* Exact predictions as power-of-two runs; a lone one is a zero residual */
+void DepthCodec::emitRun(int run) {
+
+    while (run > 1) {
+        int k = 30 - __builtin_clz(run);
+        if (k >= DEPTH_RUN_CLASSES)
+            k = DEPTH_RUN_CLASSES - 1;
+        tokens_.push_back(DEPTH_TOKEN_RUN + k);
+        run -= 2 << k;
+    }
+    if (run == 1)
+        tokens_.push_back(0);
+}
+
+int DepthCodec::encode(const uint16_t *cur, const uint16_t *prev, int width, int height, int strideInPixels,
+                       uint8_t *out, int capacity) {
+
+    int blocksPerRow = (width + DEPTH_CODEC_BLOCK - 1) / DEPTH_CODEC_BLOCK;
+    int nModeBytes = prev ? (blocksPerRow * height + 7) / 8 : 0;
+
+    tokens_.clear();
+    escapes_.clear();
+    modes_.assign(nModeBytes, 0);
+    palette_.clear();
+
+    /* The palette: every valid value in the frame, as gaps from the last in LEB128 */
+    present_.assign(NUM_VALUES / 64, 0);
+    uint64_t sum = 0, sumOfSums = 0;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            uint16_t v = cur[y * strideInPixels + x];
+            present_[v >> 6] |= (uint64_t)1 << (v & 63);
+            sum += v;
+            sumOfSums += sum;
+        }
+    present_[0] &= ~(uint64_t)1;
+
+    int nValues = 0, last = 0;
+    for (int v = 1; v < NUM_VALUES; v++) {
+        if (!(present_[v >> 6] >> (v & 63) & 1))
+            continue;
+        for (int gap = v - last; ; gap >>= 7) {
+            if (gap < 0x80) {
+                palette_.push_back((uint8_t)gap);
+                break;
+            }
+            palette_.push_back((uint8_t)(gap | 0x80));
+        }
+        last = v;
+        nValues++;
+    }
+
+    /* Predict and code ranks rather than values, so neighbouring quantization levels
+       differ by one however far apart they are in millimetres */
+    buildRanks();
+    curRanks_.resize(width * height);
+    toRanks(cur, width, height, strideInPixels, &curRanks_[0]);
+    if (prev) {
+        prevRanks_.resize(width * height);
+        toRanks(prev, width, height, strideInPixels, &prevRanks_[0]);
+    }
+
+    cur = &curRanks_[0];
+    prev = prev ? &prevRanks_[0] : NULL;
+    strideInPixels = width;
+
+    uint32_t temporal[DEPTH_CODEC_BLOCK];
+    uint32_t spatial[DEPTH_CODEC_BLOCK];
+    int run = 0;
+
+    for (int y = 0; y < height; y++) {
+
+        const uint16_t *row = cur + y * strideInPixels;
+        const uint16_t *above = y > 0 ? row - strideInPixels : NULL;
+        const uint16_t *prevRow = prev ? prev + y * strideInPixels : NULL;
+        uint16_t left = 0;                  // Last valid pixel in the row
+
+        for (int x = 0; x < width; x += DEPTH_CODEC_BLOCK) {
+
+            int n = width - x < DEPTH_CODEC_BLOCK ? width - x : DEPTH_CODEC_BLOCK;
+            int temporalCost = 0, spatialCost = 0;
+
+            /* Codes under both predictors. Temporally, a pixel invalid in both frames is
+               exact, and one that's newly valid is predicted spatially. */
+            for (int i = 0; i < n; i++) {
+
+                uint16_t v = row[x + i];
+                uint16_t s = predictSpatial(left, above, x + i);
+
+                spatial[i] = v ? zigzag((uint16_t)(v - s)) : CODE_HOLE;
+                spatialCost += codeCost(spatial[i]);
+
+                if (prevRow) {
+                    uint16_t t = prevRow[x + i];
+                    if (t)
+                        temporal[i] = v ? zigzag((uint16_t)(v - t)) : CODE_HOLE;
+                    else if (v)
+                        temporal[i] = spatial[i] ? spatial[i] : CODE_ESCAPE;
+                    else
+                        temporal[i] = 0;
+                    temporalCost += codeCost(temporal[i]);
+                }
+
+                if (v)
+                    left = v;
+            }
+
+            bool useSpatial = !prevRow || spatialCost < temporalCost;
+            const uint32_t *codes = useSpatial ? spatial : temporal;
+
+            if (prevRow && useSpatial) {
+                int block = y * blocksPerRow + x / DEPTH_CODEC_BLOCK;
+                modes_[block >> 3] |= 1 << (block & 7);
+            }
+
+            for (int i = 0; i < n; i++) {
+
+                uint32_t code = codes[i];
+
+                if (code == 0) {
+                    run++;
+                    continue;
+                }
+
+                emitRun(run);
+                run = 0;
+
+                if (code == CODE_HOLE)
+                    tokens_.push_back(DEPTH_TOKEN_HOLE);
+                else if (code < DEPTH_TOKEN_HOLE)
+                    tokens_.push_back((uint16_t)code);
+                else {
+                    tokens_.push_back(DEPTH_TOKEN_ESCAPE);
+                    escapes_.push_back(row[x + i]);
+                }
+            }
+        }
+    }
+
+    emitRun(run);
+
+    uint32_t counts[DEPTH_NUM_TOKENS] = {0};
+    uint8_t lengths[DEPTH_NUM_TOKENS];
+    uint16_t codes[DEPTH_NUM_TOKENS];
+
+    for (size_t i = 0; i < tokens_.size(); i++)
+        counts[tokens_[i]]++;
+
+    buildLengths(counts, lengths);
+    buildCodes(lengths, codes);
+
+    uint64_t nBits = 0;
+    for (int i = 0; i < DEPTH_NUM_TOKENS; i++)
+        nBits += (uint64_t)counts[i] * lengths[i];
+
+    /* Header, palette, code lengths as nibbles, block modes, escaped ranks, then the tokens */
+    int nLengthBytes = (DEPTH_NUM_TOKENS + 1) / 2;
+    int nBitBytes = (int)((nBits + 7) / 8);
+    int64_t size = HEADER_BYTES + (int64_t)palette_.size() + nLengthBytes + nModeBytes + 2 * (int64_t)escapes_.size() + nBitBytes;
+
+    if (size > capacity)
+        return -1;
+
+    uint8_t *p = out;
+    *p++ = prev ? TEMPORAL_FLAG : 0;
+    put16(p, (uint16_t)nValues);
+    put32(p + 2, (uint32_t)palette_.size());
+    put32(p + 6, (uint32_t)escapes_.size());
+    put32(p + 10, (uint32_t)nBitBytes);
+    put32(p + 14, imageChecksum(sum, sumOfSums));
+    p += HEADER_BYTES - 1;
+
+    if (!palette_.empty())
+        memcpy(p, &palette_[0], palette_.size());
+    p += palette_.size();
+
+    for (int i = 0; i < DEPTH_NUM_TOKENS; i += 2)
+        *p++ = (uint8_t)(lengths[i] | (i + 1 < DEPTH_NUM_TOKENS ? lengths[i + 1] << 4 : 0));
+
+    if (nModeBytes)
+        memcpy(p, &modes_[0], nModeBytes);
+    p += nModeBytes;
+
+    for (size_t i = 0; i < escapes_.size(); i++, p += 2)
+        put16(p, escapes_[i]);
+
+    uint64_t acc = 0;
+    int bits = 0;
+
+    for (size_t i = 0; i < tokens_.size(); i++) {
+        acc |= (uint64_t)codes[tokens_[i]] << bits;
+        bits += lengths[tokens_[i]];
+        if (bits >= 32) {
+            put32(p, (uint32_t)acc);
+            p += 4;
+            acc >>= 32;
+            bits -= 32;
+        }
+    }
+    while (bits > 0) {
+        *p++ = (uint8_t)acc;
+        acc >>= 8;
+        bits -= 8;
+    }
+
+    return (int)(p - out);
+}
+
+#pragma mark - Decoding
+
+bool DepthCodec::decode(const uint8_t *in, int length, const uint16_t *prev, int width, int height, int strideInPixels,
+                        uint16_t *out) {
+
+    int blocksPerRow = (width + DEPTH_CODEC_BLOCK - 1) / DEPTH_CODEC_BLOCK;
+    int nLengthBytes = (DEPTH_NUM_TOKENS + 1) / 2;
+
+    if (length < HEADER_BYTES + nLengthBytes)
+        return false;
+
+    bool temporalFrame = (in[0] & TEMPORAL_FLAG) != 0;
+    int nValues = in[1] | (in[2] << 8);
+    int64_t nPaletteBytes = get32(in + 3);
+    int64_t nEscapes = get32(in + 7);
+    int64_t nBitBytes = get32(in + 11);
+    uint32_t checksum = get32(in + 15);
+    int nModeBytes = temporalFrame ? (blocksPerRow * height + 7) / 8 : 0;
+
+    if (temporalFrame && !prev)
+        return false;
+    if (HEADER_BYTES + nPaletteBytes + nLengthBytes + nModeBytes + 2 * nEscapes + nBitBytes != length)
+        return false;
+
+    const uint8_t *p = in + HEADER_BYTES;
+    const uint8_t *paletteEnd = p + nPaletteBytes;
+
+    /* Palette values by rank, rank 0 being invalid depth */
+    present_.assign(NUM_VALUES / 64, 0);
+    values_.resize(nValues + 1);
+    values_[0] = 0;
+
+    for (int i = 1, v = 0; i <= nValues; i++) {
+        int gap = 0;
+        for (int shift = 0; ; shift += 7) {
+            if (p >= paletteEnd || shift > 14)
+                return false;
+            gap |= (*p & 0x7f) << shift;
+            if (!(*p++ & 0x80))
+                break;
+        }
+        v += gap;
+        if (gap == 0 || v >= NUM_VALUES)
+            return false;
+        values_[i] = (uint16_t)v;
+        present_[v >> 6] |= (uint64_t)1 << (v & 63);
+    }
+    if (p != paletteEnd)
+        return false;
+
+    buildRanks();
+    curRanks_.resize(width * height);
+    if (temporalFrame) {
+        prevRanks_.resize(width * height);
+        toRanks(prev, width, height, strideInPixels, &prevRanks_[0]);
+    }
+
+    uint8_t lengths[DEPTH_NUM_TOKENS];
+    uint16_t codes[DEPTH_NUM_TOKENS];
+
+    for (int i = 0; i < DEPTH_NUM_TOKENS; i++)
+        lengths[i] = (p[i / 2] >> (4 * (i & 1))) & 0x0f;
+    p += nLengthBytes;
+
+    /* Reject lengths that don't form a prefix code */
+    uint32_t kraft = 0;
+    for (int i = 0; i < DEPTH_NUM_TOKENS; i++) {
+        if (lengths[i] > DEPTH_CODEC_MAX_CODE_BITS)
+            return false;
+        if (lengths[i])
+            kraft += TABLE_SIZE >> lengths[i];
+    }
+    if (kraft > TABLE_SIZE)
+        return false;
+
+    buildCodes(lengths, codes);
+
+    /* Every code's bits followed by any others index the same entry; unused ones stay 0 */
+    decodeTable_.assign(TABLE_SIZE, 0);
+    for (int i = 0; i < DEPTH_NUM_TOKENS; i++) {
+        int len = lengths[i];
+        if (!len)
+            continue;
+        for (int rest = 0; rest < TABLE_SIZE >> len; rest++)
+            decodeTable_[codes[i] | (rest << len)] = (uint32_t)i << 8 | len;
+    }
+
+    const uint8_t *modes = p;
+    const uint8_t *escapes = p + nModeBytes;
+    const uint8_t *bitsStart = escapes + 2 * nEscapes;
+    const uint8_t *end = in + length;
+    const uint8_t *q = bitsStart;
+    int64_t escapeIndex = 0;
+
+    uint64_t acc = 0;
+    int bits = 0;
+    int run = 0;
+    uint64_t sum = 0, sumOfSums = 0;
+
+    for (int y = 0; y < height; y++) {
+
+        uint16_t *row = &curRanks_[y * width];
+        const uint16_t *above = y > 0 ? row - width : NULL;
+        const uint16_t *prevRow = temporalFrame ? &prevRanks_[y * width] : NULL;
+        uint16_t left = 0;
+
+        for (int x = 0; x < width; x += DEPTH_CODEC_BLOCK) {
+
+            int n = width - x < DEPTH_CODEC_BLOCK ? width - x : DEPTH_CODEC_BLOCK;
+            int block = y * blocksPerRow + x / DEPTH_CODEC_BLOCK;
+            bool useSpatial = !prevRow || (modes[block >> 3] >> (block & 7)) & 1;
+
+            for (int i = 0; i < n; i++) {
+
+                uint16_t s = predictSpatial(left, above, x + i);
+                uint16_t t = useSpatial ? s : prevRow[x + i];
+                uint16_t v;
+
+                if (run > 0) {
+                    v = t;
+                    run--;
+                }
+                else {
+
+                    while (bits <= 56 && q < end) {
+                        acc |= (uint64_t)*q++ << bits;
+                        bits += 8;
+                    }
+
+                    uint32_t entry = decodeTable_[acc & (TABLE_SIZE - 1)];
+                    int len = entry & 0xff;
+                    int token = entry >> 8;
+
+                    if (len == 0 || len > bits)
+                        return false;
+                    acc >>= len;
+                    bits -= len;
+
+                    if (token >= DEPTH_TOKEN_RUN) {
+                        run = (2 << (token - DEPTH_TOKEN_RUN)) - 1;
+                        v = t;
+                    }
+                    else if (token == DEPTH_TOKEN_HOLE)
+                        v = 0;
+                    else if (token == DEPTH_TOKEN_ESCAPE) {
+                        if (escapeIndex >= nEscapes)
+                            return false;
+                        v = (uint16_t)(escapes[2 * escapeIndex] | (escapes[2 * escapeIndex + 1] << 8));
+                        escapeIndex++;
+                    }
+                    else if (token == 0)
+                        v = t;
+                    else
+                        v = (uint16_t)((t ? t : s) + unzigzag(token));
+                }
+
+                if (v > nValues)
+                    return false;
+
+                row[x + i] = v;
+                out[y * strideInPixels + x + i] = values_[v];
+                sum += values_[v];
+                sumOfSums += sum;
+                if (v)
+                    left = v;
+            }
+        }
+    }
+
+    /* Everything consumed, give or take the last byte's padding */
+    return run == 0 && escapeIndex == nEscapes && q == end && bits < 8 &&
+           imageChecksum(sum, sumOfSums) == checksum;
+}
@@ -0,0 +1,75 @@
+//
+//  DepthCodec.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Lossless compression for 16-bit depth images. The Kinect reports depth through a fixed
+//  disparity table, so a frame holds only a few hundred distinct values; each frame's
+//  values are sent once as a palette and pixels are coded as their rank in it. Each block
+//  of 16 ranks is predicted either from the previous frame or from its neighbours in the
+//  same frame (LOCO-I's median edge detector), whichever leaves smaller residuals.
+//  Residuals, invalid pixels and runs of exact predictions become tokens, Huffman coded
+//  with a table built for each frame. A checksum of the image rejects corrupt frames and
+//  delta frames decoded against the wrong reference.
+
+#ifndef __KinectOSC__DepthCodec__
+#define __KinectOSC__DepthCodec__
+
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+
+#define DEPTH_CODEC_BLOCK 16
+#define DEPTH_CODEC_MAX_CODE_BITS 12
+
+/* Tokens: zigzagged residuals below DEPTH_TOKEN_HOLE, an invalid (zero) pixel, a raw value
+   too far from its prediction, or a run of 2^(k+1) exact predictions */
+#define DEPTH_TOKEN_HOLE 254
+#define DEPTH_TOKEN_ESCAPE 255
+#define DEPTH_TOKEN_RUN 256
+#define DEPTH_RUN_CLASSES 10
+#define DEPTH_NUM_TOKENS (DEPTH_TOKEN_RUN + DEPTH_RUN_CLASSES)
+
+/* Worst case compressed size, for sizing output buffers */
+#define DEPTH_CODEC_MAX_BYTES(width, height) (64 + DEPTH_NUM_TOKENS + (width) * (height) * 4)
+
+/* Keeps its scratch buffers between frames, so one per thread */
+class DepthCodec {
+
+public:
+
+    /* Compress cur, predicting from prev where that helps; prev NULL makes a keyframe. Both
+       images have strideInPixels pixels per row. Returns the compressed length, or -1 if it
+       won't fit in capacity. */
+    int encode(const uint16_t *cur, const uint16_t *prev, int width, int height, int strideInPixels,
+               uint8_t *out, int capacity);
+
+    /* Reverse encode(). prev must be the image the frame was encoded against (NULL for a
+       keyframe). Returns false on corrupt input, leaving out partly written. */
+    bool decode(const uint8_t *in, int length, const uint16_t *prev, int width, int height, int strideInPixels,
+                uint16_t *out);
+
+private:
+
+    void buildRanks();
+    void toRanks(const uint16_t *image, int width, int height, int strideInPixels, uint16_t *out);
+    void emitRun(int run);
+    static void buildLengths(const uint32_t *counts, uint8_t *lengths);
+    static void buildCodes(const uint8_t *lengths, uint16_t *codes);
+
+private:
+
+    std::vector<uint64_t> present_;         // Bitmap of the values in the palette
+    std::vector<uint16_t> ranks_;           // Value to palette rank
+    std::vector<uint16_t> values_;          // Palette rank to value
+    std::vector<uint8_t> palette_;
+    std::vector<uint16_t> curRanks_;
+    std::vector<uint16_t> prevRanks_;
+    std::vector<uint16_t> tokens_;
+    std::vector<uint16_t> escapes_;
+    std::vector<uint8_t> modes_;            // One bit per block: predicted from the same frame
+    std::vector<uint32_t> decodeTable_;     // Symbol << 8 | length, indexed by the next code bits
+};
+
+#endif /* defined(__KinectOSC__DepthCodec__) */
@@ -0,0 +1,365 @@
+//
+//  DepthHistogram.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "DepthHistogram.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define DEPTH_HIST_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define DEPTH_HIST_NEON 1
+#endif
+
+DepthHistogram::DepthHistogram(int histogramSize, int nThreads) {
+
+    histogramSize_ = histogramSize;
+
+    if (nThreads < 1) nThreads = 1;
+    if (nThreads > DEPTH_HIST_MAX_THREADS) nThreads = DEPTH_HIST_MAX_THREADS;
+    nThreads_ = nThreads;
+
+    width_ = 0;
+    height_ = 0;
+    stride_ = 0;
+    nPoints_ = 0;
+
+    counts_.resize(histogramSize_);
+    sliceCounts_.resize(nThreads_ * DEPTH_HIST_SUBHISTOGRAMS * (histogramSize_ + 1));
+
+    incrementalThresh_ = 0;
+    hasPrevious_ = false;
+    lastWasIncremental_ = false;
+
+    for (int i = 0; i < nThreads_; i++) {
+        slices_[i].owner = this;
+        slices_[i].index = i;
+        slices_[i].pDepth = NULL;
+        slices_[i].rowBegin = 0;
+        slices_[i].rowEnd = 0;
+        slices_[i].counts = &sliceCounts_[i * DEPTH_HIST_SUBHISTOGRAMS * (histogramSize_ + 1)];
+    }
+
+    startWorkers();
+}
+
+DepthHistogram::~DepthHistogram() {
+
+    stopWorkers();
+}
+
+#pragma mark - Worker pool
+
+/* Slice 0 always runs on the calling thread, so only nThreads_-1 workers are spawned */
+void DepthHistogram::startWorkers() {
+
+    pthread_mutex_init(&poolMutex_, NULL);
+    pthread_cond_init(&workCond_, NULL);
+    pthread_cond_init(&doneCond_, NULL);
+
+    generation_ = 0;
+    nPending_ = 0;
+    shouldStop_ = false;
+
+    for (int i = 1; i < nThreads_; i++) {
+        if (pthread_create(&workers_[i], NULL, staticWorkerLoop, (void *)&slices_[i]) != 0) {
+            printf("%s: Error creating worker thread; using %d threads\n", __PRETTY_FUNCTION__, i);
+            nThreads_ = i;
+            break;
+        }
+    }
+}
+
+void DepthHistogram::stopWorkers() {
+
+    pthread_mutex_lock(&poolMutex_);
+    shouldStop_ = true;
+    pthread_cond_broadcast(&workCond_);
+    pthread_mutex_unlock(&poolMutex_);
+
+    for (int i = 1; i < nThreads_; i++)
+        pthread_join(workers_[i], NULL);
+
+    pthread_cond_destroy(&doneCond_);
+    pthread_cond_destroy(&workCond_);
+    pthread_mutex_destroy(&poolMutex_);
+}
+
+void *DepthHistogram::workerLoop(Slice *slice) {
+
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&poolMutex_);
+
+    while (true) {
+
+        while (generation_ == seen && !shouldStop_)
+            pthread_cond_wait(&workCond_, &poolMutex_);
+
+        if (shouldStop_)
+            break;
+
+        seen = generation_;
+        pthread_mutex_unlock(&poolMutex_);
+
+        countSlice(slice);
+
+        pthread_mutex_lock(&poolMutex_);
+        if (--nPending_ == 0)
+            pthread_cond_signal(&doneCond_);
+    }
+
+    pthread_mutex_unlock(&poolMutex_);
+    return 0;
+}
+
+#pragma mark - Counting
+
+/* Count one band of rows into this slice's interleaved sub-histograms. Consecutive pixels
+   usually share a depth value, so spreading them over separate count arrays keeps each
+   increment from waiting on the store of the previous one. Zero (invalid) pixels land in
+   bin 0 and out-of-range pixels in the extra bin at the end, which keeps the loop branch-free. */
+void DepthHistogram::countSlice(Slice *slice) {
+
+    const int binsPerSub = histogramSize_ + 1;
+    const uint32_t overflowBin = (uint32_t)histogramSize_;
+
+    uint32_t *sub0 = slice->counts;
+    uint32_t *sub1 = sub0 + binsPerSub;
+    uint32_t *sub2 = sub1 + binsPerSub;
+    uint32_t *sub3 = sub2 + binsPerSub;
+
+    memset(slice->counts, 0, DEPTH_HIST_SUBHISTOGRAMS * binsPerSub * sizeof(uint32_t));
+
+    for (int y = slice->rowBegin; y < slice->rowEnd; y++) {
+
+        const uint16_t *pRow = slice->pDepth + y * stride_;
+        int x = 0;
+
+        for (; x + 4 <= width_; x += 4) {
+            uint32_t d0 = pRow[x], d1 = pRow[x+1], d2 = pRow[x+2], d3 = pRow[x+3];
+            sub0[d0 < overflowBin ? d0 : overflowBin]++;
+            sub1[d1 < overflowBin ? d1 : overflowBin]++;
+            sub2[d2 < overflowBin ? d2 : overflowBin]++;
+            sub3[d3 < overflowBin ? d3 : overflowBin]++;
+        }
+        for (; x < width_; x++) {
+            uint32_t d = pRow[x];
+            sub0[d < overflowBin ? d : overflowBin]++;
+        }
+    }
+}
+
+void DepthHistogram::rebuildCounts(const uint16_t *pDepth) {
+
+    /* Split the frame into bands of rows */
+    int rowsPerSlice = (height_ + nThreads_ - 1) / nThreads_;
+
+    for (int i = 0; i < nThreads_; i++) {
+        slices_[i].pDepth = pDepth;
+        slices_[i].rowBegin = i * rowsPerSlice < height_ ? i * rowsPerSlice : height_;
+        slices_[i].rowEnd = (i+1) * rowsPerSlice < height_ ? (i+1) * rowsPerSlice : height_;
+    }
+
+    /* Wake the workers and count our own slice */
+    if (nThreads_ > 1) {
+        pthread_mutex_lock(&poolMutex_);
+        nPending_ = nThreads_ - 1;
+        generation_++;
+        pthread_cond_broadcast(&workCond_);
+        pthread_mutex_unlock(&poolMutex_);
+    }
+
+    countSlice(&slices_[0]);
+
+    if (nThreads_ > 1) {
+        pthread_mutex_lock(&poolMutex_);
+        while (nPending_ > 0)
+            pthread_cond_wait(&doneCond_, &poolMutex_);
+        pthread_mutex_unlock(&poolMutex_);
+    }
+
+    /* Merge all sub-histograms */
+    const int binsPerSub = histogramSize_ + 1;
+    const int nSubs = nThreads_ * DEPTH_HIST_SUBHISTOGRAMS;
+    uint32_t *counts = &counts_[0];
+
+    memcpy(counts, &sliceCounts_[0], histogramSize_ * sizeof(uint32_t));
+    uint32_t nInvalid = sliceCounts_[0];
+
+    for (int s = 1; s < nSubs; s++) {
+        const uint32_t *sub = &sliceCounts_[s * binsPerSub];
+        for (int b = 0; b < histogramSize_; b++)
+            counts[b] += sub[b];
+        nInvalid += sub[0];
+    }
+
+    /* Zero-depth pixels are not valid points */
+    counts[0] = 0;
+    nPoints_ = (uint32_t)(width_ * height_) - nInvalid;
+}
+
+/* Patch the previous frame's counts with the pixels that changed. Returns false without
+   touching the counts if more pixels changed than the incremental threshold allows. */
+bool DepthHistogram::patchCounts(const uint16_t *pDepth) {
+
+    const uint32_t maxChanged = (uint32_t)(incrementalThresh_ * width_ * height_);
+    const uint16_t *pPrev = &previous_[0];
+
+    changed_.clear();
+
+    for (int y = 0; y < height_; y++) {
+
+        const uint16_t *pRow = pDepth + y * stride_;
+        const uint16_t *pPrevRow = pPrev + y * width_;
+
+        /* Most rows of a static scene are identical */
+        if (memcmp(pRow, pPrevRow, width_ * sizeof(uint16_t)) == 0)
+            continue;
+
+        for (int x = 0; x < width_; x++) {
+            if (pRow[x] != pPrevRow[x]) {
+                if (changed_.size() >= maxChanged)
+                    return false;
+                changed_.push_back(y * width_ + x);
+            }
+        }
+    }
+
+    uint32_t *counts = &counts_[0];
+
+    for (size_t i = 0; i < changed_.size(); i++) {
+
+        uint32_t idx = changed_[i];
+        uint16_t oldDepth = pPrev[idx];
+        uint16_t newDepth = pDepth[(idx / width_) * stride_ + idx % width_];
+
+        if (oldDepth != 0) {
+            if (oldDepth < histogramSize_) counts[oldDepth]--;
+            nPoints_--;
+        }
+        if (newDepth != 0) {
+            if (newDepth < histogramSize_) counts[newDepth]++;
+            nPoints_++;
+        }
+    }
+
+    return true;
+}
+
+void DepthHistogram::storePrevious(const uint16_t *pDepth) {
+
+    previous_.resize(width_ * height_);
+
+    if (stride_ == width_)
+        memcpy(&previous_[0], pDepth, width_ * height_ * sizeof(uint16_t));
+    else {
+        for (int y = 0; y < height_; y++)
+            memcpy(&previous_[y * width_], pDepth + y * stride_, width_ * sizeof(uint16_t));
+    }
+
+    hasPrevious_ = true;
+}
+
+#pragma mark - Output
+
+/* The prefix sum runs on integers and is fused with the normalization, four bins at a time:
+   each vector is scanned in two shifted adds, offset by the running total carried from the
+   previous vector, then converted and normalized in place. Counts never exceed 2^24, so
+   converting the integer sums to float reproduces the reference's float accumulation
+   exactly, and the normalization is the reference's expression, one IEEE operation at a
+   time, so the output is bit-exact on every path. */
+void DepthHistogram::accumulateAndNormalize(float *pHistogram) {
+
+    const uint32_t *counts = &counts_[0];
+    const float nPoints = (float)nPoints_;
+    int b = 0;
+
+#if DEPTH_HIST_SSE2
+    const __m128 scale = _mm_set1_ps(256.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 divisor = _mm_set1_ps(nPoints);
+    __m128i carry = _mm_setzero_si128();
+
+    for (; b + 4 <= histogramSize_; b += 4) {
+        __m128i sum = _mm_loadu_si128((const __m128i *)(counts + b));
+        sum = _mm_add_epi32(sum, _mm_slli_si128(sum, 4));
+        sum = _mm_add_epi32(sum, _mm_slli_si128(sum, 8));
+        sum = _mm_add_epi32(sum, carry);
+        carry = _mm_shuffle_epi32(sum, _MM_SHUFFLE(3, 3, 3, 3));
+
+        __m128 value = _mm_cvtepi32_ps(sum);
+        if (nPoints_)
+            value = _mm_mul_ps(scale, _mm_sub_ps(one, _mm_div_ps(value, divisor)));
+        _mm_storeu_ps(pHistogram + b, value);
+    }
+    uint32_t total = (uint32_t)_mm_cvtsi128_si32(carry);
+#elif DEPTH_HIST_NEON
+    const float32x4_t scale = vdupq_n_f32(256.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t divisor = vdupq_n_f32(nPoints);
+    const uint32x4_t zero = vdupq_n_u32(0);
+    uint32x4_t carry = zero;
+
+    for (; b + 4 <= histogramSize_; b += 4) {
+        uint32x4_t sum = vld1q_u32(counts + b);
+        sum = vaddq_u32(sum, vextq_u32(zero, sum, 3));
+        sum = vaddq_u32(sum, vextq_u32(zero, sum, 2));
+        sum = vaddq_u32(sum, carry);
+        carry = vdupq_laneq_u32(sum, 3);
+
+        float32x4_t value = vcvtq_f32_u32(sum);
+        if (nPoints_)
+            value = vmulq_f32(scale, vsubq_f32(one, vdivq_f32(value, divisor)));
+        vst1q_f32(pHistogram + b, value);
+    }
+    uint32_t total = vgetq_lane_u32(carry, 0);
+#else
+    uint32_t total = 0;
+#endif
+
+    for (; b < histogramSize_; b++) {
+        total += counts[b];
+        pHistogram[b] = nPoints_ ? (256 * (1.0f - ((float)total / nPoints))) : (float)total;
+    }
+
+    pHistogram[0] = 0;
+}
+
+void DepthHistogram::calculate(float *pHistogram, const uint16_t *pDepth, int width, int height, int strideInPixels) {
+
+    /* Frame geometry changed; previous frame is unusable */
+    if (width != width_ || height != height_ || strideInPixels != stride_)
+        hasPrevious_ = false;
+
+    width_ = width;
+    height_ = height;
+    stride_ = strideInPixels;
+
+    lastWasIncremental_ = false;
+
+    if (incrementalThresh_ > 0 && hasPrevious_)
+        lastWasIncremental_ = patchCounts(pDepth);
+
+    if (!lastWasIncremental_)
+        rebuildCounts(pDepth);
+
+    accumulateAndNormalize(pHistogram);
+
+    if (incrementalThresh_ > 0) {
+        if (lastWasIncremental_) {
+            for (size_t i = 0; i < changed_.size(); i++) {
+                uint32_t idx = changed_[i];
+                previous_[idx] = pDepth[(idx / width_) * stride_ + idx % width_];
+            }
+        }
+        else
+            storePrevious(pDepth);
+    }
+}
@@ -0,0 +1,101 @@
+//
+//  DepthHistogram.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Accumulative depth histogram for 16-bit depth frames. Produces exactly the
+//  same output as calculateHistogram() in NiteSampleUtilities.h, but counts into
+//  interleaved integer sub-histograms split across worker threads, and can
+//  update the previous frame's histogram in place when few pixels changed.
+
+#ifndef __KinectOSC__DepthHistogram__
+#define __KinectOSC__DepthHistogram__
+
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+
+#define DEPTH_HIST_SUBHISTOGRAMS 4      // Interleaved sub-histograms per thread
+#define DEPTH_HIST_MAX_THREADS   8
+
+class DepthHistogram {
+
+public:
+
+    DepthHistogram(int histogramSize, int nThreads = 4);
+    ~DepthHistogram();
+
+    /* Compute the accumulative histogram of a depth frame into pHistogram (histogramSize floats).
+       Pixels with depth >= histogramSize are counted as valid points but not binned (the reference
+       implementation writes past the end of its buffer in that case). */
+    void calculate(float *pHistogram, const uint16_t *pDepth, int width, int height, int strideInPixels);
+
+    /* Incremental mode: if fewer than (fraction * nPixels) pixels differ from the previous frame,
+       patch the previous counts instead of rebuilding them. 0 disables. */
+    void setIncrementalThreshold(float fraction) { incrementalThresh_ = fraction; hasPrevious_ = false; }
+
+    /* Whether the last call to calculate() was served incrementally */
+    bool lastWasIncremental() { return lastWasIncremental_; }
+
+    int histogramSize() { return histogramSize_; }
+
+private:
+
+    struct Slice {
+        DepthHistogram *owner;
+        int index;
+        const uint16_t *pDepth;
+        int rowBegin;
+        int rowEnd;
+        uint32_t *counts;           // DEPTH_HIST_SUBHISTOGRAMS x (histogramSize_ + 1)
+    };
+
+    /* Worker pool */
+    void startWorkers();
+    void stopWorkers();
+    void *workerLoop(Slice *slice);
+    static void *staticWorkerLoop(void *arg) {
+        Slice *slice = (Slice *)arg;
+        return slice->owner->workerLoop(slice);
+    }
+
+    void countSlice(Slice *slice);
+    void rebuildCounts(const uint16_t *pDepth);
+    bool patchCounts(const uint16_t *pDepth);
+    void accumulateAndNormalize(float *pHistogram);
+    void storePrevious(const uint16_t *pDepth);
+
+private:
+
+    int histogramSize_;
+    int nThreads_;
+
+    /* Frame geometry for the current call */
+    int width_;
+    int height_;
+    int stride_;
+
+    std::vector<uint32_t> counts_;           // Merged per-bin counts for the current frame
+    std::vector<uint32_t> sliceCounts_;      // Per-thread sub-histograms, last bin of each collects out-of-range depths
+    uint32_t nPoints_;
+
+    /* Previous frame, kept for incremental updates */
+    std::vector<uint16_t> previous_;
+    std::vector<uint32_t> changed_;          // Indices of pixels that differ from previous_
+    float incrementalThresh_;
+    bool hasPrevious_;
+    bool lastWasIncremental_;
+
+    Slice slices_[DEPTH_HIST_MAX_THREADS];
+    pthread_t workers_[DEPTH_HIST_MAX_THREADS];
+    pthread_mutex_t poolMutex_;
+    pthread_cond_t workCond_;
+    pthread_cond_t doneCond_;
+    unsigned int generation_;
+    int nPending_;
+    bool shouldStop_;
+};
+
+#endif /* defined(__KinectOSC__DepthHistogram__) */
@@ -0,0 +1,170 @@
+//
+//  FrameBufferPool.cpp
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+
+#include "FrameBufferPool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct FrameBuffer::Block {
+    FrameBufferPool *pool;
+    std::atomic<int> refs;
+    uint16_t *pixels;
+    int width;
+    int height;
+    uint64_t timestamp;
+    int frameIndex;
+};
+
+#pragma mark - FrameBuffer
+
+FrameBuffer &FrameBuffer::operator=(FrameBuffer &&other) {
+
+    if (this != &other) {
+        release();
+        block_ = other.block_;
+        other.block_ = NULL;
+    }
+
+    return *this;
+}
+
+FrameBuffer FrameBuffer::share() const {
+
+    if (block_)
+        block_->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return FrameBuffer(block_);
+}
+
+void FrameBuffer::release() {
+
+    if (!block_)
+        return;
+
+    /* The last handle's pixel reads happen before the buffer is reused */
+    if (block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        block_->pool->recycle(block_);
+
+    block_ = NULL;
+}
+
+uint16_t *FrameBuffer::data() const { return block_ ? block_->pixels : NULL; }
+int FrameBuffer::width() const { return block_ ? block_->width : 0; }
+int FrameBuffer::height() const { return block_ ? block_->height : 0; }
+int FrameBuffer::stride() const { return block_ ? block_->pool->stride_ : 0; }
+uint64_t FrameBuffer::timestamp() const { return block_ ? block_->timestamp : 0; }
+int FrameBuffer::frameIndex() const { return block_ ? block_->frameIndex : 0; }
+int FrameBuffer::useCount() const { return block_ ? block_->refs.load() : 0; }
+
+/* Smaller images use the top-left of the buffer at the pool's stride */
+void FrameBuffer::setSize(int width, int height) {
+
+    if (!block_)
+        return;
+
+    block_->width = width < block_->pool->width_ ? width : block_->pool->width_;
+    block_->height = height < block_->pool->height_ ? height : block_->pool->height_;
+}
+
+void FrameBuffer::setTimestamp(uint64_t timestamp, int frameIndex) {
+
+    if (!block_)
+        return;
+
+    block_->timestamp = timestamp;
+    block_->frameIndex = frameIndex;
+}
+
+#pragma mark - FrameBufferPool
+
+FrameBufferPool::FrameBufferPool(int capacity, int width, int height) {
+
+    capacity_ = capacity;
+    width_ = width;
+    height_ = height;
+
+    /* Pad rows to the alignment so every row starts aligned */
+    int pixelsPerLine = FRAME_BUFFER_ALIGNMENT / sizeof(uint16_t);
+    stride_ = (width + pixelsPerLine - 1) / pixelsPerLine * pixelsPerLine;
+
+    nAllocations_ = 0;
+    nExhausted_ = 0;
+
+    free_.reserve(capacity);
+    blocks_.reserve(capacity);
+    pthread_mutex_init(&mutex_, NULL);
+}
+
+FrameBufferPool::~FrameBufferPool() {
+
+    if ((int)free_.size() != (int)blocks_.size())
+        printf("%s: %d buffers still in use\n", __PRETTY_FUNCTION__, (int)(blocks_.size() - free_.size()));
+
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        free(blocks_[i]->pixels);
+        delete blocks_[i];
+    }
+
+    pthread_mutex_destroy(&mutex_);
+}
+
+FrameBuffer FrameBufferPool::acquire() {
+
+    FrameBuffer::Block *block = NULL;
+
+    pthread_mutex_lock(&mutex_);
+
+    if (!free_.empty()) {
+        block = free_.back();
+        free_.pop_back();
+    }
+
+    /* Warming up: allocate another buffer while under capacity */
+    else if ((int)blocks_.size() < capacity_) {
+
+        void *pixels = NULL;
+        if (posix_memalign(&pixels, FRAME_BUFFER_ALIGNMENT, (size_t)stride_ * height_ * sizeof(uint16_t)) == 0) {
+            block = new FrameBuffer::Block;
+            block->pool = this;
+            block->pixels = (uint16_t *)pixels;
+            blocks_.push_back(block);
+            nAllocations_++;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_);
+
+    if (!block) {
+        nExhausted_++;
+        return FrameBuffer();
+    }
+
+    block->refs.store(1, std::memory_order_relaxed);
+    block->width = width_;
+    block->height = height_;
+    block->timestamp = 0;
+    block->frameIndex = 0;
+
+    return FrameBuffer(block);
+}
+
+int FrameBufferPool::numFree() {
+
+    pthread_mutex_lock(&mutex_);
+    int n = (int)free_.size() + capacity_ - (int)blocks_.size();
+    pthread_mutex_unlock(&mutex_);
+
+    return n;
+}
+
+void FrameBufferPool::recycle(FrameBuffer::Block *block) {
+
+    pthread_mutex_lock(&mutex_);
+    free_.push_back(block);
+    pthread_mutex_unlock(&mutex_);
+}
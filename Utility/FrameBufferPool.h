@@ -0,0 +1,108 @@
+//
+//  FrameBufferPool.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Fixed-size 16-bit image buffers (depth, user map) that are recycled rather than freed.
+//  A FrameBuffer is a move-only handle to one pooled buffer; share() makes another handle
+//  to the same pixels, so one frame can go to the recorder, the display and analysis
+//  without a copy. The buffer goes back to its pool when the last handle is released.
+//  Buffers are allocated on first use, up to the pool's capacity, and never after that,
+//  so once warmed up, capturing frames doesn't touch malloc. The pool must outlive every
+//  handle it gives out.
+
+#ifndef __KinectOSC__FrameBufferPool__
+#define __KinectOSC__FrameBufferPool__
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+
+#define FRAME_BUFFER_WIDTH 640
+#define FRAME_BUFFER_HEIGHT 480
+#define FRAME_BUFFER_ALIGNMENT 64       // Rows start on cache-line boundaries
+
+class FrameBufferPool;
+
+class FrameBuffer {
+
+    friend class FrameBufferPool;
+
+public:
+
+    FrameBuffer() : block_(NULL) {}
+    ~FrameBuffer() { release(); }
+
+    FrameBuffer(FrameBuffer &&other) : block_(other.block_) { other.block_ = NULL; }
+    FrameBuffer &operator=(FrameBuffer &&other);
+
+    FrameBuffer(const FrameBuffer &) = delete;
+    FrameBuffer &operator=(const FrameBuffer &) = delete;
+
+    /* Another handle to the same pixels. Write the pixels before sharing them. */
+    FrameBuffer share() const;
+    void release();
+
+    /* Getters */
+    bool isValid() const { return block_ != NULL; }
+    uint16_t *data() const;
+    int width() const;
+    int height() const;
+    int stride() const;                 // Pixels per row
+    uint64_t timestamp() const;
+    int frameIndex() const;
+    int useCount() const;
+
+    /* Setters, for whoever fills the buffer */
+    void setSize(int width, int height);
+    void setTimestamp(uint64_t timestamp, int frameIndex);
+
+private:
+
+    struct Block;
+    explicit FrameBuffer(Block *block) : block_(block) {}
+
+    Block *block_;
+};
+
+class FrameBufferPool {
+
+    friend class FrameBuffer;
+
+public:
+
+    FrameBufferPool(int capacity, int width = FRAME_BUFFER_WIDTH, int height = FRAME_BUFFER_HEIGHT);
+    ~FrameBufferPool();
+
+    /* A free buffer sized to the pool, or an invalid one if all capacity buffers are
+       in use. Thread-safe. */
+    FrameBuffer acquire();
+
+    /* Getters */
+    int capacity() { return capacity_; }
+    int numAllocations() { return nAllocations_; }      // Buffers allocated so far, at most capacity
+    int numFree();
+    int numExhausted() { return nExhausted_; }          // acquire() calls that found nothing free
+
+private:
+
+    void recycle(FrameBuffer::Block *block);
+
+private:
+
+    int capacity_;
+    int width_;
+    int height_;
+    int stride_;
+
+    pthread_mutex_t mutex_;
+    std::vector<FrameBuffer::Block *> free_;            // Reserved to capacity up front
+    std::vector<FrameBuffer::Block *> blocks_;
+    std::atomic<int> nAllocations_;
+    std::atomic<int> nExhausted_;
+};
+
+#endif /* defined(__KinectOSC__FrameBufferPool__) */
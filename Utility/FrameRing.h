@@ -0,0 +1,140 @@
+//
+//  FrameRing.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  A fixed-capacity queue of frame references handed from a driver's thread to a reader.
+//  push() never blocks: if the ring is full, the oldest frame is released and counted as
+//  overwritten. pop() sleeps until a frame is there, the timeout passes or wake() is
+//  called, so the reader wakes once per frame and can still be stopped. Each frame keeps
+//  the host time it was pushed at.
+//
+//  Frame is a reference type such as nite::UserTrackerFrameRef: copyable, with release()
+//  to let go of what it refers to. Slots are allocated up front and only assigned to.
+
+#ifndef __KinectOSC__FrameRing__
+#define __KinectOSC__FrameRing__
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+template <class Frame>
+class FrameRing {
+
+public:
+
+    FrameRing(int capacity) : ring_(capacity), arrival_(capacity) {
+
+        capacity_ = capacity;
+        head_ = 0;
+        count_ = 0;
+        nOverwritten_ = 0;
+        woken_ = false;
+
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&ready_, NULL);
+    }
+
+    ~FrameRing() {
+
+        clear();
+        pthread_cond_destroy(&ready_);
+        pthread_mutex_destroy(&mutex_);
+    }
+
+    /* The driver's thread: queue a reference to frame, delivered at host time arrival */
+    void push(const Frame &frame, uint64_t arrival) {
+
+        pthread_mutex_lock(&mutex_);
+
+        if (count_ == capacity_) {
+            ring_[head_].release();
+            head_ = (head_ + 1) % capacity_;
+            count_--;
+            nOverwritten_++;
+        }
+
+        int tail = (head_ + count_) % capacity_;
+        ring_[tail] = frame;
+        arrival_[tail] = arrival;
+        count_++;
+
+        pthread_cond_signal(&ready_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    /* The oldest frame and its arrival time, waiting up to timeoutMs for one. Returns false
+       on timeout, or at once if wake() was called since the last pop() and nothing is
+       queued. */
+    bool pop(Frame *frame, uint64_t *arrival, int timeoutMs) {
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        struct timespec deadline;
+        uint64_t usec = now.tv_usec + (uint64_t)timeoutMs * 1000;
+        deadline.tv_sec = now.tv_sec + usec / 1000000;
+        deadline.tv_nsec = (usec % 1000000) * 1000;
+
+        pthread_mutex_lock(&mutex_);
+        while (count_ == 0 && !woken_) {
+            if (pthread_cond_timedwait(&ready_, &mutex_, &deadline) != 0)
+                break;
+        }
+        bool ready = count_ > 0;
+        if (ready) {
+            *frame = ring_[head_];
+            *arrival = arrival_[head_];
+            ring_[head_].release();
+            head_ = (head_ + 1) % capacity_;
+            count_--;
+        }
+        woken_ = false;
+        pthread_mutex_unlock(&mutex_);
+
+        return ready;
+    }
+
+    /* Make a pop() blocked on another thread return promptly */
+    void wake() {
+
+        pthread_mutex_lock(&mutex_);
+        woken_ = true;
+        pthread_cond_signal(&ready_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    /* Release every queued frame, as before the driver that made them goes away */
+    void clear() {
+
+        pthread_mutex_lock(&mutex_);
+        for (int i = 0; i < capacity_; i++)
+            ring_[i].release();
+        head_ = 0;
+        count_ = 0;
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    /* Getters */
+    int capacity() { return capacity_; }
+    int numOverwritten() { return nOverwritten_; }      // Frames released unread because the ring was full
+
+private:
+
+    int capacity_;
+
+    pthread_mutex_t mutex_;
+    pthread_cond_t ready_;
+    std::vector<Frame> ring_;
+    std::vector<uint64_t> arrival_;     // Host time each frame was pushed
+    int head_;                          // Oldest frame
+    int count_;
+    std::atomic<int> nOverwritten_;     // Read from any thread
+    bool woken_;
+};
+
+#endif /* defined(__KinectOSC__FrameRing__) */
@@ -8,6 +8,12 @@
 
 #include "Utility.h"
 
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
 float mapToInterval(float &x, float min0, float max0, float min1, float max1) {
     
     return x * ((max1 - min1) / (max0 - min0)) + (min1 - min0);
@@ -30,4 +36,25 @@ std::vector<double> linspace(double min, double max, int n)
     
     result.insert(result.begin() + iterator, max);
     return result;
+}
+
+uint64_t hostTimeMicros() {
+    
+    return hostTimeNanos() / 1000;
+}
+
+uint64_t hostTimeNanos() {
+    
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
 }
\ No newline at end of file
@@ -12,10 +12,15 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <stdint.h>
 
 /* Linearly map a number generated from the interval [min0 max0] to its corresponding value on the interval [min1 max1] */
 float mapToInterval(float &x, float min0, float max0, float min1, float max1);
 
 std::vector<double> linspace(double min, double max, int n);
 
+/* Monotonic host clock in microseconds, and in nanoseconds for timing short functions */
+uint64_t hostTimeMicros();
+uint64_t hostTimeNanos();
+
 #endif /* defined(__KinectOSC__Utility__) */
@@ -0,0 +1,55 @@
+//
+//  Vec3.h
+//  KinectOSC
+//
+//  Copyright (c) 2014 Jeff Gregorio. All rights reserved.
+//
+//  Small inline 3-vector for joint geometry. Everything is float and branch-free apart
+//  from the zero-length guards, so loops over joints vectorize.
+
+#ifndef __KinectOSC__Vec3__
+#define __KinectOSC__Vec3__
+
+#include <math.h>
+
+struct Vec3 {
+    float x;
+    float y;
+    float z;
+};
+
+inline Vec3 vec3(float x, float y, float z) {
+    Vec3 v = { x, y, z };
+    return v;
+}
+
+inline Vec3 operator+(const Vec3 &a, const Vec3 &b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Vec3 operator-(const Vec3 &a, const Vec3 &b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Vec3 operator*(const Vec3 &a, float s) { return vec3(a.x * s, a.y * s, a.z * s); }
+
+inline float dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+inline Vec3 cross(const Vec3 &a, const Vec3 &b) {
+    return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline float lengthSquared(const Vec3 &a) { return dot(a, a); }
+inline float length(const Vec3 &a) { return sqrtf(dot(a, a)); }
+
+inline float distanceSquared(const Vec3 &a, const Vec3 &b) { return lengthSquared(a - b); }
+inline float distance(const Vec3 &a, const Vec3 &b) { return length(a - b); }
+
+/* Unit vector along a, or zero if a has no length */
+inline Vec3 normalize(const Vec3 &a) {
+    float len = length(a);
+    return len > 0 ? a * (1 / len) : vec3(0, 0, 0);
+}
+
+/* Angle between a and b in [0, pi], or 0 if either has no length. atan2 keeps full
+   precision near 0 and pi, where acos of the normalized dot product loses it. Adding 0
+   turns a dot product of -0 into +0, which atan2 would otherwise take as pi. */
+inline float angleBetween(const Vec3 &a, const Vec3 &b) {
+    return atan2f(length(cross(a, b)), dot(a, b) + 0.0f);
+}
+
+#endif /* defined(__KinectOSC__Vec3__) */